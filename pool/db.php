@@ -152,6 +152,48 @@ function msgEncode($cmd, $id, $fields, $user)
  return $msg;
 }
 #
+# Send a paged cmd, following 'next' until ckdb has returned every page
+# The 'name:n' row fields of each page are renumbered after the rows
+#  already received and 'rows' is the total
+function pageDecode($fun, $cmd, $id, $flds, $user, $limit = 1000)
+{
+ $all = false;
+ $start = null;
+ do
+ {
+	$pflds = $flds;
+	$pflds['limit'] = $limit;
+	if ($start !== null)
+		$pflds['start'] = $start;
+	$msg = msgEncode($cmd, $id, $pflds, $user);
+	$rep = sendsockreply($fun, $msg);
+	if (!$rep)
+		dbdown();
+	$ans = repDecode($rep);
+	if ($ans === false || $ans['STATUS'] != 'ok')
+		return $ans;
+
+	if ($all === false)
+		$all = $ans;
+	else
+	{
+		$offset = $all['rows'];
+		foreach ($ans as $name => $value)
+			if (preg_match('/^(.+):([0-9]+)$/', $name, $m))
+				$all[$m[1].':'.($m[2]+$offset)] = $value;
+		$all['rows'] += $ans['rows'];
+	}
+
+	if (isset($ans['next']))
+		$start = $ans['next'];
+	else
+		$start = null;
+ } while ($start !== null);
+
+ unset($all['next']);
+ return $all;
+}
+#
 function getStats($user)
 {
  if ($user === null)
@@ -298,8 +340,19 @@ function workerSet($user, $settings)
 function getAllUsers($user)
 {
  $flds = array();
- $msg = msgEncode('allusers', 'all', $flds, $user);
- $rep = sendsockreply('getAllUsers', $msg);
+ return pageDecode('getAllUsers', 'allusers', 'all', $flds, $user);
+}
+#
+function getTSeries($user, $pool = false, $res = null)
+{
+ if ($pool === true)
+	$flds = array();
+ else
+	$flds = array('username' => $user);
+ if ($res !== null)
+	$flds['res'] = $res;
+ $msg = msgEncode('tseries', 'ts', $flds, $user);
+ $rep = sendsockreply('getTSeries', $msg);
  if (!$rep)
 	dbdown();
  return repDecode($rep);
@@ -346,11 +399,7 @@ function getMPayouts($user)
  if ($user == false)
 	showIndex();
  $flds = array('username' => $user);
- $msg = msgEncode('mpayouts', 'mp', $flds, $user);
- $rep = sendsockreply('getMPayments', $msg);
- if (!$rep)
-	dbdown();
- return repDecode($rep);
+ return pageDecode('getMPayments', 'mpayouts', 'mp', $flds, $user);
 }
 #
 function getShifts($user, $workers = null)
@@ -46,7 +46,8 @@
  *
  * socksetup() starts:
  *	replier() for pool '_preplier' cmd '_creplier' and btc '_breplier'
- *	listener_all() for cmd '_c00listen' and btc '_b00listen'
+ *	listener_all() for cmd '_c00listen', btc '_b00listen' and auth
+ *		'_a00listen'
  *		each of which manage their thead counts
  *	process_socket() '_procsock'
  *	sockrun() for ckpool '_psockrun' web '_wsockrun' and cmd '_csockrun'
@@ -176,6 +177,7 @@ static bool logger_using_data;
 static bool plistener_using_data;
 static bool clistener_using_data;
 static bool blistener_using_data;
+static bool alistener_using_data;
 static bool breakdown_using_data;
 static bool replier_using_data;
 
@@ -201,8 +203,13 @@ int cmd_breakdown_threads_delta = 0;
 
 int cmd_listener_threads = 2;
 int btc_listener_threads = 2;
+/* Password hashing and 2FA checks are CPU heavy, so they have their own
+ *  listener threads to stop a burst of web logins holding up the cmd/btc
+ *  listeners - use -H to change it */
+int auth_listener_threads = 2;
 int cmd_listener_threads_delta = 0;
 int btc_listener_threads_delta = 0;
+int auth_listener_threads_delta = 0;
 
 // Lock used to determine when the last breakdown thread exits
 static cklock_t breakdown_lock;
@@ -257,22 +264,22 @@ const char Transfer[] = "Transfer";
 // older version missing field defaults
 // see end of alloc_storage()
 static TRANSFER auth_2 = { "preauth", FALSE_STR, auth_2.svalue, 0, NULL };
-K_ITEM auth_preauth = { Transfer, NULL, NULL, (void *)(&auth_2) };
+K_ITEM auth_preauth = { Transfer, NULL, NULL, (void *)(&auth_2), 0 };
 static TRANSFER poolstats_1 = { "elapsed", "0", poolstats_1.svalue, 0, NULL };
-K_ITEM poolstats_elapsed = { Transfer, NULL, NULL, (void *)(&poolstats_1) };
+K_ITEM poolstats_elapsed = { Transfer, NULL, NULL, (void *)(&poolstats_1), 0 };
 static TRANSFER userstats_1 = { "elapsed", "0", userstats_1.svalue, 0, NULL };
-K_ITEM userstats_elapsed = { Transfer, NULL, NULL, (void *)(&userstats_1) };
+K_ITEM userstats_elapsed = { Transfer, NULL, NULL, (void *)(&userstats_1), 0 };
 // see end of alloc_storage()
 INTRANSIENT *userstats_workername = NULL;
 static TRANSFER userstats_3 = { "idle", FALSE_STR, userstats_3.svalue, 0, NULL };
-K_ITEM userstats_idle = { Transfer, NULL, NULL, (void *)(&userstats_3) };
+K_ITEM userstats_idle = { Transfer, NULL, NULL, (void *)(&userstats_3), 0 };
 static TRANSFER userstats_4 = { "eos", TRUE_STR, userstats_4.svalue, 0, NULL };
-K_ITEM userstats_eos = { Transfer, NULL, NULL, (void *)(&userstats_4) };
+K_ITEM userstats_eos = { Transfer, NULL, NULL, (void *)(&userstats_4), 0 };
 
 static TRANSFER shares_1 = { "secondaryuserid", TRUE_STR, shares_1.svalue, 0, NULL };
-K_ITEM shares_secondaryuserid = { Transfer, NULL, NULL, (void *)(&shares_1) };
+K_ITEM shares_secondaryuserid = { Transfer, NULL, NULL, (void *)(&shares_1), 0 };
 static TRANSFER shareerrors_1 = { "secondaryuserid", TRUE_STR, shareerrors_1.svalue, 0, NULL };
-K_ITEM shareerrors_secondaryuserid = { Transfer, NULL, NULL, (void *)(&shareerrors_1) };
+K_ITEM shareerrors_secondaryuserid = { Transfer, NULL, NULL, (void *)(&shareerrors_1), 0 };
 // Time limit that this problem occurred
 // 24-Aug-2014 05:20+00 (1st one shortly after this)
 tv_t missing_secuser_min = { 1408857600L, 0L };
@@ -282,6 +289,8 @@ tv_t missing_secuser_max = { 1408860000L, 0L };
 LOADSTATUS dbstatus;
 
 POOLSTATUS pool = { 0, START_POOL_HEIGHT, 0, 0, 0, 0, 0, 0 };
+mutex_t workerstatus_locks[WORKERSTATUS_LOCKS];
+POOLSTATUS pool_stripe[WORKERSTATUS_LOCKS];
 
 // Ensure long long and int64_t are both 8 bytes (and thus also the same)
 #define ASSERT1(condition) __maybe_unused static char sizeof_longlong_must_be_8[(condition)?1:-1]
@@ -351,6 +360,21 @@ static double ccl_unordered_most;
 // The workinfoid range we are processing
 int64_t confirm_first_workinfoid;
 int64_t confirm_last_workinfoid;
+
+/* argv -e - don't run in ckdb mode, just replay the CCLs as a benchmark
+ * The value is the unix time to start the reload from
+ * The DB is loaded as normal, so use a copy of the DB, then all DB IO is
+ *  paused (see pgdb_paused) before the reload starts, so the reload
+ *  does the full breakdown -> process without any DB writes
+ * No sockets are opened, and after the reload completes, the per command
+ *  processing stats, peak RSS and the status_report() are logged and it
+ *  exits
+ * Use -r to choose the directory of CCLs to replay */
+bool replay_bench;
+static tv_t replay_start;
+static cklock_t replay_lock;
+static uint64_t replay_count[CMD_END];
+static double replay_us[CMD_END], replay_break_us[CMD_END];
 /* Stop the reload 11min after the 'last' workinfoid+1 appears
  * ckpool uses 10min - but add 1min to be sure */
 #define WORKINFO_AGE 660
@@ -434,6 +458,11 @@ static double clis_us;
 static uint64_t clis_processed;
 static double blis_us;
 static uint64_t blis_processed;
+static double alis_us;
+static uint64_t alis_processed;
+// Time the auth commands waited in the auth_workqueue_store
+static double alis_wait_us, alis_wait_max_us;
+static uint64_t alis_rejected;
 
 static cklock_t fpm_lock;
 static char *first_pool_message;
@@ -448,6 +477,7 @@ char *btc_server = "http://127.0.0.1:8330";
 char *btc_auth;
 int btc_timeout = 5;
 cklock_t btc_lock;
+mutex_t btc_io_lock;
 
 char *by_default = "code";
 char *inet_default = "127.0.0.1";
@@ -599,6 +629,7 @@ K_STORE *pool0_workqueue_store;
 K_STORE *pool_workqueue_store;
 K_STORE *cmd_workqueue_store;
 K_STORE *btc_workqueue_store;
+K_STORE *auth_workqueue_store;
 // this counter ensures we don't switch early from pool0 to pool
 int64_t earlysock_left;
 int64_t pool0_tot;
@@ -608,13 +639,15 @@ int64_t pool0_discarded;
 mutex_t wq_pool_waitlock;
 mutex_t wq_cmd_waitlock;
 mutex_t wq_btc_waitlock;
+mutex_t wq_auth_waitlock;
 pthread_cond_t wq_pool_waitcond;
 pthread_cond_t wq_cmd_waitcond;
 pthread_cond_t wq_btc_waitcond;
+pthread_cond_t wq_auth_waitcond;
 
-uint64_t wq_pool_signals, wq_cmd_signals, wq_btc_signals;
-uint64_t wq_pool_wakes, wq_cmd_wakes, wq_btc_wakes;
-uint64_t wq_pool_timeouts, wq_cmd_timeouts, wq_btc_timeouts;
+uint64_t wq_pool_signals, wq_cmd_signals, wq_btc_signals, wq_auth_signals;
+uint64_t wq_pool_wakes, wq_cmd_wakes, wq_btc_wakes, wq_auth_wakes;
+uint64_t wq_pool_timeouts, wq_cmd_timeouts, wq_btc_timeouts, wq_auth_timeouts;
 
 // REPLIES
 K_LIST *replies_free;
@@ -912,6 +945,21 @@ K_STORE *markersummary_pool_store;
 char mark_start_type = '\0';
 int64_t mark_start = -1;
 
+// MSBLOCK sealed markersummaries
+K_TREE *msblock_root;
+K_LIST *msblock_free;
+K_STORE *msblock_store;
+
+int64_t msblock_rows;
+int64_t msblock_full_ram;
+
+// Paged markersummaries
+K_STORE *msblock_page_store;
+int64_t ms_page_hits;
+int64_t ms_page_misses;
+int64_t ms_page_evicts;
+int64_t ms_page_drops;
+
 // KEYSHARESUMMARY
 K_TREE *keysharesummary_root;
 K_LIST *keysharesummary_free;
@@ -930,6 +978,13 @@ K_STORE *workmarkers_store;
 // static for key_update
 static K_STORE *workmarkers_key_store;
 
+// Shift processing markersummary aggregation threads
+MS_AGG ms_agg[MS_AGG_THREADS_MAX];
+int ms_agg_running;
+mutex_t ms_agg_lock;
+pthread_cond_t ms_agg_cond;
+pthread_cond_t ms_agg_done_cond;
+
 // MARKS
 K_TREE *marks_root;
 K_LIST *marks_free;
@@ -958,6 +1013,14 @@ K_TREE *userinfo_root;
 K_LIST *userinfo_free;
 K_STORE *userinfo_store;
 
+// TSERIES from poolstats and userstats/workerstats
+K_TREE *tseries_root;
+K_LIST *tseries_free;
+K_STORE *tseries_store;
+
+// CMDLAT
+cklock_t cmdlat_lock;
+
 static char *listener_base = "listener";
 static char *process_name = "main";
 static char logname_db[512];
@@ -1253,27 +1316,195 @@ static char *hour_filename(const char *path, const char *name, time_t when)
 	return filename;
 }
 
-// low spec version of rotating_log() - no locking
-static bool rotating_log_nolock(char *msg, char *prefix)
-{
-	char *filename;
-	FILE *fp;
-	bool ok = false;
+static JOURNAL journal_db = { logname_db, true, 0, NULL, NULL, 0, 0, 0, 0, { 0, 0 } };
+static JOURNAL journal_io = { logname_io, false, 0, NULL, NULL, 0, 0, 0, 0, { 0, 0 } };
 
-	filename = rotating_filename(prefix, time(NULL));
-	fp = fopen(filename, "a+e");
-	if (unlikely(!fp)) {
-		LOGERR("Failed to fopen %s in rotating_log!", filename);
-		goto stageleft;
+static void journal_close(JOURNAL *journal)
+{
+	if (journal->fp) {
+		fclose(journal->fp);
+		journal->fp = NULL;
 	}
-	fprintf(fp, "%s\n", msg);
-	fclose(fp);
-	ok = true;
+	if (journal->idx_fp) {
+		fclose(journal->idx_fp);
+		journal->idx_fp = NULL;
+	}
+}
+
+static bool journal_open(JOURNAL *journal, time_t now)
+{
+	char *filename, *idxname;
+
+	journal_close(journal);
 
-stageleft:
+	journal->hour = now - (now % ROLL_S);
+	filename = rotating_filename(journal->prefix, now);
+	journal->fp = fopen(filename, "a+e");
+	if (unlikely(!journal->fp)) {
+		LOGERR("Failed to fopen %s in %s!", filename, __func__);
+		free(filename);
+		return false;
+	}
+	fseeko(journal->fp, 0, SEEK_END);
+	journal->offset = (int64_t)ftello(journal->fp);
+	journal->next_idx = journal->offset + JOURNAL_IDX_BYTES;
+	journal->max_seqall = 0;
+	/* The createdates of any lines already in the file, from before a
+	 *  restart, aren't known but now will be later than them */
+	journal->max_cd = journal->offset ? now : 0;
+
+	if (journal->indexed) {
+		ASPRINTF(&idxname, "%s%s", filename, JOURNAL_IDX_EXT);
+		journal->idx_fp = fopen(idxname, "a+e");
+		if (unlikely(!journal->idx_fp))
+			LOGERR("Failed to fopen %s in %s!", idxname, __func__);
+		free(idxname);
+	}
 	free(filename);
+	return true;
+}
 
-	return ok;
+/* Get the seqall and createdate seconds of a pool message line,
+ *  json or CKDB_RECFMT, 0 if not found */
+static void journal_line_info(char *msg, int64_t *seqall, time_t *cd)
+{
+	const char **fields = NULL;
+	char *ptr, *end;
+	int i;
+
+	*seqall = 0;
+	*cd = 0;
+
+	// Skip cmd.id.
+	ptr = strchr(msg, '.');
+	if (ptr)
+		ptr = strchr(ptr+1, '.');
+	if (!ptr)
+		return;
+	ptr++;
+
+	if (strncmp(ptr, JSON_TRANSFER, JSON_TRANSFER_LEN) == 0) {
+		end = strstr(ptr, "\"" SEQALL "\":");
+		if (end)
+			*seqall = atoll(end + sizeof(SEQALL) + 2);
+		end = strstr(ptr, "\"createdate\":\"");
+		if (end)
+			*cd = (time_t)atol(end + 14);
+	} else if (strncmp(ptr, CKDB_REC_TAG, CKDB_REC_TAG_LEN) == 0) {
+		if (strncmp(msg, "workinfo.", 9) == 0)
+			fields = ckdb_rec_workinfo;
+		else if (strncmp(msg, "shares.", 7) == 0)
+			fields = ckdb_rec_shares;
+		else if (strncmp(msg, "shareerror.", 11) == 0)
+			fields = ckdb_rec_shareerror;
+		if (!fields)
+			return;
+		ptr += CKDB_REC_TAG_LEN;
+		for (i = 0; fields[i] && ptr; i++) {
+			if (strcmp(fields[i], SEQALL) == 0)
+				*seqall = atoll(ptr);
+			else if (strcmp(fields[i], "createdate") == 0)
+				*cd = (time_t)atol(ptr);
+			ptr = strchr(ptr, CKDB_REC_SEP);
+			if (ptr)
+				ptr++;
+		}
+	}
+}
+
+// Only called by logger(), so no locking
+static bool journal_write(char *msg, JOURNAL *journal)
+{
+	time_t now = time(NULL), cd;
+	int64_t seqall;
+	int len;
+
+	if (!journal->fp || (now - (now % ROLL_S)) != journal->hour) {
+		if (!journal_open(journal, now))
+			return false;
+	}
+
+	if (journal->indexed) {
+		if (journal->idx_fp && journal->offset >= journal->next_idx) {
+			fprintf(journal->idx_fp, "%"PRId64",%"PRId64",%ld\n",
+				journal->offset, journal->max_seqall,
+				(long)(journal->max_cd));
+			journal->next_idx = journal->offset + JOURNAL_IDX_BYTES;
+		}
+		journal_line_info(msg, &seqall, &cd);
+		if (journal->max_seqall < seqall)
+			journal->max_seqall = seqall;
+		if (journal->max_cd < cd)
+			journal->max_cd = cd;
+	}
+
+	len = fprintf(journal->fp, "%s\n", msg);
+	if (unlikely(len < 0)) {
+		LOGERR("Failed to write to %s in %s!",
+			journal->prefix, __func__);
+		journal_close(journal);
+		return false;
+	}
+	journal->offset += len;
+	return true;
+}
+
+/* Group commit - flush everything written since the last call and fsync
+ *  if sync_ms has passed since the last fsync */
+static void journal_commit(JOURNAL *journal, tv_t *now, int64_t sync_ms)
+{
+	if (!journal->fp)
+		return;
+
+	fflush(journal->fp);
+	if (journal->idx_fp)
+		fflush(journal->idx_fp);
+	if (sync_ms > 0 && ms_tvdiff(now, &(journal->last_sync)) >= sync_ms) {
+		fsync(fileno(journal->fp));
+		if (journal->idx_fp)
+			fsync(fileno(journal->idx_fp));
+		copy_tv(&(journal->last_sync), now);
+	}
+}
+
+/* Use the index of the first reload file to skip the lines that are all
+ *  before start
+ * The index entries are in ascending order so stop at the first one that
+ *  is too late */
+static void journal_seek(char *filename, FILE *fp, tv_t *start)
+{
+	char *idxname, line[128];
+	int64_t offset, seqall, use = 0, use_seqall = 0;
+	FILE *idx_fp;
+	long cd;
+
+	ASPRINTF(&idxname, "%s%s", filename, JOURNAL_IDX_EXT);
+	idx_fp = fopen(idxname, "re");
+	if (idx_fp) {
+		while (fgets(line, sizeof(line), idx_fp)) {
+			if (sscanf(line, "%"SCNd64",%"SCNd64",%ld",
+				   &offset, &seqall, &cd) != 3)
+				break;
+			if (cd >= (start->tv_sec - JOURNAL_SEEK_MARGIN))
+				break;
+			use = offset;
+			use_seqall = seqall;
+		}
+		fclose(idx_fp);
+	}
+	if (use > 0) {
+		if (fseeko(fp, (off_t)use, SEEK_SET)) {
+			int err = errno;
+			LOGERR("%s() failed to seek %s to %"PRId64" (%d) %s",
+				__func__, filename, use, err, strerror(err));
+			rewind(fp);
+		} else {
+			LOGWARNING("%s() seeked %s to %"PRId64" after seqall "
+				   "%"PRId64" using %s",
+				   __func__, filename, use, use_seqall, idxname);
+		}
+	}
+	free(idxname);
 }
 
 static void log_queue_message(char *msg, bool db)
@@ -1436,10 +1667,12 @@ void status_report(tv_t *now, bool showseq)
 
 	LOGWARNING(" process pool: %"PRIu64"s/%"PRIu64"w/%"PRIu64"t"
 		   " cmd: %"PRIu64"s/%"PRIu64"w/%"PRIu64"t"
-		   " btc: %"PRIu64"s/%"PRIu64"w/%"PRIu64"t",
+		   " btc: %"PRIu64"s/%"PRIu64"w/%"PRIu64"t"
+		   " auth: %"PRIu64"s/%"PRIu64"w/%"PRIu64"t",
 		   wq_pool_signals, wq_pool_wakes, wq_pool_timeouts,
 		   wq_cmd_signals, wq_cmd_wakes, wq_cmd_timeouts,
-		   wq_btc_signals, wq_btc_wakes, wq_btc_timeouts);
+		   wq_btc_signals, wq_btc_wakes, wq_btc_timeouts,
+		   wq_auth_signals, wq_auth_wakes, wq_auth_timeouts);
 
 	count1 = clis_processed ? : 1;
 	count2 = blis_processed ? : 1;
@@ -1448,6 +1681,13 @@ void status_report(tv_t *now, bool showseq)
 		   clis_us/1000000, clis_processed, (clis_us/count1)/1000000,
 		   blis_us/1000000, blis_processed, (blis_us/count2)/1000000);
 
+	count1 = alis_processed ? : 1;
+	LOGWARNING(" alistener: t%fs/t%"PRIu64"/av%fs"
+		   " wait: t%fs/av%fs/max%fs rej %"PRIu64,
+		   alis_us/1000000, alis_processed, (alis_us/count1)/1000000,
+		   alis_wait_us/1000000, (alis_wait_us/count1)/1000000,
+		   alis_wait_max_us/1000000, alis_rejected);
+
 	rep_max_fd = rep_max_pool_sockd_fd;
 	if (rep_max_fd < rep_max_cmd_sockd_fd)
 		rep_max_fd = rep_max_cmd_sockd_fd;
@@ -1648,6 +1888,7 @@ static void _ckdb_unix_msg(enum reply_type reply_typ, int sockd, char *msg,
 	copy_tv(&(replies->accepted), &(ml->accepted));
 	copy_tv(&(replies->broken), &(ml->broken));
 	copy_tv(&(replies->processed), &(ml->processed));
+	cmdlat_add(ml, &now);
 	replies->event.events = EPOLLOUT | EPOLLHUP;
 	replies->event.data.ptr = r_item;
 	replies->sockd = sockd;
@@ -1828,7 +2069,7 @@ sukamudai:
 	return ok;
 }
 
-static bool reload_from(tv_t *start, const tv_t *finish);
+static bool reload_from(tv_t *start, const tv_t *finish, bool seek);
 
 static bool reload()
 {
@@ -1881,7 +2122,7 @@ static bool reload()
 		}
 		free(filename);
 	}
-	return reload_from(&start, &date_eot);
+	return reload_from(&start, &date_eot, true);
 }
 
 /* Open the file in path, check if there is a pid in there that still exists
@@ -2064,6 +2305,7 @@ static void alloc_storage()
 	pool_workqueue_store = k_new_store(workqueue_free);
 	cmd_workqueue_store = k_new_store(workqueue_free);
 	btc_workqueue_store = k_new_store(workqueue_free);
+	auth_workqueue_store = k_new_store(workqueue_free);
 
 	replies_free = k_new_list("Replies", sizeof(REPLIES),
 					ALLOC_REPLIES, LIMIT_REPLIES, true);
@@ -2266,6 +2508,13 @@ static void alloc_storage()
 					    cmp_markersummary,
 					    markersummary_free);
 
+	msblock_free = k_new_list("MSBlock", sizeof(MSBLOCK),
+				  ALLOC_MSBLOCK, LIMIT_MSBLOCK, true);
+	msblock_store = k_new_store(msblock_free);
+	msblock_page_store = k_new_store(msblock_free);
+	// Under the markersummary lock
+	msblock_root = new_ktree("MSBlock", cmp_msblock, markersummary_free);
+
 	keysharesummary_free = k_new_list("KeyShareSummary",
 					  sizeof(KEYSHARESUMMARY),
 					  ALLOC_KEYSHARESUMMARY,
@@ -2299,6 +2548,11 @@ static void alloc_storage()
 	userinfo_store = k_new_store(userinfo_free);
 	userinfo_root = new_ktree(NULL, cmp_userinfo, userinfo_free);
 
+	tseries_free = k_new_list("TSeries", sizeof(TSERIES),
+					ALLOC_TSERIES, LIMIT_TSERIES, true);
+	tseries_store = k_new_store(tseries_free);
+	tseries_root = new_ktree(NULL, cmp_tseries, tseries_free);
+
 	// Emulate a list for lock checking
 	pgdb_free = k_lock_only_list("PGDB");
 
@@ -2318,6 +2572,7 @@ static void alloc_storage()
 	DLPRIO(keysharesummary, 67);
 	DLPRIO(markersummary, 65);
 	DLPRIO(keysummary, 64);
+	DLPRIO(msblock, 63);
 	DLPRIO(workmarkers, 62);
 
 	DLPRIO(marks, 60);
@@ -2365,6 +2620,7 @@ static void alloc_storage()
 	DLPRIO(ips, PRIO_TERMINAL);
 	DLPRIO(replies, PRIO_TERMINAL);
 	DLPRIO(pgdb, PRIO_TERMINAL);
+	DLPRIO(tseries, PRIO_TERMINAL);
 
 	DLPCHECK();
 
@@ -2594,6 +2850,10 @@ static void dealloc_storage()
 	LOGWARNING("%s() user/marks ...", __func__);
 	FREE_ALL(userinfo);
 
+	FREE_TREE(tseries);
+	FREE_STORE_DATA(tseries);
+	FREE_LIST(tseries);
+
 	FREE_TREE(marks);
 	FREE_STORE_DATA(marks);
 	FREE_LIST_DATA(marks);
@@ -2628,6 +2888,13 @@ static void dealloc_storage()
 		FREE_TREE(markersummary);
 		FREE_STORE_DATA(markersummary);
 		FREE_LIST_DATA(markersummary);
+
+		FREE_TREE(msblock);
+		k_list_transfer_to_tail_nolock(msblock_page_store,
+					       msblock_store);
+		FREE_STORE(msblock_page);
+		FREE_STORE_DATA(msblock);
+		FREE_LIST_DATA(msblock);
 	}
 
 	FREE_ALL(workerstatus);
@@ -2766,6 +3033,55 @@ static void dealloc_storage()
 	LOGWARNING("%s() finished", __func__);
 }
 
+// Must be called only when replay_bench
+static void replay_add(MSGLINE *msgline)
+{
+	enum cmd_values cmd_val = ckdb_cmds[msgline->which_cmds].cmd_val;
+	tv_t now;
+
+	setnow(&now);
+	ck_wlock(&replay_lock);
+	replay_count[cmd_val]++;
+	replay_us[cmd_val] += us_tvdiff(&now, &(msgline->started));
+	replay_break_us[cmd_val] += us_tvdiff(&(msgline->broken),
+					      &(msgline->accepted));
+	ck_wunlock(&replay_lock);
+}
+
+static void replay_report(double sec)
+{
+	struct rusage usage;
+	enum cmd_values cmd_val;
+	uint64_t count, total = 0;
+	int i;
+
+	if (sec <= 0.0)
+		sec = 1.0;
+
+	ck_wlock(&replay_lock);
+	for (i = 0; ckdb_cmds[i].cmd_val != CMD_END; i++) {
+		cmd_val = ckdb_cmds[i].cmd_val;
+		count = replay_count[cmd_val];
+		if (count == 0)
+			continue;
+		LOGWARNING("replay %s: %"PRIu64" %.2f/s proc av %.3fms"
+			   " break av %.3fms",
+			   ckdb_cmds[i].cmd_str, count, count / sec,
+			   replay_us[cmd_val] / count / 1000.0,
+			   replay_break_us[cmd_val] / count / 1000.0);
+		total += count;
+	}
+	ck_wunlock(&replay_lock);
+
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		usage.ru_maxrss = 0;
+	LOGWARNING("replay total %"PRIu64" %.2f/s in %.3fs peak RSS %ldKB",
+		   total, total / sec, sec, usage.ru_maxrss);
+
+	// The queue/lock stats
+	status_report(NULL, false);
+}
+
 static bool setup_data()
 {
 	K_TREE_CTX ctx[1];
@@ -2818,14 +3134,28 @@ static bool setup_data()
 
 	db_load_complete = true;
 
+	if (replay_bench) {
+		ck_wlock(&pgdb_pause_lock);
+		pgdb_paused = true;
+		ck_wunlock(&pgdb_pause_lock);
+		LOGWARNING("replay DB IO paused");
+	}
+
 	setnow(&rel_stt);
 
-	if (!reload() || everyone_die)
-		return false;
+	if (replay_bench) {
+		if (!reload_from(&replay_start, &date_eot, true) || everyone_die)
+			return false;
+	} else {
+		if (!reload() || everyone_die)
+			return false;
+	}
 
 	POOLINSTANCE_RESET_MSG("reload");
 	setnow(&rel_fin);
 	sec = tvdiff(&rel_fin, &rel_stt);
+	if (replay_bench)
+		replay_report(sec);
 	min = floor(sec / 60.0);
 	sec -= min * 60.0;
 	LOGWARNING("reload complete %.0fm %.3fs", min, sec);
@@ -4083,6 +4413,159 @@ static void setup_seq(K_ITEM *seqall, MSGLINE *msgline)
 	}
 }
 
+// The CKDB_RECFMT record field names for the cmds that can use it
+static const char **rec_fields(enum cmd_values cmd_val)
+{
+	switch (cmd_val) {
+		case CMD_WORKINFO:
+			return ckdb_rec_workinfo;
+		case CMD_SHARES:
+			return ckdb_rec_shares;
+		case CMD_SHAREERRORS:
+			return ckdb_rec_shareerror;
+		default:
+			return NULL;
+	}
+}
+
+// Decode 4 hex digits of a json \u escape
+static bool json_hex4(const char *hex, const char *end, unsigned int *code)
+{
+	int i;
+
+	if (hex + 4 > end)
+		return false;
+	*code = 0;
+	for (i = 0; i < 4; i++) {
+		if (!isxdigit((unsigned char)hex[i]))
+			return false;
+		*code = (*code << 4) | (isdigit((unsigned char)hex[i]) ?
+					hex[i] - '0' :
+					(tolower((unsigned char)hex[i]) - 'a' + 10));
+	}
+	return true;
+}
+
+/* Unescape a json string value of len bytes in place, returning the new
+ *  length, which is never longer
+ * \u escapes are stored as UTF-8, an invalid escape or \u0000 is kept */
+static size_t json_unescape(char *value, size_t len)
+{
+	char *src = value, *dst = value, *end = value + len;
+	unsigned int code, lo;
+
+	while (src < end) {
+		if (*src != JSON_ESC || src + 1 >= end) {
+			*(dst++) = *(src++);
+			continue;
+		}
+		switch (src[1]) {
+			case '"':
+			case '\\':
+			case '/':
+				*(dst++) = src[1];
+				break;
+			case 'b':
+				*(dst++) = '\b';
+				break;
+			case 'f':
+				*(dst++) = '\f';
+				break;
+			case 'n':
+				*(dst++) = '\n';
+				break;
+			case 'r':
+				*(dst++) = '\r';
+				break;
+			case 't':
+				*(dst++) = '\t';
+				break;
+			case 'u':
+				if (!json_hex4(src + 2, end, &code) || code == 0) {
+					*(dst++) = *(src++);
+					continue;
+				}
+				src += 4;
+				// A surrogate pair is a single code point
+				if (code >= 0xD800 && code < 0xDC00 &&
+				    src + 8 <= end && src[2] == JSON_ESC &&
+				    src[3] == 'u' &&
+				    json_hex4(src + 4, end, &lo) &&
+				    lo >= 0xDC00 && lo < 0xE000) {
+					code = 0x10000 + ((code - 0xD800) << 10) +
+						(lo - 0xDC00);
+					src += 6;
+				}
+				if (code < 0x80)
+					*(dst++) = code;
+				else if (code < 0x800) {
+					*(dst++) = 0xC0 | (code >> 6);
+					*(dst++) = 0x80 | (code & 0x3F);
+				} else if (code < 0x10000) {
+					*(dst++) = 0xE0 | (code >> 12);
+					*(dst++) = 0x80 | ((code >> 6) & 0x3F);
+					*(dst++) = 0x80 | (code & 0x3F);
+				} else {
+					*(dst++) = 0xF0 | (code >> 18);
+					*(dst++) = 0x80 | ((code >> 12) & 0x3F);
+					*(dst++) = 0x80 | ((code >> 6) & 0x3F);
+					*(dst++) = 0x80 | (code & 0x3F);
+				}
+				break;
+			default:
+				*(dst++) = *(src++);
+				continue;
+		}
+		src += 2;
+	}
+	return dst - value;
+}
+
+// Is name one of the record fields, fields can be NULL
+static bool rec_field(const char **fields, const char *name)
+{
+	int i;
+
+	for (i = 0; fields && fields[i]; i++) {
+		if (strcmp(fields[i], name) == 0)
+			return true;
+	}
+	return false;
+}
+
+/* Store a null terminated value of size siz in transfer
+ * All breakdown() formats store their values here, so a json escaped
+ *  record field value is unescaped here to match the record format */
+static void transfer_value(TRANSFER *transfer, char *value, size_t siz,
+			   bool escaped, uint64_t *ram2)
+{
+	int i;
+
+	if (escaped) {
+		siz = json_unescape(value, siz - 1) + 1;
+		value[siz - 1] = '\0';
+	}
+
+	for (i = 0; intransient_fields[i]; i++) {
+		if (strcmp(transfer->name, intransient_fields[i]) == 0) {
+			transfer->intransient = get_intransient_siz(transfer->name,
+								    value, siz);
+			transfer->mvalue = transfer->intransient->str;
+			return;
+		}
+	}
+	transfer->intransient = NULL;
+	if (siz > sizeof(transfer->svalue)) {
+		*ram2 += siz;
+		transfer->msiz = siz;
+		transfer->mvalue = malloc(siz);
+		STRNCPYSIZ(transfer->mvalue, value, siz);
+	} else {
+		STRNCPYSIZ(transfer->svalue, value, siz);
+		transfer->mvalue = transfer->svalue;
+	}
+}
+
 static enum cmd_values breakdown(K_ITEM **ml_item, char *buf, tv_t *now,
 				 int seqentryflags, char *source, int access)
 {
@@ -4093,7 +4576,8 @@ static enum cmd_values breakdown(K_ITEM **ml_item, char *buf, tv_t *now,
 	K_ITEM *t_item = NULL, *cd_item = NULL, *seqall;
 	char *cmdptr, *idptr, *next, *eq, *end, *was;
 	char *data = NULL, *st = NULL, *st2 = NULL, *ip = NULL;
-	bool noid = false, intrans, anstr, wasend = false;
+	bool noid = false, anstr;
+	char endch;
 	uint64_t ram2 = 0;
 	size_t siz;
 	int i;
@@ -4109,6 +4593,7 @@ static enum cmd_values breakdown(K_ITEM **ml_item, char *buf, tv_t *now,
 	copy_tv(&(msgline->cd), now); // default cd to 'now'
 	DATE_ZERO(&(msgline->accepted));
 	DATE_ZERO(&(msgline->broken));
+	DATE_ZERO(&(msgline->started));
 	DATE_ZERO(&(msgline->processed));
 	msgline->msg = strdup(buf);
 	msgline->msgsiz = siz;
@@ -4180,6 +4665,10 @@ static enum cmd_values breakdown(K_ITEM **ml_item, char *buf, tv_t *now,
 	msgline->trf_store = k_new_store(transfer_free);
 	next = data;
 	if (next && strncmp(next, JSON_TRANSFER, JSON_TRANSFER_LEN) == 0) {
+		/* Only the fields the record format also carries are
+		 *  unescaped, so they match whichever format sent them */
+		const char **recfields = rec_fields(ckdb_cmds[msgline->which_cmds].cmd_val);
+
 		// It's json
 		next += JSON_TRANSFER_LEN;
 		was = next;
@@ -4196,7 +4685,7 @@ static enum cmd_values breakdown(K_ITEM **ml_item, char *buf, tv_t *now,
 		next++;
 		// while we have a new quoted name
 		while (*next == JSON_STR) {
-			anstr = wasend = false;
+			anstr = false;
 			was = next;
 			end = ++next;
 			// look for the end quote
@@ -4322,39 +4811,16 @@ static enum cmd_values breakdown(K_ITEM **ml_item, char *buf, tv_t *now,
 				}
 				siz = end - next;
 			}
-			intrans = false;
-			for (i = 0; intransient_fields[i]; i++) {
-				if (strcmp(transfer->name,
-					   intransient_fields[i]) == 0) {
-					intrans = true;
-					/* If this is the last field & it wasn't
-					 *  a string, it will wipe the closing
-					 *  JSON_END - so flag it */
-					if (!anstr && *(next + siz) == JSON_END)
-						wasend = true;
-					// This will affect 'was' if JSON_END is missing
-					*(next + siz) = '\0';
-					transfer->intransient =
-						get_intransient_siz(transfer->name,
-								    next, siz+1);
-					transfer->mvalue = transfer->intransient->str;
-					break;
-				}
-			}
-			if (!intrans) {
-				transfer->intransient = NULL;
-				if (siz >= sizeof(transfer->svalue)) {
-					transfer->msiz = siz+1;
-					ram2 += siz+1;
-					transfer->mvalue = malloc(siz+1);
-					STRNCPYSIZ(transfer->mvalue, next,
-						   siz+1);
-				} else {
-					STRNCPYSIZ(transfer->svalue, next,
-						   siz+1);
-					transfer->mvalue = transfer->svalue;
-				}
-			}
+			/* Terminate the value in buf, then put back what
+			 *  was there, since a value that isn't a string
+			 *  ends on the JSON_SEP or JSON_END */
+			was = next + siz;
+			endch = *was;
+			*was = '\0';
+			transfer_value(transfer, next, siz + 1,
+					anstr && rec_field(recfields, transfer->name),
+					&ram2);
+			*was = endch;
 			add_to_ktree_nolock(msgline->trf_root, t_item);
 			k_add_head_nolock(msgline->trf_store, t_item);
 			t_item = NULL;
@@ -4369,9 +4835,7 @@ static enum cmd_values breakdown(K_ITEM **ml_item, char *buf, tv_t *now,
 					next++;
 			}
 		}
-		/* If the last field was intransient and not a string, then it
-		 *  wiped the closing JSON_END - but flagged that with wasend */
-		if (*next != JSON_END && (!wasend)) {
+		if (*next != JSON_END) {
 			LOGERR("JSON_END '%c' was:%.32s... buf=%.32s...",
 				JSON_END, st = safe_text(next),
 				st2 = safe_text(buf));
@@ -4379,6 +4843,49 @@ static enum cmd_values breakdown(K_ITEM **ml_item, char *buf, tv_t *now,
 			FREENULL(st2);
 			goto nogood;
 		}
+	} else if (next && strncmp(next, CKDB_REC_TAG, CKDB_REC_TAG_LEN) == 0) {
+		// It's a record, the values are in the order of the field names
+		const char **fields = rec_fields(ckdb_cmds[msgline->which_cmds].cmd_val);
+		if (!fields) {
+			LOGERR("%s(): '%s' has no record format buf=%.32s...",
+				__func__, msgline->cmd, st2 = safe_text(buf));
+			FREENULL(st2);
+			goto nogood;
+		}
+		next += CKDB_REC_TAG_LEN;
+		for (i = 0; fields[i]; i++) {
+			if (!next) {
+				LOGERR("%s(): '%s' record missing '%s' onwards"
+					" buf=%.32s...",
+					__func__, msgline->cmd, fields[i],
+					st2 = safe_text(buf));
+				FREENULL(st2);
+				goto nogood;
+			}
+			data = next;
+			next = strchr(data, CKDB_REC_SEP);
+			if (next)
+				*(next++) = '\0';
+			if (data[0] == CKDB_REC_ABSENT && data[1] == '\0')
+				continue;
+
+			K_WLOCK(transfer_free);
+			t_item = k_unlink_head_zero(transfer_free);
+			K_WUNLOCK(transfer_free);
+			DATA_TRANSFER(transfer, t_item);
+			STRNCPY(transfer->name, fields[i]);
+			transfer_value(transfer, data, strlen(data) + 1, false,
+					&ram2);
+			add_to_ktree_nolock(msgline->trf_root, t_item);
+			k_add_head_nolock(msgline->trf_store, t_item);
+			t_item = NULL;
+		}
+		if (next) {
+			LOGERR("%s(): '%s' record has extra values buf=%.32s...",
+				__func__, msgline->cmd, st2 = safe_text(buf));
+			FREENULL(st2);
+			goto nogood;
+		}
 	} else {
 		while (next && *next) {
 			data = next;
@@ -4397,31 +4904,8 @@ static enum cmd_values breakdown(K_ITEM **ml_item, char *buf, tv_t *now,
 			K_WUNLOCK(transfer_free);
 			DATA_TRANSFER(transfer, t_item);
 			STRNCPY(transfer->name, data);
-			siz = strlen(eq) + 1;
-			intrans = false;
-			for (i = 0; intransient_fields[i]; i++) {
-				if (strcmp(transfer->name,
-					   intransient_fields[i]) == 0) {
-					intrans = true;
-					transfer->intransient =
-						get_intransient_siz(transfer->name,
-								    eq, siz);
-					transfer->mvalue = transfer->intransient->str;
-					break;
-				}
-			}
-			if (!intrans) {
-				transfer->intransient = NULL;
-				if (siz > sizeof(transfer->svalue)) {
-					ram2 += siz;
-					transfer->msiz = siz;
-					transfer->mvalue = malloc(siz);
-					STRNCPYSIZ(transfer->mvalue, eq, siz);
-				} else {
-					STRNCPYSIZ(transfer->svalue, eq, siz);
-					transfer->mvalue = transfer->svalue;
-				}
-			}
+			transfer_value(transfer, eq, strlen(eq) + 1, false,
+					&ram2);
 
 			// Discard duplicates
 			if (find_in_ktree_nolock(msgline->trf_root, t_item, ctx)) {
@@ -4925,11 +5409,13 @@ static void check_blocks()
 {
 	K_TREE_CTX ctx[1];
 	K_ITEM *b_item;
-	BLOCKS *blocks;
+	BLOCKS *blocks, **list = NULL;
+	int count = 0, size = 0;
 
 	K_RLOCK(blocks_free);
-	/* Find the oldest block BLOCKS_NEW or BLOCKS_CONFIRM
-	 * ... that's summarised, so processing order is correct */
+	/* Find all the blocks BLOCKS_NEW or BLOCKS_CONFIRM
+	 * ... that are summarised, oldest first, so processing order
+	 *  is correct */
 	b_item = first_in_ktree(blocks_root, ctx);
 	while (b_item) {
 		DATA_BLOCKS(blocks, b_item);
@@ -4937,18 +5423,25 @@ static void check_blocks()
 		    CURRENT(&(blocks->expirydate)) &&
 		    blocks->statsconfirmed[0] != BLOCKS_STATSPENDING &&
 		    (blocks->confirmed[0] == BLOCKS_NEW ||
-		     blocks->confirmed[0] == BLOCKS_CONFIRM))
-			break;
+		     blocks->confirmed[0] == BLOCKS_CONFIRM)) {
+			if (count >= size) {
+				size += 16;
+				list = realloc(list, size * sizeof(*list));
+				if (!list)
+					quithere(1, "realloc (%d) OOM", size);
+			}
+			list[count++] = blocks;
+		}
 		b_item = next_in_ktree(ctx);
 	}
 	K_RUNLOCK(blocks_free);
 
 	// None
-	if (!b_item)
+	if (!count)
 		return;
 
-	if (btc_orphancheck(blocks))
-		btc_blockstatus(blocks);
+	btc_blockstatus(list, count);
+	free(list);
 }
 
 static void pplns_block(BLOCKS *blocks)
@@ -4968,8 +5461,9 @@ static void pplns_block(BLOCKS *blocks)
 static void summarise_blocks()
 {
 	K_ITEM *b_item, *b_prev, *wi_item, ss_look, *ss_item;
-	K_ITEM wm_look, *wm_item, ms_look, *ms_item;
-	K_TREE_CTX ctx[1], ss_ctx[1], ms_ctx[1];
+	K_ITEM wm_look, *wm_item;
+	K_TREE_CTX ctx[1], ss_ctx[1];
+	MS_ITER ms_iter;
 	double diffacc, diffinv, shareacc, shareinv;
 	tv_t now, elapsed_start, elapsed_finish;
 	int64_t elapsed, wi_start, wi_finish;
@@ -4977,7 +5471,7 @@ static void summarise_blocks()
 	WORKINFO *prev_workinfo;
 	SHARESUMMARY looksharesummary, *sharesummary;
 	WORKMARKERS lookworkmarkers, *workmarkers;
-	MARKERSUMMARY lookmarkersummary, *markersummary;
+	MARKERSUMMARY *markersummary;
 	bool has_ss = false, has_ms = false, ok;
 	int32_t hi, prev_hi;
 
@@ -5049,6 +5543,15 @@ static void summarise_blocks()
 	INIT_SHARESUMMARY(&ss_look);
 	ss_look.data = (void *)(&looksharesummary);
 
+	// Old markersummaries may not be in RAM
+	if (!page_markersummary_range(NULL, wi_start, wi_finish, &now)) {
+		// This will repeat each call here until fixed ...
+		LOGERR("%s() block %d, failed to page markersummaries after "
+			"%"PRId64" up to %"PRId64,
+			__func__, blocks->height, wi_start, wi_finish);
+		return;
+	}
+
 	// We don't want them in an indeterminate state due to pplns
 	K_KLONGWLOCK(process_pplns_free);
 
@@ -5116,15 +5619,9 @@ static void summarise_blocks()
 				 workmarkers->status, hi, wi_finish);
 		}
 		if (WMPROCESSED(workmarkers->status)) {
-			lookmarkersummary.markerid = workmarkers->markerid;
-			lookmarkersummary.userid = MAXID;
-			lookmarkersummary.in_workername = EMPTY;
-			INIT_MARKERSUMMARY(&ms_look);
-			ms_look.data = (void *)(&lookmarkersummary);
-			ms_item = find_before_in_ktree(markersummary_root, &ms_look,
-						       ms_ctx);
-			DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
-			while (ms_item && markersummary->markerid == workmarkers->markerid) {
+			markersummary = first_ms_iter(&ms_iter, workmarkers->markerid,
+						      MS_ITER_ALL);
+			while (markersummary) {
 				has_ms = true;
 				if (markersummary->diffacc > 0) {
 					if (elapsed_start.tv_sec == 0 ||
@@ -5142,8 +5639,7 @@ static void summarise_blocks()
 				shareinv += markersummary->sharesta + markersummary->sharedup +
 					    markersummary->sharehi + markersummary-> sharerej;
 
-				ms_item = prev_in_ktree(ms_ctx);
-				DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
+				markersummary = next_ms_iter(&ms_iter);
 			}
 		}
 		wm_item = prev_in_ktree(ctx);
@@ -5189,10 +5685,52 @@ static void summarise_blocks()
 	}
 }
 
+/* When klist_mem is over the -G budget, release all the free list memory
+ *  chunks, one list at a time, until it's below the low watermark
+ * Lists are only locked one at a time so there's no deadlock risk */
+static void klist_governor()
+{
+	K_LIST **klist = NULL;
+	K_LISTS *klists;
+	int i, count = 0, released = 0;
+	uint64_t was;
+
+	if (!klist_mem_over)
+		return;
+
+	was = klist_mem;
+	ck_wlock(&lock_check_lock);
+	for (klists = all_klists; klists; klists = klists->next)
+		count++;
+	klist = calloc(count ? : 1, sizeof(*klist));
+	if (!klist)
+		quithere(1, "calloc (%d) OOM", count);
+	count = 0;
+	for (klists = all_klists; klists; klists = klists->next) {
+		// Tree node lists have no lock
+		if (!(klists->klist->is_lock_only) && klists->klist->lock)
+			klist[count++] = klists->klist;
+	}
+	ck_wunlock(&lock_check_lock);
+
+	for (i = 0; i < count && klist_mem_over; i++) {
+		K_WLOCK(klist[i]);
+		released += k_reclaim_list(klist[i]);
+		K_WUNLOCK(klist[i]);
+	}
+	free(klist);
+
+	LOGWARNING("%s() released %d chunk%s %"PRIu64"MB -> %"PRIu64"MB%s",
+		   __func__, released, (released == 1) ? EMPTY : "s",
+		   was >> 20, klist_mem >> 20,
+		   klist_mem_over ? " still over" : EMPTY);
+}
+
 static void *summariser(__maybe_unused void *arg)
 {
 	bool orphan_check = false;
 	char buf[128];
+	tv_t now;
 	int i;
 
 	pthread_detach(pthread_self());
@@ -5251,6 +5789,19 @@ static void *summariser(__maybe_unused void *arg)
 		else
 			summarise_blocks();
 
+		if (everyone_die)
+			break;
+		else {
+			setnow(&now);
+			userinfo_stats_expire(&now);
+			tseries_expire(&now);
+		}
+
+		if (everyone_die)
+			break;
+		else
+			klist_governor();
+
 		for (i = 0; i < 4; i++) {
 			if (!everyone_die)
 				sleep(1);
@@ -5782,6 +6333,64 @@ static void make_a_workmarker()
 		LOGERR("%s() ERR %s", __func__, msg);
 }
 
+/* Each thread runs the partition in it's own ms_agg[] entry
+ * A pending partition is always completed, even if everyone_die, so
+ *  sharesummaries_to_markersummaries() never waits on an exited thread */
+static void *ms_aggregator(void *arg)
+{
+	MS_AGG *agg = (MS_AGG *)arg;
+	ts_t when;
+	char buf[128];
+	bool pending;
+
+	pthread_detach(pthread_self());
+
+	snprintf(buf, sizeof(buf), "db%s_ms%02d%s",
+		 dbcode, (int)(agg - ms_agg), __func__);
+	LOCK_INIT(buf);
+	rename_proc(buf);
+
+	mutex_lock(&ms_agg_lock);
+	ms_agg_running++;
+	mutex_unlock(&ms_agg_lock);
+
+	while (true) {
+		mutex_lock(&ms_agg_lock);
+		if (!agg->pending) {
+			if (everyone_die) {
+				ms_agg_running--;
+				mutex_unlock(&ms_agg_lock);
+				break;
+			}
+			setnowts(&when);
+			when.tv_sec++;
+			cond_timedwait(&ms_agg_cond, &ms_agg_lock, &when);
+		}
+		pending = agg->pending;
+		mutex_unlock(&ms_agg_lock);
+
+		if (pending) {
+			markersummary_aggregate(agg);
+
+			mutex_lock(&ms_agg_lock);
+			agg->pending = false;
+			pthread_cond_broadcast(&ms_agg_done_cond);
+			mutex_unlock(&ms_agg_lock);
+		}
+	}
+
+	return NULL;
+}
+
+static void start_ms_aggregators()
+{
+	pthread_t ms_agg_pt;
+	int i;
+
+	for (i = 0; i < MS_AGG_THREADS_MAX; i++)
+		create_pthread(&ms_agg_pt, ms_aggregator, &(ms_agg[i]));
+}
+
 static void *marker(__maybe_unused void *arg)
 {
 	char buf[128];
@@ -5843,8 +6452,14 @@ static void *marker(__maybe_unused void *arg)
 		if (everyone_die)
 			break;
 		else {
-			if (markersummary_auto)
+			if (markersummary_auto) {
+				tv_t now;
+
 				make_markersummaries(false, NULL, NULL, NULL, NULL, NULL);
+				setnow(&now);
+				seal_markersummaries(&now);
+				drop_markersummaries(&now);
+			}
 		}
 	}
 
@@ -5859,6 +6474,7 @@ static void *logger(__maybe_unused void *arg)
 	LOGQUEUE *lq;
 	char buf[128];
 	tv_t now, then;
+	int64_t sync_ms;
 	int count;
 
 	pthread_detach(pthread_self());
@@ -5873,8 +6489,8 @@ static void *logger(__maybe_unused void *arg)
 	setnow(&now);
 	snprintf(buf, sizeof(buf), "logstart.%ld,%ld",
 				   now.tv_sec, now.tv_usec);
-	LOGFILE(buf, logname_db);
-	LOGFILE(buf, logname_io);
+	LOGFILE(buf, &journal_db);
+	LOGFILE(buf, &journal_io);
 
 	while (!everyone_die) {
 		K_WLOCK(logqueue_free);
@@ -5884,9 +6500,9 @@ static void *logger(__maybe_unused void *arg)
 			DATA_LOGQUEUE(lq, lq_item);
 			if (lq->db) {
 				if (db_logger)
-					LOGFILE(lq->msg, logname_db);
+					LOGFILE(lq->msg, &journal_db);
 			} else
-				LOGFILE(lq->msg, logname_io);
+				LOGFILE(lq->msg, &journal_io);
 			FREENULL(lq->msg);
 
 			K_WLOCK(logqueue_free);
@@ -5897,6 +6513,11 @@ static void *logger(__maybe_unused void *arg)
 				lq_item = NULL;
 			K_WUNLOCK(logqueue_free);
 		}
+		setnow(&now);
+		sync_ms = sys_setting(JOURNAL_SYNC_MS_STR, JOURNAL_SYNC_MS,
+				      &date_eot);
+		journal_commit(&journal_db, &now, sync_ms);
+		journal_commit(&journal_io, &now, sync_ms);
 		cksleep_ms(42);
 	}
 
@@ -5905,8 +6526,8 @@ static void *logger(__maybe_unused void *arg)
 	setnow(&now);
 	snprintf(buf, sizeof(buf), "logstopping.%d.%ld,%ld",
 				   count, now.tv_sec, now.tv_usec);
-	LOGFILE(buf, logname_db);
-	LOGFILE(buf, logname_io);
+	LOGFILE(buf, &journal_db);
+	LOGFILE(buf, &journal_io);
 	if (count)
 		LOGERR("%s", buf);
 	lq_item = STORE_WHEAD(logqueue_store);
@@ -5914,9 +6535,9 @@ static void *logger(__maybe_unused void *arg)
 	while (lq_item) {
 		DATA_LOGQUEUE(lq, lq_item);
 		if (lq->db)
-			LOGFILE(lq->msg, logname_db);
+			LOGFILE(lq->msg, &journal_db);
 		else
-			LOGFILE(lq->msg, logname_io);
+			LOGFILE(lq->msg, &journal_io);
 		FREENULL(lq->msg);
 		count--;
 		setnow(&now);
@@ -5934,8 +6555,10 @@ static void *logger(__maybe_unused void *arg)
 	setnow(&now);
 	snprintf(buf, sizeof(buf), "logstop.%ld,%ld",
 				   now.tv_sec, now.tv_usec);
-	LOGFILE(buf, logname_db);
-	LOGFILE(buf, logname_io);
+	LOGFILE(buf, &journal_db);
+	LOGFILE(buf, &journal_io);
+	journal_close(&journal_db);
+	journal_close(&journal_io);
 	LOGWARNING("%s", buf);
 
 	return NULL;
@@ -6119,6 +6742,7 @@ static void process_sockd(PGconn *conn, K_ITEM *wq_item, enum reply_type reply_t
 	ml_item = workqueue->msgline_item;
 	DATA_MSGLINE(msgline, ml_item);
 
+	setnow(&(msgline->started));
 	ans = ckdb_cmds[msgline->which_cmds].func(conn,
 						  msgline->cmd,
 						  msgline->id,
@@ -6160,18 +6784,26 @@ struct listener_setup {
 
 #define BC_B 0
 #define BC_C 1
+#define BC_A 2
+#define BC_COUNT 3
 
-static pthread_t listener_pt[2][THREAD_LIMIT];
-static struct listener_setup listener_setup[2][THREAD_LIMIT];
+static const char bc_chr[BC_COUNT] = { 'b', 'c', 'a' };
+static const char *bc_name[BC_COUNT] = { "btc", "cmd", "auth" };
+
+static pthread_t listener_pt[BC_COUNT][THREAD_LIMIT];
+static struct listener_setup listener_setup[BC_COUNT][THREAD_LIMIT];
 
 static void *listener_all(void *arg)
 {
-	static bool running[2][THREAD_LIMIT];
+	static bool running[BC_COUNT][THREAD_LIMIT];
 
 	struct listener_setup *setup;
 	PGconn *conn = NULL;
 	K_ITEM *wq_item;
+	WORKQUEUE *workqueue;
+	MSGLINE *msgline;
 	tv_t now1, now2;
+	double wait_us;
 	char buf[128];
 	time_t now;
 	ts_t when, when_add;
@@ -6183,7 +6815,7 @@ static void *listener_all(void *arg)
 	mythread = setup->thread;
 
 	snprintf(buf, sizeof(buf), "db%s_%c%02d%s",
-		 dbcode, (typ == BC_B) ? 'b' : 'c', mythread, "listen");
+		 dbcode, bc_chr[typ], mythread, "listen");
 	LOCK_INIT(buf);
 	rename_proc(buf);
 
@@ -6199,11 +6831,13 @@ static void *listener_all(void *arg)
 
 		if (typ == BC_B)
 			listener_delta = btc_listener_threads - 1;
+		else if (typ == BC_A)
+			listener_delta = auth_listener_threads - 1;
 		else
 			listener_delta = cmd_listener_threads - 1;
 
 		LOGNOTICE("%s() %s initialised - delta %d",
-			  __func__, (typ == BC_B) ? "btc" : "cmd", listener_delta);
+			  __func__, bc_name[typ], listener_delta);
 	}
 	LOGNOTICE("%s() %s processing", __func__, buf);
 
@@ -6212,6 +6846,8 @@ static void *listener_all(void *arg)
 
 	if (typ == BC_B)
 		blistener_using_data = true;
+	else if (typ == BC_A)
+		alistener_using_data = true;
 	else
 		clistener_using_data = true;
 
@@ -6232,9 +6868,15 @@ static void *listener_all(void *arg)
 		    cmd_listener_threads_delta != 0) {
 			listener_delta = cmd_listener_threads_delta;
 			cmd_listener_threads_delta = 0;
+		} else if (mythread == 0 && typ == BC_A &&
+		    auth_listener_threads_delta != 0) {
+			listener_delta = auth_listener_threads_delta;
+			auth_listener_threads_delta = 0;
 		} else {
 			if (typ == BC_B)
 				wq_item = k_unlink_head(btc_workqueue_store);
+			else if (typ == BC_A)
+				wq_item = k_unlink_head(auth_workqueue_store);
 			else
 				wq_item = k_unlink_head(cmd_workqueue_store);
 		}
@@ -6266,7 +6908,7 @@ static void *listener_all(void *arg)
 #endif
 					   , __func__,
 					   done,
-					   (typ == BC_B) ? "btc" : "cmd",
+					   bc_name[typ],
 					   (done == 1) ? EMPTY : "s",
 					   tot
 #if LOCK_CHECK
@@ -6283,7 +6925,7 @@ static void *listener_all(void *arg)
 							listener_delta++;
 							LOGNOTICE("%s() %s stopping %d",
 								  __func__,
-								  (typ == BC_B) ? "btc" : "cmd",
+								  bc_name[typ],
 								  i);
 							running[typ][i] = false;
 							join_pthread(listener_pt[typ][i]);
@@ -6298,7 +6940,7 @@ static void *listener_all(void *arg)
 #endif
 					   , __func__,
 					   done,
-					   (typ == BC_B) ? "btc" : "cmd",
+					   bc_name[typ],
 					   (done == 1) ? EMPTY : "s",
 					   tot
 #if LOCK_CHECK
@@ -6319,6 +6961,12 @@ static void *listener_all(void *arg)
 
 		if (wq_item) {
 			setnow(&now1);
+			wait_us = 0.0;
+			if (typ == BC_A) {
+				DATA_WORKQUEUE(workqueue, wq_item);
+				DATA_MSGLINE(msgline, workqueue->msgline_item);
+				wait_us = us_tvdiff(&now1, &(msgline->broken));
+			}
 			process_sockd(conn, wq_item,
 				      (typ == BC_B) ? REPLIER_BTC : REPLIER_CMD);
 			setnow(&now2);
@@ -6326,6 +6974,12 @@ static void *listener_all(void *arg)
 			if (typ == BC_B) {
 				blis_us += us_tvdiff(&now2, &now1);
 				blis_processed++;
+			} else if (typ == BC_A) {
+				alis_us += us_tvdiff(&now2, &now1);
+				alis_processed++;
+				alis_wait_us += wait_us;
+				if (alis_wait_max_us < wait_us)
+					alis_wait_max_us = wait_us;
 			} else {
 				clis_us += us_tvdiff(&now2, &now1);
 				clis_processed++;
@@ -6344,6 +6998,15 @@ static void *listener_all(void *arg)
 				else if (errno == ETIMEDOUT)
 					wq_btc_timeouts++;
 				mutex_unlock(&wq_btc_waitlock);
+			} else if (typ == BC_A) {
+				mutex_lock(&wq_auth_waitlock);
+				ret = cond_timedwait(&wq_auth_waitcond,
+						     &wq_auth_waitlock, &when);
+				if (ret == 0)
+					wq_auth_wakes++;
+				else if (errno == ETIMEDOUT)
+					wq_auth_timeouts++;
+				mutex_unlock(&wq_auth_waitlock);
 			} else {
 				mutex_lock(&wq_cmd_waitlock);
 				ret = cond_timedwait(&wq_cmd_waitcond,
@@ -6373,6 +7036,9 @@ static void *listener_all(void *arg)
 		if (typ == BC_B) {
 			LOGNOTICE("%s() %s exiting, processed %"PRIu64, __func__, buf, blis_processed);
 			blistener_using_data = false;
+		} else if (typ == BC_A) {
+			LOGNOTICE("%s() %s exiting, processed %"PRIu64, __func__, buf, alis_processed);
+			alistener_using_data = false;
 		} else {
 			LOGNOTICE("%s() %s exiting, processed %"PRIu64, __func__, buf, clis_processed);
 			clistener_using_data = false;
@@ -6624,13 +7290,46 @@ static void *process_socket(__maybe_unused void *arg)
 				}
 				setnow(&(msgline->processed));
 				break;
-			case CMD_USERSET:
-			case CMD_BTCSET:
-				btc = true;
+			// Password hashing and 2FA go to the auth listeners
 			case CMD_CHKPASS:
 			case CMD_2FA:
 			case CMD_ADDUSER:
 			case CMD_NEWPASS:
+				K_WLOCK(workqueue_free);
+				if (auth_workqueue_store->count >= AUTH_QUEUE_LIMIT) {
+					K_WUNLOCK(workqueue_free);
+					ck_wlock(&listener_all_lock);
+					alis_rejected++;
+					ck_wunlock(&listener_all_lock);
+					snprintf(reply, sizeof(reply),
+						 "%s.%ld.busy.%s",
+						 msgline->id,
+						 bq->now.tv_sec,
+						 msgline->cmd);
+					setnow(&(msgline->processed));
+					ckdb_unix_msg(REPLIER_CMD, bq->sockd,
+						      reply, msgline, true);
+					break;
+				}
+				msgline->sockd = bq->sockd;
+				bq->sockd = -1;
+				wq_item = k_unlink_head(workqueue_free);
+				DATA_WORKQUEUE(workqueue, wq_item);
+				workqueue->msgline_item = bq->ml_item;
+				workqueue->by = by_default;
+				workqueue->code =  (char *)__func__;
+				workqueue->inet = inet_default;
+				k_add_tail(auth_workqueue_store, wq_item);
+				K_WUNLOCK(workqueue_free);
+				mutex_lock(&wq_auth_waitlock);
+				wq_auth_signals++;
+				pthread_cond_signal(&wq_auth_waitcond);
+				mutex_unlock(&wq_auth_waitlock);
+				wq_item = bq->ml_item = NULL;
+				break;
+			case CMD_USERSET:
+			case CMD_BTCSET:
+				btc = true;
 			case CMD_WORKERSET:
 			case CMD_GETATTS:
 			case CMD_SETATTS:
@@ -6690,6 +7389,7 @@ static void *process_socket(__maybe_unused void *arg)
 			case CMD_DSP:
 			case CMD_BLOCKSTATUS:
 			case CMD_MARKS:
+			case CMD_TSERIES:
 				if (!startup_complete && !key_update) {
 					snprintf(reply, sizeof(reply),
 						 "%s.%ld.loading.%s",
@@ -7074,6 +7774,11 @@ static void *socksetup(__maybe_unused void *arg)
 		create_pthread(&listener_pt[BC_C][0], listener_all,
 				&(listener_setup[BC_C][0]));
 
+		listener_setup[BC_A][0].bc = BC_A;
+		listener_setup[BC_A][0].thread = 0;
+		create_pthread(&listener_pt[BC_A][0], listener_all,
+				&(listener_setup[BC_A][0]));
+
 		create_pthread(&proc_pt, process_socket, NULL);
 
 		create_pthread(&psock_pt, sockrun, &ckp);
@@ -7163,6 +7868,7 @@ static void process_reload_item(PGconn *conn, K_ITEM *bq_item)
 		case CMD_HIGH:
 		case CMD_THREADS:
 		case CMD_PAUSE:
+		case CMD_TSERIES:
 			LOGERR("%s() INVALID message line %"PRIu64
 				" ignored '%.42s...",
 				__func__, bq->count,
@@ -7187,6 +7893,8 @@ static void process_reload_item(PGconn *conn, K_ITEM *bq_item)
 			// This will return the same cmdnum or DUP
 			cmdnum = process_seq(msgline);
 			if (cmdnum != CMD_DUPSEQ) {
+				if (replay_bench)
+					setnow(&(msgline->started));
 				ans = ckdb_cmds[msgline->which_cmds].func(conn,
 						msgline->cmd,
 						msgline->id,
@@ -7197,6 +7905,8 @@ static void process_reload_item(PGconn *conn, K_ITEM *bq_item)
 						&(msgline->cd),
 						msgline->trf_root, true);
 				FREENULL(ans);
+				if (replay_bench)
+					replay_add(msgline);
 			}
 			// TODO: time stats from each msgline tv_t
 			break;
@@ -7566,8 +8276,10 @@ static bool logopen(char **filename, FILE **fp, bool *apipe)
 
 /* If the reload start file is missing and -r was specified correctly:
  *	touch the filename reported in "Failed to open 'filename'",
- *	if ckdb aborts at the beginning of the reload, then start again */
-static bool reload_from(tv_t *start, const tv_t *finish)
+ *	if ckdb aborts at the beginning of the reload, then start again
+ * seek means use the first file's index, if it has one, to skip the lines
+ *  before start */
+static bool reload_from(tv_t *start, const tv_t *finish, bool seek)
 {
 	// proc_pt could exit after this returns
 	static pthread_t proc_pt;
@@ -7605,6 +8317,9 @@ static bool reload_from(tv_t *start, const tv_t *finish)
 	if (!logopen(&filename, &fp, &apipe))
 		quithere(1, "Failed to open '%s'", filename);
 	last_file = reload_timestamp.tv_sec;
+	// Can't seek in a decompression pipe
+	if (seek && !apipe)
+		journal_seek(filename, fp, start);
 
 	setnow(&now);
 	copy_tv(&begin, &now);
@@ -8162,11 +8877,12 @@ static void *listener(__maybe_unused void *arg)
 	if (no_data_log == false)
 		create_pthread(&log_pt, logger, NULL);
 
-	if (!confirm_sharesummary)
+	if (!confirm_sharesummary && !replay_bench)
 		create_pthread(&sock_pt, socksetup, NULL);
 
 	create_pthread(&summ_pt, summariser, NULL);
 
+	start_ms_aggregators();
 	create_pthread(&mark_pt, marker, NULL);
 
 	plistener_using_data = true;
@@ -8178,6 +8894,10 @@ static void *listener(__maybe_unused void *arg)
 		}
 	}
 
+	// The replay is complete
+	if (replay_bench)
+		everyone_die = true;
+
 	if (!everyone_die) {
 		K_RLOCK(workqueue_free);
 		wq0count = pool0_workqueue_store->count;
@@ -8407,6 +9127,7 @@ static void update_reload(WORKINFO *wi_stt, WORKINFO *wi_fin)
 		return;
 	}
 
+	start_ms_aggregators();
 	create_pthread(&keymark_pt, keymarker, NULL);
 
 	start = &(wi_stt->createdate);
@@ -8417,7 +9138,7 @@ static void update_reload(WORKINFO *wi_stt, WORKINFO *wi_fin)
 	// include the reload file after wi_fin
 	finish.tv_sec += ROLL_S;
 
-	reload_from(start, &finish);
+	reload_from(start, &finish, false);
 
 	// wait for all loaded data to be used
 	while (!everyone_die) {
@@ -9032,7 +9753,7 @@ static void confirm_reload()
 		free(filename);
 	}
 
-	if (!reload_from(&start, &date_eot)) {
+	if (!reload_from(&start, &date_eot, false)) {
 		LOGEMERG("%s() ABORTING from reload_from()", __func__);
 		return;
 	}
@@ -9191,9 +9912,14 @@ static struct option long_options[] = {
 	{ "cmd-listener-threads", required_argument,	0,	'C' },
 	{ "dbname",		required_argument,	0,	'd' },
 	{ "minsdiff",		required_argument,	0,	'D' },
+	// replay the CCLs from the given unix time, without DB IO, then exit
+	{ "replay",		required_argument,	0,	'e' },
 	{ "free",		required_argument,	0,	'f' },
 	// generate = enable payout pplns auto generation
 	{ "generate",		no_argument,		0,	'g' },
+	// K_LIST memory budget MB, 0 = none, see klist_mem_high
+	{ "mem-budget",		required_argument,	0,	'G' },
+	{ "auth-listener-threads", required_argument,	0,	'H' },
 	{ "help",		no_argument,		0,	'h' },
 	{ "pool-instance",	required_argument,	0,	'i' },
 	// only use 'I' for reloading lots of known valid data via CKDB,
@@ -9271,7 +9997,7 @@ int main(int argc, char **argv)
 	memset(&ckpcmd, 0, sizeof(ckp));
 	ckp.loglevel = LOG_NOTICE;
 
-	while ((c = getopt_long(argc, argv, "a:Ab:B:c:C:d:D:f:ghi:IkK:l:L:mM:n:N:o:p:P:q:Q:r:R:s:S:t:Tu:U:vw:xXyY:", long_options, &i)) != -1) {
+	while ((c = getopt_long(argc, argv, "a:Ab:B:c:C:d:D:e:f:gG:H:hi:IkK:l:L:mM:n:N:o:p:P:q:Q:r:R:s:S:t:Tu:U:vw:xXyY:", long_options, &i)) != -1) {
 		switch(c) {
 			case '?':
 			case ':':
@@ -9339,6 +10065,19 @@ int main(int argc, char **argv)
 						"must be >= 0", optarg);
 				}
 				break;
+			case 'e':
+				{
+					int64_t stt = atoll(optarg);
+					if (stt < DATE_BEGIN) {
+						quit(1, "Invalid replay start "
+						     "%"PRId64" - must be >= %ld",
+						     stt, DATE_BEGIN);
+					}
+					replay_start.tv_sec = (time_t)stt;
+					replay_start.tv_usec = 0L;
+					replay_bench = true;
+				}
+				break;
 			case 'f':
 				if (strcasecmp(optarg, FREE_MODE_ALL_STR) == 0)
 					free_mode = FREE_MODE_ALL;
@@ -9357,6 +10096,31 @@ int main(int argc, char **argv)
 			case 'g':
 				genpayout_auto = true;
 				break;
+			case 'G':
+				{
+					int64_t mb = atoll(optarg);
+					if (mb < 0) {
+						quit(1, "Invalid mem-budget "
+						     "%"PRId64" - must be >= 0",
+						     mb);
+					}
+					// low is 90% of high
+					klist_mem_high = (uint64_t)mb << 20;
+					klist_mem_low = klist_mem_high / 10 * 9;
+				}
+				break;
+			case 'H':
+				{
+					int al = atoi(optarg);
+					if (al < 1 || al > THREAD_LIMIT) {
+						quit(1, "Invalid auth listener "
+						     "thread count %d "
+						     "- must be >0 and <=%d",
+						     al, THREAD_LIMIT);
+					}
+					auth_listener_threads = al;
+				}
+				break;
 			case 'h':
 				for (j = 0; long_options[j].val; j++) {
 					struct option *jopt = &long_options[j];
@@ -9581,6 +10345,10 @@ int main(int argc, char **argv)
 			no_data_log = true;
 			ignore_seqall = true;
 			exclusive_db = false;
+		} else if (replay_bench) {
+			dbcode = "e";
+			no_data_log = true;
+			exclusive_db = false;
 		} else
 			dbcode = "";
 	}
@@ -9674,8 +10442,11 @@ int main(int argc, char **argv)
 	cklock_init(&breakdown_lock);
 	cklock_init(&replier_lock);
 	cklock_init(&listener_all_lock);
+	cklock_init(&cmdlat_lock);
+	cklock_init(&replay_lock);
 	cklock_init(&last_lock);
 	cklock_init(&btc_lock);
+	mutex_init(&btc_io_lock);
 	cklock_init(&pgdb_pause_lock);
 	cklock_init(&poolinstance_lock);
 	cklock_init(&seq_found_lock);
@@ -9693,13 +10464,22 @@ int main(int argc, char **argv)
 	mutex_init(&wq_pool_waitlock);
 	mutex_init(&wq_cmd_waitlock);
 	mutex_init(&wq_btc_waitlock);
+	mutex_init(&wq_auth_waitlock);
 	cond_init(&wq_pool_waitcond);
 	cond_init(&wq_cmd_waitcond);
 	cond_init(&wq_btc_waitcond);
+	cond_init(&wq_auth_waitcond);
 
 	mutex_init(&f_ioqueue_waitlock);
 	cond_init(&f_ioqueue_waitcond);
 
+	for (i = 0; i < WORKERSTATUS_LOCKS; i++)
+		mutex_init(&(workerstatus_locks[i]));
+
+	mutex_init(&ms_agg_lock);
+	cond_init(&ms_agg_cond);
+	cond_init(&ms_agg_done_cond);
+
 	cklock_init(&fpm_lock);
 	cksem_init(&socksetup_sem);
 
@@ -9746,6 +10526,9 @@ int main(int argc, char **argv)
 		// TODO: add a system lock to stop running 2 at once?
 		confirm_summaries();
 		everyone_die = true;
+	} else if (replay_bench) {
+		create_pthread(&ckp.pth_listener, listener, NULL);
+		join_pthread(ckp.pth_listener);
 	} else {
 		write_namepid(&ckp.main);
 		create_process_unixsock(&ckp.main);
@@ -9779,7 +10562,7 @@ int main(int argc, char **argv)
 	while (socksetup_using_data || summariser_using_data ||
 		logger_using_data || plistener_using_data ||
 		clistener_using_data || blistener_using_data ||
-		marker_using_data || breakdown_using_data) {
+		alistener_using_data || marker_using_data || breakdown_using_data) {
 		msg = NULL;
 		curr = time(NULL);
 		if (curr - start > 4) {
@@ -9792,7 +10575,7 @@ int main(int argc, char **argv)
 		if (msg) {
 			trigger = curr;
 			snprintf(buf, sizeof(buf),
-				"%s %ds due to%s%s%s%s%s%s%s%s%s",
+				"%s %ds due to%s%s%s%s%s%s%s%s%s%s",
 				msg, (int)(curr - start),
 				socksetup_using_data ? " socksetup" : EMPTY,
 				summariser_using_data ? " summariser" : EMPTY,
@@ -9800,6 +10583,7 @@ int main(int argc, char **argv)
 				plistener_using_data ? " plistener" : EMPTY,
 				clistener_using_data ? " clistener" : EMPTY,
 				blistener_using_data ? " blistener" : EMPTY,
+				alistener_using_data ? " alistener" : EMPTY,
 				marker_using_data ? " marker" : EMPTY,
 				breakdown_using_data ? " breakdown" : EMPTY,
 				replier_using_data ? " replier" : EMPTY);
@@ -21,6 +21,7 @@
 
 #include <sys/ioctl.h>
 #include <sys/prctl.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -137,6 +138,8 @@ extern int cmd_listener_threads;
 extern int btc_listener_threads;
 extern int cmd_listener_threads_delta;
 extern int btc_listener_threads_delta;
+extern int auth_listener_threads;
+extern int auth_listener_threads_delta;
 
 #define BLANK " "
 extern char *EMPTY;
@@ -337,6 +340,9 @@ extern int64_t key_wi_fin;
 // argv -y - don't run in ckdb mode, just confirm sharesummaries
 extern bool confirm_sharesummary;
 
+// argv -e - don't run in ckdb mode, just replay the CCLs as a benchmark
+extern bool replay_bench;
+
 extern int64_t confirm_first_workinfoid;
 extern int64_t confirm_last_workinfoid;
 
@@ -413,6 +419,8 @@ extern char *btc_auth;
 extern int btc_timeout;
 // Lock access to the above variables so they can be changed
 extern cklock_t btc_lock;
+// Protects the idle bitcoind connections in ckdb_btc.c
+extern mutex_t btc_io_lock;
 
 #define _EDDB expirydate
 #define _CDDB createdate
@@ -795,6 +803,7 @@ enum cmd_values {
 	CMD_HIGH,
 	CMD_THREADS,
 	CMD_PAUSE,
+	CMD_TSERIES,
 	CMD_END
 };
 
@@ -842,7 +851,35 @@ extern void _io_msg(bool stamp, char *msg, bool alloc, int errn, bool logfd,
 		    WHERE_FFL_ARGS);
 
 #define LOGQUE(_msg, _db) log_queue_message(_msg, _db)
-#define LOGFILE(_msg, _prefix) rotating_log_nolock(_msg, _prefix)
+#define LOGFILE(_msg, _journal) journal_write(_msg, _journal)
+
+/* The logger() keeps the current hour file of each log open and buffered,
+ *  flushing it after each group of queued messages and fsync'ing it every
+ *  JOURNAL_SYNC_MS_STR ms (default JOURNAL_SYNC_MS) 0 means never fsync
+ * The -db log (the CCLs) also has a sidecar JOURNAL_IDX_EXT index file
+ *  with a line "offset,seqall,createdate" every JOURNAL_IDX_BYTES of the
+ *  log, where seqall and createdate (seconds) are the maximum of all the
+ *  lines before offset, so reload_from() can seek into the first file */
+#define JOURNAL_SYNC_MS_STR "JournalSyncMs"
+#define JOURNAL_SYNC_MS 1000
+#define JOURNAL_IDX_EXT ".idx"
+#define JOURNAL_IDX_BYTES (1024*1024)
+/* How far before the reload start the seek point must be, to allow for
+ *  ckpool messages being out of order */
+#define JOURNAL_SEEK_MARGIN 60
+
+typedef struct journal {
+	char *prefix;
+	bool indexed;
+	time_t hour;
+	FILE *fp;
+	FILE *idx_fp;
+	int64_t offset;
+	int64_t next_idx;
+	int64_t max_seqall;
+	time_t max_cd;
+	tv_t last_sync;
+} JOURNAL;
 #define LOGDUP "dup."
 
 // ***
@@ -1415,6 +1452,7 @@ typedef struct msgline {
 	tv_t cd;
 	tv_t accepted; // copied from breakqueue
 	tv_t broken; // breakdown done
+	tv_t started; // processing started - only for queued commands
 	tv_t processed; // not all are processed
 	tv_t replied;
 	char id[ID_SIZ+1];
@@ -1486,6 +1524,10 @@ typedef struct breakqueue {
 // Don't really limit the cmd queue
 #define CMD_QUEUE_LIMIT 1048500
 #define CMD_QUEUE_SLEEP_MS 42
+/* The auth listener threads are bounded, so limit their queue also
+ * Any auth command that arrives when the queue is full is replied 'busy'
+ *  immediately rather than queueing up more hashing work */
+#define AUTH_QUEUE_LIMIT 1000
 
 extern K_LIST *breakqueue_free;
 extern K_STORE *reload_breakqueue_store;
@@ -1541,6 +1583,7 @@ extern K_STORE *pool0_workqueue_store;
 extern K_STORE *pool_workqueue_store;
 extern K_STORE *cmd_workqueue_store;
 extern K_STORE *btc_workqueue_store;
+extern K_STORE *auth_workqueue_store;
 // this counter ensures we don't switch early from pool0 to pool
 extern int64_t earlysock_left;
 extern int64_t pool0_tot;
@@ -1550,13 +1593,15 @@ extern int64_t pool0_discarded;
 extern mutex_t wq_pool_waitlock;
 extern mutex_t wq_cmd_waitlock;
 extern mutex_t wq_btc_waitlock;
+extern mutex_t wq_auth_waitlock;
 extern pthread_cond_t wq_pool_waitcond;
 extern pthread_cond_t wq_cmd_waitcond;
 extern pthread_cond_t wq_btc_waitcond;
+extern pthread_cond_t wq_auth_waitcond;
 
-extern uint64_t wq_pool_signals, wq_cmd_signals, wq_btc_signals;
-extern uint64_t wq_pool_wakes, wq_cmd_wakes, wq_btc_wakes;
-extern uint64_t wq_pool_timeouts, wq_cmd_timeouts, wq_btc_timeouts;
+extern uint64_t wq_pool_signals, wq_cmd_signals, wq_btc_signals, wq_auth_signals;
+extern uint64_t wq_pool_wakes, wq_cmd_wakes, wq_btc_wakes, wq_auth_wakes;
+extern uint64_t wq_pool_timeouts, wq_cmd_timeouts, wq_btc_timeouts, wq_auth_timeouts;
 
 // REPLIES
 typedef struct replies {
@@ -2829,6 +2874,7 @@ typedef struct userstats {
 	double hashrate1hr;
 	double hashrate24hr;
 	bool idle; // non-DB field
+	bool counted; // non-DB field - in the USERINFO stats totals
 	int instances;
 	char summarylevel[TXT_FLAG+1]; // SUMMARY_NONE in RAM
 	int32_t summarycount;
@@ -2969,6 +3015,14 @@ typedef struct workerstatus {
 	double active_sharehi;
 	double active_sharerej;
 	tv_t active_start;
+	// The latest userstats of the worker
+	tv_t stats_date;
+	double stats_hashrate5m;
+	double stats_hashrate1hr;
+	double stats_hashrate24hr;
+	int64_t stats_elapsed;
+	int stats_instances;
+	int lock; // workerstatus_locks[] stripe
 } WORKERSTATUS;
 
 #define ALLOC_WORKERSTATUS 1000
@@ -2980,6 +3034,16 @@ extern K_TREE *workerstatus_root;
 extern K_LIST *workerstatus_free;
 extern K_STORE *workerstatus_store;
 
+/* Share, auth and stats updates of a workerstatus only hold a read lock on
+ *  workerstatus_free plus it's workerstatus_locks[] stripe, so the share
+ *  ingest threads don't serialise on workerstatus_free
+ * Code that resets the counters must hold the workerstatus_free write lock
+ * The pool share counters since the last block are also split by stripe
+ *  into pool_stripe[], use pool_totals() to read them */
+#define WORKERSTATUS_LOCKS 64
+extern mutex_t workerstatus_locks[WORKERSTATUS_LOCKS];
+extern POOLSTATUS pool_stripe[WORKERSTATUS_LOCKS];
+
 // MARKERSUMMARY
 typedef struct markersummary {
 	int64_t markerid;
@@ -3023,6 +3087,130 @@ extern K_STORE *markersummary_pool_store;
 extern char mark_start_type;
 extern int64_t mark_start;
 
+/* MSBLOCK - a read only columnar copy of all the markersummaries of one
+ *  processed workmarker, replacing the MARKERSUMMARY items in
+ *  markersummary_root and markersummary_userid_root (but not the pool one)
+ * The rows are in markersummary_root order i.e. userid asc, workername asc
+ * Each column is encoded separately:
+ *  userid is a varint delta from the previous row
+ *  workername is a varint index into the block's intransient dictionary
+ *  the doubles are zigzag varints if they are integral, otherwise the
+ *   varint xor of the previous value in the column with trailing zeros
+ *   removed
+ *  the counts are zigzag varints and the tv_t are the zigzag varint
+ *   tv_sec delta from basesec and the varint tv_usec
+ * The modify fields are never set on processed markersummaries and the
+ *  create fields are the same for the whole marker so are stored once
+ * Access the block with the MS_ITER functions, under the markersummary
+ *  lock, exactly like markersummary_root */
+enum msb_cols {
+	MSB_USERID,
+	MSB_WORKERNAME,
+	MSB_DIFFACC,
+	MSB_DIFFSTA,
+	MSB_DIFFDUP,
+	MSB_DIFFHI,
+	MSB_DIFFREJ,
+	MSB_SHAREACC,
+	MSB_SHARESTA,
+	MSB_SHAREDUP,
+	MSB_SHAREHI,
+	MSB_SHAREREJ,
+	MSB_SHARECOUNT,
+	MSB_ERRORCOUNT,
+	MSB_FIRSTSHARE,
+	MSB_LASTSHARE,
+	MSB_FIRSTSHAREACC,
+	MSB_LASTSHAREACC,
+	MSB_LASTDIFFACC,
+	MSB_COLUMNS
+};
+
+typedef struct msblock {
+	int64_t markerid;
+	int rows;
+	int dict_count;
+	char **dict; // intransient workernames
+	int64_t basesec;
+	tv_t createdate;
+	char *in_createby;
+	char *in_createcode;
+	char *in_createinet;
+	size_t col_off[MSB_COLUMNS+1];
+	unsigned char *data;
+	double diffacc; // total of all rows
+	bool paged; // loaded from the DB, not sealed
+	tv_t last_used; // paged only
+} MSBLOCK;
+
+#define ALLOC_MSBLOCK 100
+#define LIMIT_MSBLOCK 0
+#define INIT_MSBLOCK(_item) INIT_GENERIC(_item, msblock)
+#define DATA_MSBLOCK(_var, _item) DATA_GENERIC(_var, _item, msblock, true)
+#define DATA_MSBLOCK_NULL(_var, _item) DATA_GENERIC(_var, _item, msblock, false)
+
+// The tree uses the markersummary lock
+extern K_TREE *msblock_root;
+extern K_LIST *msblock_free;
+extern K_STORE *msblock_store;
+
+// Rows sealed and the MARKERSUMMARY item/tree RAM they would have used
+extern int64_t msblock_rows;
+extern int64_t msblock_full_ram;
+
+/* Processed workmarkers newer than this many are left as MARKERSUMMARY
+ *  items, older ones are sealed into an MSBLOCK, 0 means don't seal */
+#define MSBLOCK_KEEP_STR "MarkerSummaryKeep"
+#define MSBLOCK_KEEP 48
+// Limit the number of workmarkers sealed each time
+#define MSBLOCK_SEAL_LIMIT 8
+
+/* A processed workmarker with no markersummaries in RAM, either due to
+ *  -M markstart or being dropped by drop_markersummaries(), has them
+ *  loaded (paged) from the DB when needed into a paged MSBLOCK
+ * Paged MSBLOCKs are in msblock_root and msblock_page_store and the least
+ *  recently used are discarded when there are more than MS_PAGE_LIMIT_STR
+ *  (default MS_PAGE_LIMIT) but not if they've been used in the last
+ *  MS_PAGE_PIN seconds
+ * Code that needs old markersummaries must call page_markersummary(),
+ *  page_markersummary_window() or page_markersummary_range(), with no
+ *  locks held, before using the MS_ITER functions */
+extern K_STORE *msblock_page_store;
+extern int64_t ms_page_hits;
+extern int64_t ms_page_misses;
+extern int64_t ms_page_evicts;
+extern int64_t ms_page_drops;
+#define MS_PAGE_LIMIT_STR "MarkerSummaryPageLimit"
+#define MS_PAGE_LIMIT 64
+#define MS_PAGE_PIN 60
+/* Only keep this many of the newest processed workmarkers resident,
+ *  older ones are dropped from RAM and paged in when needed
+ *  0 means keep them all */
+#define MS_RESIDENT_STR "MarkerSummaryResident"
+#define MS_RESIDENT 0
+// Limit the number of workmarkers dropped each time
+#define MS_DROP_LIMIT 8
+
+/* Iterate all the markersummaries for a markerid, in markersummary_root
+ *  order, whether they are sealed or not
+ * Set userid to MS_ITER_ALL for all users, or a userid to only return
+ *  that user's rows
+ * The MARKERSUMMARY returned is only valid until the next call and must be
+ *  treated as read only */
+#define MS_ITER_ALL -1
+
+typedef struct ms_iter {
+	int64_t markerid;
+	int64_t userid;
+	K_TREE_CTX ctx[1];
+	K_ITEM *ms_item;
+	MSBLOCK *msblock;
+	int row;
+	size_t pos[MSB_COLUMNS];
+	double prev[MSB_COLUMNS];
+	MARKERSUMMARY ms;
+} MS_ITER;
+
 // KEYSHARESUMMARY
 typedef struct keysharesummary {
 	int64_t workinfoid;
@@ -3132,6 +3320,39 @@ extern K_STORE *workmarkers_store;
 #define MARKER_PROCESSED_STR "p"
 #define WMPROCESSED(_status) (tolower((_status)[0]) == MARKER_PROCESSED)
 
+/* Shift processing splits the markersummary aggregation by userid into
+ *  partitions run by the ms_aggregator() threads, while the caller
+ *  aggregates the keysummaries
+ * MS_AGG_THREADS_STR (default MS_AGG_THREADS) is how many are used,
+ *  up to MS_AGG_THREADS_MAX, 1 means do it all in the caller */
+#define MS_AGG_THREADS_STR "MarkerSummaryThreads"
+#define MS_AGG_THREADS 4
+#define MS_AGG_THREADS_MAX 8
+
+typedef struct ms_agg {
+	// Set by the caller
+	WORKMARKERS *workmarkers;
+	K_STORE *ss_store; // read only
+	int partition;
+	int partitions;
+	bool pending;
+	// Set by the aggregator
+	K_TREE *ms_root;
+	K_STORE *ms_store;
+	int64_t diffacc;
+	int64_t shareacc;
+	int ss_count;
+	tv_t stt;
+	tv_t fin;
+} MS_AGG;
+
+// ms_agg_lock protects ms_agg[].pending and ms_agg_running
+extern MS_AGG ms_agg[MS_AGG_THREADS_MAX];
+extern int ms_agg_running;
+extern mutex_t ms_agg_lock;
+extern pthread_cond_t ms_agg_cond;
+extern pthread_cond_t ms_agg_done_cond;
+
 // MARKS
 typedef struct marks {
 	char *in_poolinstance;
@@ -3254,6 +3475,16 @@ typedef struct userinfo {
 	double sharedup;
 	double sharehi;
 	double sharerej;
+	/* Totals of the latest userstats of each of the user's workers
+	 *  that are newer than USERSTATS_PER_S - see userinfo_stats() */
+	int stats_workers;
+	double stats_hashrate5m;
+	double stats_hashrate1hr;
+	double stats_hashrate24hr;
+	int64_t stats_elapsed; // Minimum
+	int stats_instances;
+	int stats_instworkers; // How many workers have instance data
+	tv_t stats_last;
 } USERINFO;
 
 #define ALLOC_USERINFO 1000
@@ -3265,6 +3496,75 @@ extern K_TREE *userinfo_root;
 extern K_LIST *userinfo_free;
 extern K_STORE *userinfo_store;
 
+// TSERIES
+/* A fixed size RAM history of the hashrate5m of the pool and of each user
+ *  at multiple resolutions, for the web graphs
+ * Each ring is an array of slots indexed by (time / seconds) % size
+ * The last sample in a slot of the finest ring is it's value, and when a
+ *  slot completes, it's value is averaged into each coarser ring
+ * The pool gets poolstats about every minute, but users only get
+ *  userstats about every 10 minutes, so users don't have the 1 minute ring */
+typedef struct tslot {
+	int32_t slot; // time / ring seconds
+	int32_t count;
+	double value; // total of count values
+} TSLOT;
+
+#define TS_RINGS 4
+// The ring of the first user sample
+#define TS_USER_RING 1
+
+typedef struct tseries {
+	int64_t userid; // TSERIES_POOL for the pool
+	int first; // The finest ring
+	int32_t last; // The latest slot in the finest ring
+	TSLOT *ring[TS_RINGS];
+} TSERIES;
+
+#define TSERIES_POOL -1
+
+// User time series idle for longer than this many seconds are discarded
+#define TSERIES_IDLE_STR "TSeriesIdle"
+#define TSERIES_IDLE (7 * 86400)
+
+#define ALLOC_TSERIES 100
+#define LIMIT_TSERIES 0
+#define INIT_TSERIES(_item) INIT_GENERIC(_item, tseries)
+#define DATA_TSERIES(_var, _item) DATA_GENERIC(_var, _item, tseries, true)
+#define DATA_TSERIES_NULL(_var, _item) DATA_GENERIC(_var, _item, tseries, false)
+
+extern K_TREE *tseries_root;
+extern K_LIST *tseries_free;
+extern K_STORE *tseries_store;
+extern const int32_t ts_seconds[TS_RINGS];
+extern const int32_t ts_size[TS_RINGS];
+
+// CMDLAT
+/* Per command reply latency histograms, RAM only, from the MSGLINE times
+ * Bucket b counts times < 2^b us, the last bucket is everything longer
+ * Two windows are kept and reports cover both, i.e. the last 5 to 10 min */
+enum cmdlat_stage {
+	CMDLAT_BREAK, // accepted to breakdown done
+	CMDLAT_QUEUE, // breakdown done to processing started
+	CMDLAT_PROC, // processing started to processing done
+	CMDLAT_TOTAL, // accepted to the reply being queued
+	CMDLAT_STAGES
+};
+
+#define CMDLAT_BUCKETS 26
+#define CMDLAT_WINDOW_S 300
+// Replies for an unknown command are counted after all the commands
+#define CMDLAT_UNKNOWN CMD_END
+#define CMDLAT_CMDS (CMD_END + 1)
+
+typedef struct cmdlat {
+	uint64_t count;
+	uint32_t hist[CMDLAT_STAGES][CMDLAT_BUCKETS];
+	uint64_t max_us[CMDLAT_STAGES];
+} CMDLAT;
+
+extern cklock_t cmdlat_lock;
+
 enum reply_type {
 	REPLIER_POOL,
 	REPLIER_CMD,
@@ -3303,10 +3603,12 @@ extern void free_payouts_data(K_ITEM *item);
 extern void free_ips_data(K_ITEM *item);
 extern void free_optioncontrol_data(K_ITEM *item);
 #define free_markersummary_data(_i) FREE_ITEM(_i)
+extern void free_msblock_data(K_ITEM *item);
 extern void free_keysharesummary_data(K_ITEM *item);
 extern void free_keysummary_data(K_ITEM *item);
 extern void free_workmarkers_data(K_ITEM *item);
 extern void free_marks_data(K_ITEM *item);
+extern void free_tseries_data(K_ITEM *item);
 #define free_seqset_data(_item) _free_seqset_data(_item)
 extern void _free_seqset_data(K_ITEM *item);
 
@@ -3440,6 +3742,7 @@ extern K_ITEM *_find_create_workerstatus(bool gotlock, bool alertcreate,
 					 const char *func2, const int line2,
 					 WHERE_FFL_ARGS);
 extern void zero_all_active(tv_t *when);
+extern void pool_totals(POOLSTATUS *totals);
 extern void workerstatus_ready();
 #define workerstatus_update(_auths, _shares, _userstats) \
 	_workerstatus_update(_auths, _shares, _userstats, WHERE_FFL_HERE)
@@ -3634,6 +3937,23 @@ extern K_ITEM *find_markersummary_userid(int64_t userid, char *workername,
 	} while (0)
 extern K_ITEM *_find_markersummary(int64_t markerid, int64_t workinfoid,
 				   int64_t userid, char *workername, bool pool);
+extern cmp_t cmp_msblock(K_ITEM *a, K_ITEM *b);
+extern K_ITEM *find_msblock(int64_t markerid);
+extern MARKERSUMMARY *first_ms_iter(MS_ITER *iter, int64_t markerid,
+				    int64_t userid);
+extern MARKERSUMMARY *next_ms_iter(MS_ITER *iter);
+extern bool msblock_seal(int64_t markerid);
+extern void msblock_discard(K_ITEM *msb_item);
+extern void seal_markersummaries(tv_t *now);
+extern bool msblock_page_add(int64_t markerid, K_ITEM **items, int count,
+				double *diffacc, tv_t *now);
+extern bool page_markersummary(PGconn *conn, int64_t markerid,
+				double *diffacc, tv_t *now);
+extern bool page_markersummary_window(PGconn *conn, int64_t workinfoid,
+					double diff_want, tv_t *now);
+extern bool page_markersummary_range(PGconn *conn, int64_t wi_start,
+					int64_t wi_finish, tv_t *now);
+extern void drop_markersummaries(tv_t *now);
 extern bool make_markersummaries(bool msg, char *by, char *code, char *inet,
 				 tv_t *cd, K_TREE *trf_root);
 extern cmp_t cmp_keysharesummary(K_ITEM *a, K_ITEM *b);
@@ -3666,6 +3986,14 @@ extern K_ITEM *_find_create_userinfo(int64_t userid, WHERE_FFL_ARGS);
 extern void userinfo_update(SHARES *shares, SHARESUMMARY *sharesummary,
 			    MARKERSUMMARY *markersummary, bool ss_sub);
 extern void userinfo_block(BLOCKS *blocks, enum info_type isnew, int delta);
+extern void userinfo_stats(USERSTATS *was, USERSTATS *now);
+extern void userinfo_stats_expire(tv_t *now);
+extern cmp_t cmp_tseries(K_ITEM *a, K_ITEM *b);
+extern K_ITEM *find_tseries(int64_t userid);
+extern void tseries_add(int64_t userid, tv_t *when, double value);
+extern void tseries_expire(tv_t *now);
+extern void cmdlat_add(MSGLINE *ml, tv_t *now);
+extern char *cmdlat_stats(bool metrics);
 
 // ***
 // *** PostgreSQL functions ckdb_dbio.c
@@ -3805,6 +4133,7 @@ extern bool shareerrors_add(PGconn *conn, char *workinfoid, char *username,
 				char *errn, char *error, char *secondaryuserid,
 				char *by, char *code, char *inet, tv_t *cd,
 				K_TREE *trf_root);
+extern void markersummary_aggregate(MS_AGG *agg);
 extern bool sharesummaries_to_markersummaries(PGconn *conn, WORKMARKERS *workmarkers,
 						char *by, char *code, char *inet,
 						tv_t *cd, K_TREE *trf_root);
@@ -3880,6 +4209,10 @@ extern bool userstats_fill(PGconn *conn);
 extern bool markersummary_add(PGconn *conn, K_ITEM *ms_item, char *by, char *code,
 				char *inet, tv_t *cd, K_TREE *trf_root);
 extern bool markersummary_fill(PGconn *conn);
+extern bool markersummary_page(PGconn *conn, int64_t markerid,
+				double *diffacc, tv_t *now);
+extern MARKERSUMMARY *markersummary_last_shares(PGconn *conn,
+						int64_t markerid, int *count);
 extern bool keysummary_add(PGconn *conn, K_ITEM *ks_item, char *by, char *code,
 			   char *inet, tv_t *cd);
 #define workmarkers_process(_conn, _already, _add, _markerid, _poolinstance, \
@@ -3939,9 +4272,10 @@ extern struct CMDS ckdb_cmds[];
 // *** ckdb_btc.c
 // ***
 
+extern void btc_reset();
 extern bool btc_valid_address(char *addr);
 extern bool btc_orphancheck(BLOCKS *blocks);
-extern void btc_blockstatus(BLOCKS *blocks);
+extern void btc_blockstatus(BLOCKS **blocks, int count);
 
 // ***
 // *** ckdb_crypt.c
@@ -13,17 +13,35 @@
 #define BTCKEY ((const char *)"result")
 
 #define GETBLOCKHASHCMD "getblockhash"
-#define GETBLOCKHASH "{\"method\":\"" GETBLOCKHASHCMD "\",\"params\":[%d],\"id\":1}"
+#define GETBLOCKHASH "{\"method\":\"" GETBLOCKHASHCMD "\",\"params\":[%d],\"id\":%d}"
 #define GETBLOCKHASHKEY NULL
 
-#define GETBLOCKCMD "getblock"
-#define GETBLOCK "{\"method\":\"" GETBLOCKCMD "\",\"params\":[\"%s\"],\"id\":1}"
+/* getblockheader has the same confirmations as getblock without the
+ *  transaction list, which matters when batching many blocks */
+#define GETBLOCKCMD "getblockheader"
+#define GETBLOCK "{\"method\":\"" GETBLOCKCMD "\",\"params\":[\"%s\"],\"id\":%d}"
 #define GETBLOCKCONFKEY ((const char *)"confirmations")
 
 #define VALIDADDRCMD "validateaddress"
-#define VALIDADDR "{\"method\":\"" VALIDADDRCMD "\",\"params\":[\"%s\"],\"id\":1}"
+#define VALIDADDR "{\"method\":\"" VALIDADDRCMD "\",\"params\":[\"%s\"],\"id\":%d}"
 #define VALIDADDRKEY ((const char *)"isvalid")
 
+#define BATCHCMD "batch"
+
+/* bitcoind connections are kept open with HTTP/1.1 keep-alive and
+ *  reused by later requests
+ * Each request takes an idle connection, or opens a new one, and does
+ *  its request/reply pair without any lock held, so a slow request
+ *  doesn't hold up others, then returns it to the idle list if it can
+ *  be reused
+ * btc_io_lock only protects the idle list and btc_gen
+ * btc_gen changes when btc_server or btc_auth change, so that no
+ *  connection to the old server is reused */
+#define BTC_IDLE_MAX 4
+static int btc_idle_fd[BTC_IDLE_MAX];
+static int btc_idle = 0;
+static int btc_gen = 0;
+
 static char *btc_data(char *json, size_t *len)
 {
 	size_t off;
@@ -38,6 +56,7 @@ static char *btc_data(char *json, size_t *len)
 	snprintf(tmp, sizeof(tmp), "Host: %s/\n", btc_server);
 	ck_wunlock(&btc_lock);
 	APPEND_REALLOC(buf, off, *len, tmp);
+	APPEND_REALLOC(buf, off, *len, "Connection: keep-alive\n");
 	APPEND_REALLOC(buf, off, *len, "Content-Type: application/json\n");
 	snprintf(tmp, sizeof(tmp), "Content-Length: %d\n\n", (int)strlen(json));
 	APPEND_REALLOC(buf, off, *len, tmp);
@@ -46,12 +65,72 @@ static char *btc_data(char *json, size_t *len)
 	return buf;
 }
 
+static void btc_close(int *fd)
+{
+	if (*fd >= 0) {
+		if (close(*fd)) {
+			LOGERR("%s() btc socket close error %d:%s",
+				__func__, errno, strerror(errno));
+		}
+		*fd = -1;
+	}
+}
+
+// Take an idle connection, or -1 if there are none, and the current btc_gen
+static int btc_take(int *gen)
+{
+	int fd = -1;
+
+	mutex_lock(&btc_io_lock);
+	if (btc_idle > 0)
+		fd = btc_idle_fd[--btc_idle];
+	*gen = btc_gen;
+	mutex_unlock(&btc_io_lock);
+	return fd;
+}
+
+// Keep fd for reuse unless the settings changed or the idle list is full
+static void btc_give(int fd, int gen)
+{
+	mutex_lock(&btc_io_lock);
+	if (gen == btc_gen && btc_idle < BTC_IDLE_MAX) {
+		btc_idle_fd[btc_idle++] = fd;
+		fd = -1;
+	}
+	mutex_unlock(&btc_io_lock);
+	btc_close(&fd);
+}
+
+/* Call after changing btc_server or btc_auth
+ * Closes the idle connections, and connections in use will be closed
+ *  when their request completes */
+void btc_reset()
+{
+	int fd;
+
+	mutex_lock(&btc_io_lock);
+	btc_gen++;
+	while (btc_idle > 0) {
+		fd = btc_idle_fd[--btc_idle];
+		btc_close(&fd);
+	}
+	mutex_unlock(&btc_io_lock);
+}
+
 #define SOCK_READ 8192
 
-static int read_socket(int fd, char **buf, int timeout)
+/* Read one HTTP reply, using the Content-Length to know where it ends
+ *  so the connection can be reused
+ * Without a Content-Length it reads until bitcoind closes the connection
+ * Returns the size read, or -1 on error/timeout or if the connection
+ *  closed before the Content-Length was read
+ * *body is the offset of the reply body in *buf, *keep is false if the
+ *  connection can't be reused, which is always the case on a failure */
+static int read_reply(int fd, char **buf, int *body, bool *keep, int timeout)
 {
 	char tmp[SOCK_READ+1];
-	int ret, off, len;
+	char *hdr_end, *clen, *conn;
+	int ret, off, len, want = -1;
 	tv_t tv_timeout;
 	fd_set readfs;
 
@@ -60,33 +139,45 @@ static int read_socket(int fd, char **buf, int timeout)
 	if (!(*buf))
 		quithere(1, "malloc (%d) OOM", len+1);
 	off = 0;
+	*body = 0;
+	*keep = false;
 
-	while (42) {
+	while (want < 0 || off < want) {
 		tv_timeout.tv_sec = timeout;
 		tv_timeout.tv_usec = 0;
 		FD_ZERO(&readfs);
 		FD_SET(fd, &readfs);
 		ret = select(fd + 1, &readfs, NULL, NULL, &tv_timeout);
-		if (ret == 0)
-			break;
+		if (ret == 0) {
+			LOGERR("%s() btc socket timeout %ds", __func__, timeout);
+			goto shortread;
+		}
 
 		if (ret < 0) {
 			LOGERR("%s() btc socket select error %d:%s",
 				__func__, errno, strerror(errno));
-			break;
+			goto shortread;
 		}
 
 		ret = recv(fd, tmp, SOCK_READ, 0);
-		if (ret == 0)
-			break;
+		if (ret == 0) {
+			// Without a Content-Length, close is the end
+			if (want < 0 && off)
+				return off;
+			if (off) {
+				LOGERR("%s() btc socket closed after %d of %d",
+					__func__, off, want);
+			}
+			goto shortread;
+		}
 		if (ret < 0) {
 			LOGERR("%s() btc socket recv error %d:%s",
 				__func__, errno, strerror(errno));
-			break;
+			goto shortread;
 		}
 
 		if ((off + ret) > len) {
-			len += SOCK_READ;
+			len = off + ret + SOCK_READ;
 			*buf = realloc(*buf, len + 1);
 			if (!(*buf))
 				quithere(1, "realloc (%d) OOM", len);
@@ -94,60 +185,117 @@ static int read_socket(int fd, char **buf, int timeout)
 
 		memcpy(*buf + off, tmp, ret);
 		off += ret;
-	}
-
-	if (close(fd)) {
-                LOGERR("%s() btc socket close error %d:%s",
-			__func__, errno, strerror(errno));
+		(*buf)[off] = '\0';
+
+		if (*body == 0) {
+			hdr_end = strstr(*buf, "\r\n\r\n");
+			if (hdr_end)
+				*body = hdr_end - *buf + 4;
+			else {
+				hdr_end = strstr(*buf, "\n\n");
+				if (hdr_end)
+					*body = hdr_end - *buf + 2;
+			}
+			if (*body) {
+				(*buf)[*body - 1] = '\0';
+				clen = strcasestr(*buf, "\nContent-Length:");
+				conn = strcasestr(*buf, "\nConnection: close");
+				(*buf)[*body - 1] = '\n';
+				if (clen) {
+					want = *body + atoi(clen + 16);
+					*keep = (conn == NULL);
+				}
+			}
+		}
 	}
 
 	return off;
+
+shortread:
+	*keep = false;
+	return -1;
 }
 
 #define btc_io(_cmd, _json) _btc_io(_cmd, _json, WHERE_FFL_HERE)
 
 static char *_btc_io(__maybe_unused const char *cmd, char *json, WHERE_FFL_ARGS)
 {
-	char *ip = NULL, *port = NULL;
-	char *data, *ans, *res, *ptr;
-	int fd, ret, red;
+	char *ip = NULL, *port = NULL, *server;
+	char *data, *ans = NULL, *res;
+	int ret, red = -1, body, try, fd, gen;
+	bool reused, keep = false;
 	size_t len;
 
+	/* Take the connection first so a btc_reset() after it means this
+	 *  connection, and the data built with the old settings, is not kept */
+	fd = btc_take(&gen);
 	data = btc_data(json, &len);
-	if (!extract_sockaddr(btc_server, &ip, &port)) {
-		LOGERR("%s() invalid btc server '%s'",
-		        __func__, btc_server);
-		return NULL;
-	}
-	fd = connect_socket(ip, port);
-	if (fd < 0) {
-		LOGERR("%s() failed to connect to btc server %s",
-		        __func__, btc_server);
-		return NULL;
+	ck_wlock(&btc_lock);
+	server = strdup(btc_server);
+	ck_wunlock(&btc_lock);
+	if (!server)
+		quithere(1, "strdup OOM");
+	/* A kept connection may have been closed by bitcoind since the
+	 *  last request, so retry once on a new connection */
+	for (try = 0; try < 2; try++) {
+		reused = (fd >= 0);
+		if (!reused) {
+			if (!extract_sockaddr(server, &ip, &port)) {
+				LOGERR("%s() invalid btc server '%s'",
+					__func__, server);
+				break;
+			}
+			fd = connect_socket(ip, port);
+			FREENULL(ip);
+			FREENULL(port);
+			if (fd < 0) {
+				LOGERR("%s() failed to connect to btc server %s",
+					__func__, server);
+				fd = -1;
+				break;
+			}
+		}
+		ret = write_socket(fd, data, len);
+		if (ret != (int)len) {
+			btc_close(&fd);
+			if (reused)
+				continue;
+			LOGERR("%s() failed to write to btc server %s",
+				__func__, server);
+			break;
+		}
+		red = read_reply(fd, &ans, &body, &keep, btc_timeout);
+		if (!keep)
+			btc_close(&fd);
+		if (red < 0) {
+			FREENULL(ans);
+			if (reused)
+				continue;
+		}
+		break;
 	}
-	ret = write_socket(fd, data, len);
-	if (ret != (int)len) {
-		LOGERR("%s() failed to write to btc server %s",
-		        __func__, btc_server);
+	if (fd >= 0)
+		btc_give(fd, gen);
+	free(server);
+	free(data);
+
+	if (red < 0) {
+		free(ans);
 		return NULL;
 	}
-	red = read_socket(fd, &ans, btc_timeout);
-	ans[red] = '\0';
 	if (strncasecmp(ans, "HTTP/1.1 200 OK", 15)) {
 		char *text = safe_text(ans);
 		LOGERR("%s() btc server response not ok: %s",
 		       __func__, text);
 		free(text);
-		free(ans);
 		res = strdup(EMPTY);
 	} else {
-		ptr = strstr(ans, "\n{");
-		if (ptr)
-			res = strdup(ptr+1);
+		if (body)
+			res = strdup(ans + body);
 		else
 			res = strdup(EMPTY);
-		free(ans);
 	}
+	free(ans);
 	return res;
 }
 
@@ -219,27 +367,6 @@ static char *single_decode_str(char *ans, const char *cmd, const char *key)
 	return str;
 }
 
-static int64_t single_decode_int(char *ans, const char *cmd, const char *key)
-{
-	json_t *json_ob;
-	int64_t val = 0;
-
-	json_ob = single_decode(ans, cmd, key);
-	if (json_ob) {
-		if (!json_is_integer(json_ob)) {
-			char *text = safe_text(ans);
-			if (!key)
-				key = BTCKEY;
-			LOGERR("%s() Json %s key %s "
-				"not an int ans='%s'",
-				__func__, cmd, key, text);
-			free(text);
-		} else
-			val = (int64_t)json_integer_value(json_ob);
-	}
-	return val;
-}
-
 static bool single_decode_bool(char *ans, const char *cmd, const char *key)
 {
 	json_t *json_ob;
@@ -271,47 +398,51 @@ static char *btc_blockhash(int32_t height)
 	char *ans;
 	char *hash;
 
-	snprintf(buf, sizeof(buf), GETBLOCKHASH, height);
+	snprintf(buf, sizeof(buf), GETBLOCKHASH, height, 1);
 	ans = btc_io(GETBLOCKHASHCMD, buf);
 	hash = single_decode_str(ans, GETBLOCKHASHCMD, GETBLOCKHASHKEY);
 	free(ans);
 	return hash;
 }
 
-static int32_t btc_confirms(char *hash)
-{
-	char buf[1024];
-	char *ans;
-	int32_t conf;
-
-	snprintf(buf, sizeof(buf), GETBLOCK, hash);
-	ans = btc_io(GETBLOCKCMD, buf);
-	conf = (int32_t)single_decode_int(ans, GETBLOCKCMD, GETBLOCKCONFKEY);
-	free(ans);
-	return conf;
-}
-
 bool btc_valid_address(char *addr)
 {
 	char buf[1024];
 	char *ans;
 	bool valid;
 
-	snprintf(buf, sizeof(buf), VALIDADDR, addr);
+	snprintf(buf, sizeof(buf), VALIDADDR, addr, 1);
 	ans = btc_io(VALIDADDRCMD, buf);
 	valid = single_decode_bool(ans, VALIDADDRCMD, VALIDADDRKEY);
 	free(ans);
 	return valid;
 }
 
+static void flag_block(BLOCKS *blocks, char *confirmed)
+{
+	tv_t now;
+	bool ok;
+
+	setnow(&now);
+
+	ok = blocks_add(NULL, blocks->height,
+			      blocks->blockhash,
+			      confirmed, EMPTY,
+			      EMPTY, EMPTY, NULL, EMPTY,
+			      EMPTY, EMPTY, EMPTY, EMPTY,
+			      by_default, (char *)__func__, inet_default,
+			      &now, false, id_default, NULL);
+
+	if (!ok)
+		blocks->ignore = true;
+}
+
 // Check orphan, returns true only if all OK and not an orphan
 bool btc_orphancheck(BLOCKS *blocks)
 {
 	char hash[TXT_BIG+1];
 	char *blockhash;
 	size_t len;
-	tv_t now;
-	bool ok;
 
 	LOGDEBUG("%s() checking %d %s",
 		 __func__, blocks->height, blocks->blockhash);
@@ -349,18 +480,7 @@ bool btc_orphancheck(BLOCKS *blocks)
 			blocks_confirmed(BLOCKS_ORPHAN_STR),
 			hash, blockhash);
 
-		setnow(&now);
-
-		ok = blocks_add(NULL, blocks->height,
-				      blocks->blockhash,
-				      BLOCKS_ORPHAN_STR, EMPTY,
-				      EMPTY, EMPTY, NULL, EMPTY,
-				      EMPTY, EMPTY, EMPTY, EMPTY,
-				      by_default, (char *)__func__, inet_default,
-				      &now, false, id_default, NULL);
-
-		if (!ok)
-			blocks->ignore = true;
+		flag_block(blocks, BLOCKS_ORPHAN_STR);
 
 		free(blockhash);
 		return false;
@@ -370,69 +490,208 @@ bool btc_orphancheck(BLOCKS *blocks)
 	return true;
 }
 
-// Check to update confirm count
-void btc_blockstatus(BLOCKS *blocks)
+/* Send the count requests as one JSON-RPC batch and decode the reply
+ * Each reply is stored in replies[] by it's request id, 0 up to ids-1,
+ *  or NULL if missing, and the returned array must be json_decref'd */
+static json_t *btc_batch(char **reqs, int count, json_t **replies, int ids)
 {
-	char hash[TXT_BIG+1];
-	char *blockhash;
-	int32_t confirms;
-	size_t len;
-	tv_t now;
-	bool ok;
-
-	LOGDEBUG("%s() checking %d %s",
-		 __func__, blocks->height, blocks->blockhash);
-
-	// Caller must check this to avoid resending it every time
-	if (blocks->ignore) {
-		LOGERR("%s() ignored block %d passed",
-			__func__, blocks->height);
-		return;
+	json_t *json_data = NULL, *reply, *id;
+	json_error_t err_val;
+	char *buf, *ans;
+	size_t siz, off;
+	size_t i;
+	int n;
+
+	for (n = 0; n < ids; n++)
+		replies[n] = NULL;
+
+	APPEND_REALLOC_INIT(buf, off, siz);
+	APPEND_REALLOC(buf, off, siz, "[");
+	for (n = 0; n < count; n++) {
+		if (n)
+			APPEND_REALLOC(buf, off, siz, ",");
+		APPEND_REALLOC(buf, off, siz, reqs[n]);
 	}
+	APPEND_REALLOC(buf, off, siz, "]");
 
-	len = strlen(blocks->blockhash);
-	if (len != SHA256SIZHEX) {
-		LOGERR("%s() invalid blockhash size %d (%d) for block %d",
-			__func__, (int)len, SHA256SIZHEX, blocks->height);
+	ans = btc_io(BATCHCMD, buf);
+	free(buf);
+	if (ans && *ans) {
+		json_data = json_loads(ans, JSON_DISABLE_EOF_CHECK, &err_val);
+		if (!json_data || !json_is_array(json_data)) {
+			char *text = safe_text(ans);
+			LOGERR("%s() Json %s decode error "
+				"json_err=(%d:%d:%d)%s:%s ans='%s'",
+				__func__, BATCHCMD,
+				err_val.line, err_val.column,
+				err_val.position, err_val.source,
+				err_val.text, text);
+			free(text);
+			if (json_data) {
+				json_decref(json_data);
+				json_data = NULL;
+			}
+		} else {
+			json_array_foreach(json_data, i, reply) {
+				id = json_object_get(reply, "id");
+				if (id && json_is_integer(id)) {
+					n = (int)json_integer_value(id);
+					if (n >= 0 && n < ids)
+						replies[n] = reply;
+				}
+			}
+		}
+	}
+	free(ans);
+	return json_data;
+}
 
-		/* So we don't keep repeating the message
-		 * This should never happen */
-		blocks->ignore = true;
+// The result, or key in the result, of a batch reply
+static json_t *batch_result(json_t *reply, const char *cmd, const char *key,
+			    int32_t height)
+{
+	json_t *btc_ob, *json_ob = NULL;
 
-		return;
+	if (!reply) {
+		LOGERR("%s() Json %s block %d reply missing",
+			__func__, cmd, height);
+		return NULL;
 	}
+	btc_ob = json_object_get(reply, BTCKEY);
+	if (btc_ob && !json_is_null(btc_ob)) {
+		if (key == NULL)
+			json_ob = btc_ob;
+		else
+			json_ob = json_object_get(btc_ob, key);
+	}
+	if (!json_ob) {
+		char *ans = json_dumps(reply, JSON_COMPACT);
+		char *text = safe_text(ans);
+		LOGERR("%s() Json %s block %d reply missing key %s ans='%s'",
+			__func__, cmd, height, key ? key : BTCKEY, text);
+		free(text);
+		free(ans);
+	}
+	return json_ob;
+}
 
-	dbhash2btchash(blocks->blockhash, hash, sizeof(hash));
+/* Check orphan and update the confirm count of all the blocks,
+ *  in the order given, with one batch round trip to bitcoind
+ * Each block sends both the getblockhash for it's height and the
+ *  getblockheader for it's hash, request ids 2*n and 2*n+1 */
+void btc_blockstatus(BLOCKS **blocks, int count)
+{
+	char hash[TXT_BIG+1], **reqs;
+	json_t *json_data, **replies, *json_ob;
+	const char *blockhash;
+	int32_t confirms;
+	tv_t io_stt, io_fin;
+	int n, reqn;
+	size_t len;
 
-	blockhash = btc_blockhash(blocks->height);
-	// Something's amiss - let it try again later
-	if (!blockhash)
+	if (count < 1)
 		return;
 
-	if (strlen(blockhash) != SHA256SIZHEX) {
-		free(blockhash);
+	reqs = calloc(count * 2, sizeof(*reqs));
+	replies = calloc(count * 2, sizeof(*replies));
+	if (!reqs || !replies)
+		quithere(1, "calloc (%d) OOM", count * 2);
+
+	reqn = 0;
+	for (n = 0; n < count; n++) {
+		LOGDEBUG("%s() checking %d %s",
+			 __func__, blocks[n]->height, blocks[n]->blockhash);
+
+		// Caller must check this to avoid resending it every time
+		if (blocks[n]->ignore) {
+			LOGERR("%s() ignored block %d passed",
+				__func__, blocks[n]->height);
+			continue;
+		}
+
+		len = strlen(blocks[n]->blockhash);
+		if (len != SHA256SIZHEX) {
+			LOGERR("%s() invalid blockhash size %d (%d) for block %d",
+				__func__, (int)len, SHA256SIZHEX,
+				blocks[n]->height);
+
+			/* So we don't keep repeating the message
+			 * This should never happen */
+			blocks[n]->ignore = true;
+			continue;
+		}
+
+		dbhash2btchash(blocks[n]->blockhash, hash, sizeof(hash));
+		ASPRINTF(&(reqs[reqn++]), GETBLOCKHASH,
+			 blocks[n]->height, n*2);
+		ASPRINTF(&(reqs[reqn++]), GETBLOCK, hash, n*2+1);
+	}
+
+	if (reqn == 0) {
+		free(replies);
+		free(reqs);
 		return;
 	}
 
-	confirms = btc_confirms(hash);
-	if (confirms >= BLOCKS_42_VALUE) {
-		LOGERR("%s() flagging block %d as %s confirms=%d(%d)",
-			__func__, blocks->height,
-			blocks_confirmed(BLOCKS_42_STR),
-			confirms, BLOCKS_42_VALUE);
+	setnow(&io_stt);
+	json_data = btc_batch(reqs, reqn, replies, count * 2);
+	setnow(&io_fin);
 
-		setnow(&now);
+	LOGDEBUG("%s() checked %d block%s io=%.3fs",
+		 __func__, reqn / 2, (reqn == 2) ? EMPTY : "s",
+		 tvdiff(&io_fin, &io_stt));
 
-		ok = blocks_add(NULL, blocks->height,
-				      blocks->blockhash,
-				      BLOCKS_42_STR, EMPTY,
-				      EMPTY, EMPTY, NULL, EMPTY,
-				      EMPTY, EMPTY, EMPTY, EMPTY,
-				      by_default, (char *)__func__, inet_default,
-				      &now, false, id_default, NULL);
+	// Something's amiss - let it try again later
+	if (!json_data)
+		goto out;
+
+	for (n = 0; n < count; n++) {
+		if (blocks[n]->ignore ||
+		    strlen(blocks[n]->blockhash) != SHA256SIZHEX)
+			continue;
+
+		dbhash2btchash(blocks[n]->blockhash, hash, sizeof(hash));
+
+		json_ob = batch_result(replies[n*2], GETBLOCKHASHCMD,
+					GETBLOCKHASHKEY, blocks[n]->height);
+		// Something's amiss - let it try again later
+		if (!json_ob || !json_is_string(json_ob))
+			continue;
+		blockhash = json_string_value(json_ob);
+		if (!blockhash || strlen(blockhash) != SHA256SIZHEX)
+			continue;
+
+		if (strcmp(blockhash, hash) != 0) {
+			LOGERR("%s() flagging block %d as %s pool=%s btc=%s "
+				"io=%.3fs",
+				__func__, blocks[n]->height,
+				blocks_confirmed(BLOCKS_ORPHAN_STR),
+				hash, blockhash, tvdiff(&io_fin, &io_stt));
+
+			flag_block(blocks[n], BLOCKS_ORPHAN_STR);
+			continue;
+		}
 
-		if (!ok)
-			blocks->ignore = true;
+		json_ob = batch_result(replies[n*2+1], GETBLOCKCMD,
+					GETBLOCKCONFKEY, blocks[n]->height);
+		if (!json_ob || !json_is_integer(json_ob))
+			continue;
+		confirms = (int32_t)json_integer_value(json_ob);
+		if (confirms >= BLOCKS_42_VALUE) {
+			LOGERR("%s() flagging block %d as %s confirms=%d(%d) "
+				"io=%.3fs",
+				__func__, blocks[n]->height,
+				blocks_confirmed(BLOCKS_42_STR),
+				confirms, BLOCKS_42_VALUE,
+				tvdiff(&io_fin, &io_stt));
+
+			flag_block(blocks[n], BLOCKS_42_STR);
+		}
 	}
-	free(blockhash);
+	json_decref(json_data);
+out:
+	for (n = 0; n < reqn; n++)
+		free(reqs[n]);
+	free(replies);
+	free(reqs);
 }
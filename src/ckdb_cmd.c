@@ -1854,11 +1854,11 @@ static char *cmd_payments(__maybe_unused PGconn *conn, char *cmd, char *id,
 
 static char *cmd_percent(char *cmd, char *id, tv_t *now, USERS *users)
 {
-	K_ITEM w_look, *w_item, us_look, *us_item, *ws_item;
+	K_ITEM w_look, *w_item, *ws_item;
+	POOLSTATUS totals;
 	K_TREE_CTX w_ctx[1], pay_ctx[1];
 	WORKERS lookworkers, *workers;
 	WORKERSTATUS *workerstatus;
-	USERSTATS *userstats;
 	char tmp[1024];
 	char *buf;
 	size_t len, off;
@@ -1880,17 +1880,17 @@ static char *cmd_percent(char *cmd, char *id, tv_t *now, USERS *users)
 
 	LOGDEBUG("%s(): cmd '%s'", __func__, cmd);
 
+	pool_totals(&totals);
 	APPEND_REALLOC_INIT(buf, off, len);
 	APPEND_REALLOC(buf, off, len, "ok.");
 	snprintf(tmp, sizeof(tmp), "blockacc=%.1f%c",
-				   pool.diffacc, FLDSEP);
+				   totals.diffacc, FLDSEP);
 	APPEND_REALLOC(buf, off, len, tmp);
 	snprintf(tmp, sizeof(tmp), "blockreward=%"PRId64"%c",
 				   pool.reward, FLDSEP);
 	APPEND_REALLOC(buf, off, len, tmp);
 
 	INIT_WORKERS(&w_look);
-	INIT_USERSTATS(&us_look);
 
 	// Add up all user's worker stats to be divided into payout percentages
 	lookworkers.userid = users->userid;
@@ -1920,24 +1920,13 @@ static char *cmd_percent(char *cmd, char *id, tv_t *now, USERS *users)
 				t_sharedup += workerstatus->block_sharedup;
 				t_sharehi += workerstatus->block_sharehi;
 				t_sharerej += workerstatus->block_sharerej;
-			}
-			K_RUNLOCK(workerstatus_free);
-
-			/* TODO: workers_root userid+worker is ordered
-			 *  so no 'find' should be needed -
-			 *  just cmp to last 'unused us_item' userid+worker
-			 *  then step it forward to be the next ready 'unused' */
-			K_RLOCK(userstats_free);
-			us_item = find_userstats(users->userid, workers->in_workername);
-			if (us_item) {
-				DATA_USERSTATS(userstats, us_item);
-				if (tvdiff(now, &(userstats->statsdate)) < USERSTATS_PER_S) {
-					t_hashrate5m += userstats->hashrate5m;
-					t_hashrate1hr += userstats->hashrate1hr;
-					t_hashrate24hr += userstats->hashrate24hr;
+				if (tvdiff(now, &(workerstatus->stats_date)) < USERSTATS_PER_S) {
+					t_hashrate5m += workerstatus->stats_hashrate5m;
+					t_hashrate1hr += workerstatus->stats_hashrate1hr;
+					t_hashrate24hr += workerstatus->stats_hashrate24hr;
 				}
 			}
-			K_RUNLOCK(userstats_free);
+			K_RUNLOCK(workerstatus_free);
 		}
 		K_RLOCK(workers_free);
 		w_item = next_in_ktree(w_ctx);
@@ -2091,12 +2080,12 @@ static char *cmd_workers(__maybe_unused PGconn *conn, char *cmd, char *id,
 			 __maybe_unused bool reload_data)
 {
 	K_ITEM *i_stats, *i_percent, w_look, *u_item, *w_item;
-	K_ITEM *ua_item, *us_item, *ws_item;
+	K_ITEM *ua_item, *ws_item;
 	INTRANSIENT *in_username;
+	POOLSTATUS totals;
 	K_TREE_CTX w_ctx[1];
 	WORKERS lookworkers, *workers;
 	WORKERSTATUS *workerstatus;
-	USERSTATS *userstats;
 	USERATTS *useratts;
 	USERS *users;
 	int ovent = OVENT_OK;
@@ -2156,10 +2145,11 @@ static char *cmd_workers(__maybe_unused PGconn *conn, char *cmd, char *id,
 		oldworkers = useratts->attnum;
 	}
 
+	pool_totals(&totals);
 	APPEND_REALLOC_INIT(buf, off, len);
 	APPEND_REALLOC(buf, off, len, "ok.");
 	snprintf(tmp, sizeof(tmp), "blockacc=%.1f%c",
-				   pool.diffacc, FLDSEP);
+				   totals.diffacc, FLDSEP);
 	APPEND_REALLOC(buf, off, len, tmp);
 	snprintf(tmp, sizeof(tmp), "blockreward=%"PRId64"%c",
 				   pool.reward, FLDSEP);
@@ -2267,31 +2257,15 @@ static char *cmd_workers(__maybe_unused PGconn *conn, char *cmd, char *id,
 						w_sharerej = workerstatus->block_sharerej;
 						w_active_diffacc = workerstatus->active_diffacc;
 						w_active_start.tv_sec = workerstatus->active_start.tv_sec;
-						K_RUNLOCK(workerstatus_free);
-					}
-
-					/* TODO: workers_root userid+worker is ordered
-					 *  so no 'find' should be needed -
-					 *  just cmp to last 'unused us_item' userid+worker
-					 *  then step it forward to be the next ready 'unused' */
-					K_RLOCK(userstats_free);
-					us_item = find_userstats(users->userid, workers->in_workername);
-					if (us_item) {
-						DATA_USERSTATS(userstats, us_item);
-						if (tvdiff(now, &(userstats->statsdate)) < USERSTATS_PER_S) {
-							w_hashrate5m += userstats->hashrate5m;
-							w_hashrate1hr += userstats->hashrate1hr;
-							w_hashrate24hr += userstats->hashrate24hr;
-							if (w_elapsed == -1 || w_elapsed > userstats->elapsed)
-								w_elapsed = userstats->elapsed;
-							if (userstats->instances != NO_INSTANCE_DATA) {
-								if (w_instances == NO_INSTANCE_DATA)
-									w_instances = 0;
-								w_instances += userstats->instances;
-							}
+						if (tvdiff(now, &(workerstatus->stats_date)) < USERSTATS_PER_S) {
+							w_hashrate5m = workerstatus->stats_hashrate5m;
+							w_hashrate1hr = workerstatus->stats_hashrate1hr;
+							w_hashrate24hr = workerstatus->stats_hashrate24hr;
+							w_elapsed = workerstatus->stats_elapsed;
+							w_instances = workerstatus->stats_instances;
 						}
+						K_RUNLOCK(workerstatus_free);
 					}
-					K_RUNLOCK(userstats_free);
 
 					double_to_buf(w_hashrate5m, reply, sizeof(reply));
 					snprintf(tmp, sizeof(tmp), "w_hashrate5m:%d=%s%c", rows, reply, FLDSEP);
@@ -2411,6 +2385,38 @@ static char *cmd_workers(__maybe_unused PGconn *conn, char *cmd, char *id,
 	return buf;
 }
 
+/* Paging of the large web replies
+ * 'start' is the tree key to continue from, as returned in 'next' by the
+ *  previous page, and 'limit' the maximum number of rows, default no limit
+ * The tree is walked in chunks of PAGE_CHUNK keys, releasing the lock
+ *  between chunks, so a large reply doesn't hold the lock the whole time */
+#define PAGE_CHUNK 100
+
+static bool page_params(K_TREE *trf_root, int64_t *start, int *limit,
+			char *reply, size_t siz)
+{
+	K_ITEM *i_start, *i_limit;
+
+	*start = -1;
+	*limit = 0;
+
+	i_start = optional_name(trf_root, "start", 1, (char *)intpatt,
+				reply, siz);
+	if (*reply)
+		return false;
+	if (i_start)
+		TXT_TO_BIGINT("start", transfer_data(i_start), *start);
+
+	i_limit = optional_name(trf_root, "limit", 1, (char *)intpatt,
+				reply, siz);
+	if (*reply)
+		return false;
+	if (i_limit)
+		TXT_TO_INT("limit", transfer_data(i_limit), *limit);
+
+	return true;
+}
+
 static char *cmd_allusers(__maybe_unused PGconn *conn, char *cmd, char *id,
 			  __maybe_unused tv_t *now, __maybe_unused char *by,
 			  __maybe_unused char *code, __maybe_unused char *inet,
@@ -2419,51 +2425,89 @@ static char *cmd_allusers(__maybe_unused PGconn *conn, char *cmd, char *id,
 			  __maybe_unused bool reload_data)
 {
 	K_STORE *usu_store = k_new_store(userstats_free);
-	K_ITEM *us_item, *usu_item, *u_item;
+	K_ITEM *us_item, *usu_item, *u_item, look;
 	K_TREE_CTX us_ctx[1];
-	USERSTATS *userstats, *userstats_u = NULL;
+	USERSTATS lookuserstats, *userstats, *userstats_u;
 	USERS *users;
 	char reply[1024] = "";
 	char tmp[1024];
 	char *buf;
 	size_t len, off;
-	int rows;
+	int64_t start, nextid, lastid;
+	int rows, limit, count, chunk;
+	bool more;
 
 	LOGDEBUG("%s(): cmd '%s'", __func__, cmd);
 
+	if (!page_params(trf_root, &start, &limit, reply, sizeof(reply))) {
+		k_free_store(usu_store);
+		return strdup(reply);
+	}
+
+	lookuserstats.in_workername = EMPTY;
+	INIT_USERSTATS(&look);
+	look.data = (void *)(&lookuserstats);
+
 	/* Sum up all recent userstats without workername
 	 * i.e. userstasts per username */
-	K_WLOCK(userstats_free);
-	us_item = first_in_ktree(userstats_root, us_ctx);
-	while (us_item) {
-		DATA_USERSTATS(userstats, us_item);
-		if (tvdiff(now, &(userstats->statsdate)) < ALLUSERS_LIMIT_S) {
-			if (!userstats_u || userstats->userid != userstats_u->userid) {
-				usu_item = k_unlink_head(userstats_free);
-				DATA_USERSTATS(userstats_u, usu_item);
-
-				userstats_u->userid = userstats->userid;
-				/* Remember the first workername for if we ever
-				 *  get the missing user LOGERR message below */
-				userstats_u->in_workername = userstats->in_workername;
-				userstats_u->hashrate5m = userstats->hashrate5m;
-				userstats_u->hashrate1hr = userstats->hashrate1hr;
-				userstats_u->instances = userstats->instances;
-
-				k_add_head(usu_store, usu_item);
-			} else {
-				userstats_u->hashrate5m += userstats->hashrate5m;
-				userstats_u->hashrate1hr += userstats->hashrate1hr;
-				if (userstats->instances != NO_INSTANCE_DATA) {
-					if ( userstats_u->instances == NO_INSTANCE_DATA)
-						userstats_u->instances = 0;
-					userstats_u->instances += userstats->instances;
+	nextid = start;
+	count = 0;
+	do {
+		more = false;
+		chunk = 0;
+		lastid = -1;
+		userstats_u = NULL;
+		K_WLOCK(userstats_free);
+		if (nextid < 0)
+			us_item = first_in_ktree(userstats_root, us_ctx);
+		else {
+			lookuserstats.userid = nextid;
+			us_item = find_after_in_ktree(userstats_root, &look,
+						      us_ctx);
+		}
+		while (us_item) {
+			DATA_USERSTATS(userstats, us_item);
+			// Only stop between users
+			if (userstats->userid != lastid) {
+				if (chunk >= PAGE_CHUNK ||
+				    (limit > 0 && count >= limit)) {
+					nextid = userstats->userid;
+					more = true;
+					break;
 				}
+				lastid = userstats->userid;
+				chunk++;
 			}
+			if (tvdiff(now, &(userstats->statsdate)) < ALLUSERS_LIMIT_S) {
+				if (!userstats_u || userstats->userid != userstats_u->userid) {
+					usu_item = k_unlink_head(userstats_free);
+					DATA_USERSTATS(userstats_u, usu_item);
+
+					userstats_u->userid = userstats->userid;
+					/* Remember the first workername for if we ever
+					 *  get the missing user LOGERR message below */
+					userstats_u->in_workername = userstats->in_workername;
+					userstats_u->hashrate5m = userstats->hashrate5m;
+					userstats_u->hashrate1hr = userstats->hashrate1hr;
+					userstats_u->instances = userstats->instances;
+
+					// The reply is in descending userid order
+					k_add_head(usu_store, usu_item);
+					count++;
+				} else {
+					userstats_u->hashrate5m += userstats->hashrate5m;
+					userstats_u->hashrate1hr += userstats->hashrate1hr;
+					if (userstats->instances != NO_INSTANCE_DATA) {
+						if ( userstats_u->instances == NO_INSTANCE_DATA)
+							userstats_u->instances = 0;
+						userstats_u->instances += userstats->instances;
+					}
+				}
+			}
+			us_item = next_in_ktree(us_ctx);
 		}
-		us_item = next_in_ktree(us_ctx);
-	}
-	K_WUNLOCK(userstats_free);
+		K_WUNLOCK(userstats_free);
+	} while (more && !(limit > 0 && count >= limit));
 
 	APPEND_REALLOC_INIT(buf, off, len);
 	APPEND_REALLOC(buf, off, len, "ok.");
@@ -2511,6 +2555,11 @@ static char *cmd_allusers(__maybe_unused PGconn *conn, char *cmd, char *id,
 	K_WUNLOCK(userstats_free);
 	k_free_store(usu_store);
 
+	if (more) {
+		snprintf(tmp, sizeof(tmp), "next=%"PRId64"%c", nextid, FLDSEP);
+		APPEND_REALLOC(buf, off, len, tmp);
+	}
+
 	snprintf(tmp, sizeof(tmp),
 		 "rows=%d%cflds=%s%c",
 		 rows, FLDSEP,
@@ -3372,7 +3421,8 @@ static char *cmd_heartbeat(__maybe_unused PGconn *conn, char *cmd, char *id,
 		hq_item = hq_item->prev;
 		first = false;
 	}
-	APPEND_REALLOC(buf, off, len, "]}");
+	snprintf(tmp, sizeof(tmp), "],\"recfmt\":%d}", CKDB_RECFMT);
+	APPEND_REALLOC(buf, off, len, tmp);
 
 	K_WLOCK(heartbeatqueue_free);
 	k_list_transfer_to_head(hq_store, heartbeatqueue_free);
@@ -3382,7 +3432,8 @@ static char *cmd_heartbeat(__maybe_unused PGconn *conn, char *cmd, char *id,
 	LOGDEBUG("%s.%s.%s", cmd, id, buf);
 	return buf;
 pulse:
-	snprintf(reply, siz, "ok.pulse");
+	// Tell ckpool the compact record format it can use
+	snprintf(reply, siz, "ok.pulse.recfmt=%d", CKDB_RECFMT);
 	LOGDEBUG("%s.%s.%s", cmd, id, reply);
 	return strdup(reply);
 }
@@ -3393,18 +3444,19 @@ static char *cmd_homepage(__maybe_unused PGconn *conn, char *cmd, char *id,
 			  __maybe_unused tv_t *notcd, K_TREE *trf_root,
 			  __maybe_unused bool reload_data)
 {
-	K_ITEM *i_username, *u_item, *b_item, *p_item, *us_item, look;
+	K_ITEM *i_username, *u_item, *b_item, *p_item, *ui_item;
 	K_ITEM *ua_item, *pa_item;
+	POOLSTATUS totals;
 	int ovent = OVENT_OK;
-	double u_hashrate5m, u_hashrate1hr;
+	double u_hashrate5m = 0.0, u_hashrate1hr = 0.0;
 	char reply[1024], tmp[1024], *buf;
 	size_t siz = sizeof(reply);
-	USERSTATS lookuserstats, *userstats;
+	USERINFO *userinfo;
 	POOLSTATS *poolstats;
 	BLOCKS *blocks;
 	USERS *users;
-	int64_t u_elapsed;
-	int u_instances;
+	int64_t u_elapsed = -1;
+	int u_instances = NO_INSTANCE_DATA;
 	K_TREE_CTX ctx[1];
 	size_t len, off;
 	bool has_uhr;
@@ -3499,20 +3551,21 @@ static char *cmd_homepage(__maybe_unused PGconn *conn, char *cmd, char *id,
 	}
 
 
+	pool_totals(&totals);
 	snprintf(tmp, sizeof(tmp), "blockacc=%.1f%c",
-				   pool.diffacc, FLDSEP);
+				   totals.diffacc, FLDSEP);
 	APPEND_REALLOC(buf, off, len, tmp);
 
 	snprintf(tmp, sizeof(tmp), "blockerr=%.1f%c",
-				   pool.diffinv, FLDSEP);
+				   totals.diffinv, FLDSEP);
 	APPEND_REALLOC(buf, off, len, tmp);
 
 	snprintf(tmp, sizeof(tmp), "blockshareacc=%.1f%c",
-				   pool.shareacc, FLDSEP);
+				   totals.shareacc, FLDSEP);
 	APPEND_REALLOC(buf, off, len, tmp);
 
 	snprintf(tmp, sizeof(tmp), "blockshareinv=%.1f%c",
-				   pool.shareinv, FLDSEP);
+				   totals.shareinv, FLDSEP);
 	APPEND_REALLOC(buf, off, len, tmp);
 
 	// TODO: DB only has one poolinstance with -i
@@ -3619,36 +3672,22 @@ static char *cmd_homepage(__maybe_unused PGconn *conn, char *cmd, char *id,
 
 	has_uhr = false;
 	if (p_item && u_item) {
-		u_hashrate5m = u_hashrate1hr = 0.0;
-		u_elapsed = -1;
-		u_instances = NO_INSTANCE_DATA;
-		/* find last matching userid record - before userid+1
-		 * Use 'before' in case there is (unexpectedly) a userstats
-		 *  with an empty workername */
-		lookuserstats.userid = users->userid+1;
-		lookuserstats.in_workername = EMPTY;
-		INIT_USERSTATS(&look);
-		look.data = (void *)(&lookuserstats);
-		K_RLOCK(userstats_free);
-		us_item = find_before_in_ktree(userstats_root, &look, ctx);
-		DATA_USERSTATS_NULL(userstats, us_item);
-		while (us_item && userstats->userid == users->userid) {
-			if (tvdiff(now, &(userstats->statsdate)) < USERSTATS_PER_S) {
-				u_hashrate5m += userstats->hashrate5m;
-				u_hashrate1hr += userstats->hashrate1hr;
-				if (u_elapsed == -1 || u_elapsed > userstats->elapsed)
-					u_elapsed = userstats->elapsed;
-				if (userstats->instances != NO_INSTANCE_DATA) {
-					if (u_instances == NO_INSTANCE_DATA)
-						u_instances = 0;
-					u_instances += userstats->instances;
-				}
+		K_RLOCK(userinfo_free);
+		ui_item = get_userinfo(users->userid);
+		if (ui_item) {
+			DATA_USERINFO(userinfo, ui_item);
+			if (userinfo->stats_workers > 0) {
+				u_hashrate5m = userinfo->stats_hashrate5m;
+				u_hashrate1hr = userinfo->stats_hashrate1hr;
+				u_elapsed = userinfo->stats_elapsed;
+				if (userinfo->stats_instworkers > 0)
+					u_instances = userinfo->stats_instances;
+				else
+					u_instances = NO_INSTANCE_DATA;
 				has_uhr = true;
 			}
-			us_item = prev_in_ktree(ctx);
-			DATA_USERSTATS_NULL(userstats, us_item);
 		}
-		K_RUNLOCK(userstats_free);
+		K_RUNLOCK(userinfo_free);
 	}
 
 	if (has_uhr) {
@@ -3661,7 +3700,7 @@ static char *cmd_homepage(__maybe_unused PGconn *conn, char *cmd, char *id,
 		APPEND_REALLOC(buf, off, len, tmp);
 
 		bigint_to_buf(u_elapsed, reply, siz);
-		snprintf(tmp, sizeof(tmp), "u_elapsed=%s", reply);
+		snprintf(tmp, sizeof(tmp), "u_elapsed=%s%c", reply, FLDSEP);
 		APPEND_REALLOC(buf, off, len, tmp);
 
 		int_to_buf(u_instances, reply, siz);
@@ -4320,11 +4359,12 @@ static char *cmd_pplns(__maybe_unused PGconn *conn, char *cmd, char *id,
 	size_t siz = sizeof(reply);
 	K_ITEM *i_height, *i_difftimes, *i_diffadd, *i_allowaged;
 	K_ITEM b_look, ss_look, *b_item, *w_item, *ss_item;
-	K_ITEM wm_look, *wm_item, ms_look, *ms_item;
+	K_ITEM wm_look, *wm_item;
 	K_ITEM *mu_item, *wb_item, *u_item;
 	SHARESUMMARY looksharesummary, *sharesummary;
 	WORKMARKERS lookworkmarkers, *workmarkers;
-	MARKERSUMMARY lookmarkersummary, *markersummary;
+	MARKERSUMMARY *markersummary;
+	MS_ITER ms_iter;
 	MININGPAYOUTS *miningpayouts;
 	WORKINFO *workinfo;
 	TRANSFER *transfer;
@@ -4339,7 +4379,7 @@ static char *cmd_pplns(__maybe_unused PGconn *conn, char *cmd, char *id,
 	int64_t ss_count, wm_count, ms_count;
 	char tv_buf[DATE_BUFSIZ];
 	tv_t cd, begin_tv, block_tv, end_tv;
-	K_TREE_CTX ctx[1], wm_ctx[1], ms_ctx[1], pay_ctx[1];
+	K_TREE_CTX ctx[1], wm_ctx[1], pay_ctx[1];
 	double ndiff, total_diff, elapsed;
 	double diff_times = 1.0;
 	double diff_add = 0.0;
@@ -4449,6 +4489,12 @@ static char *cmd_pplns(__maybe_unused PGconn *conn, char *cmd, char *id,
 	total_diff = 0;
 	ss_count = wm_count = ms_count = 0;
 
+	// An old block's markersummaries may not be in RAM
+	if (!page_markersummary_window(conn, block_workinfoid, diff_want, now)) {
+		snprintf(reply, siz, "ERR.failed to page markersummaries");
+		return strdup(reply);
+	}
+
 	mu_store = k_new_store(miningpayouts_free);
 	mu_root = new_ktree_auto("OldMPU", cmp_mu, miningpayouts_free);
 
@@ -4536,16 +4582,10 @@ static char *cmd_pplns(__maybe_unused PGconn *conn, char *cmd, char *id,
 		while (total_diff < diff_want && wm_item && CURRENT(&(workmarkers->expirydate))) {
 			if (WMPROCESSED(workmarkers->status)) {
 				wm_count++;
-				lookmarkersummary.markerid = workmarkers->markerid;
-				lookmarkersummary.userid = MAXID;
-				lookmarkersummary.in_workername = EMPTY;
-				INIT_MARKERSUMMARY(&ms_look);
-				ms_look.data = (void *)(&lookmarkersummary);
-				ms_item = find_before_in_ktree(markersummary_root,
-								&ms_look, ms_ctx);
-				DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
+				markersummary = first_ms_iter(&ms_iter, workmarkers->markerid,
+							      MS_ITER_ALL);
 				// add the whole markerid
-				while (ms_item && markersummary->markerid == workmarkers->markerid) {
+				while (markersummary) {
 					if (end_workinfoid == 0)
 						end_workinfoid = workmarkers->workinfoidend;
 					ms_count++;
@@ -4557,8 +4597,7 @@ static char *cmd_pplns(__maybe_unused PGconn *conn, char *cmd, char *id,
 						copy_tv(&end_tv, &(markersummary->lastshareacc));
 					upd_add_mu(mu_root, mu_store, markersummary->userid,
 						   (int64_t)(markersummary->diffacc));
-					ms_item = prev_in_ktree(ms_ctx);
-					DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
+					markersummary = next_ms_iter(&ms_iter);
 				}
 			}
 			wm_item = prev_in_ktree(wm_ctx);
@@ -5302,18 +5341,21 @@ static char *cmd_mpayouts(__maybe_unused PGconn *conn, char *cmd, char *id,
 			  __maybe_unused K_TREE *trf_root,
 			  __maybe_unused bool reload_data)
 {
-	K_ITEM *u_item, *mp_item, *po_item;
+	K_ITEM *u_item, *mp_item, *po_item, look;
 	INTRANSIENT *in_username;
 	K_TREE_CTX ctx[1];
 	MININGPAYOUTS *mp;
-	PAYOUTS *payouts;
+	PAYOUTS lookpayouts, *payouts;
 	USERS *users;
 	char reply[1024] = "";
 	char tmp[1024];
 	size_t siz = sizeof(reply);
 	char *buf;
 	size_t len, off;
-	int rows;
+	int64_t start;
+	int32_t nextheight, lastheight;
+	int rows, limit, chunk;
+	bool more;
 
 	LOGDEBUG("%s(): cmd '%s'", __func__, cmd);
 
@@ -5321,6 +5363,10 @@ static char *cmd_mpayouts(__maybe_unused PGconn *conn, char *cmd, char *id,
 	if (!in_username)
 		return strdup(reply);
 
+	// start is a block height, the payouts are newest first
+	if (!page_params(trf_root, &start, &limit, reply, siz))
+		return strdup(reply);
+
 	K_RLOCK(users_free);
 	u_item = find_users(in_username->str);
 	K_RUNLOCK(users_free);
@@ -5331,79 +5377,111 @@ static char *cmd_mpayouts(__maybe_unused PGconn *conn, char *cmd, char *id,
 	APPEND_REALLOC_INIT(buf, off, len);
 	APPEND_REALLOC(buf, off, len, "ok.");
 	rows = 0;
-	K_RLOCK(payouts_free);
-	po_item = last_in_ktree(payouts_root, ctx);
-	DATA_PAYOUTS_NULL(payouts, po_item);
+	nextheight = (int32_t)start;
+	STRNCPY(lookpayouts.blockhash, EMPTY);
+	DATE_ZERO(&(lookpayouts.expirydate));
+	INIT_PAYOUTS(&look);
+	look.data = (void *)(&lookpayouts);
 	/* TODO: allow to see details of a single payoutid
 	 *	 if it has multiple items (percent payout user) */
-	while (po_item) {
-		if (CURRENT(&(payouts->expirydate)) &&
-		    PAYGENERATED(payouts->status)) {
-			K_RLOCK(miningpayouts_free);
-			mp_item = find_miningpayouts(payouts->payoutid,
-						     users->userid);
-			if (mp_item) {
-				DATA_MININGPAYOUTS(mp, mp_item);
-
-				bigint_to_buf(payouts->payoutid, reply,
-					      sizeof(reply));
-				snprintf(tmp, sizeof(tmp), "payoutid:%d=%s%c",
-							   rows, reply, FLDSEP);
-				APPEND_REALLOC(buf, off, len, tmp);
+	do {
+		more = false;
+		chunk = 0;
+		lastheight = -1;
+		K_RLOCK(payouts_free);
+		if (nextheight < 0)
+			po_item = last_in_ktree(payouts_root, ctx);
+		else {
+			// The last item <= nextheight
+			lookpayouts.height = nextheight + 1;
+			po_item = find_before_in_ktree(payouts_root, &look, ctx);
+		}
+		DATA_PAYOUTS_NULL(payouts, po_item);
+		while (po_item) {
+			// Only stop between heights
+			if (payouts->height != lastheight) {
+				if (chunk >= PAGE_CHUNK ||
+				    (limit > 0 && rows >= limit)) {
+					nextheight = payouts->height;
+					more = true;
+					break;
+				}
+				lastheight = payouts->height;
+				chunk++;
+			}
+			if (CURRENT(&(payouts->expirydate)) &&
+			    PAYGENERATED(payouts->status)) {
+				K_RLOCK(miningpayouts_free);
+				mp_item = find_miningpayouts(payouts->payoutid,
+							     users->userid);
+				if (mp_item) {
+					DATA_MININGPAYOUTS(mp, mp_item);
+
+					bigint_to_buf(payouts->payoutid, reply,
+						      sizeof(reply));
+					snprintf(tmp, sizeof(tmp), "payoutid:%d=%s%c",
+								   rows, reply, FLDSEP);
+					APPEND_REALLOC(buf, off, len, tmp);
 
-				int_to_buf(payouts->height, reply,
-					   sizeof(reply));
-				snprintf(tmp, sizeof(tmp), "height:%d=%s%c",
-							   rows, reply, FLDSEP);
-				APPEND_REALLOC(buf, off, len, tmp);
+					int_to_buf(payouts->height, reply,
+						   sizeof(reply));
+					snprintf(tmp, sizeof(tmp), "height:%d=%s%c",
+								   rows, reply, FLDSEP);
+					APPEND_REALLOC(buf, off, len, tmp);
 
-				snprintf(tmp, sizeof(tmp),
-					 "block"CDTRF":%d=%ld%c", rows,
-					 payouts->blockcreatedate.tv_sec, FLDSEP);
-				APPEND_REALLOC(buf, off, len, tmp);
+					snprintf(tmp, sizeof(tmp),
+						 "block"CDTRF":%d=%ld%c", rows,
+						 payouts->blockcreatedate.tv_sec, FLDSEP);
+					APPEND_REALLOC(buf, off, len, tmp);
 
-				bigint_to_buf(payouts->elapsed, reply,
-					      sizeof(reply));
-				snprintf(tmp, sizeof(tmp), "elapsed:%d=%s%c",
-							   rows, reply, FLDSEP);
-				APPEND_REALLOC(buf, off, len, tmp);
+					bigint_to_buf(payouts->elapsed, reply,
+						      sizeof(reply));
+					snprintf(tmp, sizeof(tmp), "elapsed:%d=%s%c",
+								   rows, reply, FLDSEP);
+					APPEND_REALLOC(buf, off, len, tmp);
 
-				bigint_to_buf(mp->amount, reply, sizeof(reply));
-				snprintf(tmp, sizeof(tmp), "amount:%d=%s%c",
-							   rows, reply, FLDSEP);
-				APPEND_REALLOC(buf, off, len, tmp);
+					bigint_to_buf(mp->amount, reply, sizeof(reply));
+					snprintf(tmp, sizeof(tmp), "amount:%d=%s%c",
+								   rows, reply, FLDSEP);
+					APPEND_REALLOC(buf, off, len, tmp);
 
-				double_to_buf(mp->diffacc, reply, sizeof(reply));
-				snprintf(tmp, sizeof(tmp), "diffacc:%d=%s%c",
-							   rows, reply, FLDSEP);
-				APPEND_REALLOC(buf, off, len, tmp);
+					double_to_buf(mp->diffacc, reply, sizeof(reply));
+					snprintf(tmp, sizeof(tmp), "diffacc:%d=%s%c",
+								   rows, reply, FLDSEP);
+					APPEND_REALLOC(buf, off, len, tmp);
 
-				bigint_to_buf(payouts->minerreward, reply,
-					      sizeof(reply));
-				snprintf(tmp, sizeof(tmp), "minerreward:%d=%s%c",
-							   rows, reply, FLDSEP);
-				APPEND_REALLOC(buf, off, len, tmp);
+					bigint_to_buf(payouts->minerreward, reply,
+						      sizeof(reply));
+					snprintf(tmp, sizeof(tmp), "minerreward:%d=%s%c",
+								   rows, reply, FLDSEP);
+					APPEND_REALLOC(buf, off, len, tmp);
 
-				double_to_buf(payouts->diffused, reply,
-					      sizeof(reply));
-				snprintf(tmp, sizeof(tmp), "diffused:%d=%s%c",
-							   rows, reply, FLDSEP);
-				APPEND_REALLOC(buf, off, len, tmp);
+					double_to_buf(payouts->diffused, reply,
+						      sizeof(reply));
+					snprintf(tmp, sizeof(tmp), "diffused:%d=%s%c",
+								   rows, reply, FLDSEP);
+					APPEND_REALLOC(buf, off, len, tmp);
 
-				str_to_buf(payouts->status, reply,
-					   sizeof(reply));
-				snprintf(tmp, sizeof(tmp), "status:%d=%s%c",
-							   rows, reply, FLDSEP);
-				APPEND_REALLOC(buf, off, len, tmp);
+					str_to_buf(payouts->status, reply,
+						   sizeof(reply));
+					snprintf(tmp, sizeof(tmp), "status:%d=%s%c",
+								   rows, reply, FLDSEP);
+					APPEND_REALLOC(buf, off, len, tmp);
 
-				rows++;
+					rows++;
+				}
+				K_RUNLOCK(miningpayouts_free);
 			}
-			K_RUNLOCK(miningpayouts_free);
+			po_item = prev_in_ktree(ctx);
+			DATA_PAYOUTS_NULL(payouts, po_item);
 		}
-		po_item = prev_in_ktree(ctx);
-		DATA_PAYOUTS_NULL(payouts, po_item);
+		K_RUNLOCK(payouts_free);
+	} while (more && !(limit > 0 && rows >= limit));
+
+	if (more) {
+		snprintf(tmp, sizeof(tmp), "next=%"PRId32"%c", nextheight, FLDSEP);
+		APPEND_REALLOC(buf, off, len, tmp);
 	}
-	K_RUNLOCK(payouts_free);
 
 	snprintf(tmp, sizeof(tmp), "rows=%d%cflds=%s%c",
 		 rows, FLDSEP,
@@ -5498,11 +5576,12 @@ static char *cmd_shifts(__maybe_unused PGconn *conn, char *cmd, char *id,
 {
 	INTRANSIENT *in_username;
 	K_ITEM *i_select;
-	K_ITEM *u_item, *p_item, *m_item, ms_look, *wm_item, *ms_item, *wi_item;
-	K_TREE_CTX wm_ctx[1], ms_ctx[1];
+	K_ITEM *u_item, *p_item, *m_item, *wm_item, *wi_item;
+	K_TREE_CTX wm_ctx[1];
 	WORKMARKERS *wm;
 	WORKINFO *wi;
-	MARKERSUMMARY markersummary, *ms, ms_add[SELECT_LIMIT+1];
+	MARKERSUMMARY *ms, ms_add[SELECT_LIMIT+1];
+	MS_ITER ms_iter;
 	PAYOUTS *payouts;
 	USERS *users;
 	MARKS *marks = NULL;
@@ -5594,8 +5673,6 @@ static char *cmd_shifts(__maybe_unused PGconn *conn, char *cmd, char *id,
 
 	APPEND_REALLOC_INIT(buf, off, len);
 	APPEND_REALLOC(buf, off, len, "ok.");
-	INIT_MARKERSUMMARY(&ms_look);
-	ms_look.data = (void *)(&markersummary);
 	rows = 0;
 	K_RLOCK(workmarkers_free);
 	wm_item = last_in_ktree(workmarkers_workinfoid_root, wm_ctx);
@@ -5626,15 +5703,13 @@ static char *cmd_shifts(__maybe_unused PGconn *conn, char *cmd, char *id,
 					workm[i].used = false;
 			}
 
-			markersummary.markerid = wm->markerid;
-			markersummary.userid = users->userid;
-			markersummary.in_workername = EMPTY;
+			// Old shifts may not be in RAM
+			page_markersummary(conn, wm->markerid, NULL, now);
+
 			K_RLOCK(markersummary_free);
-			ms_item = find_after_in_ktree(markersummary_root,
-							&ms_look, ms_ctx);
-			DATA_MARKERSUMMARY_NULL(ms, ms_item);
-			while (ms_item && ms->markerid == wm->markerid &&
-			       ms->userid == users->userid) {
+			ms = first_ms_iter(&ms_iter, wm->markerid,
+					   users->userid);
+			while (ms) {
 				work = worker_offset(ms->in_workername);
 				for (want = 0; workm[want].worker; want++) {
 					if ((want == where_all) ||
@@ -5654,8 +5729,7 @@ static char *cmd_shifts(__maybe_unused PGconn *conn, char *cmd, char *id,
 						ms_add[want].sharerej += ms->sharerej;
 					}
 				}
-				ms_item = next_in_ktree(ms_ctx);
-				DATA_MARKERSUMMARY_NULL(ms, ms_item);
+				ms = next_ms_iter(&ms_iter);
 			}
 			K_RUNLOCK(markersummary_free);
 
@@ -5959,17 +6033,19 @@ static char *cmd_dsp(__maybe_unused PGconn *conn, __maybe_unused char *cmd,
 #endif
 }
 
+/* Optional type=lat returns the per command latency fields instead,
+ *  and type=metrics returns them as metrics text lines */
 static char *cmd_stats(__maybe_unused PGconn *conn, char *cmd, char *id,
 			__maybe_unused tv_t *now, __maybe_unused char *by,
 			__maybe_unused char *code, __maybe_unused char *inet,
-			__maybe_unused tv_t *notcd,
-			__maybe_unused K_TREE *trf_root,
+			__maybe_unused tv_t *notcd, K_TREE *trf_root,
 			__maybe_unused bool reload_data)
 {
-	char tmp[1024], *buf;
+	char tmp[1024] = "", *buf;
 	const char *name;
 	size_t len, off;
-	int64_t ram, ram2, tot = 0;
+	int64_t ram, ram2, reclaim, tot = 0, tot_reclaim = 0;
+	K_ITEM *i_type;
 	K_LIST *klist;
 	K_LISTS *klists;
 	int rows = 0;
@@ -5977,6 +6053,24 @@ static char *cmd_stats(__maybe_unused PGconn *conn, char *cmd, char *id,
 
 	LOGDEBUG("%s(): cmd '%s'", __func__, cmd);
 
+	i_type = optional_name(trf_root, "type", 1, NULL, tmp, sizeof(tmp));
+	if (*tmp)
+		return strdup(tmp);
+	if (i_type) {
+		if (strcasecmp(transfer_data(i_type), "lat") == 0)
+			buf = cmdlat_stats(false);
+		else if (strcasecmp(transfer_data(i_type), "metrics") == 0)
+			buf = cmdlat_stats(true);
+		else {
+			snprintf(tmp, sizeof(tmp), "unknown type '%s'",
+				 transfer_data(i_type));
+			LOGERR("%s() %s.%s", __func__, id, tmp);
+			return strdup(tmp);
+		}
+		LOGDEBUG("%s.ok.%s...", id, cmd);
+		return buf;
+	}
+
 	APPEND_REALLOC_INIT(buf, off, len);
 	APPEND_REALLOC(buf, off, len, "ok.");
 
@@ -6010,12 +6104,21 @@ static char *cmd_stats(__maybe_unused PGconn *conn, char *cmd, char *id,
 		// stores
 		ram += klist->stores * sizeof(K_STORE);
 
+		// chunk arrays
+		ram += klist->item_mem_count * (sizeof(*(klist->chunk_items)) +
+						sizeof(*(klist->chunk_free)));
+
 		ram2 = klist->ram;
 
+		// Approximate, since the last chunk can be smaller with a limit
+		reclaim = (int64_t)(klist->free_chunks) * klist->allocate *
+			  (sizeof(K_ITEM) + klist->siz);
+
 		snprintf(tmp, sizeof(tmp),
 			 "name:%d=%s%s%s%cinitial:%d=%d%callocated:%d=%d%c"
 			 "instore:%d=%d%cram:%d=%"PRId64"%c"
-			 "ram2:%d=%"PRId64"%ccull:%d=%d%ccull_limit:%d=%d%c",
+			 "ram2:%d=%"PRId64"%ccull:%d=%d%ccull_limit:%d=%d%c"
+			 "reclaim:%d=%"PRId64"%creleased:%d=%d%c",
 			 rows, name, istree ? " (tree)" : "",
 			 klist->is_lock_only ? " (lock)" : "", FLDSEP,
 			 rows, klist->allocate, FLDSEP,
@@ -6024,10 +6127,13 @@ static char *cmd_stats(__maybe_unused PGconn *conn, char *cmd, char *id,
 			 rows, ram, FLDSEP,
 			 rows, ram2, FLDSEP,
 			 rows, klist->cull_count, FLDSEP,
-			 rows, klist->cull_limit, FLDSEP);
+			 rows, klist->cull_limit, FLDSEP,
+			 rows, reclaim, FLDSEP,
+			 rows, klist->chunk_released, FLDSEP);
 		APPEND_REALLOC(buf, off, len, tmp);
 
 		tot += ram + ram2;
+		tot_reclaim += reclaim;
 		rows++;
 
 		klists = klists->next;
@@ -6037,10 +6143,37 @@ static char *cmd_stats(__maybe_unused PGconn *conn, char *cmd, char *id,
 	snprintf(tmp, sizeof(tmp), "totalram=%"PRId64"%c", tot, FLDSEP);
 	APPEND_REALLOC(buf, off, len, tmp);
 
+	snprintf(tmp, sizeof(tmp), "klist_mem=%"PRIu64"%cklist_reclaim=%"PRId64
+		 "%cklist_released=%"PRIu64"%cklist_mem_high=%"PRIu64"%c"
+		 "klist_mem_low=%"PRIu64"%cklist_mem_over=%s%c",
+		 klist_mem, FLDSEP, tot_reclaim, FLDSEP,
+		 klist_mem_released, FLDSEP, klist_mem_high, FLDSEP,
+		 klist_mem_low, FLDSEP, klist_mem_over ? TRUE_STR : FALSE_STR,
+		 FLDSEP);
+	APPEND_REALLOC(buf, off, len, tmp);
+
+	K_RLOCK(markersummary_free);
+	K_RLOCK(msblock_free);
+	snprintf(tmp, sizeof(tmp), "msblocks=%d%cmsblock_rows=%"PRId64"%c"
+		 "msblock_ram=%"PRId64"%cmsblock_full_ram=%"PRId64"%c",
+		 msblock_store->count, FLDSEP, msblock_rows, FLDSEP,
+		 msblock_free->ram, FLDSEP, msblock_full_ram, FLDSEP);
+	APPEND_REALLOC(buf, off, len, tmp);
+	snprintf(tmp, sizeof(tmp), "ms_paged=%d%cms_page_hits=%"PRId64"%c"
+		 "ms_page_misses=%"PRId64"%cms_page_evicts=%"PRId64"%c"
+		 "ms_page_drops=%"PRId64"%c",
+		 msblock_page_store->count, FLDSEP, ms_page_hits, FLDSEP,
+		 ms_page_misses, FLDSEP, ms_page_evicts, FLDSEP,
+		 ms_page_drops, FLDSEP);
+	K_RUNLOCK(msblock_free);
+	K_RUNLOCK(markersummary_free);
+	APPEND_REALLOC(buf, off, len, tmp);
+
 	snprintf(tmp, sizeof(tmp),
 		 "rows=%d%cflds=%s%c",
 		 rows, FLDSEP,
-		 "name,initial,allocated,instore,ram,cull,cull_limit", FLDSEP);
+		 "name,initial,allocated,instore,ram,cull,cull_limit,"
+		 "reclaim,released", FLDSEP);
 	APPEND_REALLOC(buf, off, len, tmp);
 
 	snprintf(tmp, sizeof(tmp), "arn=%s%carp=%s", "Stats", FLDSEP, "");
@@ -6984,6 +7117,8 @@ static char *cmd_btcset(__maybe_unused PGconn *conn, char *cmd, char *id,
 			btc_auth = http_base64(userpass);
 		}
 		ck_wunlock(&btc_lock);
+		// Don't reuse any connection to the old server
+		btc_reset();
 
 		if (userpass) {
 			tmp = userpass;
@@ -8592,6 +8727,14 @@ static char *cmd_threads(__maybe_unused PGconn *conn, char *cmd, char *id,
 		K_WUNLOCK(workqueue_free);
 		snprintf(reply, siz, "ok.delta %d request sent", delta_value);
 		return strdup(reply);
+	} else if (strcasecmp(name, "al") == 0 ||
+		   strcasecmp(name, "auth_listener") == 0) {
+		K_WLOCK(workqueue_free);
+		// Just overwrite whatever's there
+		auth_listener_threads_delta = delta_value;
+		K_WUNLOCK(workqueue_free);
+		snprintf(reply, siz, "ok.delta %d request sent", delta_value);
+		return strdup(reply);
 	} else {
 		snprintf(reply, siz, "unknown name '%s'", name);
 		LOGERR("%s() %s.%s", __func__, id, reply);
@@ -8666,6 +8809,107 @@ out:
 	return strdup(reply);
 }
 
+/* Return the time series of the hashrate5m of the pool, or of the user if
+ *  username is given, at resolution res seconds
+ *  res defaults to the finest that the pool or user has
+ * Rows are oldest first, and slots without data are skipped */
+static char *cmd_tseries(__maybe_unused PGconn *conn, char *cmd, char *id,
+			 tv_t *now, __maybe_unused char *by,
+			 __maybe_unused char *code, __maybe_unused char *inet,
+			 __maybe_unused tv_t *cd, K_TREE *trf_root,
+			 __maybe_unused bool reload_data)
+{
+	K_ITEM *i_username, *i_res, *u_item, *ts_item;
+	char reply[1024] = "";
+	size_t siz = sizeof(reply);
+	char tmp[1024];
+	char *buf;
+	size_t len, off;
+	TSERIES *tseries;
+	TSLOT *tslot;
+	USERS *users;
+	int64_t userid = TSERIES_POOL;
+	int32_t cur, slot;
+	int res = 0, r, rows;
+
+	LOGDEBUG("%s(): cmd '%s'", __func__, cmd);
+
+	i_username = optional_name(trf_root, "username", MIN_USERNAME,
+				   (char *)userpatt, reply, siz);
+	if (*reply)
+		return strdup(reply);
+	if (i_username) {
+		K_RLOCK(users_free);
+		u_item = find_users(transfer_data(i_username));
+		K_RUNLOCK(users_free);
+		if (!u_item) {
+			snprintf(reply, siz, "unknown user");
+			return strdup(reply);
+		}
+		DATA_USERS(users, u_item);
+		userid = users->userid;
+	}
+
+	i_res = optional_name(trf_root, "res", 1, (char *)intpatt, reply, siz);
+	if (*reply)
+		return strdup(reply);
+	if (i_res)
+		res = atoi(transfer_data(i_res));
+
+	APPEND_REALLOC_INIT(buf, off, len);
+	APPEND_REALLOC(buf, off, len, "ok.");
+	rows = 0;
+	K_RLOCK(tseries_free);
+	ts_item = find_tseries(userid);
+	if (ts_item) {
+		DATA_TSERIES(tseries, ts_item);
+		if (res == 0)
+			r = tseries->first;
+		else {
+			for (r = tseries->first; r < TS_RINGS; r++) {
+				if (ts_seconds[r] == res)
+					break;
+			}
+		}
+		if (r >= TS_RINGS) {
+			K_RUNLOCK(tseries_free);
+			free(buf);
+			snprintf(reply, siz, "unknown res %d", res);
+			return strdup(reply);
+		}
+		res = ts_seconds[r];
+		cur = (int32_t)(now->tv_sec / res);
+		for (slot = cur - ts_size[r] + 1; slot <= cur; slot++) {
+			tslot = &(tseries->ring[r][slot % ts_size[r]]);
+			if (tslot->slot != slot || tslot->count == 0)
+				continue;
+
+			snprintf(tmp, sizeof(tmp), "time:%d=%"PRId64"%c",
+				 rows, (int64_t)slot * res, FLDSEP);
+			APPEND_REALLOC(buf, off, len, tmp);
+
+			double_to_buf(tslot->value / (double)(tslot->count),
+				      reply, siz);
+			snprintf(tmp, sizeof(tmp), "hashrate5m:%d=%s%c",
+				 rows, reply, FLDSEP);
+			APPEND_REALLOC(buf, off, len, tmp);
+
+			rows++;
+		}
+	}
+	K_RUNLOCK(tseries_free);
+
+	snprintf(tmp, sizeof(tmp), "res=%d%crows=%d%cflds=%s%c",
+		 res, FLDSEP, rows, FLDSEP, "time,hashrate5m", FLDSEP);
+	APPEND_REALLOC(buf, off, len, tmp);
+
+	snprintf(tmp, sizeof(tmp), "arn=%s%carp=%s", "TSeries", FLDSEP, "");
+	APPEND_REALLOC(buf, off, len, tmp);
+
+	LOGDEBUG("%s.ok.%s", id, i_username ? transfer_data(i_username) : "pool");
+	return buf;
+}
+
 /* The socket command format is as follows:
  *  Basic structure:
  *    cmd.ID.fld1=value1 FLDSEP fld2=value2 FLDSEP fld3=...
@@ -8722,7 +8966,11 @@ out:
  * The reply format for authorise, addrauth and heartbeat includes json:
  *   ID.STAMP.ok.cmd={json}
  *  where cmd is auth, addrauth, or heartbeat
- * For the heartbeat pulse reply it has no '={}'
+ * For the heartbeat pulse reply it has no '={}' but ends with
+ *  .recfmt=CKDB_RECFMT, as does the heartbeat json with "recfmt":CKDB_RECFMT
+ *
+ * workinfo, shares and shareerror data can also be the CKDB_RECFMT record
+ *  format "cmd.ID.rec1=..." of ckpool.h instead of json
  */
 
 //	  cmd_val	cmd_str		noid	createdate func		seq		access
@@ -8780,5 +9028,6 @@ struct CMDS ckdb_cmds[] = {
 	{ CMD_HIGH,	"high",		false,	false,	cmd_high,	SEQ_NONE,	ACCESS_SYSTEM },
 	{ CMD_THREADS,	"threads",	false,	false,	cmd_threads,	SEQ_NONE,	ACCESS_SYSTEM },
 	{ CMD_PAUSE,	"pause",	false,	false,	cmd_pause,	SEQ_NONE,	ACCESS_SYSTEM },
+	{ CMD_TSERIES,	"tseries",	false,	false,	cmd_tseries,	SEQ_NONE,	ACCESS_SYSTEM | ACCESS_WEB },
 	{ CMD_END,	NULL,		false,	false,	NULL,		SEQ_NONE,	0 }
 };
@@ -116,6 +116,16 @@ void free_keysummary_data(K_ITEM *item)
 	FREENULL(keysummary->key);
 }
 
+void free_msblock_data(K_ITEM *item)
+{
+	MSBLOCK *msblock;
+
+	DATA_MSBLOCK(msblock, item);
+	FREENULL(msblock->dict);
+	FREENULL(msblock->data);
+	msblock->rows = msblock->dict_count = 0;
+}
+
 void free_workmarkers_data(K_ITEM *item)
 {
 	WORKMARKERS *workmarkers;
@@ -136,6 +146,22 @@ void free_marks_data(K_ITEM *item)
 	FREENULL(marks->extra);
 }
 
+void free_tseries_data(K_ITEM *item)
+{
+	TSERIES *tseries;
+	size_t siz;
+	int r;
+
+	DATA_TSERIES(tseries, item);
+	for (r = 0; r < TS_RINGS; r++) {
+		if (tseries->ring[r]) {
+			siz = sizeof(TSLOT) * ts_size[r];
+			tseries_free->ram -= (int)siz;
+			FREENULL(tseries->ring[r]);
+		}
+	}
+}
+
 void _free_seqset_data(K_ITEM *item)
 {
 	K_STORE *reload_lost;
@@ -1253,6 +1279,8 @@ K_ITEM *_find_create_workerstatus(bool gotlock, bool alertcreate,
 			row->userid = userid;
 			row->in_workername = intransient_str("workername",
 							     workername);
+			row->lock = workerstatus_store->count %
+					WORKERSTATUS_LOCKS;
 
 			add_to_ktree(workerstatus_root, ws_item);
 			k_add_head(workerstatus_store, ws_item);
@@ -1312,6 +1340,78 @@ void zero_all_active(tv_t *when)
 	K_WUNLOCK(workerstatus_free);
 }
 
+static bool ms_in_tree(int64_t markerid);
+
+static void ms_last_share(WORKERSTATUS *workerstatus,
+			  MARKERSUMMARY *markersummary)
+{
+	if (tv_newer(&(workerstatus->last_share),
+		     &(markersummary->lastshare))) {
+		copy_tv(&(workerstatus->last_share),
+			&(markersummary->lastshare));
+	}
+	if (tv_newer(&(workerstatus->last_share_acc),
+		     &(markersummary->lastshareacc))) {
+		copy_tv(&(workerstatus->last_share_acc),
+			&(markersummary->lastshareacc));
+		workerstatus->last_diff_acc = markersummary->lastdiffacc;
+	}
+}
+
+/* markersummary_userid_root only has the unsealed markersummaries, so
+ *  get the last share of each worker in the processed workmarkers that
+ *  aren't in the tree, sealed or dropped, from one DB query rather than
+ *  paging them all in
+ * They are always older than the workmarkers in the tree, so the query
+ *  only needs the newest of them */
+static void ms_sealed_last_share()
+{
+	WORKMARKERS *workmarkers;
+	MARKERSUMMARY *rows, *markersummary;
+	WORKERSTATUS *workerstatus;
+	K_ITEM *wm_item, *ws_item;
+	K_TREE_CTX ctx[1];
+	int64_t markerid = -1;
+	int count = 0, i;
+
+	K_RLOCK(markersummary_free);
+	K_RLOCK(workmarkers_free);
+	wm_item = last_in_ktree(workmarkers_workinfoid_root, ctx);
+	DATA_WORKMARKERS_NULL(workmarkers, wm_item);
+	while (wm_item && CURRENT(&(workmarkers->expirydate))) {
+		if (WMPROCESSED(workmarkers->status) &&
+		    !ms_in_tree(workmarkers->markerid)) {
+			markerid = workmarkers->markerid;
+			break;
+		}
+		wm_item = prev_in_ktree(ctx);
+		DATA_WORKMARKERS_NULL(workmarkers, wm_item);
+	}
+	K_RUNLOCK(workmarkers_free);
+	K_RUNLOCK(markersummary_free);
+
+	if (markerid < 0)
+		return;
+
+	rows = markersummary_last_shares(NULL, markerid, &count);
+	if (!rows) {
+		LOGERR("%s() failed to load the last shares of markerid<="
+			"%"PRId64, __func__, markerid);
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		markersummary = &(rows[i]);
+		ws_item = find_workerstatus(true, markersummary->userid,
+					    markersummary->in_workername);
+		if (ws_item) {
+			DATA_WORKERSTATUS(workerstatus, ws_item);
+			ms_last_share(workerstatus, markersummary);
+		}
+	}
+	free(rows);
+}
+
 /* All data is loaded, now update workerstatus fields
    TODO: combine set_block_share_counters() with this? */
 void workerstatus_ready()
@@ -1324,6 +1424,8 @@ void workerstatus_ready()
 
 	LOGWARNING("%s(): Updating workerstatus...", __func__);
 
+	ms_sealed_last_share();
+
 	ws_item = first_in_ktree(workerstatus_root, ws_ctx);
 	while (ws_item) {
 		DATA_WORKERSTATUS(workerstatus, ws_item);
@@ -1334,18 +1436,7 @@ void workerstatus_ready()
 						    NULL);
 		if (ms_item) {
 			DATA_MARKERSUMMARY(markersummary, ms_item);
-			if (tv_newer(&(workerstatus->last_share),
-				     &(markersummary->lastshare))) {
-				copy_tv(&(workerstatus->last_share),
-					&(markersummary->lastshare));
-			}
-			if (tv_newer(&(workerstatus->last_share_acc),
-				     &(markersummary->lastshareacc))) {
-				copy_tv(&(workerstatus->last_share_acc),
-					&(markersummary->lastshareacc));
-				workerstatus->last_diff_acc =
-					markersummary->lastdiffacc;
-			}
+			ms_last_share(workerstatus, markersummary);
 		}
 
 		ss_item = find_last_sharesummary(workerstatus->userid,
@@ -1375,6 +1466,7 @@ void workerstatus_ready()
 void _workerstatus_update(AUTHS *auths, SHARES *shares,
 				USERSTATS *userstats, WHERE_FFL_ARGS)
 {
+	POOLSTATUS *stripe;
 	WORKERSTATUS *row;
 	K_ITEM *item;
 
@@ -1384,29 +1476,33 @@ void _workerstatus_update(AUTHS *auths, SHARES *shares,
 						file, func, line);
 		if (item) {
 			DATA_WORKERSTATUS(row, item);
-			K_WLOCK(workerstatus_free);
+			K_RLOCK(workerstatus_free);
+			mutex_lock(&(workerstatus_locks[row->lock]));
 			if (tv_newer(&(row->last_auth), &(auths->createdate)))
 				copy_tv(&(row->last_auth), &(auths->createdate));
 			if (row->active_start.tv_sec == 0)
 				copy_tv(&(row->active_start), &(auths->createdate));
-			K_WUNLOCK(workerstatus_free);
+			mutex_unlock(&(workerstatus_locks[row->lock]));
+			K_RUNLOCK(workerstatus_free);
 		}
 	}
 
 	if (startup_complete && shares) {
-		if (shares->errn == SE_NONE) {
-			pool.diffacc += shares->diff;
-			pool.shareacc++;
-		} else {
-			pool.diffinv += shares->diff;
-			pool.shareinv++;
-		}
 		item = find_create_workerstatus(false, true, shares->userid,
 						shares->in_workername, false,
 						file, func, line);
 		if (item) {
 			DATA_WORKERSTATUS(row, item);
-			K_WLOCK(workerstatus_free);
+			K_RLOCK(workerstatus_free);
+			mutex_lock(&(workerstatus_locks[row->lock]));
+			stripe = &(pool_stripe[row->lock]);
+			if (shares->errn == SE_NONE) {
+				stripe->diffacc += shares->diff;
+				stripe->shareacc++;
+			} else {
+				stripe->diffinv += shares->diff;
+				stripe->shareinv++;
+			}
 			if (tv_newer(&(row->last_share), &(shares->createdate)))
 				copy_tv(&(row->last_share), &(shares->createdate));
 			if (row->active_start.tv_sec == 0)
@@ -1465,7 +1561,8 @@ void _workerstatus_update(AUTHS *auths, SHARES *shares,
 					row->active_sharerej++;
 					break;
 			}
-			K_WUNLOCK(workerstatus_free);
+			mutex_unlock(&(workerstatus_locks[row->lock]));
+			K_RUNLOCK(workerstatus_free);
 		}
 	}
 
@@ -1475,21 +1572,45 @@ void _workerstatus_update(AUTHS *auths, SHARES *shares,
 						file, func, line);
 		if (item) {
 			DATA_WORKERSTATUS(row, item);
-			K_WLOCK(workerstatus_free);
 			if (userstats->idle) {
+				// Resets the counters
+				K_WLOCK(workerstatus_free);
 				if (tv_newer(&(row->last_idle), &(userstats->statsdate))) {
 					copy_tv(&(row->last_idle), &(userstats->statsdate));
 					zero_on_idle(&(userstats->statsdate), row);
 				}
+				K_WUNLOCK(workerstatus_free);
 			} else {
+				K_RLOCK(workerstatus_free);
+				mutex_lock(&(workerstatus_locks[row->lock]));
 				if (tv_newer(&(row->last_stats), &(userstats->statsdate)))
 					copy_tv(&(row->last_stats), &(userstats->statsdate));
+				mutex_unlock(&(workerstatus_locks[row->lock]));
+				K_RUNLOCK(workerstatus_free);
 			}
-			K_WUNLOCK(workerstatus_free);
 		}
 	}
 }
 
+/* The pool share counters since the last block, pool plus the shares
+ *  added to pool_stripe[] */
+void pool_totals(POOLSTATUS *totals)
+{
+	POOLSTATUS *stripe;
+	int i;
+
+	memcpy(totals, &pool, sizeof(*totals));
+	for (i = 0; i < WORKERSTATUS_LOCKS; i++) {
+		stripe = &(pool_stripe[i]);
+		mutex_lock(&(workerstatus_locks[i]));
+		totals->diffacc += stripe->diffacc;
+		totals->diffinv += stripe->diffinv;
+		totals->shareacc += stripe->shareacc;
+		totals->shareinv += stripe->shareinv;
+		mutex_unlock(&(workerstatus_locks[i]));
+	}
+}
+
 /* default tree order by now asc
  *  now is guaranteed unique since it's acquired under exclusive lock */
 cmp_t cmp_replies(K_ITEM *a, K_ITEM *b)
@@ -3713,6 +3834,8 @@ void zero_on_new_block(bool gotlock)
 
 	pool.diffacc = pool.diffinv = pool.shareacc =
 	pool.shareinv = pool.best_sdiff = 0;
+	// The write lock excludes all the stripe updates
+	bzero(pool_stripe, sizeof(pool_stripe));
 	ws_item = first_in_ktree(workerstatus_root, ctx);
 	while (ws_item) {
 		DATA_WORKERSTATUS(workerstatus, ws_item);
@@ -3731,17 +3854,25 @@ void zero_on_new_block(bool gotlock)
 // Currently only used at the end of the startup
 void set_block_share_counters()
 {
-	K_TREE_CTX ctx[1], ctx_ms[1];
-	K_ITEM *ss_item, ss_look, *ws_item, *wm_item, *ms_item, ms_look;
+	K_TREE_CTX ctx[1];
+	K_ITEM *ss_item, ss_look, *ws_item, *wm_item;
+	MS_ITER ms_iter;
 	WORKERSTATUS *workerstatus = NULL;
 	SHARESUMMARY *sharesummary, looksharesummary;
 	WORKMARKERS *workmarkers;
-	MARKERSUMMARY *markersummary, lookmarkersummary;
+	MARKERSUMMARY *markersummary;
+	tv_t now;
 
 	LOGWARNING("%s(): Updating block sharesummary counters...", __func__);
 
+	// Old markersummaries may not be in RAM
+	setnow(&now);
+	if (!page_markersummary_range(NULL, pool.workinfoid, MAXID, &now)) {
+		LOGEMERG("%s(): failed to page markersummaries, block "
+			 "counters will be wrong", __func__);
+	}
+
 	INIT_SHARESUMMARY(&ss_look);
-	INIT_MARKERSUMMARY(&ms_look);
 
 	zero_on_new_block(true);
 
@@ -3832,17 +3963,10 @@ void set_block_share_counters()
 					 pool.height, pool.workinfoid);
 			}
 
-			lookmarkersummary.markerid = workmarkers->markerid;
-			lookmarkersummary.userid = MAXID;
-			lookmarkersummary.in_workername = EMPTY;
-			ms_look.data = (void *)(&lookmarkersummary);
-			ms_item = find_before_in_ktree(markersummary_root,
-							&ms_look, ctx_ms);
-			while (ms_item) {
-				DATA_MARKERSUMMARY(markersummary, ms_item);
-				if (markersummary->markerid != workmarkers->markerid)
-					break;
-
+			markersummary = first_ms_iter(&ms_iter,
+							workmarkers->markerid,
+							MS_ITER_ALL);
+			while (markersummary) {
 				/* Check for user/workername change for new workerstatus
 				 * The tree has user/workername grouped together in order
 				 *  so this will only be once per user/workername */
@@ -3883,7 +4007,7 @@ void set_block_share_counters()
 				workerstatus->block_sharehi += markersummary->sharehi;
 				workerstatus->block_sharerej += markersummary->sharerej;
 
-				ms_item = prev_in_ktree(ctx_ms);
+				markersummary = next_ms_iter(&ms_iter);
 			}
 		}
 		wm_item = prev_in_ktree(ctx);
@@ -4553,7 +4677,7 @@ double payout_stats(PAYOUTS *payouts, char *statname)
 */
 bool process_pplns(int32_t height, char *blockhash, tv_t *addr_cd)
 {
-	K_TREE_CTX b_ctx[1], ss_ctx[1], wm_ctx[1], ms_ctx[1], pay_ctx[1], mu_ctx[1];
+	K_TREE_CTX b_ctx[1], ss_ctx[1], wm_ctx[1], pay_ctx[1], mu_ctx[1];
 	bool allow_aged = true, conned = false, begun = false;
 	bool ok = false;
 	PGconn *conn = NULL;
@@ -4568,8 +4692,9 @@ bool process_pplns(int32_t height, char *blockhash, tv_t *addr_cd)
 	K_ITEM *u_item, *mu_item, *oc_item, *pay_item, *p2_item, *old_p2_item;
 	SHARESUMMARY looksharesummary, *sharesummary;
 	WORKMARKERS lookworkmarkers, *workmarkers;
-	MARKERSUMMARY lookmarkersummary, *markersummary;
-	K_ITEM ss_look, *ss_item, wm_look, *wm_item, ms_look, *ms_item;
+	MARKERSUMMARY *markersummary;
+	MS_ITER ms_iter;
+	K_ITEM ss_look, *ss_item, wm_look, *wm_item;
 	int64_t amount, used, d64, g64, begin_workinfoid, end_workinfoid;
 	int64_t total_share_count, acc_share_count;
 	int64_t ss_count, wm_count, ms_count;
@@ -4691,6 +4816,16 @@ bool process_pplns(int32_t height, char *blockhash, tv_t *addr_cd)
 	total_diff = 0;
 	ss_count = wm_count = ms_count = 0;
 
+	// The markersummaries may not all be in RAM
+	if (!page_markersummary_window(NULL, blocks->workinfoid, diff_want,
+					&now)) {
+		LOGERR("%s(): failed to page markersummaries, block %"PRId32
+			"/%"PRId64"/%s/%s/%"PRId64,
+			__func__, blocks->height, blocks->workinfoid,
+			blocks->in_workername, blocks->confirmed, blocks->reward);
+		goto oku;
+	}
+
 	mu_store = k_new_store(miningpayouts_free);
 
 	/* Use the master size for this local tree since
@@ -4805,16 +4940,10 @@ bool process_pplns(int32_t height, char *blockhash, tv_t *addr_cd)
 		while (total_diff < diff_want && wm_item && CURRENT(&(workmarkers->expirydate))) {
 			if (WMPROCESSED(workmarkers->status)) {
 				wm_count++;
-				lookmarkersummary.markerid = workmarkers->markerid;
-				lookmarkersummary.userid = MAXID;
-				lookmarkersummary.in_workername = EMPTY;
-				INIT_MARKERSUMMARY(&ms_look);
-				ms_look.data = (void *)(&lookmarkersummary);
-				ms_item = find_before_in_ktree(markersummary_root,
-							       &ms_look, ms_ctx);
-				DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
+				markersummary = first_ms_iter(&ms_iter, workmarkers->markerid,
+							      MS_ITER_ALL);
 				// add the whole markerid
-				while (ms_item && markersummary->markerid == workmarkers->markerid) {
+				while (markersummary) {
 					if (end_workinfoid == 0)
 						end_workinfoid = workmarkers->workinfoidend;
 					ms_count++;
@@ -4826,8 +4955,7 @@ bool process_pplns(int32_t height, char *blockhash, tv_t *addr_cd)
 						copy_tv(&end_tv, &(markersummary->lastshareacc));
 					upd_add_mu(mu_root, mu_store, markersummary->userid,
 						   markersummary->diffacc);
-					ms_item = prev_in_ktree(ms_ctx);
-					DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
+					markersummary = next_ms_iter(&ms_iter);
 				}
 			}
 			wm_item = prev_in_ktree(wm_ctx);
@@ -6361,7 +6489,10 @@ cmp_t cmp_markersummary_userid(K_ITEM *a, K_ITEM *b)
 	return c;
 }
 
-// Finds the last markersummary for the worker and optionally return the CTX
+/* Finds the last unsealed markersummary for the worker and optionally
+ *  return the CTX
+ * Sealed markersummaries aren't in markersummary_userid_root, use the
+ *  MS_ITER for those */
 K_ITEM *find_markersummary_userid(int64_t userid, char *workername,
 				  K_TREE_CTX *ctx)
 {
@@ -6427,6 +6558,939 @@ K_ITEM *_find_markersummary(int64_t markerid, int64_t workinfoid,
 	return ms_item;
 }
 
+// order by markerid asc
+cmp_t cmp_msblock(K_ITEM *a, K_ITEM *b)
+{
+	MSBLOCK *ma, *mb;
+	DATA_MSBLOCK(ma, a);
+	DATA_MSBLOCK(mb, b);
+	return CMP_BIGINT(ma->markerid, mb->markerid);
+}
+
+// Must be R or W locked markersummary
+K_ITEM *find_msblock(int64_t markerid)
+{
+	MSBLOCK msblock;
+	K_TREE_CTX ctx[1];
+	K_ITEM look;
+
+	msblock.markerid = markerid;
+
+	INIT_MSBLOCK(&look);
+	look.data = (void *)(&msblock);
+	return find_in_ktree(msblock_root, &look, ctx);
+}
+
+// A column while building an MSBLOCK
+typedef struct msb_col {
+	unsigned char *buf;
+	size_t off;
+	size_t siz;
+} MSB_COL;
+
+// 2^53 - all integral doubles below this fit exactly in an int64_t
+#define MSB_INTEGRAL 9007199254740992.0
+
+// Tell the double decoder the value didn't change
+#define MSB_SAME 64
+
+static inline uint64_t zigzag(int64_t val)
+{
+	return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t val)
+{
+	return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}
+
+static void msb_put(MSB_COL *col, uint64_t val)
+{
+	// A varint is at most 10 bytes
+	if (col->off + 10 > col->siz) {
+		col->siz += AR_SIZ;
+		col->buf = realloc(col->buf, col->siz);
+		if (!(col->buf))
+			quithere(1, "realloc (%d) OOM", (int)(col->siz));
+	}
+	while (val >= 0x80) {
+		col->buf[col->off++] = (unsigned char)(val | 0x80);
+		val >>= 7;
+	}
+	col->buf[col->off++] = (unsigned char)val;
+}
+
+static inline uint64_t msb_get(unsigned char *data, size_t *pos)
+{
+	uint64_t val = 0;
+	unsigned char c;
+	int shift = 0;
+
+	do {
+		c = data[(*pos)++];
+		val |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return val;
+}
+
+static void msb_put_double(MSB_COL *col, double val, double *prev)
+{
+	uint64_t x, p;
+	int tz;
+
+	if (val == floor(val) && fabs(val) < MSB_INTEGRAL)
+		msb_put(col, zigzag((int64_t)val) << 1);
+	else {
+		memcpy(&x, &val, sizeof(x));
+		memcpy(&p, prev, sizeof(p));
+		x ^= p;
+		if (x == 0)
+			msb_put(col, (MSB_SAME << 1) | 1);
+		else {
+			tz = __builtin_ctzll(x);
+			msb_put(col, ((uint64_t)tz << 1) | 1);
+			msb_put(col, x >> tz);
+		}
+	}
+	*prev = val;
+}
+
+static inline double msb_get_double(unsigned char *data, size_t *pos,
+				    double *prev)
+{
+	uint64_t u, x, p;
+	double val;
+	int tz;
+
+	u = msb_get(data, pos);
+	if ((u & 1) == 0)
+		val = (double)unzigzag(u >> 1);
+	else {
+		tz = (int)(u >> 1);
+		memcpy(&p, prev, sizeof(p));
+		if (tz == MSB_SAME)
+			x = p;
+		else
+			x = (msb_get(data, pos) << tz) ^ p;
+		memcpy(&val, &x, sizeof(val));
+	}
+	*prev = val;
+	return val;
+}
+
+static void msb_put_tv(MSB_COL *col, tv_t *tv, int64_t basesec)
+{
+	msb_put(col, zigzag((int64_t)(tv->tv_sec) - basesec));
+	msb_put(col, (uint64_t)(tv->tv_usec));
+}
+
+static inline void msb_get_tv(unsigned char *data, size_t *pos, tv_t *tv,
+			      int64_t basesec)
+{
+	tv->tv_sec = (time_t)(basesec + unzigzag(msb_get(data, pos)));
+	tv->tv_usec = (suseconds_t)msb_get(data, pos);
+}
+
+static int cmp_msb_dict(const void *a, const void *b)
+{
+	uintptr_t pa = (uintptr_t)(*(char **)a), pb = (uintptr_t)(*(char **)b);
+
+	return (pa < pb) ? -1 : ((pa > pb) ? 1 : 0);
+}
+
+static void ms_iter_block(MS_ITER *iter, MSBLOCK *msblock)
+{
+	MARKERSUMMARY *ms = &(iter->ms);
+	int c;
+
+	iter->msblock = msblock;
+	iter->row = 0;
+	for (c = 0; c < MSB_COLUMNS; c++) {
+		iter->pos[c] = msblock->col_off[c];
+		iter->prev[c] = 0.0;
+	}
+
+	bzero(ms, sizeof(*ms));
+	ms->markerid = msblock->markerid;
+	copy_tv(&(ms->createdate), &(msblock->createdate));
+	ms->in_createby = msblock->in_createby;
+	ms->in_createcode = msblock->in_createcode;
+	ms->in_createinet = msblock->in_createinet;
+	ms->in_modifyby = EMPTY;
+	ms->in_modifycode = EMPTY;
+	ms->in_modifyinet = EMPTY;
+}
+
+#define MSB_DOUBLE(_fld, _col) \
+	ms->_fld = msb_get_double(data, &(iter->pos[_col]), &(iter->prev[_col]))
+#define MSB_BIGINT(_fld, _col) \
+	ms->_fld = unzigzag(msb_get(data, &(iter->pos[_col])))
+#define MSB_TV(_fld, _col) \
+	msb_get_tv(data, &(iter->pos[_col]), &(ms->_fld), msblock->basesec)
+
+static MARKERSUMMARY *ms_iter_decode(MS_ITER *iter)
+{
+	MSBLOCK *msblock = iter->msblock;
+	MARKERSUMMARY *ms = &(iter->ms);
+	unsigned char *data = msblock->data;
+
+	while (iter->row < msblock->rows) {
+		iter->row++;
+		ms->userid += unzigzag(msb_get(data, &(iter->pos[MSB_USERID])));
+		ms->in_workername = msblock->dict[msb_get(data,
+						&(iter->pos[MSB_WORKERNAME]))];
+		MSB_DOUBLE(diffacc, MSB_DIFFACC);
+		MSB_DOUBLE(diffsta, MSB_DIFFSTA);
+		MSB_DOUBLE(diffdup, MSB_DIFFDUP);
+		MSB_DOUBLE(diffhi, MSB_DIFFHI);
+		MSB_DOUBLE(diffrej, MSB_DIFFREJ);
+		MSB_DOUBLE(shareacc, MSB_SHAREACC);
+		MSB_DOUBLE(sharesta, MSB_SHARESTA);
+		MSB_DOUBLE(sharedup, MSB_SHAREDUP);
+		MSB_DOUBLE(sharehi, MSB_SHAREHI);
+		MSB_DOUBLE(sharerej, MSB_SHAREREJ);
+		MSB_BIGINT(sharecount, MSB_SHARECOUNT);
+		MSB_BIGINT(errorcount, MSB_ERRORCOUNT);
+		MSB_TV(firstshare, MSB_FIRSTSHARE);
+		MSB_TV(lastshare, MSB_LASTSHARE);
+		MSB_TV(firstshareacc, MSB_FIRSTSHAREACC);
+		MSB_TV(lastshareacc, MSB_LASTSHAREACC);
+		MSB_DOUBLE(lastdiffacc, MSB_LASTDIFFACC);
+
+		if (iter->userid == MS_ITER_ALL || ms->userid == iter->userid)
+			return ms;
+		// The rows are in userid order
+		if (ms->userid > iter->userid)
+			break;
+	}
+	return NULL;
+}
+
+static MARKERSUMMARY *ms_iter_item(MS_ITER *iter)
+{
+	MARKERSUMMARY *ms;
+
+	DATA_MARKERSUMMARY_NULL(ms, iter->ms_item);
+	if (ms && (ms->markerid != iter->markerid ||
+		   (iter->userid != MS_ITER_ALL && ms->userid != iter->userid))) {
+		iter->ms_item = NULL;
+		ms = NULL;
+	}
+	return ms;
+}
+
+// Must be R or W locked markersummary
+MARKERSUMMARY *first_ms_iter(MS_ITER *iter, int64_t markerid, int64_t userid)
+{
+	MARKERSUMMARY lookmarkersummary;
+	K_ITEM look, *msb_item;
+	MSBLOCK *msblock;
+
+	iter->markerid = markerid;
+	iter->userid = userid;
+	iter->ms_item = NULL;
+	iter->msblock = NULL;
+
+	msb_item = find_msblock(markerid);
+	if (msb_item) {
+		DATA_MSBLOCK(msblock, msb_item);
+		ms_iter_block(iter, msblock);
+		return ms_iter_decode(iter);
+	}
+
+	// MS_ITER_ALL is before all userids
+	lookmarkersummary.markerid = markerid;
+	lookmarkersummary.userid = userid;
+	lookmarkersummary.in_workername = EMPTY;
+
+	INIT_MARKERSUMMARY(&look);
+	look.data = (void *)(&lookmarkersummary);
+	iter->ms_item = find_after_in_ktree(markersummary_root, &look,
+					    iter->ctx);
+	return ms_iter_item(iter);
+}
+
+// Must be R or W locked markersummary
+MARKERSUMMARY *next_ms_iter(MS_ITER *iter)
+{
+	if (iter->msblock)
+		return ms_iter_decode(iter);
+
+	if (!iter->ms_item)
+		return NULL;
+
+	iter->ms_item = next_in_ktree(iter->ctx);
+	return ms_iter_item(iter);
+}
+
+// Encode the MARKERSUMMARY items into msblock
+static void msblock_encode(MSBLOCK *msblock, K_ITEM **items, int count)
+{
+	MSB_COL cols[MSB_COLUMNS];
+	double prev[MSB_COLUMNS];
+	MARKERSUMMARY *ms;
+	char **found;
+	int64_t userid = 0;
+	size_t siz;
+	int i, c;
+
+	msblock->rows = count;
+	msblock->diffacc = 0.0;
+	msblock->dict = malloc((count + 1) * sizeof(char *));
+	if (!(msblock->dict))
+		quithere(1, "malloc (%d) OOM", (int)((count + 1) * sizeof(char *)));
+	// Dictionary of the unique intransient workernames
+	msblock->dict_count = 0;
+	for (i = 0; i < count; i++) {
+		DATA_MARKERSUMMARY(ms, items[i]);
+		msblock->dict[i] = ms->in_workername;
+	}
+	if (count > 0) {
+		qsort(msblock->dict, count, sizeof(char *), cmp_msb_dict);
+		msblock->dict_count = 1;
+		for (i = 1; i < count; i++) {
+			if (msblock->dict[i] != msblock->dict[msblock->dict_count-1])
+				msblock->dict[msblock->dict_count++] = msblock->dict[i];
+		}
+		msblock->dict = realloc(msblock->dict,
+					msblock->dict_count * sizeof(char *));
+		if (!(msblock->dict)) {
+			quithere(1, "realloc (%d) OOM",
+				 (int)(msblock->dict_count * sizeof(char *)));
+		}
+	}
+
+	if (count > 0) {
+		DATA_MARKERSUMMARY(ms, items[0]);
+		msblock->basesec = (int64_t)(ms->firstshare.tv_sec);
+		copy_tv(&(msblock->createdate), &(ms->createdate));
+		msblock->in_createby = ms->in_createby;
+		msblock->in_createcode = ms->in_createcode;
+		msblock->in_createinet = ms->in_createinet;
+	} else {
+		msblock->basesec = 0;
+		DATE_ZERO(&(msblock->createdate));
+		msblock->in_createby = EMPTY;
+		msblock->in_createcode = EMPTY;
+		msblock->in_createinet = EMPTY;
+	}
+
+	bzero(cols, sizeof(cols));
+	for (c = 0; c < MSB_COLUMNS; c++)
+		prev[c] = 0.0;
+	for (i = 0; i < count; i++) {
+		DATA_MARKERSUMMARY(ms, items[i]);
+		msb_put(&cols[MSB_USERID], zigzag(ms->userid - userid));
+		userid = ms->userid;
+		found = bsearch(&(ms->in_workername), msblock->dict,
+				msblock->dict_count, sizeof(char *),
+				cmp_msb_dict);
+		msb_put(&cols[MSB_WORKERNAME], (uint64_t)(found - msblock->dict));
+		msb_put_double(&cols[MSB_DIFFACC], ms->diffacc, &prev[MSB_DIFFACC]);
+		msblock->diffacc += ms->diffacc;
+		msb_put_double(&cols[MSB_DIFFSTA], ms->diffsta, &prev[MSB_DIFFSTA]);
+		msb_put_double(&cols[MSB_DIFFDUP], ms->diffdup, &prev[MSB_DIFFDUP]);
+		msb_put_double(&cols[MSB_DIFFHI], ms->diffhi, &prev[MSB_DIFFHI]);
+		msb_put_double(&cols[MSB_DIFFREJ], ms->diffrej, &prev[MSB_DIFFREJ]);
+		msb_put_double(&cols[MSB_SHAREACC], ms->shareacc, &prev[MSB_SHAREACC]);
+		msb_put_double(&cols[MSB_SHARESTA], ms->sharesta, &prev[MSB_SHARESTA]);
+		msb_put_double(&cols[MSB_SHAREDUP], ms->sharedup, &prev[MSB_SHAREDUP]);
+		msb_put_double(&cols[MSB_SHAREHI], ms->sharehi, &prev[MSB_SHAREHI]);
+		msb_put_double(&cols[MSB_SHAREREJ], ms->sharerej, &prev[MSB_SHAREREJ]);
+		msb_put(&cols[MSB_SHARECOUNT], zigzag(ms->sharecount));
+		msb_put(&cols[MSB_ERRORCOUNT], zigzag(ms->errorcount));
+		msb_put_tv(&cols[MSB_FIRSTSHARE], &(ms->firstshare), msblock->basesec);
+		msb_put_tv(&cols[MSB_LASTSHARE], &(ms->lastshare), msblock->basesec);
+		msb_put_tv(&cols[MSB_FIRSTSHAREACC], &(ms->firstshareacc), msblock->basesec);
+		msb_put_tv(&cols[MSB_LASTSHAREACC], &(ms->lastshareacc), msblock->basesec);
+		msb_put_double(&cols[MSB_LASTDIFFACC], ms->lastdiffacc, &prev[MSB_LASTDIFFACC]);
+	}
+
+	siz = 0;
+	for (c = 0; c < MSB_COLUMNS; c++) {
+		msblock->col_off[c] = siz;
+		siz += cols[c].off;
+	}
+	msblock->col_off[MSB_COLUMNS] = siz;
+	msblock->data = malloc(siz + 1);
+	if (!(msblock->data))
+		quithere(1, "malloc (%d) OOM", (int)(siz + 1));
+	for (c = 0; c < MSB_COLUMNS; c++) {
+		if (cols[c].off)
+			memcpy(msblock->data + msblock->col_off[c], cols[c].buf, cols[c].off);
+		FREENULL(cols[c].buf);
+	}
+}
+
+// Compare every decoded row with the original item
+static bool msblock_verify(MSBLOCK *msblock, K_ITEM **items, int count,
+			   double *diffacc)
+{
+	MARKERSUMMARY *ms, *ms2;
+	MS_ITER iter;
+	int i = 0;
+
+	*diffacc = 0.0;
+	iter.markerid = msblock->markerid;
+	iter.userid = MS_ITER_ALL;
+	ms_iter_block(&iter, msblock);
+	ms2 = ms_iter_decode(&iter);
+	while (ms2) {
+		if (i >= count)
+			return false;
+		DATA_MARKERSUMMARY(ms, items[i++]);
+		if (ms->userid != ms2->userid ||
+		    ms->in_workername != ms2->in_workername ||
+		    ms->diffacc != ms2->diffacc || ms->diffsta != ms2->diffsta ||
+		    ms->diffdup != ms2->diffdup || ms->diffhi != ms2->diffhi ||
+		    ms->diffrej != ms2->diffrej ||
+		    ms->shareacc != ms2->shareacc ||
+		    ms->sharesta != ms2->sharesta ||
+		    ms->sharedup != ms2->sharedup ||
+		    ms->sharehi != ms2->sharehi ||
+		    ms->sharerej != ms2->sharerej ||
+		    ms->sharecount != ms2->sharecount ||
+		    ms->errorcount != ms2->errorcount ||
+		    !tv_equal(&(ms->firstshare), &(ms2->firstshare)) ||
+		    !tv_equal(&(ms->lastshare), &(ms2->lastshare)) ||
+		    !tv_equal(&(ms->firstshareacc), &(ms2->firstshareacc)) ||
+		    !tv_equal(&(ms->lastshareacc), &(ms2->lastshareacc)) ||
+		    ms->lastdiffacc != ms2->lastdiffacc)
+			return false;
+		*diffacc += ms2->diffacc;
+		ms2 = ms_iter_decode(&iter);
+	}
+	return (i == count);
+}
+
+// The RAM an MSBLOCK uses, excluding the K_ITEM
+#define MSBLOCK_RAM(_msb) ((_msb)->col_off[MSB_COLUMNS] + \
+			   (_msb)->dict_count * sizeof(char *))
+
+// The RAM a MARKERSUMMARY uses in markersummary_root + userid_root
+#define MS_ROW_RAM (sizeof(K_ITEM) + sizeof(MARKERSUMMARY) + \
+		    2 * (sizeof(K_ITEM) + sizeof(K_NODE)))
+
+/* Seal the markersummaries of a processed workmarker into an MSBLOCK
+ * The block is built under a read lock, since processed markersummaries
+ *  can't change, then swapped in under a write lock
+ * Also reports the RAM and the scan time of the old items vs the block */
+bool msblock_seal(int64_t markerid)
+{
+	MARKERSUMMARY lookmarkersummary, *markersummary;
+	K_ITEM look, *ms_item, *msb_item, **items = NULL;
+	K_TREE_CTX ctx[1];
+	MSBLOCK *msblock;
+	tv_t tree_stt, tree_fin, block_fin;
+	double tree_diff = 0.0, block_diff = 0.0;
+	int count = 0, alloc = 0, i;
+	size_t block_ram;
+	bool ok;
+
+	lookmarkersummary.markerid = markerid;
+	lookmarkersummary.userid = MS_ITER_ALL;
+	lookmarkersummary.in_workername = EMPTY;
+	INIT_MARKERSUMMARY(&look);
+	look.data = (void *)(&lookmarkersummary);
+
+	K_RLOCK(markersummary_free);
+	if (find_msblock(markerid)) {
+		K_RUNLOCK(markersummary_free);
+		return true;
+	}
+	setnow(&tree_stt);
+	ms_item = find_after_in_ktree(markersummary_root, &look, ctx);
+	DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
+	while (ms_item && markersummary->markerid == markerid) {
+		if (count >= alloc) {
+			alloc += AR_SIZ;
+			items = realloc(items, alloc * sizeof(*items));
+			if (!items)
+				quithere(1, "realloc (%d) OOM", (int)(alloc * sizeof(*items)));
+		}
+		items[count++] = ms_item;
+		tree_diff += markersummary->diffacc;
+		ms_item = next_in_ktree(ctx);
+		DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
+	}
+	setnow(&tree_fin);
+
+	// Nothing to seal
+	if (count == 0) {
+		K_RUNLOCK(markersummary_free);
+		return true;
+	}
+
+	K_WLOCK(msblock_free);
+	msb_item = k_unlink_head_zero(msblock_free);
+	K_WUNLOCK(msblock_free);
+	DATA_MSBLOCK(msblock, msb_item);
+	msblock->markerid = markerid;
+	msblock_encode(msblock, items, count);
+	ok = msblock_verify(msblock, items, count, &block_diff);
+	setnow(&block_fin);
+	K_RUNLOCK(markersummary_free);
+
+	if (!ok) {
+		LOGEMERG("%s() markerid %"PRId64" block verify failed - not "
+			 "sealed", __func__, markerid);
+		goto discard;
+	}
+
+	K_WLOCK(markersummary_free);
+	// Recheck nothing changed while unlocked
+	ms_item = find_after_in_ktree(markersummary_root, &look, ctx);
+	DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
+	for (i = 0; i < count; i++) {
+		if (ms_item != items[i])
+			break;
+		ms_item = next_in_ktree(ctx);
+		DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
+	}
+	if (i != count || (ms_item && markersummary->markerid == markerid) ||
+	    find_msblock(markerid)) {
+		K_WUNLOCK(markersummary_free);
+		LOGERR("%s() markerid %"PRId64" changed while sealing - not "
+			"sealed", __func__, markerid);
+		ok = false;
+		goto discard;
+	}
+	for (i = 0; i < count; i++) {
+		remove_from_ktree(markersummary_root, items[i]);
+		remove_from_ktree(markersummary_userid_root, items[i]);
+		free_markersummary_data(items[i]);
+		k_unlink_item(markersummary_store, items[i]);
+		k_add_head(markersummary_free, items[i]);
+	}
+	block_ram = MSBLOCK_RAM(msblock);
+	add_to_ktree(msblock_root, msb_item);
+	K_WLOCK(msblock_free);
+	k_add_head(msblock_store, msb_item);
+	msblock_free->ram += block_ram;
+	K_WUNLOCK(msblock_free);
+	msblock_rows += count;
+	msblock_full_ram += count * MS_ROW_RAM;
+	K_WUNLOCK(markersummary_free);
+
+	LOGNOTICE("%s() markerid %"PRId64" sealed %d rows %d workers ram "
+		  "%"PRId64"->%d scan %.3fms->%.3fms diff %.0f/%.0f",
+		  __func__, markerid, count, msblock->dict_count,
+		  (int64_t)(count * MS_ROW_RAM), (int)block_ram,
+		  tvdiff(&tree_fin, &tree_stt) * 1000.0,
+		  tvdiff(&block_fin, &tree_fin) * 1000.0,
+		  tree_diff, block_diff);
+	goto bye;
+
+discard:
+	K_WLOCK(msblock_free);
+	free_msblock_data(msb_item);
+	k_add_head(msblock_free, msb_item);
+	K_WUNLOCK(msblock_free);
+bye:
+	FREENULL(items);
+	return ok;
+}
+
+/* Discard an MSBLOCK, sealed or paged, from RAM
+ * Must be W locked markersummary */
+void msblock_discard(K_ITEM *msb_item)
+{
+	MSBLOCK *msblock;
+
+	DATA_MSBLOCK(msblock, msb_item);
+	remove_from_ktree(msblock_root, msb_item);
+	K_WLOCK(msblock_free);
+	if (msblock->paged)
+		k_unlink_item(msblock_page_store, msb_item);
+	else {
+		k_unlink_item(msblock_store, msb_item);
+		msblock_rows -= msblock->rows;
+		msblock_full_ram -= msblock->rows * MS_ROW_RAM;
+	}
+	msblock_free->ram -= MSBLOCK_RAM(msblock);
+	free_msblock_data(msb_item);
+	k_add_head(msblock_free, msb_item);
+	K_WUNLOCK(msblock_free);
+}
+
+// Must be R or W locked markersummary
+static bool ms_in_tree(int64_t markerid)
+{
+	MARKERSUMMARY lookmarkersummary, *markersummary;
+	K_TREE_CTX ctx[1];
+	K_ITEM look, *ms_item;
+
+	lookmarkersummary.markerid = markerid;
+	lookmarkersummary.userid = MS_ITER_ALL;
+	lookmarkersummary.in_workername = EMPTY;
+	INIT_MARKERSUMMARY(&look);
+	look.data = (void *)(&lookmarkersummary);
+	ms_item = find_after_in_ktree(markersummary_root, &look, ctx);
+	DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
+	return (ms_item && markersummary->markerid == markerid);
+}
+
+/* Seal processed workmarkers older than the newest MSBLOCK_KEEP_STR
+ *  (default MSBLOCK_KEEP) processed workmarkers, a few at a time */
+void seal_markersummaries(tv_t *now)
+{
+	int64_t keep, markerids[MSBLOCK_SEAL_LIMIT];
+	WORKMARKERS *workmarkers;
+	K_TREE_CTX ctx[1];
+	K_ITEM *wm_item;
+	int64_t processed = 0;
+	int count = 0, i;
+
+	keep = sys_setting(MSBLOCK_KEEP_STR, MSBLOCK_KEEP, now);
+	if (keep <= 0)
+		return;
+
+	K_RLOCK(markersummary_free);
+	K_RLOCK(workmarkers_free);
+	wm_item = last_in_ktree(workmarkers_workinfoid_root, ctx);
+	DATA_WORKMARKERS_NULL(workmarkers, wm_item);
+	while (wm_item && CURRENT(&(workmarkers->expirydate)) &&
+	       count < MSBLOCK_SEAL_LIMIT) {
+		if (WMPROCESSED(workmarkers->status) && ++processed > keep &&
+		    ms_in_tree(workmarkers->markerid))
+			markerids[count++] = workmarkers->markerid;
+		wm_item = prev_in_ktree(ctx);
+		DATA_WORKMARKERS_NULL(workmarkers, wm_item);
+	}
+	K_RUNLOCK(workmarkers_free);
+	K_RUNLOCK(markersummary_free);
+
+	for (i = 0; i < count && !everyone_die; i++)
+		msblock_seal(markerids[i]);
+}
+
+static int cmp_msb_items(const void *a, const void *b)
+{
+	return (int)cmp_markersummary(*(K_ITEM **)a, *(K_ITEM **)b);
+}
+
+/* Add a paged MSBLOCK of the markersummaries of markerid loaded from the DB
+ * The items aren't in any list, they're just used to encode the block
+ * Discard the least recently used paged blocks over the limit */
+bool msblock_page_add(int64_t markerid, K_ITEM **items, int count,
+			double *diffacc, tv_t *now)
+{
+	K_ITEM *msb_item, *old_item, *lru_item;
+	MSBLOCK *msblock, *old, *lru;
+	int64_t limit;
+	double diff = 0.0;
+
+	limit = sys_setting(MS_PAGE_LIMIT_STR, MS_PAGE_LIMIT, now);
+
+	// The DB order may not match the tree order
+	qsort(items, count, sizeof(*items), cmp_msb_items);
+
+	K_WLOCK(msblock_free);
+	msb_item = k_unlink_head_zero(msblock_free);
+	K_WUNLOCK(msblock_free);
+	DATA_MSBLOCK(msblock, msb_item);
+	msblock->markerid = markerid;
+	msblock->paged = true;
+	copy_tv(&(msblock->last_used), now);
+	msblock_encode(msblock, items, count);
+	if (!msblock_verify(msblock, items, count, &diff)) {
+		LOGEMERG("%s() markerid %"PRId64" block verify failed - not "
+			 "paged", __func__, markerid);
+		K_WLOCK(msblock_free);
+		free_msblock_data(msb_item);
+		k_add_head(msblock_free, msb_item);
+		K_WUNLOCK(msblock_free);
+		return false;
+	}
+	if (diffacc)
+		*diffacc = msblock->diffacc;
+
+	K_WLOCK(markersummary_free);
+	// Another thread may have paged it in
+	if (find_msblock(markerid)) {
+		K_WUNLOCK(markersummary_free);
+		K_WLOCK(msblock_free);
+		free_msblock_data(msb_item);
+		k_add_head(msblock_free, msb_item);
+		K_WUNLOCK(msblock_free);
+		return true;
+	}
+	add_to_ktree(msblock_root, msb_item);
+	K_WLOCK(msblock_free);
+	k_add_head(msblock_page_store, msb_item);
+	msblock_free->ram += MSBLOCK_RAM(msblock);
+	while (msblock_page_store->count > limit) {
+		lru_item = NULL;
+		lru = NULL;
+		old_item = STORE_HEAD_NOLOCK(msblock_page_store);
+		while (old_item) {
+			DATA_MSBLOCK(old, old_item);
+			if (!lru || tv_newer(&(old->last_used), &(lru->last_used))) {
+				lru_item = old_item;
+				lru = old;
+			}
+			old_item = old_item->next;
+		}
+		// Don't discard any in use
+		if (tvdiff(now, &(lru->last_used)) < MS_PAGE_PIN)
+			break;
+		remove_from_ktree(msblock_root, lru_item);
+		k_unlink_item(msblock_page_store, lru_item);
+		msblock_free->ram -= MSBLOCK_RAM(lru);
+		free_msblock_data(lru_item);
+		k_add_head(msblock_free, lru_item);
+		ms_page_evicts++;
+	}
+	K_WUNLOCK(msblock_free);
+	K_WUNLOCK(markersummary_free);
+
+	LOGDEBUG("%s() markerid %"PRId64" paged %d rows %d workers ram %d",
+		 __func__, markerid, count, msblock->dict_count,
+		 (int)MSBLOCK_RAM(msblock));
+	return true;
+}
+
+/* Make sure the markersummaries of a processed markerid are in RAM, paging
+ *  them in from the DB if they aren't
+ * Must not hold any locks
+ * Returns the markerid diffacc total in diffacc, if it's not NULL */
+bool page_markersummary(PGconn *conn, int64_t markerid, double *diffacc,
+			tv_t *now)
+{
+	MARKERSUMMARY lookmarkersummary, *markersummary, *p_ms;
+	K_ITEM look, *ms_item, *msb_item, *p_item;
+	K_TREE_CTX ctx[1];
+	MSBLOCK *msblock;
+	bool resident = false, processed = false;
+
+	if (diffacc)
+		*diffacc = 0.0;
+
+	lookmarkersummary.markerid = markerid;
+	lookmarkersummary.userid = MS_ITER_ALL;
+	lookmarkersummary.in_workername = EMPTY;
+	INIT_MARKERSUMMARY(&look);
+	look.data = (void *)(&lookmarkersummary);
+
+	K_RLOCK(markersummary_free);
+	msb_item = find_msblock(markerid);
+	if (msb_item) {
+		resident = true;
+		DATA_MSBLOCK(msblock, msb_item);
+		if (diffacc)
+			*diffacc = msblock->diffacc;
+		if (msblock->paged) {
+			K_WLOCK(msblock_free);
+			copy_tv(&(msblock->last_used), now);
+			ms_page_hits++;
+			K_WUNLOCK(msblock_free);
+		}
+	} else {
+		ms_item = find_after_in_ktree(markersummary_root, &look, ctx);
+		DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
+		K_RLOCK(workmarkers_free);
+		if (ms_item && markersummary->markerid == markerid) {
+			resident = true;
+			if (diffacc) {
+				p_item = find_markersummary_p(markerid);
+				if (p_item) {
+					DATA_MARKERSUMMARY(p_ms, p_item);
+					*diffacc = p_ms->diffacc;
+				}
+			}
+		} else {
+			if (find_workmarkerid(markerid, false, MARKER_PROCESSED))
+				processed = true;
+		}
+		K_RUNLOCK(workmarkers_free);
+	}
+	K_RUNLOCK(markersummary_free);
+
+	// Unprocessed markersummaries aren't complete in the DB
+	if (resident || !processed)
+		return resident;
+
+	K_WLOCK(msblock_free);
+	ms_page_misses++;
+	K_WUNLOCK(msblock_free);
+
+	return markersummary_page(conn, markerid, diffacc, now);
+}
+
+/* Page in the processed markersummaries before workinfoid, newest first,
+ *  until their diffacc total reaches diff_want
+ * i.e. the markersummaries a PPLNS ending at workinfoid could use
+ * Must not hold any locks */
+bool page_markersummary_window(PGconn *conn, int64_t workinfoid,
+				double diff_want, tv_t *now)
+{
+	WORKMARKERS lookworkmarkers, *workmarkers;
+	K_ITEM look, *wm_item;
+	K_TREE_CTX ctx[1];
+	int64_t markerid;
+	double total = 0.0, diffacc;
+
+	lookworkmarkers.expirydate.tv_sec = default_expiry.tv_sec;
+	lookworkmarkers.expirydate.tv_usec = default_expiry.tv_usec;
+	lookworkmarkers.workinfoidend = workinfoid + 1;
+	INIT_WORKMARKERS(&look);
+	look.data = (void *)(&lookworkmarkers);
+	while (total < diff_want && !everyone_die) {
+		markerid = -1;
+		K_RLOCK(workmarkers_free);
+		wm_item = find_before_in_ktree(workmarkers_workinfoid_root,
+						&look, ctx);
+		DATA_WORKMARKERS_NULL(workmarkers, wm_item);
+		while (wm_item && CURRENT(&(workmarkers->expirydate))) {
+			if (WMPROCESSED(workmarkers->status)) {
+				markerid = workmarkers->markerid;
+				lookworkmarkers.workinfoidend =
+					workmarkers->workinfoidend;
+				break;
+			}
+			wm_item = prev_in_ktree(ctx);
+			DATA_WORKMARKERS_NULL(workmarkers, wm_item);
+		}
+		K_RUNLOCK(workmarkers_free);
+
+		if (markerid < 0)
+			break;
+
+		if (!page_markersummary(conn, markerid, &diffacc, now)) {
+			LOGERR("%s() failed to page markerid %"PRId64,
+				__func__, markerid);
+			return false;
+		}
+		total += diffacc;
+	}
+	return true;
+}
+
+/* Page in the processed markersummaries of the workmarkers ending after
+ *  wi_start, up to wi_finish, i.e. those a block range will iterate
+ * Must not hold any locks
+ * Returns false if any of them failed to page in */
+bool page_markersummary_range(PGconn *conn, int64_t wi_start,
+				int64_t wi_finish, tv_t *now)
+{
+	WORKMARKERS lookworkmarkers, *workmarkers;
+	K_ITEM look, *wm_item;
+	K_TREE_CTX ctx[1];
+	int64_t markerid;
+
+	lookworkmarkers.expirydate.tv_sec = default_expiry.tv_sec;
+	lookworkmarkers.expirydate.tv_usec = default_expiry.tv_usec;
+	if (wi_finish < MAXID)
+		lookworkmarkers.workinfoidend = wi_finish + 1;
+	else
+		lookworkmarkers.workinfoidend = MAXID;
+	INIT_WORKMARKERS(&look);
+	look.data = (void *)(&lookworkmarkers);
+	while (!everyone_die) {
+		markerid = -1;
+		K_RLOCK(workmarkers_free);
+		wm_item = find_before_in_ktree(workmarkers_workinfoid_root,
+						&look, ctx);
+		DATA_WORKMARKERS_NULL(workmarkers, wm_item);
+		while (wm_item && CURRENT(&(workmarkers->expirydate)) &&
+		       workmarkers->workinfoidend > wi_start) {
+			lookworkmarkers.workinfoidend =
+				workmarkers->workinfoidend;
+			if (WMPROCESSED(workmarkers->status)) {
+				markerid = workmarkers->markerid;
+				break;
+			}
+			wm_item = prev_in_ktree(ctx);
+			DATA_WORKMARKERS_NULL(workmarkers, wm_item);
+		}
+		K_RUNLOCK(workmarkers_free);
+
+		if (markerid < 0)
+			break;
+
+		if (!page_markersummary(conn, markerid, NULL, now)) {
+			LOGERR("%s() failed to page markerid %"PRId64,
+				__func__, markerid);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Drop the markersummaries, from RAM, of the processed workmarkers older
+ *  than the newest MS_RESIDENT_STR (default MS_RESIDENT) processed
+ *  workmarkers, a few at a time
+ * They are in the DB and will be paged back in when needed
+ * The pool markersummaries are kept */
+void drop_markersummaries(tv_t *now)
+{
+	MARKERSUMMARY lookmarkersummary, *markersummary;
+	int64_t resident, markerids[MS_DROP_LIMIT];
+	WORKMARKERS *workmarkers;
+	K_ITEM look, *wm_item, *ms_item, *msb_item;
+	K_TREE_CTX ctx[1];
+	MSBLOCK *msblock;
+	int64_t processed = 0;
+	int count = 0, i;
+
+	resident = sys_setting(MS_RESIDENT_STR, MS_RESIDENT, now);
+	if (resident <= 0)
+		return;
+
+	lookmarkersummary.userid = MS_ITER_ALL;
+	lookmarkersummary.in_workername = EMPTY;
+	INIT_MARKERSUMMARY(&look);
+	look.data = (void *)(&lookmarkersummary);
+
+	K_WLOCK(markersummary_free);
+	K_RLOCK(workmarkers_free);
+	wm_item = last_in_ktree(workmarkers_workinfoid_root, ctx);
+	DATA_WORKMARKERS_NULL(workmarkers, wm_item);
+	while (wm_item && CURRENT(&(workmarkers->expirydate)) &&
+	       count < MS_DROP_LIMIT) {
+		if (WMPROCESSED(workmarkers->status) && ++processed > resident) {
+			msb_item = find_msblock(workmarkers->markerid);
+			DATA_MSBLOCK_NULL(msblock, msb_item);
+			// Paged blocks are discarded by msblock_page_add()
+			if ((msb_item && !msblock->paged) ||
+			    (!msb_item && ms_in_tree(workmarkers->markerid)))
+				markerids[count++] = workmarkers->markerid;
+		}
+		wm_item = prev_in_ktree(ctx);
+		DATA_WORKMARKERS_NULL(workmarkers, wm_item);
+	}
+	K_RUNLOCK(workmarkers_free);
+
+	for (i = 0; i < count; i++) {
+		msb_item = find_msblock(markerids[i]);
+		if (msb_item) {
+			msblock_discard(msb_item);
+			K_WLOCK(msblock_free);
+			ms_page_drops++;
+			K_WUNLOCK(msblock_free);
+			continue;
+		}
+		lookmarkersummary.markerid = markerids[i];
+		ms_item = find_after_in_ktree(markersummary_root, &look, ctx);
+		DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
+		while (ms_item && markersummary->markerid == markerids[i]) {
+			remove_from_ktree(markersummary_root, ms_item);
+			remove_from_ktree(markersummary_userid_root, ms_item);
+			free_markersummary_data(ms_item);
+			k_unlink_item(markersummary_store, ms_item);
+			k_add_head(markersummary_free, ms_item);
+			ms_item = find_after_in_ktree(markersummary_root,
+							&look, ctx);
+			DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
+		}
+		K_WLOCK(msblock_free);
+		ms_page_drops++;
+		K_WUNLOCK(msblock_free);
+	}
+	K_WUNLOCK(markersummary_free);
+}
+
 bool make_markersummaries(bool msg, char *by, char *code, char *inet,
 			  tv_t *cd, K_TREE *trf_root)
 {
@@ -7350,3 +8414,506 @@ void userinfo_block(BLOCKS *blocks, enum info_type isnew, int delta)
 
 	K_WUNLOCK(userinfo_free);
 }
+
+/* A worker's latest userstats changed, was is the counted userstats being
+ *  replaced or expired, now is the new userstats, either may be NULL
+ * This keeps the per worker stats in workerstatus and the per user totals
+ *  in userinfo, so the web commands don't need to search userstats
+ * N.B. userstats_free has a lower DLPRIO so it mustn't be locked here */
+void userinfo_stats(USERSTATS *was, USERSTATS *now)
+{
+	WORKERSTATUS *status;
+	USERINFO *row;
+	K_ITEM *item;
+	double hashrate5m = 0.0;
+
+	if (now) {
+		item = find_create_workerstatus(false, false, now->userid,
+						now->in_workername, false,
+						__FILE__, __func__, __LINE__);
+		if (item) {
+			DATA_WORKERSTATUS(status, item);
+			K_RLOCK(workerstatus_free);
+			mutex_lock(&(workerstatus_locks[status->lock]));
+			if (tv_newer(&(status->stats_date), &(now->statsdate))) {
+				copy_tv(&(status->stats_date), &(now->statsdate));
+				status->stats_hashrate5m = now->hashrate5m;
+				status->stats_hashrate1hr = now->hashrate1hr;
+				status->stats_hashrate24hr = now->hashrate24hr;
+				status->stats_elapsed = now->elapsed;
+				status->stats_instances = now->instances;
+			}
+			mutex_unlock(&(workerstatus_locks[status->lock]));
+			K_RUNLOCK(workerstatus_free);
+		}
+	}
+
+	K_WLOCK(userinfo_free);
+	item = find_create_userinfo(now ? now->userid : was->userid);
+	DATA_USERINFO(row, item);
+	if (was) {
+		row->stats_workers--;
+		row->stats_hashrate5m -= was->hashrate5m;
+		row->stats_hashrate1hr -= was->hashrate1hr;
+		row->stats_hashrate24hr -= was->hashrate24hr;
+		if (was->instances != NO_INSTANCE_DATA) {
+			row->stats_instances -= was->instances;
+			row->stats_instworkers--;
+		}
+	}
+	if (now) {
+		row->stats_workers++;
+		row->stats_hashrate5m += now->hashrate5m;
+		row->stats_hashrate1hr += now->hashrate1hr;
+		row->stats_hashrate24hr += now->hashrate24hr;
+		if (now->instances != NO_INSTANCE_DATA) {
+			row->stats_instances += now->instances;
+			row->stats_instworkers++;
+		}
+		/* Only a new minimum is known here, userinfo_stats_expire()
+		 *  recalculates it */
+		if (row->stats_workers == 1 ||
+		    row->stats_elapsed > now->elapsed)
+			row->stats_elapsed = now->elapsed;
+		if (tv_newer(&(row->stats_last), &(now->statsdate)))
+			copy_tv(&(row->stats_last), &(now->statsdate));
+	}
+	// Clear any rounding left over
+	if (row->stats_workers <= 0) {
+		row->stats_workers = 0;
+		row->stats_hashrate5m = row->stats_hashrate1hr =
+		row->stats_hashrate24hr = 0.0;
+		row->stats_elapsed = 0;
+		row->stats_instances = row->stats_instworkers = 0;
+	}
+	if (now)
+		hashrate5m = row->stats_hashrate5m;
+	K_WUNLOCK(userinfo_free);
+
+	if (now)
+		tseries_add(now->userid, &(now->statsdate), hashrate5m);
+}
+
+/* Remove the userstats older than USERSTATS_PER_S from the userinfo totals
+ *  and recalculate the minimum elapsed of each user
+ * Called periodically by the summariser */
+void userinfo_stats_expire(tv_t *now)
+{
+	USERSTATS *userstats, *expired = NULL;
+	int64_t *userids = NULL, *elapsed = NULL;
+	int exp_count = 0, el_count = 0, size, i;
+	K_TREE_CTX ctx[1];
+	USERINFO *row;
+	K_ITEM *item;
+
+	K_WLOCK(userstats_free);
+	size = userstats_store->count;
+	if (size > 0) {
+		expired = malloc(sizeof(*expired) * size);
+		userids = malloc(sizeof(*userids) * size);
+		elapsed = malloc(sizeof(*elapsed) * size);
+		if (!expired || !userids || !elapsed)
+			quithere(1, "malloc (%d) OOM", size);
+	}
+	// Ordered by userid, so each user's workers are together
+	item = first_in_ktree(userstats_root, ctx);
+	while (item) {
+		DATA_USERSTATS(userstats, item);
+		if (userstats->counted) {
+			if (tvdiff(now, &(userstats->statsdate)) >= USERSTATS_PER_S) {
+				userstats->counted = false;
+				memcpy(&(expired[exp_count++]), userstats,
+					sizeof(*userstats));
+			} else {
+				if (el_count > 0 &&
+				    userids[el_count-1] == userstats->userid) {
+					if (elapsed[el_count-1] > userstats->elapsed)
+						elapsed[el_count-1] = userstats->elapsed;
+				} else {
+					userids[el_count] = userstats->userid;
+					elapsed[el_count++] = userstats->elapsed;
+				}
+			}
+		}
+		item = next_in_ktree(ctx);
+	}
+	K_WUNLOCK(userstats_free);
+
+	for (i = 0; i < exp_count; i++)
+		userinfo_stats(&(expired[i]), NULL);
+
+	if (el_count > 0) {
+		K_WLOCK(userinfo_free);
+		for (i = 0; i < el_count; i++) {
+			item = get_userinfo(userids[i]);
+			if (item) {
+				DATA_USERINFO(row, item);
+				if (row->stats_workers > 0)
+					row->stats_elapsed = elapsed[i];
+			}
+		}
+		K_WUNLOCK(userinfo_free);
+	}
+
+	FREENULL(elapsed);
+	FREENULL(userids);
+	FREENULL(expired);
+
+	if (exp_count > 0) {
+		LOGDEBUG("%s() expired %d userstats",
+			 __func__, exp_count);
+	}
+}
+
+// 1 minute for a day, 10 minutes for a week, 1 hour for a month, 1 day for a year
+const int32_t ts_seconds[TS_RINGS] = { 60, 600, 3600, 86400 };
+const int32_t ts_size[TS_RINGS] = { 1440, 1008, 744, 366 };
+
+// order by userid asc
+cmp_t cmp_tseries(K_ITEM *a, K_ITEM *b)
+{
+	TSERIES *ta, *tb;
+	DATA_TSERIES(ta, a);
+	DATA_TSERIES(tb, b);
+	return CMP_BIGINT(ta->userid, tb->userid);
+}
+
+// Must be R or W locked
+K_ITEM *find_tseries(int64_t userid)
+{
+	TSERIES tseries;
+	K_TREE_CTX ctx[1];
+	K_ITEM look;
+
+	tseries.userid = userid;
+
+	INIT_TSERIES(&look);
+	look.data = (void *)(&tseries);
+	return find_in_ktree(tseries_root, &look, ctx);
+}
+
+// Must be W locked
+static K_ITEM *find_create_tseries(int64_t userid)
+{
+	TSERIES *row;
+	K_ITEM *item;
+	size_t siz;
+	int r;
+
+	item = find_tseries(userid);
+	if (!item) {
+		item = k_unlink_head(tseries_free);
+		DATA_TSERIES(row, item);
+		bzero(row, sizeof(*row));
+		row->userid = userid;
+		if (userid == TSERIES_POOL)
+			row->first = 0;
+		else
+			row->first = TS_USER_RING;
+		for (r = row->first; r < TS_RINGS; r++) {
+			siz = sizeof(TSLOT) * ts_size[r];
+			row->ring[r] = calloc(1, siz);
+			if (!(row->ring[r]))
+				quithere(1, "calloc (%d) OOM", (int)siz);
+			LIST_MEM_ADD_SIZ(tseries_free, siz);
+		}
+		add_to_ktree(tseries_root, item);
+		k_add_head(tseries_store, item);
+	}
+	return item;
+}
+
+static void tslot_add(TSERIES *tseries, int r, int64_t when, double value)
+{
+	int32_t slot = (int32_t)(when / ts_seconds[r]);
+	TSLOT *tslot;
+
+	tslot = &(tseries->ring[r][slot % ts_size[r]]);
+	if (tslot->slot != slot) {
+		tslot->slot = slot;
+		tslot->count = 0;
+		tslot->value = 0.0;
+	}
+	tslot->count++;
+	tslot->value += value;
+}
+
+/* Add a sample to the userid time series, userid TSERIES_POOL is the pool
+ * Samples older than the latest sample's slot are ignored */
+void tseries_add(int64_t userid, tv_t *when, double value)
+{
+	TSERIES *row;
+	TSLOT *tslot;
+	K_ITEM *item;
+	int32_t slot;
+	int r;
+
+	K_WLOCK(tseries_free);
+	item = find_create_tseries(userid);
+	DATA_TSERIES(row, item);
+	slot = (int32_t)(when->tv_sec / ts_seconds[row->first]);
+	if (slot >= row->last) {
+		if (slot != row->last) {
+			// The previous slot is complete so downsample it
+			if (row->last) {
+				tslot = &(row->ring[row->first][row->last %
+						ts_size[row->first]]);
+				for (r = row->first + 1; r < TS_RINGS; r++) {
+					tslot_add(row, r, (int64_t)(row->last) *
+						  ts_seconds[row->first],
+						  tslot->value);
+				}
+			}
+			row->last = slot;
+		}
+		// The finest ring is the last sample
+		tslot = &(row->ring[row->first][slot % ts_size[row->first]]);
+		tslot->slot = slot;
+		tslot->count = 1;
+		tslot->value = value;
+	}
+	K_WUNLOCK(tseries_free);
+}
+
+/* Discard the user time series without a sample in the last
+ *  TSERIES_IDLE_STR (default TSERIES_IDLE) seconds, since each one is a
+ *  fixed size and would otherwise stay in RAM for every user ever seen
+ * The pool time series is always kept
+ * Called periodically by the summariser */
+void tseries_expire(tv_t *now)
+{
+	TSERIES *row;
+	K_ITEM *item, *next;
+	int64_t idle;
+	int exp_count = 0;
+
+	idle = sys_setting(TSERIES_IDLE_STR, TSERIES_IDLE, now);
+	if (idle <= 0)
+		return;
+
+	K_WLOCK(tseries_free);
+	item = STORE_HEAD_NOLOCK(tseries_store);
+	while (item) {
+		next = item->next;
+		DATA_TSERIES(row, item);
+		if (row->userid != TSERIES_POOL &&
+		    (now->tv_sec - (int64_t)(row->last) *
+				   ts_seconds[row->first]) > idle) {
+			remove_from_ktree(tseries_root, item);
+			k_unlink_item(tseries_store, item);
+			free_tseries_data(item);
+			k_add_head(tseries_free, item);
+			exp_count++;
+		}
+		item = next;
+	}
+	K_WUNLOCK(tseries_free);
+
+	if (exp_count) {
+		LOGDEBUG("%s() expired %d idle user tseries",
+			 __func__, exp_count);
+	}
+}
+
+/* The windows are indexed by window number % 2
+ * [CMDLAT_UNKNOWN] is replies that don't have a known command */
+static CMDLAT cmdlat[2][CMDLAT_CMDS];
+static time_t cmdlat_window[2];
+
+/* The counters are updated with atomics, cmdlat_lock is only used to
+ *  reset a window when it's reused, and to report
+ * A reply that races a reset may be counted in the new window */
+void cmdlat_add(MSGLINE *ml, tv_t *now)
+{
+	enum cmd_values cmd_val = ckdb_cmds[ml->which_cmds].cmd_val;
+	double us[CMDLAT_STAGES];
+	tv_t *started, *processed;
+	uint64_t v, old;
+	time_t window;
+	CMDLAT *lat;
+	int s, b, w;
+
+	if (ml->accepted.tv_sec == 0L)
+		return;
+
+	// The cmd lookup failed, or never happened
+	if (cmd_val >= CMD_END || !ckdb_cmds[ml->which_cmds].cmd_str ||
+	    strcasecmp(ml->cmd, ckdb_cmds[ml->which_cmds].cmd_str) != 0)
+		cmd_val = CMDLAT_UNKNOWN;
+
+	// Commands processed immediately have no queue time
+	if (ml->started.tv_sec == 0L)
+		started = &(ml->broken);
+	else
+		started = &(ml->started);
+	if (ml->processed.tv_sec == 0L)
+		processed = now;
+	else
+		processed = &(ml->processed);
+
+	us[CMDLAT_BREAK] = us_tvdiff(&(ml->broken), &(ml->accepted));
+	us[CMDLAT_QUEUE] = us_tvdiff(started, &(ml->broken));
+	us[CMDLAT_PROC] = us_tvdiff(processed, started);
+	us[CMDLAT_TOTAL] = us_tvdiff(now, &(ml->accepted));
+
+	window = now->tv_sec / CMDLAT_WINDOW_S;
+	w = (int)(window % 2);
+	if (cmdlat_window[w] != window) {
+		ck_wlock(&cmdlat_lock);
+		if (cmdlat_window[w] != window) {
+			bzero(cmdlat[w], sizeof(cmdlat[w]));
+			__sync_synchronize();
+			cmdlat_window[w] = window;
+		}
+		ck_wunlock(&cmdlat_lock);
+	}
+	lat = &(cmdlat[w][cmd_val]);
+	__sync_add_and_fetch(&(lat->count), 1);
+	for (s = 0; s < CMDLAT_STAGES; s++) {
+		if (us[s] < 0.0)
+			us[s] = 0.0;
+		for (b = 0; b < (CMDLAT_BUCKETS - 1); b++) {
+			if (us[s] < (double)(1 << b))
+				break;
+		}
+		__sync_add_and_fetch(&(lat->hist[s][b]), 1);
+		v = (uint64_t)(us[s] + 0.5);
+		old = lat->max_us[s];
+		while (old < v &&
+		       !__sync_bool_compare_and_swap(&(lat->max_us[s]), old, v))
+			old = lat->max_us[s];
+	}
+}
+
+/* The bucket upper limit is the estimate, capped by the max
+ * The last bucket has no upper limit so it's always the max */
+static double cmdlat_pc(uint32_t *hist, uint64_t count, uint64_t max_us,
+			int pc)
+{
+	uint64_t want, sum = 0;
+	int b;
+
+	if (count == 0)
+		return 0.0;
+
+	want = (count * pc + 99) / 100;
+	for (b = 0; b < (CMDLAT_BUCKETS - 1); b++) {
+		sum += hist[b];
+		if (sum >= want)
+			break;
+	}
+	if (b == (CMDLAT_BUCKETS - 1) || max_us < ((uint64_t)1 << b))
+		return (double)max_us;
+	return (double)(1 << b);
+}
+
+static const char *cmdlat_names[CMDLAT_STAGES] = {
+	"break", "queue", "proc", "total"
+};
+
+// Add the cmd_str row to buf, if it has any replies, both windows locked
+static void cmdlat_row(char **buf, size_t *off, size_t *len, bool metrics,
+			int cmd_val, const char *cmd_str, time_t window,
+			int *rows)
+{
+	uint32_t hist[CMDLAT_STAGES][CMDLAT_BUCKETS];
+	uint64_t max_us[CMDLAT_STAGES], count = 0;
+	double p50, p99;
+	char tmp[1024];
+	CMDLAT *lat;
+	int s, b, w;
+
+	bzero(hist, sizeof(hist));
+	bzero(max_us, sizeof(max_us));
+	for (w = 0; w < 2; w++) {
+		// Ignore windows older than the previous window
+		if (cmdlat_window[w] < (window - 1))
+			continue;
+		lat = &(cmdlat[w][cmd_val]);
+		count += lat->count;
+		for (s = 0; s < CMDLAT_STAGES; s++) {
+			for (b = 0; b < CMDLAT_BUCKETS; b++)
+				hist[s][b] += lat->hist[s][b];
+			if (max_us[s] < lat->max_us[s])
+				max_us[s] = lat->max_us[s];
+		}
+	}
+	if (count == 0)
+		return;
+
+	if (metrics) {
+		snprintf(tmp, sizeof(tmp),
+			 "ckdb_cmd_count{cmd=\"%s\"} %"PRIu64"\n",
+			 cmd_str, count);
+		APPEND_REALLOC(*buf, *off, *len, tmp);
+	} else {
+		snprintf(tmp, sizeof(tmp), "cmd:%d=%s%ccount:%d=%"PRIu64"%c",
+			 *rows, cmd_str, FLDSEP, *rows, count, FLDSEP);
+		APPEND_REALLOC(*buf, *off, *len, tmp);
+	}
+	for (s = 0; s < CMDLAT_STAGES; s++) {
+		p50 = cmdlat_pc(hist[s], count, max_us[s], 50);
+		p99 = cmdlat_pc(hist[s], count, max_us[s], 99);
+		if (metrics) {
+			snprintf(tmp, sizeof(tmp),
+				 "ckdb_cmd_us{cmd=\"%s\",stage=\"%s\",q=\"0.5\"} %.0f\n"
+				 "ckdb_cmd_us{cmd=\"%s\",stage=\"%s\",q=\"0.99\"} %.0f\n"
+				 "ckdb_cmd_us{cmd=\"%s\",stage=\"%s\",q=\"1\"} %"PRIu64"\n",
+				 cmd_str, cmdlat_names[s], p50,
+				 cmd_str, cmdlat_names[s], p99,
+				 cmd_str, cmdlat_names[s], max_us[s]);
+		} else {
+			snprintf(tmp, sizeof(tmp),
+				 "%s_p50:%d=%.0f%c%s_p99:%d=%.0f%c"
+				 "%s_max:%d=%"PRIu64"%c",
+				 cmdlat_names[s], *rows, p50, FLDSEP,
+				 cmdlat_names[s], *rows, p99, FLDSEP,
+				 cmdlat_names[s], *rows, max_us[s], FLDSEP);
+		}
+		APPEND_REALLOC(*buf, *off, *len, tmp);
+	}
+	(*rows)++;
+}
+
+/* Report p50/p99/max per command and stage for the current and previous
+ *  windows, either as ckdb fields or as metrics text lines
+ * Replies without a known command are reported as cmd 'unknown' */
+char *cmdlat_stats(bool metrics)
+{
+	char tmp[1024], *buf;
+	size_t len, off;
+	time_t window;
+	int i, rows = 0;
+	tv_t now;
+
+	APPEND_REALLOC_INIT(buf, off, len);
+	APPEND_REALLOC(buf, off, len, "ok.");
+	if (metrics)
+		APPEND_REALLOC(buf, off, len, "\n");
+
+	setnow(&now);
+	window = now.tv_sec / CMDLAT_WINDOW_S;
+	ck_wlock(&cmdlat_lock);
+	for (i = 0; ckdb_cmds[i].cmd_val != CMD_END; i++) {
+		cmdlat_row(&buf, &off, &len, metrics, ckdb_cmds[i].cmd_val,
+			   ckdb_cmds[i].cmd_str, window, &rows);
+	}
+	cmdlat_row(&buf, &off, &len, metrics, CMDLAT_UNKNOWN, "unknown",
+		   window, &rows);
+	ck_wunlock(&cmdlat_lock);
+
+	if (!metrics) {
+		snprintf(tmp, sizeof(tmp), "rows=%d%cflds=%s%c",
+			 rows, FLDSEP, "cmd,count,"
+			 "break_p50,break_p99,break_max,"
+			 "queue_p50,queue_p99,queue_max,"
+			 "proc_p50,proc_p99,proc_max,"
+			 "total_p50,total_p99,total_max", FLDSEP);
+		APPEND_REALLOC(buf, off, len, tmp);
+
+		snprintf(tmp, sizeof(tmp), "arn=%s%carp=%s", "CmdLat", FLDSEP, "");
+		APPEND_REALLOC(buf, off, len, tmp);
+	}
+
+	return buf;
+}
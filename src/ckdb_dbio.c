@@ -3907,6 +3907,9 @@ static bool shares_process(PGconn *conn, SHARES *shares, K_ITEM *wi_item,
 		if (shares->sdiff >= (workinfo->diff_target * diff_percent)) {
 			bool block = (shares->sdiff >= workinfo->diff_target);
 			char *sta = NULL, pct[16] = "?", est[16] = "";
+			POOLSTATUS totals;
+
+			pool_totals(&totals);
 			switch (shares->errn) {
 				case SE_NONE:
 					break;
@@ -3923,13 +3926,13 @@ static bool shares_process(PGconn *conn, SHARES *shares, K_ITEM *wi_item,
 					sta = "UNKNOWN";
 					break;
 			}
-			if (pool.diffacc >= 1000.0) {
+			if (totals.diffacc >= 1000.0) {
 				est[0] = ' ';
-				suffix_string(pool.diffacc, est+1, sizeof(est)-2, 0);
+				suffix_string(totals.diffacc, est+1, sizeof(est)-2, 0);
 			}
 			if (workinfo->diff_target > 0.0) {
 				snprintf(pct, sizeof(pct), " %.2f%%",
-					 100.0 * pool.diffacc /
+					 100.0 * totals.diffacc /
 					 workinfo->diff_target);
 			}
 			LOGWARNING("%s (%"PRIu32") %s Diff %.1f%% (%.0f/%.1f) "
@@ -3939,7 +3942,7 @@ static bool shares_process(PGconn *conn, SHARES *shares, K_ITEM *wi_item,
 				   100.0 * shares->sdiff / workinfo->diff_target,
 				   shares->sdiff, workinfo->diff_target,
 				   st = safe_text_nonull(shares->in_workername),
-				   pool.diffacc, est, pct);
+				   totals.diffacc, est, pct);
 			FREENULL(st);
 		}
 	}
@@ -5018,6 +5021,112 @@ static void markersummary_to_pool(MARKERSUMMARY *p_row, MARKERSUMMARY *row)
 	}
 }
 
+/* Aggregate one userid partition of agg->ss_store into new markersummaries
+ *  in agg->ms_store
+ * Called by an ms_aggregator() thread, or directly if not partitioned */
+void markersummary_aggregate(MS_AGG *agg)
+{
+	// shorter name for log messages
+	static const char *shortname = "K/SS_to_K/MS";
+	static const char *sshortname = "SS_to_MS";
+
+	K_TREE_CTX ms_ctx[1];
+	WORKMARKERS *workmarkers = agg->workmarkers;
+	SHARESUMMARY *sharesummary;
+	MARKERSUMMARY *markersummary = NULL, lookmarkersummary;
+	K_ITEM *ss_item, *ms_item, ms_look;
+	char *st = NULL;
+
+	setnow(&(agg->stt));
+	agg->diffacc = agg->shareacc = 0;
+	agg->ss_count = 0;
+
+	agg->ms_store = k_new_store(markersummary_free);
+	/* Use the master size for these local trees since
+	 *  they're large and don't get created often */
+	agg->ms_root = new_ktree_local(sshortname, cmp_markersummary,
+					markersummary_free);
+
+	INIT_MARKERSUMMARY(&ms_look);
+	ms_item = NULL;
+
+	ss_item = STORE_HEAD_NOLOCK(agg->ss_store);
+	while (ss_item) {
+		DATA_SHARESUMMARY(sharesummary, ss_item);
+		if (agg->partitions > 1 &&
+		    (sharesummary->userid % agg->partitions) != agg->partition) {
+			ss_item = ss_item->next;
+			continue;
+		}
+		agg->ss_count++;
+
+		// Find/create the markersummary only once per worker change
+		if (!ms_item || markersummary->userid != sharesummary->userid ||
+		    !INTREQ(markersummary->in_workername, sharesummary->in_workername)) {
+			lookmarkersummary.markerid = workmarkers->markerid;
+			lookmarkersummary.userid = sharesummary->userid;
+			lookmarkersummary.in_workername = sharesummary->in_workername;
+
+			ms_look.data = (void *)(&lookmarkersummary);
+			ms_item = find_in_ktree_nolock(agg->ms_root, &ms_look, ms_ctx);
+			if (!ms_item) {
+				K_WLOCK(markersummary_free);
+				ms_item = k_unlink_head(markersummary_free);
+				K_WUNLOCK(markersummary_free);
+				k_add_head_nolock(agg->ms_store, ms_item);
+				DATA_MARKERSUMMARY(markersummary, ms_item);
+				bzero(markersummary, sizeof(*markersummary));
+				markersummary->markerid = workmarkers->markerid;
+				markersummary->userid = sharesummary->userid;
+				markersummary->in_workername = sharesummary->in_workername;
+				add_to_ktree_nolock(agg->ms_root, ms_item);
+
+				LOGDEBUG("%s() new ms %"PRId64"/%"PRId64"/%s",
+					 shortname, markersummary->markerid,
+					 markersummary->userid,
+					 st = safe_text(markersummary->in_workername));
+				FREENULL(st);
+			} else {
+				DATA_MARKERSUMMARY(markersummary, ms_item);
+			}
+		}
+		markersummary->diffacc += sharesummary->diffacc;
+		markersummary->diffsta += sharesummary->diffsta;
+		markersummary->diffdup += sharesummary->diffdup;
+		markersummary->diffhi += sharesummary->diffhi;
+		markersummary->diffrej += sharesummary->diffrej;
+		markersummary->shareacc += sharesummary->shareacc;
+		markersummary->sharesta += sharesummary->sharesta;
+		markersummary->sharedup += sharesummary->sharedup;
+		markersummary->sharehi += sharesummary->sharehi;
+		markersummary->sharerej += sharesummary->sharerej;
+		markersummary->sharecount += sharesummary->sharecount;
+		markersummary->errorcount += sharesummary->errorcount;
+		if (!markersummary->firstshare.tv_sec ||
+		     !tv_newer(&(markersummary->firstshare), &(sharesummary->firstshare))) {
+			copy_tv(&(markersummary->firstshare), &(sharesummary->firstshare));
+		}
+		if (tv_newer(&(markersummary->lastshare), &(sharesummary->lastshare)))
+			copy_tv(&(markersummary->lastshare), &(sharesummary->lastshare));
+		if (sharesummary->diffacc > 0) {
+			if (!markersummary->firstshareacc.tv_sec ||
+			     !tv_newer(&(markersummary->firstshareacc), &(sharesummary->firstshareacc))) {
+				copy_tv(&(markersummary->firstshareacc), &(sharesummary->firstshareacc));
+			}
+			if (tv_newer(&(markersummary->lastshareacc), &(sharesummary->lastshareacc))) {
+				copy_tv(&(markersummary->lastshareacc), &(sharesummary->lastshareacc));
+				markersummary->lastdiffacc = sharesummary->lastdiffacc;
+			}
+		}
+
+		agg->diffacc += sharesummary->diffacc;
+		agg->shareacc += sharesummary->shareacc;
+
+		ss_item = ss_item->next;
+	}
+	setnow(&(agg->fin));
+}
+
 /* TODO: what to do about a failure?
  *  since it will repeat every ~13s
  * Of course manual intervention is possible via cmd_marks,
@@ -5033,7 +5142,6 @@ bool sharesummaries_to_markersummaries(PGconn *conn, WORKMARKERS *workmarkers,
 {
 	// shorter name for log messages
 	static const char *shortname = "K/SS_to_K/MS";
-	static const char *sshortname = "SS_to_MS";
 	static const char *kshortname = "KSS_to_KS";
 
 	K_TREE_CTX ss_ctx[1], kss_ctx[1], ms_ctx[1], ks_ctx[1];
@@ -5052,7 +5160,11 @@ bool sharesummaries_to_markersummaries(PGconn *conn, WORKMARKERS *workmarkers,
 	int ss_count, kss_count, ms_count, ks_count;
 	char *st = NULL;
 	tv_t add_stt, add_fin, db_stt, db_fin, lck_stt, lck_got, lck_fin;
-	tv_t kadd_stt, kadd_fin, kdb_stt, kdb_fin;
+	tv_t kadd_stt, kadd_fin, kdb_stt, kdb_fin, agg_stt, agg_fin;
+	double agg_max = 0.0;
+	int partitions = 0, part;
+	ts_t when;
+	MS_AGG *agg;
 
 	DATE_ZERO(&add_stt);
 	DATE_ZERO(&add_fin);
@@ -5062,6 +5174,8 @@ bool sharesummaries_to_markersummaries(PGconn *conn, WORKMARKERS *workmarkers,
 	DATE_ZERO(&kadd_fin);
 	DATE_ZERO(&kdb_stt);
 	DATE_ZERO(&kdb_fin);
+	DATE_ZERO(&agg_stt);
+	DATE_ZERO(&agg_fin);
 
 	LOGWARNING("%s() Processing: workmarkers %"PRId64"/%s/"
 		   "End %"PRId64"/Stt %"PRId64"/%s/%s",
@@ -5076,8 +5190,6 @@ bool sharesummaries_to_markersummaries(PGconn *conn, WORKMARKERS *workmarkers,
 
 	/* Use the master size for these local trees since
 	 *  they're large and don't get created often */
-	K_TREE *ms_root = new_ktree_local(sshortname, cmp_markersummary,
-					  markersummary_free);
 	K_TREE *ks_root = new_ktree_local(kshortname, cmp_keysummary,
 					  keysummary_free);
 
@@ -5141,73 +5253,8 @@ bool sharesummaries_to_markersummaries(PGconn *conn, WORKMARKERS *workmarkers,
 		DATA_SHARESUMMARY(sharesummary, ss_item);
 		if (sharesummary->workinfoid < workmarkers->workinfoidstart)
 			break;
-		K_RLOCK(sharesummary_free);
-		ss_prev = prev_in_ktree(ss_ctx);
-		K_RUNLOCK(sharesummary_free);
-
-		// Find/create the markersummary only once per worker change
-		if (!ms_item || markersummary->userid != sharesummary->userid ||
-		    !INTREQ(markersummary->in_workername, sharesummary->in_workername)) {
-			lookmarkersummary.markerid = workmarkers->markerid;
-			lookmarkersummary.userid = sharesummary->userid;
-			lookmarkersummary.in_workername = sharesummary->in_workername;
-
-			ms_look.data = (void *)(&lookmarkersummary);
-			ms_item = find_in_ktree_nolock(ms_root, &ms_look, ms_ctx);
-			if (!ms_item) {
-				K_WLOCK(markersummary_free);
-				ms_item = k_unlink_head(markersummary_free);
-				K_WUNLOCK(markersummary_free);
-				k_add_head_nolock(new_markersummary_store, ms_item);
-				DATA_MARKERSUMMARY(markersummary, ms_item);
-				bzero(markersummary, sizeof(*markersummary));
-				markersummary->markerid = workmarkers->markerid;
-				markersummary->userid = sharesummary->userid;
-				markersummary->in_workername = sharesummary->in_workername;
-				add_to_ktree_nolock(ms_root, ms_item);
-
-				LOGDEBUG("%s() new ms %"PRId64"/%"PRId64"/%s",
-					 shortname, markersummary->markerid,
-					 markersummary->userid,
-					 st = safe_text(markersummary->in_workername));
-				FREENULL(st);
-			} else {
-				DATA_MARKERSUMMARY(markersummary, ms_item);
-			}
-		}
-		markersummary->diffacc += sharesummary->diffacc;
-		markersummary->diffsta += sharesummary->diffsta;
-		markersummary->diffdup += sharesummary->diffdup;
-		markersummary->diffhi += sharesummary->diffhi;
-		markersummary->diffrej += sharesummary->diffrej;
-		markersummary->shareacc += sharesummary->shareacc;
-		markersummary->sharesta += sharesummary->sharesta;
-		markersummary->sharedup += sharesummary->sharedup;
-		markersummary->sharehi += sharesummary->sharehi;
-		markersummary->sharerej += sharesummary->sharerej;
-		markersummary->sharecount += sharesummary->sharecount;
-		markersummary->errorcount += sharesummary->errorcount;
-		if (!markersummary->firstshare.tv_sec ||
-		     !tv_newer(&(markersummary->firstshare), &(sharesummary->firstshare))) {
-			copy_tv(&(markersummary->firstshare), &(sharesummary->firstshare));
-		}
-		if (tv_newer(&(markersummary->lastshare), &(sharesummary->lastshare)))
-			copy_tv(&(markersummary->lastshare), &(sharesummary->lastshare));
-		if (sharesummary->diffacc > 0) {
-			if (!markersummary->firstshareacc.tv_sec ||
-			     !tv_newer(&(markersummary->firstshareacc), &(sharesummary->firstshareacc))) {
-				copy_tv(&(markersummary->firstshareacc), &(sharesummary->firstshareacc));
-			}
-			if (tv_newer(&(markersummary->lastshareacc), &(sharesummary->lastshareacc))) {
-				copy_tv(&(markersummary->lastshareacc), &(sharesummary->lastshareacc));
-				markersummary->lastdiffacc = sharesummary->lastdiffacc;
-			}
-		}
-
-		diffacc += sharesummary->diffacc;
-		shareacc += sharesummary->shareacc;
-
 		K_WLOCK(sharesummary_free);
+		ss_prev = prev_in_ktree(ss_ctx);
 		k_unlink_item(sharesummary_store, ss_item);
 		K_WUNLOCK(sharesummary_free);
 		k_add_head_nolock(old_sharesummary_store, ss_item);
@@ -5216,6 +5263,38 @@ bool sharesummaries_to_markersummaries(PGconn *conn, WORKMARKERS *workmarkers,
 	}
 	setnow(&add_fin);
 
+	/* Hand the markersummary aggregation to the ms_aggregator() threads,
+	 *  partitioned by userid, and do the keysummaries here meanwhile
+	 * Each partition has it's own local tree and store, so the only
+	 *  shared lock is for unlinking new items from markersummary_free */
+	setnow(&agg_stt);
+	partitions = (int)sys_setting(MS_AGG_THREADS_STR, MS_AGG_THREADS, cd);
+	if (partitions < 1)
+		partitions = 1;
+	if (partitions > MS_AGG_THREADS_MAX)
+		partitions = MS_AGG_THREADS_MAX;
+	mutex_lock(&ms_agg_lock);
+	if (partitions > 1 && ms_agg_running < MS_AGG_THREADS_MAX) {
+		LOGWARNING("%s() only %d of %d aggregator threads running - "
+			   "using 1 partition for workmarkers %"PRId64,
+			   shortname, ms_agg_running, MS_AGG_THREADS_MAX,
+			   workmarkers->markerid);
+		partitions = 1;
+	}
+	for (part = 0; part < partitions; part++) {
+		agg = &(ms_agg[part]);
+		agg->workmarkers = workmarkers;
+		agg->ss_store = old_sharesummary_store;
+		agg->partition = part;
+		agg->partitions = partitions;
+		agg->pending = (partitions > 1);
+	}
+	if (partitions > 1)
+		pthread_cond_broadcast(&ms_agg_cond);
+	mutex_unlock(&ms_agg_lock);
+	if (partitions == 1)
+		markersummary_aggregate(&(ms_agg[0]));
+
 dokey:
 
 	if (key_update) {
@@ -5356,6 +5435,42 @@ dokey:
 	}
 	setnow(&kadd_fin);
 
+	if (partitions > 0) {
+		// Wait for all the partitions then merge them
+		mutex_lock(&ms_agg_lock);
+		for (part = 0; part < partitions; part++) {
+			while (ms_agg[part].pending) {
+				setnowts(&when);
+				when.tv_sec++;
+				cond_timedwait(&ms_agg_done_cond, &ms_agg_lock,
+						&when);
+			}
+		}
+		mutex_unlock(&ms_agg_lock);
+
+		K_WLOCK(markersummary_free);
+		for (part = 0; part < partitions; part++) {
+			agg = &(ms_agg[part]);
+			k_list_transfer_to_head(agg->ms_store,
+						new_markersummary_store);
+		}
+		K_WUNLOCK(markersummary_free);
+		for (part = 0; part < partitions; part++) {
+			agg = &(ms_agg[part]);
+			diffacc += agg->diffacc;
+			shareacc += agg->shareacc;
+			if (agg_max < tvdiff(&(agg->fin), &(agg->stt)))
+				agg_max = tvdiff(&(agg->fin), &(agg->stt));
+			free_ktree(agg->ms_root, NULL);
+			agg->ms_store = k_free_store(agg->ms_store);
+		}
+		setnow(&agg_fin);
+	}
+
+	/* The markersummaries of all partitions, the keysummaries and the
+	 *  workmarkers status change are one transaction, since if only some
+	 *  were committed, the rest could never be added due to the
+	 *  "markersummaries already exist" check above */
 	setnow(&db_stt);
 	if (CKPQConn(&conn))
 		conned = true;
@@ -5412,10 +5527,11 @@ flail:
 	if (reason) {
 		// already displayed the full workmarkers detail at the top
 		LOGERR("%s() %s: workmarkers %"PRId64"/%s/%s add=%.3fs "
-			"kadd=%.3fs db=%.3fs kdb=%.3fs",
+			"agg=%.3fs(%d*%.3fs) kadd=%.3fs db=%.3fs kdb=%.3fs",
 			shortname, reason, workmarkers->markerid,
 			workmarkers->description, workmarkers->status,
-			tvdiff(&add_fin, &add_stt), tvdiff(&kadd_fin, &kadd_stt),
+			tvdiff(&add_fin, &add_stt), tvdiff(&agg_fin, &agg_stt),
+			partitions, agg_max, tvdiff(&kadd_fin, &kadd_stt),
 			tvdiff(&db_fin, &db_stt), tvdiff(&kdb_fin, &kdb_stt));
 
 		ok = false;
@@ -5559,8 +5675,8 @@ flail:
 			   "%"PRId64" shares %"PRId64" diff "
 			   "k(2*%"PRId64"%s/2*%"PRId64"%s) for workmarkers "
 			   "%"PRId64"/%s/End %"PRId64"/Stt %"PRId64"/%s/%s "
-			   "add=%.3fs kadd=%.3fs db=%.3fs kdb=%.3fs "
-			   "lck=%.3f+%.3fs%s",
+			   "add=%.3fs agg=%.3fs(%d*%.3fs) kadd=%.3fs db=%.3fs "
+			   "kdb=%.3fs lck=%.3f+%.3fs%s",
 			   shortname, ms_count, ks_count, ss_count, kss_count,
 			   shareacc, diffacc,
 			   kshareacc >> 1, (kshareacc & 1) ? ".5" : "",
@@ -5570,6 +5686,7 @@ flail:
 			   workmarkers->workinfoidstart,
 			   workmarkers->description,
 			   workmarkers->status, tvdiff(&add_fin, &add_stt),
+			   tvdiff(&agg_fin, &agg_stt), partitions, agg_max,
 			   tvdiff(&kadd_fin, &kadd_stt),
 			   tvdiff(&db_fin, &db_stt),
 			   tvdiff(&kdb_fin, &kdb_stt),
@@ -5584,7 +5701,6 @@ flail:
 				"are wrong!", shortname);
 		}
 	}
-	free_ktree(ms_root, NULL);
 	free_ktree(ks_root, NULL);
 	new_markersummary_store = k_free_store(new_markersummary_store);
 	new_keysummary_store = k_free_store(new_keysummary_store);
@@ -5604,8 +5720,10 @@ bool delete_markersummaries(PGconn *conn, WORKMARKERS *wm)
 	PGresult *res;
 	K_TREE_CTX ms_ctx[1];
 	MARKERSUMMARY *markersummary = NULL, lookmarkersummary;
-	K_ITEM *ms_item, ms_look, *p_ms_item = NULL;
-	bool ok = false, conned = false;
+	K_ITEM *ms_item, ms_look, *p_ms_item = NULL, *msb_item = NULL;
+	MS_ITER ms_iter;
+	tv_t now;
+	bool ok = false, conned = false, resident;
 	int64_t diffacc, shareacc;
 	char *reason = "unknown";
 	int ms_count;
@@ -5636,9 +5754,41 @@ bool delete_markersummaries(PGconn *conn, WORKMARKERS *wm)
 	INIT_MARKERSUMMARY(&ms_look);
 	ms_look.data = (void *)(&lookmarkersummary);
 
+	/* Dropped markersummaries are only in the DB, so page them in to
+	 *  be counted and unsealed below, the same as a sealed MSBLOCK */
+	K_RLOCK(markersummary_free);
+	ms_item = find_after_in_ktree(markersummary_root, &ms_look, ms_ctx);
+	DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
+	resident = (find_msblock(wm->markerid) ||
+		    (ms_item && markersummary->markerid == wm->markerid));
+	K_RUNLOCK(markersummary_free);
+	if (!resident) {
+		setnow(&now);
+		markersummary_page(conn, wm->markerid, NULL, &now);
+	}
+
 	K_WLOCK(markersummary_free);
 	K_WLOCK(workmarkers_free);
 
+	/* Sealed markersummaries are unsealed by discarding the MSBLOCK
+	 *  after the DB delete succeeds */
+	msb_item = find_msblock(wm->markerid);
+	if (msb_item) {
+		markersummary = first_ms_iter(&ms_iter, wm->markerid,
+					      MS_ITER_ALL);
+		while (markersummary) {
+			ms_count++;
+			diffacc += markersummary->diffacc;
+			shareacc += markersummary->shareacc;
+			markersummary = next_ms_iter(&ms_iter);
+		}
+		if (ms_count == 0) {
+			reason = "no markersummaries";
+			goto flail;
+		}
+		goto dodel;
+	}
+
 	ms_item = find_after_in_ktree(markersummary_root, &ms_look, ms_ctx);
 	DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
 	if (!ms_item || markersummary->markerid != wm->markerid) {
@@ -5659,6 +5809,7 @@ bool delete_markersummaries(PGconn *conn, WORKMARKERS *wm)
 		DATA_MARKERSUMMARY_NULL(markersummary, ms_item);
 	}
 
+dodel:
 	par = 0;
 	params[par++] = bigint_to_buf(wm->markerid, NULL, 0);
 	PARCHK(par, params);
@@ -5715,6 +5866,9 @@ flail:
 		k_list_transfer_to_head(del_markersummary_store,
 					markersummary_free);
 
+		if (msb_item)
+			msblock_discard(msb_item);
+
 		p_ms_item = find_markersummary_p(wm->markerid);
 		if (p_ms_item) {
 			remove_from_ktree(markersummary_pool_root, p_ms_item);
@@ -6478,10 +6632,13 @@ bool blocks_add(PGconn *conn, int32_t height, char *blockhash,
 			if (info && *info)
 				STRNCPY(row->info, info);
 			if (confirmed[0] == BLOCKS_CONFIRM) {
-				row->diffacc = pool.diffacc;
-				row->diffinv = pool.diffinv;
-				row->shareacc = pool.shareacc;
-				row->shareinv = pool.shareinv;
+				POOLSTATUS totals;
+
+				pool_totals(&totals);
+				row->diffacc = totals.diffacc;
+				row->diffinv = totals.diffinv;
+				row->shareacc = totals.shareacc;
+				row->shareinv = totals.shareinv;
 			}
 
 			HISTORYDATEINIT(row, cd, by, code, inet);
@@ -6640,6 +6797,7 @@ flail:
 		char pct[16] = "?";
 		char est[16] = "";
 		char diff[16] = "";
+		POOLSTATUS totals;
 		K_ITEM *w_item;
 		char tmp[256] = "";
 		bool blk = false;
@@ -6654,8 +6812,9 @@ flail:
 				break;
 			case BLOCKS_CONFIRM:
 				blk = true;
-				if (pool.diffacc >= 1000.0) {
-					suffix_string(pool.diffacc, est, sizeof(est)-2, 0);
+				pool_totals(&totals);
+				if (totals.diffacc >= 1000.0) {
+					suffix_string(totals.diffacc, est, sizeof(est)-2, 0);
 					strcat(est, " ");
 				}
 				w_item = find_workinfo(row->workinfoid, NULL);
@@ -6664,7 +6823,7 @@ flail:
 					DATA_WORKINFO(workinfo, w_item);
 					if (workinfo->diff_target > 0.0) {
 						snprintf(pct, sizeof(pct), "%.2f%% ",
-							 100.0 * pool.diffacc /
+							 100.0 * totals.diffacc /
 							 workinfo->diff_target);
 					}
 				}
@@ -6673,7 +6832,7 @@ flail:
 					 " Reward: %f, Worker: %s, ShareEst: %.1f %s%sUTC:%s",
 					 BTC_TO_D(row->reward),
 					 st = safe_text_nonull(row->in_workername),
-					 pool.diffacc, est, pct, cd_buf);
+					 totals.diffacc, est, pct, cd_buf);
 				FREENULL(st);
 				if (pool.workinfoid < row->workinfoid) {
 					pool.workinfoid = row->workinfoid;
@@ -8316,6 +8475,9 @@ unparam:
 	}
 	K_WUNLOCK(poolstats_free);
 
+	if (ok)
+		tseries_add(TSERIES_POOL, &(row->createdate), row->hashrate5m);
+
 	return ok;
 }
 
@@ -8324,6 +8486,7 @@ bool poolstats_fill(PGconn *conn)
 {
 	char pcombuf[64];
 	ExecStatusType rescode;
+	K_TREE_CTX ctx[1];
 	PGresult *res;
 	K_ITEM *item;
 	int n, i;
@@ -8481,6 +8644,16 @@ bool poolstats_fill(PGconn *conn)
 	}
 	if (!ok)
 		k_add_head(poolstats_free, item);
+	else {
+		// Prime the pool time series in createdate order
+		item = first_in_ktree(poolstats_root, ctx);
+		while (item) {
+			DATA_POOLSTATS(row, item);
+			tseries_add(TSERIES_POOL, &(row->createdate),
+				    row->hashrate5m);
+			item = next_in_ktree(ctx);
+		}
+	}
 
 	K_WUNLOCK(poolstats_free);
 	CKPQClear(res);
@@ -8504,7 +8677,9 @@ bool userstats_add(INTRANSIENT *in_poolinstance, char *elapsed, char *username,
 		   char *by, char *code, char *inet, tv_t *cd, K_TREE *trf_root)
 {
 	K_ITEM *us_item, *u_item, *us_match, *us_next;
-	USERSTATS *row, *match, *next;
+	USERSTATS *row, *match, *next, *was = NULL, *now = NULL;
+	bool *counted = NULL;
+	int size, changed = 0, i;
 	USERS *users;
 	K_TREE_CTX ctx[1];
 	char *st = NULL;
@@ -8573,6 +8748,14 @@ bool userstats_add(INTRANSIENT *in_poolinstance, char *elapsed, char *username,
 
 	if (eos) {
 		K_WLOCK(userstats_free);
+		size = userstats_eos_store->count;
+		if (size > 0) {
+			was = malloc(sizeof(*was) * size);
+			now = malloc(sizeof(*now) * size);
+			counted = malloc(sizeof(*counted) * size);
+			if (!was || !now || !counted)
+				quithere(1, "malloc (%d) OOM", size);
+		}
 		us_next = STORE_WHEAD(userstats_eos_store);
 		while (us_next) {
 			us_item = find_in_ktree(userstats_root, us_next, ctx);
@@ -8581,15 +8764,23 @@ bool userstats_add(INTRANSIENT *in_poolinstance, char *elapsed, char *username,
 				us_match = us_next;
 				us_next = us_match->next;
 				k_unlink_item(userstats_eos_store, us_match);
+				DATA_USERSTATS(row, us_match);
+				row->counted = true;
+				memcpy(&(now[changed]), row, sizeof(*row));
+				counted[changed++] = false;
 				add_to_ktree(userstats_root, us_match);
 				k_add_head(userstats_store, us_match);
 			} else {
 				DATA_USERSTATS(next, us_next);
 				// Old user+worker - update RAM if us_item is newer
 				DATA_USERSTATS(row, us_item);
-				if (tv_newer(&(next->createdate), &(row->createdate))) {
+				if (tv_newer(&(row->createdate), &(next->createdate))) {
+					memcpy(&(was[changed]), row, sizeof(*row));
+					counted[changed] = row->counted;
+					next->counted = true;
 					// the tree index data is the same
-					memcpy(next, row, sizeof(*row));
+					memcpy(row, next, sizeof(*row));
+					memcpy(&(now[changed++]), row, sizeof(*row));
 				}
 				us_next = us_next->next;
 			}
@@ -8598,6 +8789,12 @@ bool userstats_add(INTRANSIENT *in_poolinstance, char *elapsed, char *username,
 		if (userstats_eos_store->count > 0)
 			k_list_transfer_to_head(userstats_eos_store, userstats_free);
 		K_WUNLOCK(userstats_free);
+
+		for (i = 0; i < changed; i++)
+			userinfo_stats(counted[i] ? &(was[i]) : NULL, &(now[i]));
+		FREENULL(counted);
+		FREENULL(now);
+		FREENULL(was);
 	}
 
 	return true;
@@ -8611,7 +8808,8 @@ bool workerstats_add(INTRANSIENT *in_poolinstance, char *elapsed, char *username
 			char *inet, tv_t *cd, K_TREE *trf_root)
 {
 	K_ITEM *us_item, *u_item, *us_match;
-	USERSTATS *row, *match;
+	USERSTATS *row, *match, was, now;
+	bool newer = false, counted = false;
 	USERS *users;
 	K_TREE_CTX ctx[1];
 
@@ -8660,23 +8858,35 @@ bool workerstats_add(INTRANSIENT *in_poolinstance, char *elapsed, char *username
 
 	workerstatus_update(NULL, NULL, row);
 
+	row->counted = true;
+	// us_item may be reused once it's returned to userstats_free
+	memcpy(&now, row, sizeof(now));
 	K_WLOCK(userstats_free);
 	us_match = find_in_ktree(userstats_root, us_item, ctx);
 	if (!us_match) {
 		// New user+worker - store it in RAM
 		add_to_ktree(userstats_root, us_item);
 		k_add_head(userstats_store, us_item);
+		newer = true;
 	} else {
 		DATA_USERSTATS(match, us_match);
 		// Old user+worker - update RAM if us_item is newer
 		if (tv_newer(&(match->createdate), &(row->createdate))) {
+			if (match->counted) {
+				memcpy(&was, match, sizeof(was));
+				counted = true;
+			}
 			// the tree index data is the same
 			memcpy(match, row, sizeof(*row));
+			newer = true;
 		}
 		k_add_head(userstats_free, us_item);
 	}
 	K_WUNLOCK(userstats_free);
 
+	if (newer)
+		userinfo_stats(counted ? &was : NULL, &now);
+
 	return true;
 }
 
@@ -9127,6 +9337,322 @@ flail:
 	return ok;
 }
 
+/* Load all the markersummaries of a processed markerid from the DB and
+ *  add them as a paged MSBLOCK
+ * Returns the markerid diffacc total in diffacc, if it's not NULL */
+bool markersummary_page(PGconn *conn, int64_t markerid, double *diffacc,
+			tv_t *now)
+{
+	ExecStatusType rescode;
+	PGresult *res;
+	K_ITEM *items = NULL, **ptrs = NULL;
+	MARKERSUMMARY *rows = NULL, *row;
+	bool conned = false, ok = false;
+	char *params[1];
+	char *field = NULL;
+	char *sel;
+	int fields = 20, par = 0;
+	int n, t = 0, i;
+	tv_t stt, fin;
+
+	int markerid_num, userid_num, workername_num, diffacc_num, diffsta_num;
+	int diffdup_num, diffhi_num, diffrej_num, shareacc_num, sharesta_num;
+	int sharedup_num, sharehi_num, sharerej_num, sharecount_num;
+	int errorcount_num, firstshare_num, lastshare_num, firstshareacc_num;
+	int lastshareacc_num, lastdiffacc_num;
+	MODIFYDATE_num;
+
+	LOGDEBUG("%s(): select", __func__);
+
+	sel = "select "
+		"markerid,userid,workername,diffacc,diffsta,diffdup,diffhi,"
+		"diffrej,shareacc,sharesta,sharedup,sharehi,sharerej,"
+		"sharecount,errorcount,firstshare,lastshare,firstshareacc,"
+		"lastshareacc,lastdiffacc"
+		MODIFYDATECONTROL
+		" from markersummary where markerid=$1";
+
+	par = 0;
+	params[par++] = bigint_to_buf(markerid, NULL, 0);
+	PARCHK(par, params);
+
+	setnow(&stt);
+	if (CKPQConn(&conn))
+		conned = true;
+	res = CKPQExecParams(conn, sel, par, NULL, (const char **)params, NULL, NULL, 0, CKPQ_READ);
+	rescode = CKPQResultStatus(res);
+	if (!PGOK(rescode)) {
+		PGLOGERR("Select", rescode, conn);
+		goto clean;
+	}
+
+	n = PQnfields(res);
+	if (n != (fields + MODIFYDATECOUNT)) {
+		LOGERR("%s(): Invalid field count - should be %d, but is %d",
+			__func__, fields + MODIFYDATECOUNT, n);
+		goto clean;
+	}
+
+	t = PQntuples(res);
+	rows = calloc(t + 1, sizeof(*rows));
+	items = calloc(t + 1, sizeof(*items));
+	ptrs = calloc(t + 1, sizeof(*ptrs));
+	if (!rows || !items || !ptrs)
+		quithere(1, "calloc (%d) OOM", t + 1);
+
+	markerid_num = userid_num = workername_num = diffacc_num = diffsta_num =
+	diffdup_num = diffhi_num = diffrej_num = shareacc_num = sharesta_num =
+	sharedup_num = sharehi_num = sharerej_num = sharecount_num =
+	errorcount_num = firstshare_num = lastshare_num = firstshareacc_num =
+	lastshareacc_num = lastdiffacc_num = CKPQFUNDEF;
+	MODIFYDATE_init;
+	ok = true;
+	for (i = 0; i < t; i++) {
+		row = &(rows[i]);
+
+		CKPQ_VAL_FLD_num(res, i, markerid, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_BIGINT("markerid", field, row->markerid);
+
+		CKPQ_VAL_FLD_num(res, i, userid, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_BIGINT("userid", field, row->userid);
+
+		CKPQ_VAL_FLD_num(res, i, workername, field, ok);
+		if (!ok)
+			break;
+		row->in_workername = intransient_str("workername", field);
+
+		CKPQ_VAL_FLD_num(res, i, diffacc, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_DOUBLE("diffacc", field, row->diffacc);
+
+		CKPQ_VAL_FLD_num(res, i, diffsta, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_DOUBLE("diffsta", field, row->diffsta);
+
+		CKPQ_VAL_FLD_num(res, i, diffdup, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_DOUBLE("diffdup", field, row->diffdup);
+
+		CKPQ_VAL_FLD_num(res, i, diffhi, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_DOUBLE("diffhi", field, row->diffhi);
+
+		CKPQ_VAL_FLD_num(res, i, diffrej, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_DOUBLE("diffrej", field, row->diffrej);
+
+		CKPQ_VAL_FLD_num(res, i, shareacc, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_DOUBLE("shareacc", field, row->shareacc);
+
+		CKPQ_VAL_FLD_num(res, i, sharesta, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_DOUBLE("sharesta", field, row->sharesta);
+
+		CKPQ_VAL_FLD_num(res, i, sharedup, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_DOUBLE("sharedup", field, row->sharedup);
+
+		CKPQ_VAL_FLD_num(res, i, sharehi, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_DOUBLE("sharehi", field, row->sharehi);
+
+		CKPQ_VAL_FLD_num(res, i, sharerej, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_DOUBLE("sharerej", field, row->sharerej);
+
+		CKPQ_VAL_FLD_num(res, i, sharecount, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_BIGINT("sharecount", field, row->sharecount);
+
+		CKPQ_VAL_FLD_num(res, i, errorcount, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_BIGINT("errorcount", field, row->errorcount);
+
+		CKPQ_VAL_FLD_num(res, i, firstshare, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_TVDB("firstshare", field, row->firstshare);
+
+		CKPQ_VAL_FLD_num(res, i, lastshare, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_TVDB("lastshare", field, row->lastshare);
+
+		CKPQ_VAL_FLD_num(res, i, firstshareacc, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_TVDB("firstshareacc", field, row->firstshareacc);
+
+		CKPQ_VAL_FLD_num(res, i, lastshareacc, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_TVDB("lastshareacc", field, row->lastshareacc);
+
+		CKPQ_VAL_FLD_num(res, i, lastdiffacc, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_DOUBLE("lastdiffacc", field, row->lastdiffacc);
+
+		MODIFYDATEIN(res, i, row, ok);
+		if (!ok)
+			break;
+
+		// Same as markersummary_fill()
+		if (row->diffacc > 0) {
+			if (row->firstshareacc.tv_sec == 0L)
+				copy_tv(&(row->firstshareacc), &(row->firstshare));
+			if (row->lastshareacc.tv_sec == 0L)
+				copy_tv(&(row->lastshareacc), &(row->lastshare));
+		}
+
+		INIT_MARKERSUMMARY(&(items[i]));
+		items[i].data = (void *)row;
+		ptrs[i] = &(items[i]);
+	}
+clean:
+	CKPQClear(res);
+	CKPQDisco(&conn, conned);
+	for (i = 0; i < par; i++)
+		free(params[i]);
+
+	if (ok) {
+		ok = msblock_page_add(markerid, ptrs, t, diffacc, now);
+		setnow(&fin);
+		LOGNOTICE("%s(): paged markerid %"PRId64" %d records in "
+			  "%.3fs", __func__, markerid, t,
+			  tvdiff(&fin, &stt));
+	}
+
+	FREENULL(ptrs);
+	FREENULL(items);
+	FREENULL(rows);
+	return ok;
+}
+
+/* Load the last share of each worker from all the markersummaries of
+ *  markerid and older in one query, without loading the markersummaries
+ * Only userid, in_workername, lastshare, lastshareacc and lastdiffacc are
+ *  set in the returned rows, lastshareacc/lastdiffacc are of the newest
+ *  lastshareacc row
+ * Returns a calloc()ed array of *count rows, or NULL on error */
+MARKERSUMMARY *markersummary_last_shares(PGconn *conn, int64_t markerid,
+					  int *count)
+{
+	ExecStatusType rescode;
+	PGresult *res;
+	MARKERSUMMARY *rows = NULL, *row;
+	bool conned = false, ok = false;
+	char *params[1];
+	char *field = NULL;
+	char *sel;
+	int fields = 5, par = 0;
+	int n, t = 0, i;
+	tv_t stt, fin;
+
+	int userid_num, workername_num, lastshare_num, lastshareacc_num;
+	int lastdiffacc_num;
+
+	LOGDEBUG("%s(): select", __func__);
+
+	sel = "select distinct on (userid,workername) "
+		"userid,workername,max(lastshare) over "
+		"(partition by userid,workername) as lastshare,"
+		"lastshareacc,lastdiffacc"
+		" from markersummary where markerid<=$1"
+		" order by userid,workername,lastshareacc desc";
+
+	par = 0;
+	params[par++] = bigint_to_buf(markerid, NULL, 0);
+	PARCHK(par, params);
+
+	setnow(&stt);
+	if (CKPQConn(&conn))
+		conned = true;
+	res = CKPQExecParams(conn, sel, par, NULL, (const char **)params, NULL, NULL, 0, CKPQ_READ);
+	rescode = CKPQResultStatus(res);
+	if (!PGOK(rescode)) {
+		PGLOGERR("Select", rescode, conn);
+		goto clean;
+	}
+
+	n = PQnfields(res);
+	if (n != fields) {
+		LOGERR("%s(): Invalid field count - should be %d, but is %d",
+			__func__, fields, n);
+		goto clean;
+	}
+
+	t = PQntuples(res);
+	rows = calloc(t + 1, sizeof(*rows));
+	if (!rows)
+		quithere(1, "calloc (%d) OOM", t + 1);
+
+	userid_num = workername_num = lastshare_num = lastshareacc_num =
+	lastdiffacc_num = CKPQFUNDEF;
+	ok = true;
+	for (i = 0; i < t; i++) {
+		row = &(rows[i]);
+
+		CKPQ_VAL_FLD_num(res, i, userid, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_BIGINT("userid", field, row->userid);
+
+		CKPQ_VAL_FLD_num(res, i, workername, field, ok);
+		if (!ok)
+			break;
+		row->in_workername = intransient_str("workername", field);
+
+		CKPQ_VAL_FLD_num(res, i, lastshare, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_TVDB("lastshare", field, row->lastshare);
+
+		CKPQ_VAL_FLD_num(res, i, lastshareacc, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_TVDB("lastshareacc", field, row->lastshareacc);
+
+		CKPQ_VAL_FLD_num(res, i, lastdiffacc, field, ok);
+		if (!ok)
+			break;
+		TXT_TO_DOUBLE("lastdiffacc", field, row->lastdiffacc);
+	}
+clean:
+	CKPQClear(res);
+	CKPQDisco(&conn, conned);
+	for (i = 0; i < par; i++)
+		free(params[i]);
+
+	if (!ok) {
+		FREENULL(rows);
+		return NULL;
+	}
+
+	setnow(&fin);
+	LOGNOTICE("%s(): markerid<=%"PRId64" %d workers in %.3fs",
+		  __func__, markerid, t, tvdiff(&fin, &stt));
+	*count = t;
+	return rows;
+}
+
 bool keysummary_add(PGconn *conn, K_ITEM *ks_item, char *by, char *code,
 		    char *inet, tv_t *cd)
 {
@@ -86,6 +86,7 @@ void mkstamp(char *stamp, size_t siz)
 static struct option long_options[] = {
 	{"counter",	no_argument,		0,	'c'},
 	{"help",	no_argument,		0,	'h'},
+	{"json",	no_argument,		0,	'j'},
 	{"loglevel",	required_argument,	0,	'l'},
 	{"name",	required_argument,	0,	'n'},
 	{"sockname",	required_argument,	0,	'N'},
@@ -180,10 +181,68 @@ out:
 	return len;
 }
 
+/* Convert a ckdb CKDB_RECFMT record, e.g. from a ckdb log, back to the json
+ * message format. Returns NULL if buf isn't a record. */
+static char *rec_to_json(const char *buf)
+{
+	const char **fields = NULL, *rec;
+	char *line, *value, *next, *dump, *ret = NULL;
+	json_t *val, *fld;
+	int i;
+
+	if (!strncmp(buf, "workinfo.", 9))
+		fields = ckdb_rec_workinfo;
+	else if (!strncmp(buf, "shares.", 7))
+		fields = ckdb_rec_shares;
+	else if (!strncmp(buf, "shareerror.", 11))
+		fields = ckdb_rec_shareerror;
+	rec = strstr(buf, "." CKDB_REC_TAG);
+	if (!fields || !rec)
+		return NULL;
+
+	line = strdup(rec + 1 + CKDB_REC_TAG_LEN);
+	val = json_object();
+	next = line;
+	for (i = 0; fields[i] && next; i++) {
+		value = next;
+		next = strchr(value, CKDB_REC_SEP);
+		if (next)
+			*(next++) = '\0';
+		if (value[0] == CKDB_REC_ABSENT && !value[1])
+			continue;
+		if (!strcmp(fields[i], "merklehash")) {
+			char *arr;
+
+			ASPRINTF(&arr, "[%s]", value);
+			fld = json_loads(arr, 0, NULL);
+			free(arr);
+		} else {
+			/* Numbers and true/false/null weren't quoted */
+			fld = json_loads(value, JSON_DECODE_ANY, NULL);
+			if (fld && (json_is_string(fld) || json_is_array(fld) ||
+				    json_is_object(fld))) {
+				json_decref(fld);
+				fld = NULL;
+			}
+		}
+		if (!fld)
+			fld = json_string(value);
+		json_object_set_new_nocheck(val, fields[i], fld);
+	}
+	dump = json_dumps(val, JSON_COMPACT | JSON_PRESERVE_ORDER);
+	if (dump) {
+		ASPRINTF(&ret, "%.*sjson=%s", (int)(rec + 1 - buf), buf, dump);
+		free(dump);
+	}
+	json_decref(val);
+	free(line);
+	return ret;
+}
+
 int main(int argc, char **argv)
 {
 	char *name = NULL, *socket_dir = NULL, *buf = NULL, *sockname = "listener";
-	bool proxy = false, counter = false;
+	bool proxy = false, counter = false, tojson = false;
 	int tmo1 = RECV_UNIX_TIMEOUT1;
 	int tmo2 = RECV_UNIX_TIMEOUT2;
 	struct sigaction handler;
@@ -192,7 +251,7 @@ int main(int argc, char **argv)
 
 	tcgetattr(STDIN_FILENO, &oldctrl);
 
-	while ((c = getopt_long(argc, argv, "chl:N:n:ps:t:T:", long_options, &i)) != -1) {
+	while ((c = getopt_long(argc, argv, "chjl:N:n:ps:t:T:", long_options, &i)) != -1) {
 		switch(c) {
 			/* You'd normally disable most logmsg with -l 3 to
 			 * only see the counter */
@@ -216,6 +275,11 @@ int main(int argc, char **argv)
 						printf("-%c | --%s\n", jopt->val, jopt->name);
 				}
 				exit(0);
+			/* Convert ckdb records on stdin to json on stdout
+			 * instead of sending messages */
+			case 'j':
+				tojson = true;
+				break;
 			case 'l':
 				msg_loglevel = atoi(optarg);
 				if (msg_loglevel < LOG_EMERG ||
@@ -249,6 +313,18 @@ int main(int argc, char **argv)
 				break;
 		}
 	}
+	if (tojson) {
+		char *json;
+
+		while (get_line(&buf) != -1) {
+			json = rec_to_json(buf);
+			printf("%s\n", json ? json : buf);
+			free(json);
+			dealloc(buf);
+		}
+		return 0;
+	}
+
 	if (!socket_dir)
 		socket_dir = strdup("/tmp");
 	trail_slash(&socket_dir);
@@ -293,7 +293,7 @@ static void *unix_receiver(void *arg)
 			LOGWARNING("Failed to get message on %s socket", qname);
 			continue;
 		}
-		umsg = ckalloc(sizeof(unix_msg_t));
+		umsg = ckzalloc(sizeof(unix_msg_t));
 		umsg->sockd = sockd;
 		umsg->buf = buf;
 
@@ -694,7 +694,7 @@ out:
  * ckpool was a multi-process model but that is no longer required so we can
  * place the messages directly on the other proc_instance's queue until we
  * deprecate this mechanism. */
-void _queue_proc(proc_instance_t *pi, const char *msg, const char *file, const char *func, const int line)
+void _queue_proc(proc_instance_t *pi, const char *msg, void *data, const char *file, const char *func, const int line)
 {
 	unix_msg_t *umsg;
 
@@ -704,6 +704,7 @@ void _queue_proc(proc_instance_t *pi, const char *msg, const char *file, const c
 	}
 	umsg = ckalloc(sizeof(unix_msg_t));
 	umsg->sockd = -1;
+	umsg->data = data;
 	umsg->buf = strdup(msg);
 
 	mutex_lock(&pi->rmsg_lock);
@@ -1514,6 +1515,7 @@ static void parse_config(ckpool_t *ckp)
 		if (arr_size)
 			parse_proxies(ckp, arr_val, arr_size);
 	}
+	json_get_bool(&ckp->proxy_scoring, json_conf, "proxyscoring");
 	arr_val = json_object_get(json_conf, "redirecturl");
 	if (arr_val)
 		parse_redirecturls(ckp, arr_val);
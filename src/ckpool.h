@@ -39,6 +39,7 @@ struct unix_msg {
 	unix_msg_t *prev;
 	int sockd;
 	char *buf;
+	void *data; /* Decoded payload for messages queued within the process */
 };
 
 struct ckmsgq {
@@ -198,6 +199,8 @@ struct ckpool_instance {
 	bool remote;
 	/* Does our upstream pool in remote mode have ckdb */
 	bool upstream_ckdb;
+	/* Does our upstream pool in remote mode accept batched shares */
+	bool upstream_sharebatch;
 
 	/* Are we running in node proxy mode */
 	bool node;
@@ -269,6 +272,7 @@ struct ckpool_instance {
 	char **proxyurl;
 	char **proxyauth;
 	char **proxypass;
+	bool proxy_scoring; // Prefer lower latency healthy subproxies for new clients
 
 	/* Passthrough redirect options */
 	int redirecturls;
@@ -306,6 +310,8 @@ enum stratum_msgtype {
 	SM_REQTXNS,
 	SM_CONFIGURE,
 	SM_VERSIONMASK,
+	SM_SHARES,
+	SM_REQWORKINFO,
 	SM_NONE
 };
 
@@ -334,9 +340,18 @@ static const char __maybe_unused *stratum_msgs[] = {
 	"reqtxns",
 	"mining.configure",
 	"vmask",
+	"shares",
+	"reqworkinfo",
 	""
 };
 
+/* Optional protocol features. A node or remote server lists those it supports
+ * after its version in the mining.node or mining.remote params, and a pool
+ * lists those it supports in the caps of its mining.remote result. Older
+ * peers ignore them */
+#define CAP_TXNDELTA "txndelta" // Decodes workinfo txn hashes sent as deltas
+#define CAP_SHAREBATCH "sharebatch" // Accepts shares batched in one message
+
 #ifdef USE_CKDB
 #define CKP_STANDALONE(CKP) ((CKP)->standalone == true)
 #else
@@ -363,8 +378,9 @@ void empty_buffer(connsock_t *cs);
 int set_sendbufsize(ckpool_t *ckp, const int fd, const int len);
 int set_recvbufsize(ckpool_t *ckp, const int fd, const int len);
 int read_socket_line(connsock_t *cs, float *timeout);
-void _queue_proc(proc_instance_t *pi, const char *msg, const char *file, const char *func, const int line);
-#define send_proc(pi, msg) _queue_proc(&(pi), msg, __FILE__, __func__, __LINE__)
+void _queue_proc(proc_instance_t *pi, const char *msg, void *data, const char *file, const char *func, const int line);
+#define send_proc(pi, msg) _queue_proc(&(pi), msg, NULL, __FILE__, __func__, __LINE__)
+#define send_proc_data(pi, msg, data) _queue_proc(&(pi), msg, data, __FILE__, __func__, __LINE__)
 char *_send_recv_proc(const proc_instance_t *pi, const char *msg, int writetimeout, int readtimedout,
 		      const char *file, const char *func, const int line);
 #define send_recv_proc(pi, msg) _send_recv_proc(&(pi), msg, UNIX_WRITE_TIMEOUT, UNIX_READ_TIMEOUT, __FILE__, __func__, __LINE__)
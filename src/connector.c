@@ -25,6 +25,11 @@
 
 #define MAX_MSGSIZE 1024
 
+/* Size of the per client set of share ids pending a response in redirector
+ * mode, must be a power of 2 */
+#define REDIRECTOR_SHARES 32
+#define REDIRECTOR_SHARE_AGE 120
+
 typedef struct client_instance client_instance_t;
 typedef struct sender_send sender_send_t;
 typedef struct share share_t;
@@ -72,7 +77,8 @@ struct client_instance {
 	/* Is this the parent passthrough client */
 	bool passthrough;
 
-	/* Linked list of shares in redirector mode.*/
+	/* Open addressed set of REDIRECTOR_SHARES submitted share ids pending
+	 * a response in redirector mode, allocated on first share */
 	share_t *shares;
 
 	/* Has this client already been told to redirect */
@@ -98,10 +104,7 @@ struct sender_send {
 };
 
 struct share {
-	share_t *next;
-	share_t *prev;
-
-	time_t submitted;
+	time_t submitted; /* Zero for an unused slot */
 	int64_t id;
 };
 
@@ -235,6 +238,7 @@ static client_instance_t *recruit_client(cdata_t *cdata)
 static void __recycle_client(cdata_t *cdata, client_instance_t *client)
 {
 	dealloc(client->buf);
+	dealloc(client->shares);
 	memset(client, 0, sizeof(client_instance_t));
 	client->id = -1;
 	DL_APPEND2(cdata->recycled_clients, client, recycled_prev, recycled_next);
@@ -473,40 +477,65 @@ static void drop_all_clients(cdata_t *cdata)
 
 static void send_client(ckpool_t *ckp, cdata_t *cdata, int64_t id, char *buf);
 
-/* Look for shares being submitted via a redirector and add them to a linked
- * list for looking up the responses. */
+/* Look for shares being submitted via a redirector and add their ids to the
+ * client's set for looking up the responses. Slots are never emptied
+ * individually so a lookup can stop at the first unused one; an aged share is
+ * simply overwritten, and if the probe finds no free slot the home slot is
+ * reused since losing the odd pending share only delays the redirect. */
 static void parse_redirector_share(cdata_t *cdata, client_instance_t *client, const json_t *val)
 {
-	share_t *share, *tmp;
+	share_t *share, *slot = NULL;
 	time_t now;
 	int64_t id;
+	int i;
 
 	if (!json_get_int64(&id, val, "id")) {
 		LOGNOTICE("Failed to find redirector share id");
 		return;
 	}
-	share = ckzalloc(sizeof(share_t));
 	now = time(NULL);
-	share->submitted = now;
-	share->id = id;
 
 	LOGINFO("Redirector adding client %"PRId64" share id: %"PRId64, client->id, id);
 
 	/* We use the cdata lock instead of a separate lock since this function
 	 * is called infrequently. */
 	ck_wlock(&cdata->lock);
-	DL_APPEND(client->shares, share);
-
-	/* Age old shares. */
-	DL_FOREACH_SAFE(client->shares, share, tmp) {
-		if (now > share->submitted + 120) {
-			DL_DELETE(client->shares, share);
-			dealloc(share);
+	if (unlikely(!client->shares))
+		client->shares = ckzalloc(sizeof(share_t) * REDIRECTOR_SHARES);
+	for (i = 0; i < REDIRECTOR_SHARES; i++) {
+		share = &client->shares[(id + i) & (REDIRECTOR_SHARES - 1)];
+		if (!share->submitted || share->id == id ||
+		    now > share->submitted + REDIRECTOR_SHARE_AGE) {
+			slot = share;
+			break;
 		}
 	}
+	if (!slot)
+		slot = &client->shares[id & (REDIRECTOR_SHARES - 1)];
+	slot->submitted = now;
+	slot->id = id;
 	ck_wunlock(&cdata->lock);
 }
 
+/* Entered with cdata lock held */
+static bool __redirector_share(client_instance_t *client, const int64_t id)
+{
+	time_t now = time(NULL);
+	share_t *share;
+	int i;
+
+	if (!client->shares)
+		return false;
+	for (i = 0; i < REDIRECTOR_SHARES; i++) {
+		share = &client->shares[(id + i) & (REDIRECTOR_SHARES - 1)];
+		if (!share->submitted)
+			break;
+		if (share->id == id)
+			return now <= share->submitted + REDIRECTOR_SHARE_AGE;
+	}
+	return false;
+}
+
 /* Client is holding a reference count from being on the epoll list. Returns
  * true if we will still be receiving messages from this client. */
 static bool parse_client_msg(ckpool_t *ckp, cdata_t *cdata, client_instance_t *client)
@@ -556,11 +585,13 @@ reparse:
 		if (client->passthrough) {
 			int64_t passthrough_id;
 
-			json_getdel_int64(&passthrough_id, val, "client_id");
+			/* Setting client_id replaces the old value in place */
+			json_get_int64(&passthrough_id, val, "client_id");
 			passthrough_id = (client->id << 32) | passthrough_id;
 			json_object_set_new_nocheck(val, "client_id", json_integer(passthrough_id));
 		} else {
-			if (ckp->redirector && !client->redirected && strstr(client->buf, "mining.submit"))
+			if (ckp->redirector && !client->redirected &&
+			    !safecmp(json_string_value(json_object_get(val, "method")), "mining.submit"))
 				parse_redirector_share(cdata, client, val);
 			json_object_set_new_nocheck(val, "client_id", json_integer(client->id));
 			json_object_set_new_nocheck(val, "address", json_string(client->address_name));
@@ -908,65 +939,50 @@ static void redirect_client(ckpool_t *ckp, client_instance_t *client)
 }
 
 /* Look for accepted shares in redirector mode to know we can redirect this
- * client to a protected server. */
-static bool test_redirector_shares(cdata_t *cdata, client_instance_t *client, const char *buf)
+ * client to a protected server. The upstream pool tags the responses to
+ * shares with a share.result node.method so only those are examined, using
+ * the json the response arrived in. */
+static bool test_redirector_shares(cdata_t *cdata, client_instance_t *client, const json_t *val)
 {
-	json_t *val = json_loads(buf, 0, NULL);
-	share_t *share, *found = NULL;
-	bool ret = false;
+	bool found, result = false;
 	int64_t id;
 
-	if (!val) {
-		/* Can happen when responding to invalid json from client */
-		LOGINFO("Invalid json response to client %"PRId64 "%s", client->id, buf);
-		return ret;
-	}
+	if (safecmp(json_string_value(json_object_get(val, "node.method")),
+		    stratum_msgs[SM_SHARERESULT]))
+		return false;
 	if (!json_get_int64(&id, val, "id")) {
 		LOGINFO("Failed to find response id");
-		goto out;
+		return false;
 	}
 
 	ck_rlock(&cdata->lock);
-	DL_FOREACH(client->shares, share) {
-		if (share->id == id) {
-			LOGDEBUG("Found matching share %"PRId64" in trs for client %"PRId64,
-				 id, client->id);
-			found = share;
-			break;
-		}
-	}
+	found = __redirector_share(client, id);
 	ck_runlock(&cdata->lock);
 
-	if (found) {
-		bool result = false;
-
-		if (!json_get_bool(&result, val, "result")) {
-			LOGINFO("Failed to find result in trs share");
-			goto out;
-		}
-		if (!json_is_null(json_object_get(val, "error"))) {
-			LOGINFO("Got error for trs share");
-			goto out;
-		}
-		if (!result) {
-			LOGDEBUG("Rejected trs share");
-			goto out;
-		}
-		LOGNOTICE("Found accepted share for client %"PRId64" - redirecting",
-			   client->id);
-		ret = true;
-
-		/* Clear the list now since we don't need it any more */
-		ck_wlock(&cdata->lock);
-		DL_FOREACH_SAFE(client->shares, share, found) {
-			DL_DELETE(client->shares, share);
-			dealloc(share);
-		}
-		ck_wunlock(&cdata->lock);
+	if (!found)
+		return false;
+	LOGDEBUG("Found matching share %"PRId64" in trs for client %"PRId64,
+		 id, client->id);
+	if (!json_get_bool(&result, val, "result")) {
+		LOGINFO("Failed to find result in trs share");
+		return false;
 	}
-out:
-	json_decref(val);
-	return ret;
+	if (!json_is_null(json_object_get(val, "error"))) {
+		LOGINFO("Got error for trs share");
+		return false;
+	}
+	if (!result) {
+		LOGDEBUG("Rejected trs share");
+		return false;
+	}
+	LOGNOTICE("Found accepted share for client %"PRId64" - redirecting",
+		   client->id);
+
+	/* Clear the set now since we don't need it any more */
+	ck_wlock(&cdata->lock);
+	dealloc(client->shares);
+	ck_wunlock(&cdata->lock);
+	return true;
 }
 
 /* Send a client by id a heap allocated buffer, allowing this function to
@@ -975,7 +991,6 @@ static void send_client(ckpool_t *ckp, cdata_t *cdata, const int64_t id, char *b
 {
 	sender_send_t *sender_send;
 	client_instance_t *client;
-	bool redirect = false;
 	int64_t pass_id;
 	int len;
 
@@ -1025,15 +1040,6 @@ static void send_client(ckpool_t *ckp, cdata_t *cdata, const int64_t id, char *b
 			free(buf);
 			return;
 		}
-		if (ckp->redirector && !client->redirected && client->authorised) {
-			/* If clients match the IP of clients that have already
-			 * been whitelisted as finding valid shares then
-			 * redirect them immediately. */
-			if (redirect_matches(cdata, client))
-				redirect = true;
-			else
-				redirect = test_redirector_shares(cdata, client, buf);
-		}
 	}
 
 	sender_send = ckzalloc(sizeof(sender_send_t));
@@ -1046,10 +1052,6 @@ static void send_client(ckpool_t *ckp, cdata_t *cdata, const int64_t id, char *b
 	DL_APPEND(cdata->sender_sends, sender_send);
 	pthread_cond_signal(&cdata->sender_cond);
 	mutex_unlock(&cdata->sender_lock);
-
-	/* Redirect after sending response to shares and authorise */
-	if (unlikely(redirect))
-		redirect_client(ckp, client);
 }
 
 static void send_client_json(ckpool_t *ckp, cdata_t *cdata, int64_t client_id, json_t *json_msg)
@@ -1112,8 +1114,9 @@ static void remote_server(ckpool_t *ckp, cdata_t *cdata, client_instance_t *clie
 	LOGWARNING("Connector adding client %"PRId64" %s as remote trusted server",
 		   client->id, client->address_name);
 	client->remote = true;
-	JSON_CPACK(val, "{sbsb}",
-		   "result", true, "ckdb", CKP_STANDALONE(ckp) ? false : true);
+	JSON_CPACK(val, "{sbsbs[s]}",
+		   "result", true, "ckdb", CKP_STANDALONE(ckp) ? false : true,
+		   "caps", CAP_SHAREBATCH);
 	send_client_json(ckp, cdata, client->id, val);
 	if (!ckp->rmem_warn)
 		set_recvbufsize(ckp, client->fd, 2097152);
@@ -1126,6 +1129,7 @@ static bool connect_upstream(ckpool_t *ckp, connsock_t *cs)
 	json_t *req, *val = NULL, *res_val, *err_val;
 	bool res, ret = false;
 	float timeout = 10;
+	size_t i;
 
 	cksem_wait(&cs->sem);
 	cs->fd = connect_socket(cs->url, cs->port);
@@ -1141,9 +1145,9 @@ static bool connect_upstream(ckpool_t *ckp, connsock_t *cs)
 	if (!ckp->wmem_warn)
 		cs->sendbufsiz = set_sendbufsize(ckp, cs->fd, 2097152);
 
-	JSON_CPACK(req, "{ss,s[s]}",
+	JSON_CPACK(req, "{ss,s[s[s]]}",
 			"method", "mining.remote",
-			"params", PACKAGE"/"VERSION);
+			"params", PACKAGE"/"VERSION, CAP_TXNDELTA);
 	res = send_json_msg(cs, req);
 	json_decref(req);
 	if (!res) {
@@ -1170,6 +1174,12 @@ static bool connect_upstream(ckpool_t *ckp, connsock_t *cs)
 	res_val = json_object_get(val, "ckdb");
 	if (!res_val || json_is_true(res_val))
 		ckp->upstream_ckdb = true;
+	/* Older upstream pools list no caps so only get single shares */
+	ckp->upstream_sharebatch = false;
+	json_array_foreach(json_object_get(val, "caps"), i, res_val) {
+		if (!safecmp(json_string_value(res_val), CAP_SHAREBATCH))
+			ckp->upstream_sharebatch = true;
+	}
 	LOGWARNING("Connected to upstream %sckdb server %s:%s as trusted remote",
 		   ckp->upstream_ckdb ? "" : "non-", cs->url, cs->port);
 	ret = true;
@@ -1317,10 +1327,30 @@ static void client_message_processor(ckpool_t *ckp, json_t *json_msg)
 	cdata_t *cdata = ckp->cdata;
 	client_instance_t *client;
 	int64_t client_id;
+	json_t *raw_val;
 
 	/* Extract the client id from the json message and remove its entry */
 	client_id = json_integer_value(json_object_get(json_msg, "client_id"));
 	json_object_del(json_msg, "client_id");
+	/* A message serialised once by the stratifier for many clients can be
+	 * sent as is unless it needs to be modified on the way */
+	raw_val = json_object_get(json_msg, "raw");
+	if (raw_val) {
+		const char *raw = json_string_value(raw_val);
+
+		if (!subclient(client_id) && !ckp->node && !ckp->redirector) {
+			send_client(ckp, cdata, client_id, strdup(raw));
+			json_decref(json_msg);
+			return;
+		}
+		raw_val = json_loads(raw, 0, NULL);
+		json_decref(json_msg);
+		if (unlikely(!raw_val)) {
+			LOGWARNING("Failed to decode raw message to client %"PRId64, client_id);
+			return;
+		}
+		json_msg = raw_val;
+	}
 	/* Put client_id back in for a passthrough subclient, passing its
 	 * upstream client_id instead of the passthrough's. */
 	if (subclient(client_id))
@@ -1328,6 +1358,8 @@ static void client_message_processor(ckpool_t *ckp, json_t *json_msg)
 
 	/* Flag redirector clients once they've been authorised */
 	if (ckp->redirector && (client = ref_client_by_id(cdata, client_id))) {
+		bool redirect = false;
+
 		if (!client->redirected && !client->authorised) {
 			json_t *method_val = json_object_get(json_msg, "node.method");
 			const char *method = json_string_value(method_val);
@@ -1335,7 +1367,21 @@ static void client_message_processor(ckpool_t *ckp, json_t *json_msg)
 			if (!safecmp(method, stratum_msgs[SM_AUTHRESULT]))
 				client->authorised = true;
 		}
+		if (!client->redirected && client->authorised) {
+			/* If clients match the IP of clients that have already
+			 * been whitelisted as finding valid shares then
+			 * redirect them immediately. */
+			if (redirect_matches(cdata, client))
+				redirect = true;
+			else
+				redirect = test_redirector_shares(cdata, client, json_msg);
+		}
+		send_client_json(ckp, cdata, client_id, json_msg);
+		/* Redirect after sending response to shares and authorise */
+		if (unlikely(redirect))
+			redirect_client(ckp, client);
 		dec_instance_ref(cdata, client);
+		return;
 	}
 	send_client_json(ckp, cdata, client_id, json_msg);
 }
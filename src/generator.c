@@ -20,6 +20,7 @@
 #include "generator.h"
 #include "stratifier.h"
 #include "bitcoin.h"
+#include "sha2.h"
 #include "uthash.h"
 #include "utlist.h"
 
@@ -28,6 +29,13 @@ struct notify_instance {
 	UT_hash_handle hh;
 	int id;
 
+	/* Hash table of identical jobs by content, and ageing queue */
+	UT_hash_handle nh;
+	uchar hash[32];
+	bool hashed; /* In the content hash table */
+	struct notify_instance *next;
+	struct notify_instance *prev;
+
 	char prevhash[68];
 	json_t *jobid;
 	char *coinbase1;
@@ -49,10 +57,16 @@ typedef struct proxy_instance proxy_instance_t;
 
 struct share_msg {
 	UT_hash_handle hh;
-	int id; // Our own id for submitting upstream
+	int64_t id; // Our own id for submitting upstream
+
+	/* Expiry queue, in submit order so the oldest share is at the head */
+	struct share_msg *next;
+	struct share_msg *prev;
 
+	proxy_instance_t *proxy; /* Subproxy the share was submitted to, its shares
+				  * are dropped before it is recycled */
 	int64_t client_id;
-	time_t submit_time;
+	tv_t submit_time;
 	double diff;
 };
 
@@ -75,6 +89,24 @@ struct pass_msg {
 };
 
 typedef struct pass_msg pass_msg_t;
+
+/* Work for the proxy connect thread pool */
+struct proxy_connect {
+	/* For the list of connects waiting out a backoff, soonest first */
+	struct proxy_connect *next;
+	struct proxy_connect *prev;
+
+	proxy_instance_t *proxy;
+	bool recruit; /* Recruit a subproxy of proxy instead of reconnecting it */
+	time_t due; /* Not to be attempted before this time */
+};
+
+typedef struct proxy_connect proxy_connect_t;
+
+/* Number of threads that set up upstream connections, and the most epoll
+ * events handled per wakeup by the proxy receive threads */
+#define PROXY_CONNECT_THREADS 8
+#define PROXY_EPOLL_EVENTS 64
 typedef struct cs_msg cs_msg_t;
 
 /* Statuses of various proxy states - connect, subscribe and auth */
@@ -90,6 +122,14 @@ static const char *proxy_status[] = {
 	"Failed"
 };
 
+/* Upper bounds in ms of the share response latency histogram buckets, with
+ * one further bucket for anything slower */
+static const double latency_bounds[] = { 25, 50, 100, 250, 500, 1000, 2500 };
+#define LATENCY_BUCKETS 8
+
+/* How often in seconds to send subproxy scores to the stratifier */
+#define PROXY_SCORE_INTERVAL 30
+
 /* Per proxied pool instance data */
 struct proxy_instance {
 	UT_hash_handle hh; /* Proxy list */
@@ -126,6 +166,21 @@ struct proxy_instance {
 	double total_rejected; /* "" */
 	tv_t last_share;
 
+	/* Upstream share responses, protected by gdata share_lock */
+	int64_t shares_outstanding;
+	int64_t share_responses;
+	int64_t shares_expired;
+	double share_latency; /* Rolling average response time in ms */
+	double share_latency_max;
+	int64_t latency_hist[LATENCY_BUCKETS]; /* Responses by latency_bounds */
+	int64_t shares_stale; /* Rejected as stale or for an unknown job */
+
+	/* New block notify lateness, protected by gdata notify_lock */
+	char notify_prevhash[68];
+	int64_t notify_blocks;
+	double notify_lag; /* Rolling average ms behind the first proxy */
+	int notify_floor; /* Lowest notify id not yet sent to this subproxy */
+
 	/* Diff shares per second for 1/5/60... minute rolling averages */
 	double dsps1;
 	double dsps5;
@@ -134,6 +189,10 @@ struct proxy_instance {
 	double dsps1440;
 	tv_t last_decay;
 
+	/* Rejected diff shares per second for 5/60 minute rolling averages */
+	double rdsps5;
+	double rdsps60;
+
 	/* Total diff shares per second for all subproxies */
 	double tdsps1; /* Used only by parent proxy structures */
 	double tdsps5; /* "" */
@@ -146,6 +205,7 @@ struct proxy_instance {
 
 	bool global;	/* Part of the global list of proxies */
 	bool disabled; /* Subproxy no longer to be used */
+	bool stored; /* On the dead list, protected by gdata share_lock */
 	bool reconnect; /* We need to drop and reconnect */
 	bool reconnecting; /* Testing of parent in progress */
 	int64_t recruit; /* No of recruiting requests in progress */
@@ -167,6 +227,12 @@ struct proxy_instance {
 
 	ckmsgq_t *passsends;	// passthrough sends
 
+	/* Passthrough throughput, each only written by its own thread */
+	int64_t pass_recv_msgs;
+	int64_t pass_recv_bytes;
+	int64_t pass_send_msgs;
+	int64_t pass_send_bytes;
+
 	char_entry_t *recvd_lines; /* Linked list of unprocessed messages */
 
 	int epfd; /* Epoll fd used by the parent proxy */
@@ -198,11 +264,28 @@ struct generator_data {
 	int psends_generated;
 
 	mutex_t notify_lock;
-	notify_instance_t *notify_instances;
+	notify_instance_t *notify_instances;	// By our notify id
+	notify_instance_t *notify_hashes;	// By parent proxy and content
+	notify_instance_t *notify_queue;	// Oldest first for ageing
+	int64_t notifies_deduped;
+	time_t notify_aged;	// Last time notifies and shares were aged
+	char block_prevhash[68];	// Most recent block seen by any proxy
+	tv_t block_seen;	// When the first proxy notified it
+	time_t scores_sent;	// Last time proxy scores went to the stratifier
+
+	/* Pool of threads for proxy reconnects and subproxy recruiting */
+	ckmsgq_t *proxy_connects;
+	int proxy_connect_next;
+	pthread_t pth_pdelay;	// Hands backed off connects to the pool when due
+	mutex_t pdelay_lock;	// Lock associated with conditional below
+	pthread_cond_t pdelay_cond;
+	proxy_connect_t *pdelays;	// Connects waiting out a backoff, soonest first
 
 	mutex_t share_lock;
-	share_msg_t *shares;
+	share_msg_t *shares;	// Hashlist of outstanding shares by id
+	share_msg_t *share_queue; // The same shares oldest first for ageing
 	int64_t share_id;
+	int64_t shares_expired;
 
 	server_instance_t *current_si; // Current server instance
 
@@ -806,9 +889,9 @@ static bool node_stratum(connsock_t *cs, proxy_instance_t *proxi)
 	bool res, ret = false;
 	float timeout = 10;
 
-	JSON_CPACK(req, "{ss,s[s]}",
+	JSON_CPACK(req, "{ss,s[s[s]]}",
 			"method", "mining.node",
-			"params", PACKAGE"/"VERSION);
+			"params", PACKAGE"/"VERSION, CAP_TXNDELTA);
 
 	res = send_json_msg(cs, req);
 	json_decref(req);
@@ -842,7 +925,8 @@ out:
 	return ret;
 }
 
-static void send_notify(ckpool_t *ckp, proxy_instance_t *proxi, notify_instance_t *ni);
+static proxy_notify_t *__notify_msg(proxy_instance_t *proxi, const notify_instance_t *ni);
+static void send_notify(ckpool_t *ckp, proxy_instance_t *proxi, proxy_notify_t *pn);
 
 static void reconnect_generator(ckpool_t *ckp)
 {
@@ -936,6 +1020,56 @@ out:
 	return ret;
 }
 
+/* Hash the job content along with the parent proxy id to find identical
+ * jobs received by different subproxies. Only called for string jobids */
+static void hash_notify(const proxy_instance_t *parent, notify_instance_t *ni,
+			const char *jobid)
+{
+	sha256_ctx ctx;
+	int i;
+
+	sha256_init(&ctx);
+	sha256_update(&ctx, (const uchar *)&parent->id, sizeof(parent->id));
+	sha256_update(&ctx, (const uchar *)jobid, strlen(jobid) + 1);
+	sha256_update(&ctx, (const uchar *)ni->prevhash, strlen(ni->prevhash) + 1);
+	sha256_update(&ctx, (const uchar *)ni->coinbase1, strlen(ni->coinbase1) + 1);
+	sha256_update(&ctx, (const uchar *)ni->coinbase2, strlen(ni->coinbase2) + 1);
+	for (i = 0; i < ni->merkles; i++)
+		sha256_update(&ctx, (const uchar *)&ni->merklehash[i][0], 65);
+	sha256_update(&ctx, (const uchar *)ni->bbversion, strlen(ni->bbversion) + 1);
+	sha256_update(&ctx, (const uchar *)ni->nbit, strlen(ni->nbit) + 1);
+	sha256_update(&ctx, (const uchar *)ni->ntime, strlen(ni->ntime) + 1);
+	sha256_update(&ctx, (const uchar *)&ni->clean, sizeof(ni->clean));
+	sha256_final(&ctx, ni->hash);
+}
+
+static void clear_notify(notify_instance_t *ni);
+
+/* Track how far behind the first proxy to see each new block this proxy is
+ * with its notify. Entered with notify_lock held */
+static void __notify_lag(gdata_t *gdata, proxy_instance_t *proxi, const char *prevhash)
+{
+	double lag = 0;
+	tv_t now;
+
+	if (!strcmp(proxi->notify_prevhash, prevhash))
+		return;
+	tv_time(&now);
+	if (strcmp(gdata->block_prevhash, prevhash)) {
+		strcpy(gdata->block_prevhash, prevhash);
+		copy_tv(&gdata->block_seen, &now);
+	} else
+		lag = us_tvdiff(&now, &gdata->block_seen) / 1000;
+	/* The first notify after connecting is not a block change */
+	if (proxi->notify_prevhash[0]) {
+		if (!proxi->notify_blocks++)
+			proxi->notify_lag = lag;
+		else
+			proxi->notify_lag += (lag - proxi->notify_lag) / 8;
+	}
+	strcpy(proxi->notify_prevhash, prevhash);
+}
+
 static bool parse_notify(ckpool_t *ckp, proxy_instance_t *proxi, json_t *val)
 {
 	const char *prev_hash, *bbversion, *nbit, *ntime;
@@ -943,8 +1077,9 @@ static bool parse_notify(ckpool_t *ckp, proxy_instance_t *proxi, json_t *val)
 	char *coinbase1, *coinbase2;
 	const char *jobidbuf;
 	bool clean, ret = false;
-	notify_instance_t *ni;
+	notify_instance_t *ni, *dup = NULL;
 	json_t *arr, *job_id;
+	proxy_notify_t *pn;
 	int merkles, i;
 
 	arr = json_array_get(val, 4);
@@ -1000,14 +1135,47 @@ static bool parse_notify(ckpool_t *ckp, proxy_instance_t *proxi, json_t *val)
 	ni->merkles = merkles;
 	ret = true;
 	ni->notify_time = time(NULL);
-
-	/* Add the notify instance to the parent proxy list, not the subproxy */
+	/* Jobs are only matched by their string jobid, others are never deduped */
+	if (jobidbuf)
+		hash_notify(proxi->parent, ni, jobidbuf);
+
+	/* Add the notify instance to the parent proxy list, not the subproxy.
+	 * Subproxies of one parent usually all receive the same jobs, so an
+	 * identical job already stored for the parent is used instead, but
+	 * only if its id is newer than any sent to this subproxy so ids are
+	 * never reused within a subproxy. */
 	mutex_lock(&gdata->notify_lock);
-	ni->id = gdata->proxy_notify_id++;
-	HASH_ADD_INT(gdata->notify_instances, id, ni);
+	__notify_lag(gdata, proxi, ni->prevhash);
+	if (jobidbuf) {
+		HASH_FIND(nh, gdata->notify_hashes, ni->hash, 32, dup);
+		if (dup && dup->id < proxi->notify_floor) {
+			/* Replace it as the match for later subproxies */
+			HASH_DELETE(nh, gdata->notify_hashes, dup);
+			dup->hashed = false;
+			dup = NULL;
+		}
+	}
+	if (dup)
+		gdata->notifies_deduped++;
+	else {
+		ni->id = gdata->proxy_notify_id++;
+		HASH_ADD_INT(gdata->notify_instances, id, ni);
+		if (jobidbuf) {
+			HASH_ADD(nh, gdata->notify_hashes, hash, 32, ni);
+			ni->hashed = true;
+		}
+		DL_APPEND(gdata->notify_queue, ni);
+	}
+	proxi->notify_floor = (dup ? dup->id : ni->id) + 1;
+	pn = __notify_msg(proxi, dup ? dup : ni);
 	mutex_unlock(&gdata->notify_lock);
 
-	send_notify(ckp, proxi, ni);
+	if (dup) {
+		LOGDEBUG("Proxy %d:%d notify matches existing notify %"PRId64,
+			 proxi->id, proxi->subid, pn->jobid);
+		clear_notify(ni);
+	}
+	send_notify(ckp, proxi, pn);
 out:
 	return ret;
 }
@@ -1073,6 +1241,9 @@ static proxy_instance_t *create_subproxy(ckpool_t *ckp, gdata_t *gdata, proxy_in
 		/* Recycle an old proxy instance if one exists */
 		subproxy = gdata->dead_proxies;
 		DL_DELETE(gdata->dead_proxies, subproxy);
+		mutex_lock(&gdata->share_lock);
+		subproxy->stored = false;
+		mutex_unlock(&gdata->share_lock);
 	} else {
 		gdata->subproxies_generated++;
 		subproxy = ckzalloc(sizeof(proxy_instance_t));
@@ -1114,9 +1285,17 @@ static proxy_instance_t *__subproxy_by_id(proxy_instance_t *proxy, const int sub
 	return subproxy;
 }
 
-/* Add to the dead list to be recycled if possible */
+static void __del_share(gdata_t *gdata, share_msg_t *share);
+
+/* Add to the dead list to be recycled if possible. Any shares still
+ * outstanding on the proxy are dropped under share_lock so no share ever
+ * refers to a recycled proxy, and the stored flag stops add_share adding any
+ * more from a submitter that looked the proxy up before it died. */
 static void store_proxy(gdata_t *gdata, proxy_instance_t *proxy)
 {
+	share_msg_t *share, *tmp;
+	int purged = 0;
+
 	LOGINFO("Recycling data from proxy %d:%d", proxy->id, proxy->subid);
 
 	mutex_lock(&gdata->lock);
@@ -1125,9 +1304,22 @@ static void store_proxy(gdata_t *gdata, proxy_instance_t *proxy)
 	dealloc(proxy->baseurl);
 	dealloc(proxy->auth);
 	dealloc(proxy->pass);
+	mutex_lock(&gdata->share_lock);
+	DL_FOREACH_SAFE(gdata->share_queue, share, tmp) {
+		if (share->proxy != proxy)
+			continue;
+		__del_share(gdata, share);
+		free(share);
+		purged++;
+	}
 	memset(proxy, 0, sizeof(proxy_instance_t));
+	proxy->stored = true;
+	mutex_unlock(&gdata->share_lock);
 	DL_APPEND(gdata->dead_proxies, proxy);
 	mutex_unlock(&gdata->lock);
+
+	if (purged)
+		LOGDEBUG("Dropped %d outstanding shares from recycled proxy", purged);
 }
 
 /* The difference between a dead proxy and a deleted one is the parent proxy entry
@@ -1276,51 +1468,71 @@ out:
 static void send_diff(ckpool_t *ckp, proxy_instance_t *proxi)
 {
 	proxy_instance_t *proxy = proxi->parent;
-	json_t *json_msg;
-	char *msg, *buf;
+	proxy_diff_t *pd;
 
 	/* Not set yet */
 	if (!proxi->diff)
 		return;
 
-	JSON_CPACK(json_msg, "{sIsisf}",
-		   "proxy", proxy->id,
-		   "subproxy", proxi->subid,
-		   "diff", proxi->diff);
-	msg = json_dumps(json_msg, JSON_NO_UTF8);
-	json_decref(json_msg);
-	ASPRINTF(&buf, "diff=%s", msg);
-	free(msg);
-	send_proc(ckp->stratifier, buf);
-	free(buf);
+	pd = ckalloc(sizeof(proxy_diff_t));
+	pd->id = proxy->id;
+	pd->subid = proxi->subid;
+	pd->diff = proxi->diff;
+	send_proc_data(ckp->stratifier, "diff", pd);
 }
 
-static void send_notify(ckpool_t *ckp, proxy_instance_t *proxi, notify_instance_t *ni)
+/* Decode the notify here, in the receiving proxy's thread, so the stratifier
+ * only has to attach it to a new workbase. Entered with notify_lock held since
+ * ni is shared by every subproxy of the parent and aged by other threads */
+static proxy_notify_t *__notify_msg(proxy_instance_t *proxi, const notify_instance_t *ni)
 {
 	proxy_instance_t *proxy = proxi->parent;
-	json_t *json_msg, *merkle_arr;
-	char *msg, *buf;
+	proxy_notify_t *pn;
 	int i;
 
-	merkle_arr = json_array();
-
-	for (i = 0; i < ni->merkles; i++)
-		json_array_append_new(merkle_arr, json_string(&ni->merklehash[i][0]));
+	pn = ckzalloc(sizeof(proxy_notify_t));
+	pn->id = proxy->id;
+	pn->subid = proxi->subid;
 	/* Use our own jobid instead of the server's one for easy lookup */
-	JSON_CPACK(json_msg, "{sIsisisssisssssosssssssb}",
-			     "proxy", proxy->id, "subproxy", proxi->subid,
-			     "jobid", ni->id, "prevhash", ni->prevhash, "coinb1len", ni->coinb1len,
-			     "coinbase1", ni->coinbase1, "coinbase2", ni->coinbase2,
-			     "merklehash", merkle_arr, "bbversion", ni->bbversion,
-			     "nbit", ni->nbit, "ntime", ni->ntime,
-			     "clean", ni->clean);
-
-	msg = json_dumps(json_msg, JSON_NO_UTF8);
-	json_decref(json_msg);
-	ASPRINTF(&buf, "notify=%s", msg);
-	free(msg);
-	send_proc(ckp->stratifier, buf);
-	free(buf);
+	pn->jobid = ni->id;
+	strcpy(pn->prevhash, ni->prevhash);
+	strcpy(pn->bbversion, ni->bbversion);
+	strcpy(pn->nbit, ni->nbit);
+	strcpy(pn->ntime, ni->ntime);
+	sscanf(pn->ntime, "%x", &pn->ntime32);
+	pn->clean = ni->clean;
+
+	pn->coinb1 = strdup(ni->coinbase1);
+	pn->coinb1len = ni->coinb1len;
+	pn->coinb1bin = ckalloc(pn->coinb1len);
+	hex2bin(pn->coinb1bin, pn->coinb1, pn->coinb1len);
+	pn->coinb2 = strdup(ni->coinbase2);
+	pn->coinb2len = strlen(pn->coinb2) / 2;
+	pn->coinb2bin = ckalloc(pn->coinb2len);
+	hex2bin(pn->coinb2bin, pn->coinb2, pn->coinb2len);
+
+	pn->merkles = ni->merkles;
+	pn->merkle_array = json_array();
+	for (i = 0; i < ni->merkles; i++) {
+		strcpy(&pn->merklehash[i][0], &ni->merklehash[i][0]);
+		hex2bin(&pn->merklebin[i][0], &pn->merklehash[i][0], 32);
+		json_array_append_new(pn->merkle_array, json_string(&pn->merklehash[i][0]));
+	}
+
+	/* version, prevhash, zero merkle root, ntime, nbit, zero nonce and
+	 * the first word of sha256 padding */
+	hex2bin(pn->headerbin, pn->bbversion, 4);
+	hex2bin(pn->headerbin + 4, pn->prevhash, 32);
+	hex2bin(pn->headerbin + 68, pn->ntime, 4);
+	hex2bin(pn->headerbin + 72, pn->nbit, 4);
+	pn->headerbin[83] = 0x80;
+
+	return pn;
+}
+
+static void send_notify(ckpool_t *ckp, proxy_instance_t *proxi, proxy_notify_t *pn)
+{
+	send_proc_data(ckp->stratifier, "notify", pn);
 
 	/* Send diff now as stratifier will not accept diff till it has a
 	 * valid workbase */
@@ -1559,27 +1771,20 @@ static proxy_instance_t *proxy_by_id(gdata_t *gdata, const int id)
 
 static void send_subscribe(ckpool_t *ckp, proxy_instance_t *proxi)
 {
-	json_t *json_msg;
-	char *msg, *buf;
-
-	/* Set each field discretely instead of packing to aid debugging */
-	json_msg = json_object();
-	json_set_string(json_msg, "baseurl", proxi->baseurl);
-	json_set_string(json_msg, "url", proxi->url);
-	json_set_string(json_msg, "auth", proxi->auth);
-	json_set_string(json_msg, "pass", proxi->pass);
-	json_set_int64(json_msg, "proxy", proxi->id);
-	json_set_int(json_msg, "subproxy", proxi->subid);
-	json_set_string(json_msg, "enonce1", proxi->enonce1);
-	json_set_int(json_msg, "nonce2len", proxi->nonce2len);
-	json_set_bool(json_msg, "global", proxi->global);
-	json_set_int(json_msg, "userid", proxi->userid);
-	msg = json_dumps(json_msg, JSON_NO_UTF8);
-	json_decref(json_msg);
-	ASPRINTF(&buf, "subscribe=%s", msg);
-	free(msg);
-	send_proc(ckp->stratifier, buf);
-	free(buf);
+	proxy_subscribe_t *ps = ckzalloc(sizeof(proxy_subscribe_t));
+
+	ps->id = proxi->id;
+	ps->subid = proxi->subid;
+	ps->global = proxi->global;
+	ps->userid = proxi->userid;
+	strncpy(ps->baseurl, proxi->baseurl, 127);
+	strncpy(ps->url, proxi->url, 127);
+	strncpy(ps->auth, proxi->auth, 127);
+	strncpy(ps->pass, proxi->pass, 127);
+	/* Length is checked in parse_subscribe */
+	strcpy(ps->enonce1, proxi->enonce1);
+	ps->nonce2len = proxi->nonce2len;
+	send_proc_data(ckp->stratifier, "subscribe", ps);
 }
 
 static proxy_instance_t *subproxy_by_id(proxy_instance_t *proxy, const int subid)
@@ -1625,25 +1830,55 @@ static void stratifier_reconnect_client(ckpool_t *ckp, const int64_t id)
 	send_proc(ckp->stratifier, buf);
 }
 
-/* Add a share to the gdata share hashlist. Returns the share id */
-static int add_share(gdata_t *gdata, const int64_t client_id, const double diff)
+/* Remove a share from both the hashlist and the expiry queue. Entered with
+ * share_lock held */
+static void __del_share(gdata_t *gdata, share_msg_t *share)
 {
-	share_msg_t *share = ckzalloc(sizeof(share_msg_t)), *tmpshare;
-	time_t now;
-	int ret;
+	HASH_DEL(gdata->shares, share);
+	DL_DELETE(gdata->share_queue, share);
+	share->proxy->shares_outstanding--;
+}
+
+/* Drop shares older than 2 mins without response. Shares are queued in
+ * submit order so we only ever look at the ones that have expired. Entered
+ * with share_lock held */
+static void __age_shares(gdata_t *gdata, const time_t now)
+{
+	share_msg_t *share;
 
-	share->submit_time = now = time(NULL);
+	while ((share = gdata->share_queue) && share->submit_time.tv_sec < now - 120) {
+		__del_share(gdata, share);
+		share->proxy->shares_expired++;
+		gdata->shares_expired++;
+		free(share);
+	}
+}
+
+/* Add a share to the gdata share hashlist. Returns the share id or -1 if
+ * subproxy id:subid was recycled since proxi was looked up */
+static int64_t add_share(gdata_t *gdata, proxy_instance_t *proxi, const int id,
+			 const int subid, const int64_t client_id, const double diff)
+{
+	share_msg_t *share = ckzalloc(sizeof(share_msg_t));
+	int64_t ret;
+
+	tv_time(&share->submit_time);
+	share->proxy = proxi;
 	share->client_id = client_id;
 	share->diff = diff;
 
 	/* Add new share entry to the share hashtable. Age old shares */
 	mutex_lock(&gdata->share_lock);
+	if (unlikely(proxi->stored || proxi->id != id || proxi->subid != subid)) {
+		mutex_unlock(&gdata->share_lock);
+		free(share);
+		return -1;
+	}
 	ret = share->id = gdata->share_id++;
 	HASH_ADD_I64(gdata->shares, id, share);
-	HASH_ITER(hh, gdata->shares, share, tmpshare) {
-		if (share->submit_time < now - 120)
-			HASH_DEL(gdata->shares, share);
-	}
+	DL_APPEND(gdata->share_queue, share);
+	proxi->shares_outstanding++;
+	__age_shares(gdata, share->submit_time.tv_sec);
 	mutex_unlock(&gdata->share_lock);
 
 	return ret;
@@ -1653,10 +1888,10 @@ static void submit_share(gdata_t *gdata, json_t *val)
 {
 	proxy_instance_t *proxy, *proxi;
 	ckpool_t *ckp = gdata->ckp;
-	int id, subid, share_id;
+	int64_t client_id, share_id;
 	bool success = false;
 	stratum_msg_t *msg;
-	int64_t client_id;
+	int id, subid;
 
 	/* Get the client id so we can tell the stratifier to drop it if the
 	 * proxy it's bound to is not functional */
@@ -1693,11 +1928,18 @@ static void submit_share(gdata_t *gdata, json_t *val)
 		goto out;
 	}
 
+	share_id = add_share(gdata, proxi, id, subid, client_id, proxi->diff);
+	if (unlikely(share_id < 0)) {
+		LOGINFO("Client %"PRId64" sending shares to recycled subproxy %d:%d, dropping",
+			client_id, id, subid);
+		stratifier_reconnect_client(ckp, client_id);
+		goto out;
+	}
+
 	success = true;
 	msg = ckzalloc(sizeof(stratum_msg_t));
 	msg->json_msg = val;
-	share_id = add_share(gdata, client_id, proxi->diff);
-	json_set_int(val, "id", share_id);
+	json_set_int64(val, "id", share_id);
 
 	/* Add the new message to the psend list */
 	mutex_lock(&gdata->psend_lock);
@@ -1721,7 +1963,8 @@ static void clear_notify(notify_instance_t *ni)
 }
 
 /* Entered with proxy_lock held */
-static void __decay_proxy(proxy_instance_t *proxy, proxy_instance_t * parent, const double diff)
+static void __decay_proxy(proxy_instance_t *proxy, proxy_instance_t * parent, const double diff,
+			  const double rdiff)
 {
 	double tdiff;
 	tv_t now_t;
@@ -1732,6 +1975,8 @@ static void __decay_proxy(proxy_instance_t *proxy, proxy_instance_t * parent, co
 	decay_time(&proxy->dsps5, diff, tdiff, MIN5);
 	decay_time(&proxy->dsps60, diff, tdiff, HOUR);
 	decay_time(&proxy->dsps1440, diff, tdiff, DAY);
+	decay_time(&proxy->rdsps5, rdiff, tdiff, MIN5);
+	decay_time(&proxy->rdsps60, rdiff, tdiff, HOUR);
 	copy_tv(&proxy->last_decay, &now_t);
 
 	tdiff = sane_tdiff(&now_t, &parent->total_last_decay);
@@ -1750,22 +1995,91 @@ static void account_shares(proxy_instance_t *proxy, const double diff, const boo
 	if (result) {
 		proxy->diff_accepted += diff;
 		parent->total_accepted += diff;
-		__decay_proxy(proxy, parent, diff);
+		__decay_proxy(proxy, parent, diff, 0);
 	} else {
 		proxy->diff_rejected += diff;
 		parent->total_rejected += diff;
-		__decay_proxy(proxy, parent, 0);
+		__decay_proxy(proxy, parent, 0, diff);
 	}
 	mutex_unlock(&parent->proxy_lock);
 }
 
+/* Fraction of diff rejected over the last 5 minutes. Entered with parent
+ * proxy_lock held */
+static double __reject_rate(const proxy_instance_t *proxy)
+{
+	double total = proxy->dsps5 + proxy->rdsps5;
+
+	if (!total)
+		return 0;
+	return proxy->rdsps5 / total;
+}
+
+/* Lower is better: the rolling share latency, read by the caller under
+ * share_lock, penalised by the recent reject rate, plus how late this proxy is
+ * to notify new blocks. The lag is read without notify_lock but an incorrect
+ * value is harmless. Entered with parent proxy_lock held. */
+static double __proxy_score(const proxy_instance_t *proxy, const double latency)
+{
+	return latency * (1 + 10 * __reject_rate(proxy)) + proxy->notify_lag;
+}
+
+/* Account the result of share id from an upstream response. Returns 1 if it
+ * matched an outstanding share and -1 if not. */
+static int share_result(gdata_t *gdata, proxy_instance_t *proxi, const int64_t id,
+			const bool result, const bool stale, const char *buf)
+{
+	proxy_instance_t *subproxy;
+	share_msg_t *share;
+	double latency;
+	int bucket;
+	tv_t now;
+
+	tv_time(&now);
+	mutex_lock(&gdata->share_lock);
+	if (stale)
+		proxi->shares_stale++;
+	HASH_FIND_I64(gdata->shares, &id, share);
+	if (share) {
+		__del_share(gdata, share);
+		/* Account latency to the subproxy we sent it to */
+		subproxy = share->proxy;
+		latency = us_tvdiff(&now, &share->submit_time) / 1000;
+		if (!subproxy->share_responses++)
+			subproxy->share_latency = latency;
+		else
+			subproxy->share_latency += (latency - subproxy->share_latency) / 64;
+		if (latency > subproxy->share_latency_max)
+			subproxy->share_latency_max = latency;
+		for (bucket = 0; bucket < LATENCY_BUCKETS - 1; bucket++) {
+			if (latency < latency_bounds[bucket])
+				break;
+		}
+		subproxy->latency_hist[bucket]++;
+	}
+	mutex_unlock(&gdata->share_lock);
+
+	if (!share) {
+		LOGINFO("Proxy %d:%d failed to find matching share to result: %s",
+			proxi->id, proxi->subid, buf);
+		/* We don't know what diff these shares are so assume the
+		 * current proxy diff. */
+		account_shares(proxi, proxi->diff, result);
+		return -1;
+	}
+	account_shares(proxi, share->diff, result);
+	LOGINFO("Proxy %d:%d share result %s from client %"PRId64, proxi->id, proxi->subid,
+		buf, share->client_id);
+	free(share);
+	return 1;
+}
+
 /* Returns zero if it is not recognised as a share, 1 if it is a valid share
  * and -1 if it is recognised as a share but invalid. */
 static int parse_share(gdata_t *gdata, proxy_instance_t *proxi, const char *buf)
 {
-	json_t *val = NULL, *idval;
-	bool result = false;
-	share_msg_t *share;
+	json_t *val = NULL, *idval, *err_val;
+	bool result = false, stale = false;
 	int ret = 0;
 	int64_t id;
 
@@ -1784,33 +2098,113 @@ static int parse_share(gdata_t *gdata, proxy_instance_t *proxi, const char *buf)
 		LOGINFO("Failed to find result in upstream json msg: %s", buf);
 		goto out;
 	}
+	/* Stratum error 21 is job not found, usually a share on a stale job */
+	err_val = json_object_get(val, "error");
+	if (!result && err_val && !json_is_null(err_val)) {
+		char *errstr = json_dumps(err_val, JSON_COMPACT);
 
-	mutex_lock(&gdata->share_lock);
-	HASH_FIND_I64(gdata->shares, &id, share);
-	if (share)
-		HASH_DEL(gdata->shares, share);
-	mutex_unlock(&gdata->share_lock);
-
-	if (!share) {
-		LOGINFO("Proxy %d:%d failed to find matching share to result: %s",
-			proxi->id, proxi->subid, buf);
-		/* We don't know what diff these shares are so assume the
-		 * current proxy diff. */
-		account_shares(proxi, proxi->diff, result);
-		ret = -1;
-		goto out;
+		if (errstr) {
+			stale = strcasestr(errstr, "stale") || !strncmp(errstr, "[21,", 4);
+			dealloc(errstr);
+		}
 	}
-	ret = 1;
-	account_shares(proxi, share->diff, result);
-	LOGINFO("Proxy %d:%d share result %s from client %"PRId64, proxi->id, proxi->subid,
-		buf, share->client_id);
-	free(share);
+	ret = share_result(gdata, proxi, id, result, stale, buf);
 out:
 	if (val)
 		json_decref(val);
 	return ret;
 }
 
+static const char *skip_ws(const char *p)
+{
+	while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+		p++;
+	return p;
+}
+
+/* Recognise the usual upstream share response of exactly the keys id with an
+ * integer, result with a bool and a null error, in any order, without a json
+ * decode. Anything else returns false and goes through full parsing. */
+static bool scan_share_response(const char *buf, int64_t *id, bool *result)
+{
+	bool have_id = false, have_result = false, have_error = false;
+	const char *p = skip_ws(buf);
+	char *end;
+
+	if (*p++ != '{')
+		return false;
+	while (42) {
+		p = skip_ws(p);
+		if (!strncmp(p, "\"id\"", 4)) {
+			p = skip_ws(p + 4);
+			if (*p++ != ':')
+				return false;
+			p = skip_ws(p);
+			if (*p < '0' || *p > '9')
+				return false;
+			*id = strtoll(p, &end, 10);
+			p = end;
+			have_id = true;
+		} else if (!strncmp(p, "\"result\"", 8)) {
+			p = skip_ws(p + 8);
+			if (*p++ != ':')
+				return false;
+			p = skip_ws(p);
+			if (!strncmp(p, "true", 4)) {
+				*result = true;
+				p += 4;
+			} else if (!strncmp(p, "false", 5)) {
+				*result = false;
+				p += 5;
+			} else
+				return false;
+			have_result = true;
+		} else if (!strncmp(p, "\"error\"", 7)) {
+			p = skip_ws(p + 7);
+			if (*p++ != ':')
+				return false;
+			p = skip_ws(p);
+			if (strncmp(p, "null", 4))
+				return false;
+			p += 4;
+			have_error = true;
+		} else
+			return false;
+		p = skip_ws(p);
+		if (*p == ',') {
+			p++;
+			continue;
+		}
+		if (*p++ != '}')
+			return false;
+		break;
+	}
+	if (*skip_ws(p))
+		return false;
+	return have_id && have_result && have_error;
+}
+
+/* Handle one line received from an upstream proxy */
+static void parse_proxy_msg(ckpool_t *ckp, proxy_instance_t *proxy, const char *buf)
+{
+	gdata_t *gdata = ckp->gdata;
+	bool result = false;
+	int64_t id = 0;
+
+	/* The bulk of messages are share responses */
+	if (likely(scan_share_response(buf, &id, &result))) {
+		share_result(gdata, proxy, id, result, false, buf);
+		return;
+	}
+	if (parse_method(ckp, proxy, buf))
+		return;
+	/* If it's not a method it should be a share result */
+	if (!parse_share(gdata, proxy, buf)) {
+		LOGNOTICE("Proxy %d:%d unhandled stratum message: %s",
+			  proxy->id, proxy->subid, buf);
+	}
+}
+
 struct cs_msg {
 	cs_msg_t *next;
 	cs_msg_t *prev;
@@ -2008,6 +2402,10 @@ static void passthrough_send(ckpool_t *ckp, pass_msg_t *pm)
 	LOGDEBUG("Sending upstream json msg: %s", pm->msg);
 	len = strlen(pm->msg);
 	sent = write_socket(cs->fd, pm->msg, len);
+	if (likely(sent > 0)) {
+		proxy->pass_send_msgs++;
+		proxy->pass_send_bytes += sent;
+	}
 	if (unlikely(sent != len)) {
 		LOGWARNING("Failed to passthrough %d bytes of message %s, attempting reconnect",
 			   len, pm->msg);
@@ -2219,21 +2617,85 @@ out:
 	return ret;
 }
 
-static void *proxy_recruit(void *arg)
+/* Spread the work over the pool's queues since each thread only services its
+ * own queue */
+static void dispatch_proxy_connect(gdata_t *gdata, proxy_connect_t *pc)
 {
-	proxy_instance_t *proxy, *parent = (proxy_instance_t *)arg;
-	ckpool_t *ckp = parent->ckp;
-	gdata_t *gdata = ckp->gdata;
-	bool recruit, alive;
+	int i;
 
+	i = __sync_fetch_and_add(&gdata->proxy_connect_next, 1) & 0x7fffffff;
+	ckmsgq_add(&gdata->proxy_connects[i % PROXY_CONNECT_THREADS], pc);
+}
+
+/* Queue a connect to the pool, or if the parent is backing off after failed
+ * attempts, to the delay list to be dispatched once the backoff is up so no
+ * pool thread ever sleeps on it. */
+static void queue_proxy_connect(gdata_t *gdata, proxy_instance_t *proxy, const bool recruit)
+{
+	proxy_connect_t *pc = ckzalloc(sizeof(proxy_connect_t)), *next;
+	int backoff = proxy->parent->backoff;
+
+	pc->proxy = proxy;
+	pc->recruit = recruit;
+	if (!backoff) {
+		dispatch_proxy_connect(gdata, pc);
+		return;
+	}
+	pc->due = time(NULL) + backoff;
+
+	mutex_lock(&gdata->pdelay_lock);
+	DL_FOREACH(gdata->pdelays, next) {
+		if (next->due > pc->due)
+			break;
+	}
+	if (next)
+		DL_PREPEND_ELEM(gdata->pdelays, next, pc);
+	else
+		DL_APPEND(gdata->pdelays, pc);
+	pthread_cond_signal(&gdata->pdelay_cond);
+	mutex_unlock(&gdata->pdelay_lock);
+}
+
+/* Hand each backed off connect to the pool once it is due */
+static void *proxy_delay(void *arg)
+{
+	gdata_t *gdata = (gdata_t *)arg;
+
+	rename_proc("pdelay");
 	pthread_detach(pthread_self());
 
-	/* We do this in a separate thread so it's okay to sleep here */
-	if (parent->backoff)
-		sleep(parent->backoff);
+	while (42) {
+		proxy_connect_t *pc;
+		time_t now;
+
+		mutex_lock(&gdata->pdelay_lock);
+		now = time(NULL);
+		pc = gdata->pdelays;
+		if (!pc)
+			cond_wait(&gdata->pdelay_cond, &gdata->pdelay_lock);
+		else if (pc->due > now) {
+			ts_t due_ts = {pc->due, 0};
+
+			cond_timedwait(&gdata->pdelay_cond, &gdata->pdelay_lock, &due_ts);
+			pc = NULL;
+		} else
+			DL_DELETE(gdata->pdelays, pc);
+		mutex_unlock(&gdata->pdelay_lock);
+
+		if (pc)
+			dispatch_proxy_connect(gdata, pc);
+	}
+	return NULL;
+}
+
+/* Recruit one subproxy, requeueing the parent while more are wanted so that
+ * one parent's recruiting does not hold up a pool thread */
+static void proxy_recruit(ckpool_t *ckp, proxy_instance_t *parent)
+{
+	gdata_t *gdata = ckp->gdata;
+	proxy_instance_t *proxy;
+	bool recruit = false, alive;
 
-retry:
-	recruit = false;
 	proxy = create_subproxy(ckp, gdata, parent, parent->url, parent->baseurl);
 	alive = proxy_alive(ckp, proxy, &proxy->cs, false);
 	if (!alive) {
@@ -2250,15 +2712,12 @@ retry:
 	mutex_unlock(&parent->proxy_lock);
 
 	if (recruit)
-		goto retry;
-
-	return NULL;
+		queue_proxy_connect(gdata, parent, true);
 }
 
 static void recruit_subproxies(proxy_instance_t *proxi, const int recruits)
 {
 	bool recruit = false;
-	pthread_t pth;
 
 	mutex_lock(&proxi->proxy_lock);
 	if (!proxi->recruit)
@@ -2268,7 +2727,7 @@ static void recruit_subproxies(proxy_instance_t *proxi, const int recruits)
 	mutex_unlock(&proxi->proxy_lock);
 
 	if (recruit)
-		create_pthread(&pth, proxy_recruit, proxi);
+		queue_proxy_connect(proxi->ckp->gdata, proxi, true);
 }
 
 /* Queue up to the requested amount */
@@ -2287,29 +2746,120 @@ static void recruit_subproxy(gdata_t *gdata, const char *buf)
 	recruit_subproxies(proxy, recruits);
 }
 
-static void *proxy_reconnect(void *arg)
+static void proxy_reconnect(ckpool_t *ckp, proxy_instance_t *proxy)
 {
-	proxy_instance_t *proxy = (proxy_instance_t *)arg;
 	connsock_t *cs = &proxy->cs;
-	ckpool_t *ckp = proxy->ckp;
 
-	pthread_detach(pthread_self());
-	if (proxy->parent->backoff)
-		sleep(proxy->parent->backoff);
 	proxy_alive(ckp, proxy, cs, true);
 	proxy->reconnecting = false;
-	return NULL;
+}
+
+/* Connection setup waits on upstream responses so it's done by the proxy
+ * connect pool instead of the receive threads. Any backoff has already been
+ * waited out on the delay list. */
+static void proxy_connect(ckpool_t *ckp, proxy_connect_t *pc)
+{
+	if (pc->recruit)
+		proxy_recruit(ckp, pc->proxy);
+	else
+		proxy_reconnect(ckp, pc->proxy);
+	free(pc);
 }
 
 /* For reconnecting the parent proxy instance async */
 static void reconnect_proxy(proxy_instance_t *proxi)
 {
-	pthread_t pth;
-
 	if (proxi->reconnecting)
 		return;
 	proxi->reconnecting = true;
-	create_pthread(&pth, proxy_reconnect, proxi);
+	queue_proxy_connect(proxi->ckp->gdata, proxi, false);
+}
+
+/* Send the scores of all measured subproxies to the stratifier to weight
+ * which subproxies new clients are bound to. */
+static void send_proxy_scores(ckpool_t *ckp, gdata_t *gdata)
+{
+	proxy_scores_t *ps = ckzalloc(sizeof(proxy_scores_t));
+	proxy_instance_t *parent, *tmp;
+	int size = 0;
+
+	mutex_lock(&gdata->lock);
+	HASH_ITER(hh, gdata->proxies, parent, tmp) {
+		proxy_instance_t *subproxy, *subtmp;
+
+		mutex_unlock(&gdata->lock);
+
+		mutex_lock(&parent->proxy_lock);
+		HASH_ITER(sh, parent->subproxies, subproxy, subtmp) {
+			proxy_score_t *score;
+
+			int64_t responses;
+			double latency;
+
+			mutex_lock(&gdata->share_lock);
+			responses = subproxy->share_responses;
+			latency = subproxy->share_latency;
+			mutex_unlock(&gdata->share_lock);
+			if (!responses || subproxy->disabled)
+				continue;
+			if (ps->count >= size) {
+				size = size ? size * 2 : 16;
+				ps->scores = realloc(ps->scores, sizeof(proxy_score_t) * size);
+				if (unlikely(!ps->scores))
+					quit(1, "Failed to realloc proxy scores");
+			}
+			__decay_proxy(subproxy, parent, 0, 0);
+			score = &ps->scores[ps->count++];
+			score->id = subproxy->id;
+			score->subid = subproxy->subid;
+			score->score = __proxy_score(subproxy, latency);
+		}
+		mutex_unlock(&parent->proxy_lock);
+
+		mutex_lock(&gdata->lock);
+	}
+	mutex_unlock(&gdata->lock);
+
+	if (!ps->count) {
+		free(ps);
+		return;
+	}
+	send_proc_data(ckp->stratifier, "proxyscores", ps);
+}
+
+/* Age notifications older than 10 mins old, keeping at least 3, and shares
+ * older than 2 mins without response. Done at most once a second no matter
+ * how many messages the receive threads are handling. Both are queued in
+ * arrival order so only expired entries are looked at. */
+static void age_proxy_data(gdata_t *gdata)
+{
+	time_t now = time(NULL);
+	notify_instance_t *ni;
+
+	mutex_lock(&gdata->notify_lock);
+	if (gdata->notify_aged == now) {
+		mutex_unlock(&gdata->notify_lock);
+		return;
+	}
+	gdata->notify_aged = now;
+	while ((ni = gdata->notify_queue) && HASH_COUNT(gdata->notify_instances) >= 3 &&
+	       ni->notify_time < now - 600) {
+		HASH_DEL(gdata->notify_instances, ni);
+		if (ni->hashed)
+			HASH_DELETE(nh, gdata->notify_hashes, ni);
+		DL_DELETE(gdata->notify_queue, ni);
+		clear_notify(ni);
+	}
+	mutex_unlock(&gdata->notify_lock);
+
+	mutex_lock(&gdata->share_lock);
+	__age_shares(gdata, now);
+	mutex_unlock(&gdata->share_lock);
+
+	if (gdata->ckp->proxy_scoring && now - gdata->scores_sent >= PROXY_SCORE_INTERVAL) {
+		gdata->scores_sent = now;
+		send_proxy_scores(gdata->ckp, gdata);
+	}
 }
 
 /* For receiving messages from an upstream pool to pass downstream. Responsible
@@ -2350,6 +2900,8 @@ static void *passthrough_recv(void *arg)
 		 * here */
 		if (likely(ret > 0)) {
 			LOGDEBUG("Passthrough recv received upstream msg: %s", cs->buf);
+			proxi->pass_recv_msgs++;
+			proxi->pass_recv_bytes += ret;
 			send_proc(ckp->connector, cs->buf);
 		} else if (ret < 0) {
 			/* Read failure */
@@ -2382,16 +2934,74 @@ static bool subproxies_alive(proxy_instance_t *proxy)
 	return ret;
 }
 
-/* For receiving messages from the upstream proxy, also responsible for setting
- * up the connection and testing it's alive. */
+/* Handle one epoll event on a subproxy of proxi, reading and parsing any
+ * messages from the upstream proxy. Connection setup is left to the proxy
+ * connect pool. */
+static void proxy_recv_event(ckpool_t *ckp, proxy_instance_t *proxi, struct epoll_event *event)
+{
+	proxy_instance_t *subproxy = event->data.ptr;
+	bool message = false, hup = false;
+	gdata_t *gdata = ckp->gdata;
+	float timeout = 0;
+	connsock_t *cs;
+	int ret;
+
+	cs = &subproxy->cs;
+	/* An earlier event in the same batch may have disabled it */
+	if (!subproxy->alive)
+		return;
+
+	/* Serialise messages from here once we have a cs by
+	 * holding the semaphore. */
+	cksem_wait(&cs->sem);
+	/* Process any messages before checking for errors in
+	 * case a message is sent and then the socket
+	 * immediately closed.
+	 */
+	if (event->events & EPOLLIN) {
+		timeout = 30;
+		ret = read_socket_line(cs, &timeout);
+		/* If we are unable to read anything within 30
+		 * seconds at this point after EPOLLIN is set
+		 * then the socket is dead. */
+		if (ret < 1) {
+			LOGNOTICE("Proxy %d:%d %s failed to read_socket_line in proxy_recv",
+				  proxi->id, subproxy->subid, subproxy->url);
+			hup = true;
+		} else {
+			message = true;
+			timeout = 0;
+		}
+	}
+	if (event->events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) {
+		LOGNOTICE("Proxy %d:%d %s epoll hangup in proxy_recv",
+			  proxi->id, subproxy->subid, subproxy->url);
+		hup = true;
+	}
+
+	/* Parse any other messages already fully buffered with a zero
+	 * timeout. */
+	while (message || read_socket_line(cs, &timeout) > 0) {
+		message = false;
+		timeout = 0;
+		/* subproxy may have been recycled here if it is not a
+		 * parent and reconnect was issued */
+		parse_proxy_msg(ckp, subproxy, cs->buf);
+	}
+	cksem_post(&cs->sem);
+
+	/* Process hangup only after parsing messages */
+	if (hup || subproxy->disabled)
+		disable_subproxy(gdata, proxi, subproxy);
+}
+
 static void *proxy_recv(void *arg)
 {
 	proxy_instance_t *proxi = (proxy_instance_t *)arg;
+	struct epoll_event events[PROXY_EPOLL_EVENTS];
 	connsock_t *cs = &proxi->cs;
-	proxy_instance_t *subproxy;
 	ckpool_t *ckp = proxi->ckp;
 	gdata_t *gdata = ckp->gdata;
-	struct epoll_event event;
 	bool alive;
 	int epfd;
 
@@ -2410,14 +3020,8 @@ static void *proxy_recv(void *arg)
 	alive = proxi->alive;
 
 	while (42) {
-		bool message = false, hup = false;
-		share_msg_t *share, *tmpshare;
-		notify_instance_t *ni, *tmp;
-		float timeout;
-		time_t now;
-		int ret;
+		int i, ret;
 
-		subproxy = proxi;
 		if (!proxi->alive) {
 			reconnect_proxy(proxi);
 			while (!subproxies_alive(proxi)) {
@@ -2452,107 +3056,83 @@ static void *proxy_recv(void *arg)
 			alive = true;
 		}
 
-		now = time(NULL);
+		age_proxy_data(gdata);
 
-		/* Age old notifications older than 10 mins old */
-		mutex_lock(&gdata->notify_lock);
-		HASH_ITER(hh, gdata->notify_instances, ni, tmp) {
-			if (HASH_COUNT(gdata->notify_instances) < 3)
-				break;
-			if (ni->notify_time < now - 600) {
-				HASH_DEL(gdata->notify_instances, ni);
-				clear_notify(ni);
-			}
+		/* If we don't get an update within 10 minutes the upstream pool
+		 * has likely stopped responding. */
+		ret = epoll_wait(epfd, events, PROXY_EPOLL_EVENTS, 600000);
+		if (unlikely(ret < 1)) {
+			LOGNOTICE("Proxy %d:%d %s failed to epoll in proxy_recv",
+				  proxi->id, proxi->subid, proxi->url);
+			disable_subproxy(gdata, proxi, proxi);
+			continue;
 		}
-		mutex_unlock(&gdata->notify_lock);
+		for (i = 0; i < ret; i++)
+			proxy_recv_event(ckp, proxi, &events[i]);
+	}
 
-		/* Similary with shares older than 2 mins without response */
-		mutex_lock(&gdata->share_lock);
-		HASH_ITER(hh, gdata->shares, share, tmpshare) {
-			if (share->submit_time < now - 120) {
-				HASH_DEL(gdata->shares, share);
-			}
-		}
-		mutex_unlock(&gdata->share_lock);
+	return NULL;
+}
 
-		cs = NULL;
-		/* If we don't get an update within 10 minutes the upstream pool
-		 * has likely stopped responding. */
-		ret = epoll_wait(epfd, &event, 1, 600000);
-		if (likely(ret > 0)) {
-			subproxy = event.data.ptr;
-			cs = &subproxy->cs;
-			if (!subproxy->alive) {
-				cs = NULL;
-				continue;
-			}
+/* Handle one epoll event on a user proxy */
+static void userproxy_recv_event(ckpool_t *ckp, struct epoll_event *event)
+{
+	proxy_instance_t *proxy = event->data.ptr;
+	bool message = false, hup = false;
+	gdata_t *gdata = ckp->gdata;
+	connsock_t *cs;
+	float timeout;
+	int ret;
 
-			/* Serialise messages from here once we have a cs by
-			 * holding the semaphore. */
-			cksem_wait(&cs->sem);
-			/* Process any messages before checking for errors in
-			 * case a message is sent and then the socket
-			 * immediately closed.
-			 */
-			if (event.events & EPOLLIN) {
-				timeout = 30;
-				ret = read_socket_line(cs, &timeout);
-				/* If we are unable to read anything within 30
-				 * seconds at this point after EPOLLIN is set
-				 * then the socket is dead. */
-				if (ret < 1) {
-					LOGNOTICE("Proxy %d:%d %s failed to read_socket_line in proxy_recv",
-						  proxi->id, subproxy->subid, subproxy->url);
-					hup = true;
-				} else {
-					message = true;
-					timeout = 0;
-				}
-			}
-			if (event.events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) {
-				LOGNOTICE("Proxy %d:%d %s epoll hangup in proxy_recv",
-					  proxi->id, subproxy->subid, subproxy->url);
-				hup = true;
-			}
-		} else {
-			LOGNOTICE("Proxy %d:%d %s failed to epoll in proxy_recv",
-				  proxi->id, subproxy->subid, subproxy->url);
+	/* Make sure we haven't popped this off before we've finished
+	 * subscribe/auth, or an earlier event in the batch disabled it */
+	if (unlikely(!proxy->authorised))
+		return;
+
+	cs = &proxy->cs;
+
+	if ((event->events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP))) {
+		LOGNOTICE("Proxy %d:%d %s hangup in userproxy_recv", proxy->id,
+			  proxy->subid, proxy->url);
+		hup = true;
+	}
+
+	if (likely(event->events & EPOLLIN)) {
+		timeout = 30;
+
+		cksem_wait(&cs->sem);
+		ret = read_socket_line(cs, &timeout);
+		/* If we are unable to read anything within 30
+		 * seconds at this point after EPOLLIN is set
+		 * then the socket is dead. */
+		if (ret < 1) {
+			LOGNOTICE("Proxy %d:%d %s failed to read_socket_line in userproxy_recv",
+				  proxy->id, proxy->subid, proxy->url);
 			hup = true;
+		} else {
+			message = true;
+			timeout = 0;
 		}
-
-		/* Parse any other messages already fully buffered with a zero
-		 * timeout. This might call read_socket_line with cs == NULL
-		 * but it can gracefully handle that. */
-		while (message || read_socket_line(cs, &timeout) > 0) {
+		while (message || (ret = read_socket_line(cs, &timeout)) > 0) {
 			message = false;
 			timeout = 0;
-			/* subproxy may have been recycled here if it is not a
+			/* proxy may have been recycled here if it is not a
 			 * parent and reconnect was issued */
-			if (parse_method(ckp, subproxy, cs->buf))
-				continue;
-			/* If it's not a method it should be a share result */
-			if (!parse_share(gdata, subproxy, cs->buf)) {
-				LOGNOTICE("Proxy %d:%d unhandled stratum message: %s",
-					  subproxy->id, subproxy->subid, cs->buf);
-			}
+			parse_proxy_msg(ckp, proxy, cs->buf);
 		}
-		if (cs)
-			cksem_post(&cs->sem);
-
-		/* Process hangup only after parsing messages */
-		if (hup || subproxy->disabled)
-			disable_subproxy(gdata, proxi, subproxy);
+		cksem_post(&cs->sem);
 	}
 
-	return NULL;
+	if (hup || proxy->disabled)
+		disable_subproxy(gdata, proxy->parent, proxy);
 }
 
 /* Thread that handles all received messages from user proxies */
 static void *userproxy_recv(void *arg)
 {
+	struct epoll_event events[PROXY_EPOLL_EVENTS];
 	ckpool_t *ckp = (ckpool_t *)arg;
 	gdata_t *gdata = ckp->gdata;
-	struct epoll_event event;
 	int epfd;
 
 	rename_proc("uproxyrecv");
@@ -2566,13 +3146,7 @@ static void *userproxy_recv(void *arg)
 
 	while (42) {
 		proxy_instance_t *proxy, *tmpproxy;
-		bool message = false, hup = false;
-		share_msg_t *share, *tmpshare;
-		notify_instance_t *ni, *tmp;
-		connsock_t *cs;
-		float timeout;
-		time_t now;
-		int ret;
+		int i, ret;
 
 		mutex_lock(&gdata->lock);
 		HASH_ITER(hh, gdata->proxies, proxy, tmpproxy) {
@@ -2583,89 +3157,18 @@ static void *userproxy_recv(void *arg)
 		}
 		mutex_unlock(&gdata->lock);
 
-		ret = epoll_wait(epfd, &event, 1, 1000);
+		ret = epoll_wait(epfd, events, PROXY_EPOLL_EVENTS, 1000);
 		if (ret < 1) {
 			if (likely(!ret))
 				continue;
 			LOGEMERG("Failed to epoll_wait in userproxy_recv");
 			break;
 		}
-		proxy = event.data.ptr;
-		/* Make sure we haven't popped this off before we've finished
-		 * subscribe/auth */
-		if (unlikely(!proxy->authorised))
-			continue;
-
-		now = time(NULL);
-
-		mutex_lock(&gdata->notify_lock);
-		HASH_ITER(hh, gdata->notify_instances, ni, tmp) {
-			if (HASH_COUNT(gdata->notify_instances) < 3)
-				break;
-			if (ni->notify_time < now - 600) {
-				HASH_DEL(gdata->notify_instances, ni);
-				clear_notify(ni);
-			}
-		}
-		mutex_unlock(&gdata->notify_lock);
-
-		/* Similary with shares older than 2 mins without response */
-		mutex_lock(&gdata->share_lock);
-		HASH_ITER(hh, gdata->shares, share, tmpshare) {
-			if (share->submit_time < now - 120) {
-				HASH_DEL(gdata->shares, share);
-			}
-		}
-		mutex_unlock(&gdata->share_lock);
-
-		cs = &proxy->cs;
-
-#if 0
-		/* Is this needed at all? */
-		if (!proxy->alive)
-			continue;
-#endif
-
-		if ((event.events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP))) {
-			LOGNOTICE("Proxy %d:%d %s hangup in userproxy_recv", proxy->id,
-				  proxy->subid, proxy->url);
-			hup = true;
-		}
 
-		if (likely(event.events & EPOLLIN)) {
-			timeout = 30;
+		age_proxy_data(gdata);
 
-			cksem_wait(&cs->sem);
-			ret = read_socket_line(cs, &timeout);
-			/* If we are unable to read anything within 30
-			 * seconds at this point after EPOLLIN is set
-			 * then the socket is dead. */
-			if (ret < 1) {
-				LOGNOTICE("Proxy %d:%d %s failed to read_socket_line in userproxy_recv",
-					  proxy->id, proxy->subid, proxy->url);
-				hup = true;
-			} else {
-				message = true;
-				timeout = 0;
-			}
-			while (message || (ret = read_socket_line(cs, &timeout)) > 0) {
-				message = false;
-				timeout = 0;
-				/* proxy may have been recycled here if it is not a
-				 * parent and reconnect was issued */
-				if (parse_method(ckp, proxy, cs->buf))
-					continue;
-				/* If it's not a method it should be a share result */
-				if (!parse_share(gdata, proxy, cs->buf)) {
-					LOGNOTICE("Proxy %d:%d unhandled stratum message: %s",
-						  proxy->id, proxy->subid, cs->buf);
-				}
-			}
-			cksem_post(&cs->sem);
-		}
-
-		if (hup || proxy->disabled)
-			disable_subproxy(gdata, proxy->parent, proxy);
+		for (i = 0; i < ret; i++)
+			userproxy_recv_event(ckp, &events[i]);
 	}
 	return NULL;
 }
@@ -3005,7 +3508,7 @@ static void send_stats(gdata_t *gdata, const int sockd)
 	int total_objects, objects, generated;
 	proxy_instance_t *proxy;
 	stratum_msg_t *msg;
-	int64_t memsize;
+	int64_t memsize, expired, deduped;
 
 	mutex_lock(&gdata->lock);
 	objects = HASH_COUNT(gdata->proxies);
@@ -3035,19 +3538,25 @@ static void send_stats(gdata_t *gdata, const int sockd)
 	mutex_lock(&gdata->notify_lock);
 	objects = HASH_COUNT(gdata->notify_instances);
 	memsize = SAFE_HASH_OVERHEAD(gdata->notify_instances) + sizeof(notify_instance_t) * objects;
+	if (gdata->notify_hashes)
+		memsize += HASH_OVERHEAD(nh, gdata->notify_hashes);
 	generated = gdata->proxy_notify_id;
+	deduped = gdata->notifies_deduped;
 	mutex_unlock(&gdata->notify_lock);
 
 	JSON_CPACK(subval, "{si,si,si}", "count", objects, "memory", memsize, "generated", generated);
+	json_set_int64(subval, "deduped", deduped);
 	json_steal_object(val, "notifies", subval);
 
 	mutex_lock(&gdata->share_lock);
 	objects = HASH_COUNT(gdata->shares);
 	memsize = SAFE_HASH_OVERHEAD(gdata->shares) + sizeof(share_msg_t) * objects;
 	generated = gdata->share_id;
+	expired = gdata->shares_expired;
 	mutex_unlock(&gdata->share_lock);
 
 	JSON_CPACK(subval, "{si,si,si}", "count", objects, "memory", memsize, "generated", generated);
+	json_set_int64(subval, "expired", expired);
 	json_steal_object(val, "shares", subval);
 
 	mutex_lock(&gdata->psend_lock);
@@ -3069,7 +3578,7 @@ static json_t *__proxystats(proxy_instance_t *proxy, proxy_instance_t *parent, b
 
 	/* Opportunity to update hashrate just before we report it without
 	 * needing to check on idle proxies regularly */
-	__decay_proxy(proxy, parent, 0);
+	__decay_proxy(proxy, parent, 0, 0);
 
 	json_set_int(val, "id", proxy->id);
 	json_set_int(val, "userid", proxy->userid);
@@ -3103,10 +3612,41 @@ static json_t *__proxystats(proxy_instance_t *proxy, proxy_instance_t *parent, b
 	json_set_string(val, "authorise", proxy_status[parent->auth_status]);
 	json_set_int(val, "backoff", parent->backoff);
 	json_set_int(val, "lastshare", proxy->last_share.tv_sec);
+	if (discrete) {
+		gdata_t *gdata = proxy->ckp->gdata;
+		json_t *arr_val = json_array();
+		double latency;
+		int i;
+
+		mutex_lock(&gdata->share_lock);
+		json_set_int64(val, "outstanding", proxy->shares_outstanding);
+		json_set_int64(val, "responses", proxy->share_responses);
+		json_set_int64(val, "expired", proxy->shares_expired);
+		latency = proxy->share_latency;
+		json_set_double(val, "latency", latency);
+		json_set_double(val, "latency_max", proxy->share_latency_max);
+		for (i = 0; i < LATENCY_BUCKETS; i++)
+			json_array_append_new(arr_val, json_integer(proxy->latency_hist[i]));
+		json_set_int64(val, "stale", proxy->shares_stale);
+		mutex_unlock(&gdata->share_lock);
+
+		json_steal_object(val, "latency_hist", arr_val);
+		json_set_double(val, "rdsps5", proxy->rdsps5);
+		json_set_double(val, "rdsps60", proxy->rdsps60);
+		json_set_double(val, "reject_rate", __reject_rate(proxy));
+		json_set_double(val, "notify_lag", proxy->notify_lag);
+		json_set_double(val, "score", __proxy_score(proxy, latency));
+	}
 	json_set_bool(val, "global", proxy->global);
 	json_set_bool(val, "disabled", proxy->disabled);
 	json_set_bool(val, "alive", proxy->alive);
 	json_set_int(val, "maxclients", proxy->clients_per_proxy);
+	if (proxy->passthrough) {
+		json_set_int64(val, "recvmsgs", proxy->pass_recv_msgs);
+		json_set_int64(val, "recvbytes", proxy->pass_recv_bytes);
+		json_set_int64(val, "sendmsgs", proxy->pass_send_msgs);
+		json_set_int64(val, "sendbytes", proxy->pass_send_bytes);
+	}
 
 	return val;
 }
@@ -3482,6 +4022,16 @@ static void proxy_mode(ckpool_t *ckp, proc_instance_t *pi)
 	if (ckp->node)
 		setup_servers(ckp);
 
+	if (!ckp->passthrough) {
+		mutex_init(&gdata->psend_lock);
+		cond_init(&gdata->psend_cond);
+		gdata->proxy_connects = create_ckmsgqs(ckp, "pconnect", &proxy_connect,
+						       PROXY_CONNECT_THREADS);
+		mutex_init(&gdata->pdelay_lock);
+		cond_init(&gdata->pdelay_cond);
+		create_pthread(&gdata->pth_pdelay, proxy_delay, gdata);
+	}
+
 	/* Create all our proxy structures and pointers */
 	for (i = 0; i < ckp->proxies; i++) {
 		proxy = __add_proxy(ckp, gdata, i);
@@ -3489,14 +4039,17 @@ static void proxy_mode(ckpool_t *ckp, proc_instance_t *pi)
 			create_pthread(&proxy->pth_precv, passthrough_recv, proxy);
 			proxy->passsends = create_ckmsgq(ckp, "passsend", &passthrough_send);
 		} else {
-			mutex_init(&gdata->psend_lock);
-			cond_init(&gdata->psend_cond);
 			prepare_proxy(proxy);
-			create_pthread(&gdata->pth_uprecv, userproxy_recv, ckp);
-			create_pthread(&gdata->pth_psend, proxy_send, ckp);
 		}
 	}
 
+	/* One receive thread covers all user proxies and one send thread all
+	 * proxies */
+	if (!ckp->passthrough) {
+		create_pthread(&gdata->pth_uprecv, userproxy_recv, ckp);
+		create_pthread(&gdata->pth_psend, proxy_send, ckp);
+	}
+
 	proxy_loop(pi);
 }
 
@@ -10,6 +10,8 @@
 
 #include "klist.h"
 
+#include <sys/mman.h>
+
 const char *tree_node_list_name = "TreeNodes";
 
 #if LOCK_CHECK
@@ -32,6 +34,12 @@ __thread int my_locks_l[MAX_LOCKDEPTH];
 __thread int my_lock_level = 0;
 __thread bool my_check_deadlocks = true;
 #endif
+uint64_t klist_mem;
+uint64_t klist_mem_high;
+uint64_t klist_mem_low;
+bool klist_mem_over;
+uint64_t klist_mem_released;
+
 // Required for cmd_stats
 bool lock_check_init = false;
 cklock_t lock_check_lock;
@@ -117,11 +125,59 @@ void _dsp_kstore(K_STORE *store, char *filename, char *msg, KLIST_FFL_ARGS)
 	fclose(stream);
 }
 
+static void *k_mem_alloc(size_t siz)
+{
+	void *mem;
+
+	if (siz >= KLIST_MMAP_MIN) {
+		mem = mmap(NULL, siz, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem == MAP_FAILED)
+			return NULL;
+	} else {
+		mem = calloc(1, siz);
+		if (!mem)
+			return NULL;
+	}
+
+	// Many threads can change it, so like klist_mem it uses __sync
+	if (__sync_add_and_fetch(&klist_mem, siz) > klist_mem_high &&
+	    klist_mem_high)
+		__sync_bool_compare_and_swap(&klist_mem_over, false, true);
+
+	return mem;
+}
+
+static void k_mem_free(void *mem, size_t siz)
+{
+	if (siz >= KLIST_MMAP_MIN)
+		munmap(mem, siz);
+	else
+		free(mem);
+
+	if (__sync_sub_and_fetch(&klist_mem, siz) < klist_mem_low)
+		__sync_bool_compare_and_swap(&klist_mem_over, true, false);
+}
+
+// Free the buffers of chunk c, but leave the chunk arrays
+static void k_free_chunk(K_LIST *list, int c)
+{
+	int n = list->chunk_items[c];
+
+	if (n == 0)
+		return;
+
+	k_mem_free(list->item_memory[c], n * sizeof(K_ITEM));
+	k_mem_free(list->data_memory[c], n * list->siz);
+	list->item_memory[c] = list->data_memory[c] = NULL;
+	list->chunk_items[c] = list->chunk_free[c] = 0;
+}
+
 static void k_alloc_items(K_LIST *list, KLIST_FFL_ARGS)
 {
 	K_ITEM *item;
 	void *data;
-	int allocate, i;
+	int allocate, i, c;
 
 	CHKLIST(list);
 
@@ -137,47 +193,65 @@ static void k_alloc_items(K_LIST *list, KLIST_FFL_ARGS)
 	if (list->limit > 0 && (list->total + allocate) > list->limit)
 		allocate = list->limit - list->total;
 
-	list->item_mem_count++;
-	if (!(list->item_memory = realloc(list->item_memory,
-					  list->item_mem_count * sizeof(*(list->item_memory))))) {
-		quithere(1, "List %s item_memory failed to realloc count=%d",
-				list->name, list->item_mem_count);
+	// Reuse a released chunk slot
+	for (c = 0; c < list->item_mem_count; c++) {
+		if (list->chunk_items[c] == 0)
+			break;
+	}
+	if (c == list->item_mem_count) {
+		list->item_mem_count++;
+		if (!(list->item_memory = realloc(list->item_memory,
+						  list->item_mem_count * sizeof(*(list->item_memory))))) {
+			quithere(1, "List %s item_memory failed to realloc count=%d",
+					list->name, list->item_mem_count);
+		}
+		list->data_mem_count++;
+		if (!(list->data_memory = realloc(list->data_memory,
+						  list->data_mem_count * sizeof(*(list->data_memory))))) {
+			quithere(1, "List %s data_memory failed to realloc count=%d",
+					list->name, list->data_mem_count);
+		}
+		if (!(list->chunk_items = realloc(list->chunk_items,
+						  list->item_mem_count * sizeof(*(list->chunk_items)))) ||
+		    !(list->chunk_free = realloc(list->chunk_free,
+						 list->item_mem_count * sizeof(*(list->chunk_free))))) {
+			quithere(1, "List %s chunks failed to realloc count=%d",
+					list->name, list->item_mem_count);
+		}
 	}
-	item = calloc(allocate, sizeof(*item));
+
+	item = k_mem_alloc(allocate * sizeof(*item));
 	if (!item) {
-		quithere(1, "List %s failed to calloc %d new items - total was %d, limit was %d",
+		quithere(1, "List %s failed to alloc %d new items - total was %d, limit was %d",
 				list->name, allocate, list->total, list->limit);
 	}
-	list->item_memory[list->item_mem_count - 1] = (void *)item;
+	list->item_memory[c] = (void *)item;
 
 	item[0].name = list->name;
 	item[0].prev = NULL;
 	item[0].next = &(item[1]);
+	item[0].chunk = c;
 	for (i = 1; i < allocate-1; i++) {
 		item[i].name = list->name;
 		item[i].prev = &item[i-1];
 		item[i].next = &item[i+1];
+		item[i].chunk = c;
 	}
 	item[allocate-1].name = list->name;
 	item[allocate-1].prev = &(item[allocate-2]);
 	item[allocate-1].next = NULL;
+	item[allocate-1].chunk = c;
 
 	list->head = item;
 	if (list->do_tail)
 		list->tail = &(item[allocate-1]);
 
-	list->data_mem_count++;
-	if (!(list->data_memory = realloc(list->data_memory,
-					  list->data_mem_count * sizeof(*(list->data_memory))))) {
-		quithere(1, "List %s data_memory failed to realloc count=%d",
-				list->name, list->data_mem_count);
-	}
-	data = calloc(allocate, list->siz);
+	data = k_mem_alloc(allocate * list->siz);
 	if (!data) {
-		quithere(1, "List %s failed to calloc %d new data - total was %d, limit was %d",
+		quithere(1, "List %s failed to alloc %d new data - total was %d, limit was %d",
 				list->name, allocate, list->total, list->limit);
 	}
-	list->data_memory[list->data_mem_count - 1] = data;
+	list->data_memory[c] = data;
 
 	item = list->head;
 	while (item) {
@@ -186,11 +260,140 @@ static void k_alloc_items(K_LIST *list, KLIST_FFL_ARGS)
 		item = item->next;
 	}
 
+	list->chunk_items[c] = list->chunk_free[c] = allocate;
+	list->free_chunks++;
+
 	list->total += allocate;
 	list->count = allocate;
 	list->count_up = allocate;
 }
 
+// Only for items leaving the master list
+static inline void k_chunk_out(K_LIST *list, K_ITEM *item)
+{
+	if (list->chunk_stale)
+		return;
+
+	if (list->chunk_free[item->chunk]-- == list->chunk_items[item->chunk])
+		list->free_chunks--;
+}
+
+// Would free buffers of the list be released without being forced?
+static inline bool k_chunk_reclaimable(K_LIST *list)
+{
+	if (klist_mem_over)
+		return true;
+
+	return (list->cull_limit > 0 && list->total > list->cull_limit);
+}
+
+static bool k_chunk_release_ok(K_LIST *list, int c, bool force)
+{
+	// Always keep at least one allocation of free items
+	if ((list->count - list->chunk_items[c]) < list->allocate)
+		return false;
+
+	return (force || k_chunk_reclaimable(list));
+}
+
+// Rebuild the buffer counts after transfers made them stale
+static void k_chunk_recount(K_LIST *list)
+{
+	K_ITEM *item;
+	int c;
+
+	for (c = 0; c < list->item_mem_count; c++)
+		list->chunk_free[c] = 0;
+	for (item = list->head; item; item = item->next)
+		list->chunk_free[item->chunk]++;
+	list->free_chunks = 0;
+	for (c = 0; c < list->item_mem_count; c++) {
+		if (list->chunk_items[c] &&
+		    list->chunk_free[c] == list->chunk_items[c])
+			list->free_chunks++;
+	}
+	list->chunk_stale = false;
+}
+
+// All of chunk c's items must be in the list
+static void k_release_chunk(K_LIST *list, int c)
+{
+	K_ITEM *item = list->item_memory[c];
+	int i, n = list->chunk_items[c];
+
+	for (i = 0; i < n; i++) {
+		if (item[i].prev)
+			item[i].prev->next = item[i].next;
+		else
+			list->head = item[i].next;
+
+		if (item[i].next)
+			item[i].next->prev = item[i].prev;
+		else {
+			if (list->do_tail)
+				list->tail = item[i].prev;
+		}
+	}
+
+	k_free_chunk(list, c);
+
+	list->count -= n;
+	list->total -= n;
+	list->free_chunks--;
+	list->chunk_released++;
+	__sync_add_and_fetch(&klist_mem_released, 1);
+}
+
+/* Only for items entering the master list
+ * Returns true if the item's chunk is now completely free and wasn't
+ *  released */
+static inline bool k_chunk_in(K_LIST *list, K_ITEM *item, bool release)
+{
+	int c = item->chunk;
+
+	if (list->chunk_stale)
+		return false;
+
+	if (++(list->chunk_free[c]) == list->chunk_items[c]) {
+		list->free_chunks++;
+		if (!release)
+			return true;
+		if (k_chunk_release_ok(list, c, false))
+			k_release_chunk(list, c);
+	}
+	return false;
+}
+
+static int k_reclaim(K_LIST *list, bool force)
+{
+	int c, released = 0;
+
+	if (list->chunk_stale)
+		k_chunk_recount(list);
+
+	for (c = 0; list->free_chunks > 0 && c < list->item_mem_count; c++) {
+		if (list->chunk_items[c] &&
+		    list->chunk_free[c] == list->chunk_items[c] &&
+		    k_chunk_release_ok(list, c, force)) {
+			k_release_chunk(list, c);
+			released++;
+		}
+	}
+	return released;
+}
+
+// Release all the chunks of the list that are free
+int _k_reclaim_list(K_LIST *list, LOCK_MAYBE bool chklock, KLIST_FFL_ARGS)
+{
+	CHKLIST(list);
+	_LIST_WRITE(list, chklock, file, func, line);
+
+	if (list->is_store || list->is_lock_only)
+		return 0;
+
+	return k_reclaim(list, true);
+}
+
 K_STORE *_k_new_store(K_LIST *list, bool gotlock, KLIST_FFL_ARGS)
 {
 	K_STORE *store;
@@ -335,6 +538,9 @@ K_ITEM *_k_unlink_head(K_LIST *list, LOCK_MAYBE bool chklock, KLIST_FFL_ARGS)
 
 	list->count--;
 
+	if (!(list->is_store))
+		k_chunk_out(list, item);
+
 	return item;
 }
 
@@ -381,6 +587,9 @@ K_ITEM *_k_unlink_tail(K_LIST *list, LOCK_MAYBE bool chklock, KLIST_FFL_ARGS)
 
 	list->count--;
 
+	if (!(list->is_store))
+		k_chunk_out(list, item);
+
 	return item;
 }
 
@@ -417,16 +626,19 @@ static void k_cull_list(K_LIST *list, KLIST_FFL_ARGS)
 	}
 
 	for (i = 0; i < list->item_mem_count; i++)
-		free(list->item_memory[i]);
+		k_free_chunk(list, i);
 	free(list->item_memory);
 	list->item_memory = NULL;
 	list->item_mem_count = 0;
-
-	for (i = 0; i < list->data_mem_count; i++)
-		free(list->data_memory[i]);
 	free(list->data_memory);
 	list->data_memory = NULL;
 	list->data_mem_count = 0;
+	free(list->chunk_items);
+	list->chunk_items = NULL;
+	free(list->chunk_free);
+	list->chunk_free = NULL;
+	list->free_chunks = 0;
+	list->chunk_stale = false;
 
 	list->total = list->count = list->count_up = 0;
 	list->head = list->tail = NULL;
@@ -467,6 +679,9 @@ void _k_add_head(K_LIST *list, K_ITEM *item, LOCK_MAYBE bool chklock, KLIST_FFL_
 	list->count++;
 	list->count_up++;
 
+	if (!(list->is_store))
+		k_chunk_in(list, item, true);
+
 	CHKCULL(list);
 }
 
@@ -516,6 +731,9 @@ void _k_add_tail(K_LIST *list, K_ITEM *item, LOCK_MAYBE bool chklock, KLIST_FFL_
 	list->count++;
 	list->count_up++;
 
+	if (!(list->is_store))
+		k_chunk_in(list, item, true);
+
 	CHKCULL(list);
 }
 
@@ -556,6 +774,9 @@ void _k_insert_after(K_LIST *list, K_ITEM *item, K_ITEM *after, LOCK_MAYBE bool
 	list->count++;
 	list->count_up++;
 
+	if (!(list->is_store))
+		k_chunk_in(list, item, false);
+
 	// no point checking cull since this wouldn't be an _free list
 }
 
@@ -587,6 +808,9 @@ void _k_unlink_item(K_LIST *list, K_ITEM *item, LOCK_MAYBE bool chklock, KLIST_F
 	item->prev = item->next = NULL;
 
 	list->count--;
+
+	if (!(list->is_store))
+		k_chunk_out(list, item);
 }
 
 void _k_list_transfer_to_head(K_LIST *from, K_LIST *to, LOCK_MAYBE bool chklock, KLIST_FFL_ARGS)
@@ -610,6 +834,13 @@ void _k_list_transfer_to_head(K_LIST *from, K_LIST *to, LOCK_MAYBE bool chklock,
 	if (!(from->head))
 		return;
 
+	/* Keep the splice O(1), the master list buffer counts are only
+	 *  recounted when a buffer could be released */
+	if (!(from->is_store))
+		from->chunk_stale = true;
+	if (!(to->is_store))
+		to->chunk_stale = true;
+
 	if (to->head)
 		to->head->prev = from->tail;
 	else
@@ -624,6 +855,9 @@ void _k_list_transfer_to_head(K_LIST *from, K_LIST *to, LOCK_MAYBE bool chklock,
 	to->count_up += from->count_up;
 	from->count_up = 0;
 
+	if (!(to->is_store) && k_chunk_reclaimable(to))
+		k_reclaim(to, false);
+
 	CHKCULL(to);
 }
 
@@ -648,6 +882,13 @@ void _k_list_transfer_to_tail(K_LIST *from, K_LIST *to, LOCK_MAYBE bool chklock,
 	if (!(from->head))
 		return;
 
+	/* Keep the splice O(1), the master list buffer counts are only
+	 *  recounted when a buffer could be released */
+	if (!(from->is_store))
+		from->chunk_stale = true;
+	if (!(to->is_store))
+		to->chunk_stale = true;
+
 	if (to->tail)
 		to->tail->next = from->head;
 	else
@@ -662,6 +903,9 @@ void _k_list_transfer_to_tail(K_LIST *from, K_LIST *to, LOCK_MAYBE bool chklock,
 	to->count_up += from->count_up;
 	from->count_up = 0;
 
+	if (!(to->is_store) && k_chunk_reclaimable(to))
+		k_reclaim(to, false);
+
 	CHKCULL(to);
 }
 
@@ -677,12 +921,11 @@ K_LIST *_k_free_list(K_LIST *list, KLIST_FFL_ARGS)
 	}
 
 	for (i = 0; i < list->item_mem_count; i++)
-		free(list->item_memory[i]);
+		k_free_chunk(list, i);
 	free(list->item_memory);
-
-	for (i = 0; i < list->data_mem_count; i++)
-		free(list->data_memory[i]);
 	free(list->data_memory);
+	free(list->chunk_items);
+	free(list->chunk_free);
 
 	if (list->lock) {
 		cklock_destroy(list->lock);
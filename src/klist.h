@@ -116,6 +116,7 @@ typedef struct k_item {
 	struct k_item *prev;
 	struct k_item *next;
 	void *data;
+	int chunk;		// which item memory buffer of the list it's in
 } K_ITEM;
 
 #if LOCK_CHECK
@@ -150,6 +151,11 @@ typedef struct k_list {
 	void **item_memory;	// allocated item memory buffers
 	int data_mem_count;	// how many item data memory buffers have been allocated
 	void **data_memory;	// allocated item data memory buffers
+	int *chunk_items;	// items in each buffer - 0 means it was released
+	int *chunk_free;	// how many of each buffer's items are in the list
+	int free_chunks;	// buffers with all their items in the list
+	bool chunk_stale;	// chunk_free/free_chunks need recounting
+	int chunk_released;	// number of buffers released
 	void (*dsp_func)(K_ITEM *, FILE *); // optional data display to a file
 	int cull_limit;		// <1 means don't cull, otherwise total to cull at
 	int cull_count;		// number of times culled
@@ -165,6 +171,25 @@ typedef struct k_list {
 #endif
 } K_LIST;
 
+/* Memory governor
+ * klist_mem is the total of all list item and data memory buffers
+ * Buffers of KLIST_MMAP_MIN or larger are mmap'd so releasing them always
+ *  returns the memory to the OS
+ * When a buffer has all it's items back in the list, it's released if the
+ *  list has more than cull_limit items, or klist_mem_over is set,
+ *  but a list always keeps at least 'allocate' free items
+ * If klist_mem_high is set, klist_mem_over is set when klist_mem goes
+ *  above it and cleared when it goes below klist_mem_low
+ * k_reclaim_list() releases the list's buffers that are already free
+ * List transfers don't update the buffer counts, they only flag them to be
+ *  recounted the next time a buffer could be released */
+#define KLIST_MMAP_MIN (64*1024)
+extern uint64_t klist_mem;
+extern uint64_t klist_mem_high;
+extern uint64_t klist_mem_low;
+extern bool klist_mem_over;
+extern uint64_t klist_mem_released;
+
 // Required for cmd_stats
 extern bool lock_check_init;
 extern cklock_t lock_check_lock;
@@ -713,6 +738,8 @@ extern void _k_list_transfer_to_head(K_LIST *from, K_LIST *to, LOCK_MAYBE bool c
 extern void _k_list_transfer_to_tail(K_LIST *from, K_LIST *to, LOCK_MAYBE bool chklock, KLIST_FFL_ARGS);
 #define k_list_transfer_to_tail(_from, _to) _k_list_transfer_to_tail(_from, _to, true, KLIST_FFL_HERE)
 #define k_list_transfer_to_tail_nolock(_from, _to) _k_list_transfer_to_tail(_from, _to, false, KLIST_FFL_HERE)
+extern int _k_reclaim_list(K_LIST *list, LOCK_MAYBE bool chklock, KLIST_FFL_ARGS);
+#define k_reclaim_list(_list) _k_reclaim_list(_list, true, KLIST_FFL_HERE)
 extern K_LIST *_k_free_list(K_LIST *list, KLIST_FFL_ARGS);
 #define k_free_list(_list) _k_free_list(_list, KLIST_FFL_HERE)
 extern K_STORE *_k_free_store(K_STORE *store, KLIST_FFL_ARGS);
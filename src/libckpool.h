@@ -295,6 +295,94 @@ static const char __maybe_unused *share_errs[] = {
 
 #define SHARE_ERR(x) share_errs[((x) + 9)]
 
+/* Compact record format for the high volume ckdb messages
+ * Instead of "name.id.json={...}" the message is "name.id.rec1=" followed by
+ * just the values, in the order of the fields below, each separated by
+ * CKDB_REC_SEP. A field that isn't present is a lone CKDB_REC_ABSENT.
+ * Arrays are their json contents without the enclosing brackets.
+ * ckpool only uses it once ckdb reports CKDB_RECFMT in its heartbeat replies
+ * and uses json for any message that has other fields or a value containing
+ * a separator. ckpmsg -j converts records back to json.
+ * Changing any field list requires a new CKDB_RECFMT. */
+#define CKDB_RECFMT 1
+#define CKDB_REC_TAG "rec1="
+#define CKDB_REC_TAG_LEN (sizeof(CKDB_REC_TAG)-1)
+#define CKDB_REC_SEP '\x1f'
+#define CKDB_REC_ABSENT '\x1e'
+
+static const char __maybe_unused *ckdb_rec_shares[] = {
+	"seqstart",
+	"seqpid",
+	"seqall",
+	"seqshares",
+	"workinfoid",
+	"clientid",
+	"enonce1",
+	"secondaryuserid",
+	"nonce2",
+	"nonce",
+	"ntime",
+	"diff",
+	"sdiff",
+	"hash",
+	"result",
+	"reject-reason",
+	"error",
+	"errn",
+	"createdate",
+	"createby",
+	"createcode",
+	"createinet",
+	"workername",
+	"username",
+	"address",
+	"agent",
+	NULL
+};
+
+static const char __maybe_unused *ckdb_rec_shareerror[] = {
+	"seqstart",
+	"seqpid",
+	"seqall",
+	"seqshareerror",
+	"clientid",
+	"secondaryuserid",
+	"enonce1",
+	"workinfoid",
+	"workername",
+	"username",
+	"error",
+	"errn",
+	"createdate",
+	"createby",
+	"createcode",
+	"createinet",
+	NULL
+};
+
+static const char __maybe_unused *ckdb_rec_workinfo[] = {
+	"seqstart",
+	"seqpid",
+	"seqall",
+	"seqworkinfo",
+	"workinfoid",
+	"poolinstance",
+	"transactiontree",
+	"prevhash",
+	"coinbase1",
+	"coinbase2",
+	"version",
+	"ntime",
+	"bits",
+	"reward",
+	"merklehash",
+	"createdate",
+	"createby",
+	"createcode",
+	"createinet",
+	NULL
+};
+
 typedef struct ckmutex mutex_t;
 
 struct ckmutex {
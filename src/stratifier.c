@@ -253,6 +253,8 @@ struct stratum_instance {
 	uint32_t version_mask;	/* Mask to use for this client */
 
 	int latency; /* Latency when on a mining node */
+	int64_t workinfo_id; /* Last workinfo sent to this node or remote, protected by workinfo_lock */
+	bool txn_deltas; /* Node or remote advertised CAP_TXNDELTA */
 
 	bool reconnect; /* This client really needs to reconnect */
 	time_t reconnect_request; /* The time we sent a reconnect message */
@@ -333,6 +335,7 @@ struct proxy_base {
 	int64_t combined_clients; /* Total clients of all subproxies of a parent proxy */
 	int64_t headroom; /* Temporary variable when calculating how many more clients can bind */
 	int connecting; /* New clients in the process of connecting */
+	double score; /* Generator score with proxyscoring, lower is better */
 
 	int subproxy_count; /* Number of subproxies */
 	proxy_t *parent; /* Parent proxy of each subproxy */
@@ -404,6 +407,20 @@ static const char *ckdb_seq_names[] = {
 
 #define ID_COUNT (sizeof(ckdb_ids)/sizeof(char *))
 
+/* The CKDB_RECFMT fields of the ckdb_ids[] that can use it */
+static const char **ckdb_rec_fields[] = {
+	NULL,
+	ckdb_rec_workinfo,
+	NULL,
+	ckdb_rec_shares,
+	ckdb_rec_shareerror,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
 struct stratifier_data {
 	ckpool_t *ckp;
 
@@ -426,6 +443,8 @@ struct stratifier_data {
 	uint64_t ckdb_seq;
 	/* Incrementing ckdb_ids[] sequence numbers */
 	uint64_t ckdb_seq_ids[ID_COUNT];
+	/* CKDB_RECFMT version ckdb supports, 0 for json only */
+	int ckdb_recfmt;
 
 	bool ckdb_offline;
 	bool verbose;
@@ -448,6 +467,22 @@ struct stratifier_data {
 	/* Workbases from remote trusted servers */
 	workbase_t *remote_workbases;
 
+	/* Txn hashes of the last workinfo sent downstream and received from
+	 * upstream, as the base for txn hash deltas */
+	mutex_t workinfo_lock;
+	int64_t node_wb_id;
+	char node_wb_prevhash[68];
+	char *node_wb_hashes;
+	int node_wb_deltas;
+	int64_t upstream_wb_id;
+	char *upstream_wb_hashes;
+
+	/* Shares waiting to be sent upstream in trusted remote mode, grouped
+	 * by client and workinfo */
+	mutex_t share_batch_lock;
+	json_t *share_batch;
+	int share_batch_count;
+
 	/* Is this a node and unable to rebuild workinfos due to lack of txns */
 	bool wbincomplete;
 
@@ -735,11 +770,114 @@ static void age_share_hashtable(sdata_t *sdata, const int64_t wb_id)
 
 static char *status_chars = "|/-\\";
 
-/* Absorbs the json and generates a ckdb json message, logs it to the ckdb
- * log and returns the malloced message. */
+static void rec_append(char **buf, size_t *off, size_t *len, const char *s, const size_t slen)
+{
+	if (*off + slen + 2 > *len) {
+		*len = *off + slen + PAGESIZE;
+		*buf = realloc(*buf, *len);
+		if (unlikely(!*buf))
+			quit(1, "Failed to realloc rec_append");
+	}
+	memcpy(*buf + *off, s, slen);
+	*off += slen;
+	(*buf)[*off] = '\0';
+}
+
+/* A record value can't contain either separator or end the line */
+static bool rec_safe(const char *s, const size_t slen)
+{
+	size_t i;
+
+	for (i = 0; i < slen; i++) {
+		if (unlikely(s[i] == CKDB_REC_SEP || s[i] == CKDB_REC_ABSENT ||
+			     s[i] == '\n' || s[i] == '\r' || !s[i]))
+			return false;
+	}
+	return true;
+}
+
+/* Encodes val as a CKDB_RECFMT record of fields, returning the malloced
+ * record or NULL if val can't be encoded and must be sent as json. */
+static char *ckdb_rec(const json_t *val, const char **fields)
+{
+	size_t off = 0, len = PAGESIZE, slen, present = 0;
+	char num[64], *buf, *dump;
+	const char *s;
+	json_t *fld;
+	int i;
+
+	buf = ckalloc(len);
+	buf[0] = '\0';
+	for (i = 0; fields[i]; i++) {
+		if (i) {
+			num[0] = CKDB_REC_SEP;
+			rec_append(&buf, &off, &len, num, 1);
+		}
+		fld = json_object_get(val, fields[i]);
+		if (!fld) {
+			num[0] = CKDB_REC_ABSENT;
+			rec_append(&buf, &off, &len, num, 1);
+			continue;
+		}
+		present++;
+		switch (json_typeof(fld)) {
+			case JSON_STRING:
+				s = json_string_value(fld);
+				slen = json_string_length(fld);
+				if (!rec_safe(s, slen))
+					goto fail;
+				rec_append(&buf, &off, &len, s, slen);
+				break;
+			case JSON_INTEGER:
+				slen = snprintf(num, sizeof(num), "%"JSON_INTEGER_FORMAT,
+						json_integer_value(fld));
+				rec_append(&buf, &off, &len, num, slen);
+				break;
+			case JSON_REAL:
+				slen = snprintf(num, sizeof(num), "%.17g", json_real_value(fld));
+				rec_append(&buf, &off, &len, num, slen);
+				break;
+			case JSON_TRUE:
+				rec_append(&buf, &off, &len, "true", 4);
+				break;
+			case JSON_FALSE:
+				rec_append(&buf, &off, &len, "false", 5);
+				break;
+			case JSON_NULL:
+				rec_append(&buf, &off, &len, "null", 4);
+				break;
+			case JSON_ARRAY:
+				dump = json_dumps(fld, JSON_COMPACT);
+				if (unlikely(!dump))
+					goto fail;
+				slen = strlen(dump);
+				if (slen < 2 || !rec_safe(dump, slen)) {
+					free(dump);
+					goto fail;
+				}
+				rec_append(&buf, &off, &len, dump + 1, slen - 2);
+				free(dump);
+				break;
+			default:
+				goto fail;
+		}
+	}
+	/* Any fields not in the list need json */
+	if (present != json_object_size(val))
+		goto fail;
+	return buf;
+fail:
+	free(buf);
+	return NULL;
+}
+
+/* Absorbs the json and generates a ckdb json message, or CKDB_RECFMT record
+ * if ckdb supports it, logs it to the ckdb log and returns the malloced
+ * message. */
 static char *ckdb_msg(ckpool_t *ckp, sdata_t *sdata, json_t *val, const int idtype)
 {
-	char *json_msg;
+	const char **rec_fields = NULL;
+	char *json_msg, *rec;
 	char logname[512];
 	char *ret = NULL;
 	uint64_t seqall;
@@ -751,8 +889,20 @@ static char *ckdb_msg(ckpool_t *ckp, sdata_t *sdata, json_t *val, const int idty
 	seqall = sdata->ckdb_seq++;
 	json_set_int(val, "seqall", seqall);
 	json_set_int(val, ckdb_seq_names[idtype], sdata->ckdb_seq_ids[idtype]++);
+	if (sdata->ckdb_recfmt >= CKDB_RECFMT)
+		rec_fields = ckdb_rec_fields[idtype];
 	mutex_unlock(&sdata->ckdb_msg_lock);
 
+	if (rec_fields) {
+		rec = ckdb_rec(val, rec_fields);
+		if (likely(rec)) {
+			ASPRINTF(&ret, "%s.%"PRIu64".%s%s", ckdb_ids[idtype], seqall,
+				 CKDB_REC_TAG, rec);
+			free(rec);
+			goto out;
+		}
+	}
+
 	json_msg = json_dumps(val, JSON_COMPACT);
 	if (unlikely(!json_msg))
 		goto out;
@@ -871,6 +1021,123 @@ static void upstream_json_msgtype(ckpool_t *ckp, json_t *val, const int msg_type
 	json_decref(val);
 }
 
+/* Shares are sent upstream in batches of up to this many shares in trusted
+ * remote mode, or whatever has been queued every interval */
+#define REMOTE_SHARE_BATCH	256
+#define REMOTE_SHARE_INTERVAL	200 /* ms */
+
+/* Fields common to all shares of one client on one workinfo, sent once per
+ * group in a share batch */
+static const char *share_group_fields[] = {
+	"workinfoid",
+	"clientid",
+	"enonce1",
+	"secondaryuserid",
+	"workername",
+	"username",
+	"address",
+	"agent",
+	"createcode",
+	"createinet",
+	NULL
+};
+
+static void flush_share_batch(ckpool_t *ckp, sdata_t *sdata)
+{
+	json_t *batch, *group, *arr_val, *val;
+	const char *key;
+
+	mutex_lock(&sdata->share_batch_lock);
+	batch = sdata->share_batch;
+	sdata->share_batch = NULL;
+	sdata->share_batch_count = 0;
+	mutex_unlock(&sdata->share_batch_lock);
+
+	if (!batch)
+		return;
+	if (unlikely(!ckp->upstream_sharebatch)) {
+		/* Upstream changed to a pool without batches since these
+		 * were queued so send them singly */
+		json_object_foreach(batch, key, group) {
+			json_t *shares = json_incref(json_object_get(group, "shares")), *share;
+			size_t i;
+
+			json_object_del(group, "shares");
+			json_array_foreach(shares, i, share) {
+				json_object_update(share, group);
+				upstream_json_msgtype(ckp, json_incref(share), SM_SHARE);
+			}
+			json_decref(shares);
+		}
+		json_decref(batch);
+		return;
+	}
+	arr_val = json_array();
+	json_object_foreach(batch, key, group)
+		json_array_append(arr_val, group);
+	json_decref(batch);
+	JSON_CPACK(val, "{so}", "groups", arr_val);
+	upstream_json_msgtype(ckp, val, SM_SHARES);
+}
+
+/* Add a share to the batch to go upstream, taking ownership of val. Upstream
+ * pools that don't list CAP_SHAREBATCH get each share on its own */
+static void upstream_share(ckpool_t *ckp, sdata_t *sdata, json_t *val)
+{
+	json_t *group;
+	char key[64];
+	int i, count;
+
+	if (!ckp->upstream_sharebatch) {
+		upstream_json_msgtype(ckp, val, SM_SHARE);
+		return;
+	}
+	strip_fields(ckp, val);
+	snprintf(key, 64, "%"PRId64":%"PRId64,
+		 (int64_t)json_integer_value(json_object_get(val, "clientid")),
+		 (int64_t)json_integer_value(json_object_get(val, "workinfoid")));
+
+	mutex_lock(&sdata->share_batch_lock);
+	if (!sdata->share_batch)
+		sdata->share_batch = json_object();
+	group = json_object_get(sdata->share_batch, key);
+	if (!group) {
+		group = json_object();
+		for (i = 0; share_group_fields[i]; i++) {
+			json_t *field = json_object_get(val, share_group_fields[i]);
+
+			if (field)
+				json_object_set_nocheck(group, share_group_fields[i], field);
+		}
+		json_object_set_new_nocheck(group, "shares", json_array());
+		json_object_set_new_nocheck(sdata->share_batch, key, group);
+	}
+	for (i = 0; share_group_fields[i]; i++)
+		json_object_del(val, share_group_fields[i]);
+	json_array_append_new(json_object_get(group, "shares"), val);
+	count = ++sdata->share_batch_count;
+	mutex_unlock(&sdata->share_batch_lock);
+
+	if (count >= REMOTE_SHARE_BATCH)
+		flush_share_batch(ckp, sdata);
+}
+
+/* Send whatever shares have been batched regularly in trusted remote mode */
+static void *share_batcher(void *arg)
+{
+	ckpool_t *ckp = (ckpool_t *)arg;
+	sdata_t *sdata = ckp->sdata;
+
+	pthread_detach(pthread_self());
+	rename_proc("sharebatcher");
+
+	while (42) {
+		cksleep_ms(REMOTE_SHARE_INTERVAL);
+		flush_share_batch(ckp, sdata);
+	}
+	return NULL;
+}
+
 /* Upstream a json msgtype, duplicating the json */
 static void upstream_msgtype(ckpool_t *ckp, const json_t *val, const int msg_type)
 {
@@ -881,11 +1148,222 @@ static void upstream_msgtype(ckpool_t *ckp, const json_t *val, const int msg_typ
 	json_decref(json_msg);
 }
 
-static void send_node_workinfo(ckpool_t *ckp, sdata_t *sdata, const workbase_t *wb)
+/* Send full txn hashes at least this often even when unchanged */
+#define WORKINFO_MAX_DELTAS 16
+
+struct txn_index {
+	UT_hash_handle hh;
+	const char *hash;
+	int idx;
+};
+
+typedef struct txn_index txn_index_t;
+
+/* Describe hashes as a json array of [start, count] runs copied from the txn
+ * hashes in base, and strings for any txn hashes not in base. Returns NULL if
+ * the delta would not be much smaller than the full list. */
+static json_t *txn_hashes_delta(const char *base, const char *hashes)
 {
+	int i, basetxns, txns, start = 0, count = 0, added = 0;
+	txn_index_t *index = NULL, *entries, *entry;
+	json_t *delta, *run;
+
+	basetxns = strlen(base) / 65;
+	txns = strlen(hashes) / 65;
+	if (!basetxns || !txns)
+		return NULL;
+
+	entries = ckalloc(sizeof(txn_index_t) * basetxns);
+	for (i = 0; i < basetxns; i++) {
+		entry = &entries[i];
+		entry->hash = base + i * 65;
+		entry->idx = i;
+		HASH_ADD_KEYPTR(hh, index, entry->hash, 64, entry);
+	}
+
+	delta = json_array();
+	for (i = 0; i < txns; i++) {
+		const char *hash = hashes + i * 65;
+
+		HASH_FIND(hh, index, hash, 64, entry);
+		if (entry && count && entry->idx == start + count) {
+			count++;
+			continue;
+		}
+		if (count) {
+			JSON_CPACK(run, "[ii]", start, count);
+			json_array_append_new(delta, run);
+			count = 0;
+		}
+		if (entry) {
+			start = entry->idx;
+			count = 1;
+			continue;
+		}
+		json_array_append_new(delta, json_stringn_nocheck(hash, 64));
+		added++;
+	}
+	if (count) {
+		JSON_CPACK(run, "[ii]", start, count);
+		json_array_append_new(delta, run);
+	}
+	HASH_CLEAR(hh, index);
+	free(entries);
+
+	if (added > txns / 2) {
+		json_decref(delta);
+		delta = NULL;
+	}
+	return delta;
+}
+
+/* Rebuild txns worth of txn hashes from a delta against base. Returns NULL if
+ * the delta does not fit base. */
+static char *txn_hashes_undelta(const char *base, const json_t *delta, const int txns)
+{
+	int i, entries = json_array_size(delta), basetxns = strlen(base) / 65, pos = 0;
+	char *hashes = ckzalloc(txns * 65 + 1);
+
+	memset(hashes, 0x20, txns * 65); // Spaces
+	for (i = 0; i < entries; i++) {
+		const json_t *entry = json_array_get(delta, i);
+		int start, count;
+
+		if (json_is_string(entry)) {
+			if (unlikely(pos >= txns || json_string_length(entry) != 64))
+				goto out_fail;
+			memcpy(hashes + pos++ * 65, json_string_value(entry), 64);
+			continue;
+		}
+		start = json_integer_value(json_array_get(entry, 0));
+		count = json_integer_value(json_array_get(entry, 1));
+		if (unlikely(start < 0 || count < 1 || start + count > basetxns ||
+			     pos + count > txns))
+			goto out_fail;
+		memcpy(hashes + pos * 65, base + start * 65, count * 65);
+		pos += count;
+	}
+	if (likely(pos == txns))
+		return hashes;
+out_fail:
+	free(hashes);
+	return NULL;
+}
+
+/* Serialise a workinfo once for all nodes or remotes that need the same
+ * message */
+static json_t *workinfo_raw(json_t *val, char **buf, const char *method_key)
+{
+	json_t *raw_val = json_object();
+
+	if (!*buf) {
+		json_object_del(val, "method");
+		json_object_del(val, "node.method");
+		json_set_string(val, method_key, stratum_msgs[SM_WORKINFO]);
+		*buf = json_dumps(val, JSON_EOL | JSON_COMPACT);
+	}
+	/* The connector sends raw messages as is */
+	json_object_set_new_nocheck(raw_val, "raw", json_stringn_nocheck(*buf, strlen(*buf)));
+	return raw_val;
+}
+
+static void add_raw_msg(ckmsg_t **bulk_send, json_t *raw_val, const int64_t client_id)
+{
+	ckmsg_t *client_msg;
+	smsg_t *msg;
+
+	client_msg = ckalloc(sizeof(ckmsg_t));
+	msg = ckzalloc(sizeof(smsg_t));
+	msg->json_msg = raw_val;
+	msg->client_id = client_id;
+	client_msg->data = msg;
+	DL_APPEND(*bulk_send, client_msg);
+}
+
+/* Send a workinfo to all nodes and remotes except skip_remote and skip_node.
+ * Each form of the message is serialised only once. Those that were sent the
+ * previous workinfo get the txn hashes as a delta against it, unless the
+ * block has changed. */
+static void downstream_workinfo(sdata_t *sdata, json_t *wb_val, const workbase_t *wb,
+				const int64_t skip_remote, const int64_t skip_node)
+{
+	char *remote_full = NULL, *node_full = NULL, *remote_delta = NULL, *node_delta = NULL;
+	json_t *delta = NULL, *delta_val = NULL;
 	stratum_instance_t *client;
 	ckmsg_t *bulk_send = NULL;
-	int messages = 0;
+	int messages = 0, deltas = 0;
+
+	mutex_lock(&sdata->workinfo_lock);
+	if (sdata->node_wb_hashes && wb->txn_hashes && sdata->node_wb_deltas < WORKINFO_MAX_DELTAS &&
+	    !strncmp(sdata->node_wb_prevhash, wb->prevhash, 64))
+		delta = txn_hashes_delta(sdata->node_wb_hashes, wb->txn_hashes);
+	if (delta) {
+		delta_val = json_copy(wb_val);
+		json_object_del(delta_val, "txn_hashes");
+		json_set_int64(delta_val, "txn_base", sdata->node_wb_id);
+		json_object_set_new_nocheck(delta_val, "txn_delta", delta);
+	}
+
+	ck_rlock(&sdata->instance_lock);
+	DL_FOREACH2(sdata->remote_instances, client, remote_next) {
+		json_t *raw_val;
+
+		if (client->id == skip_remote)
+			continue;
+		if (delta && client->txn_deltas && client->workinfo_id == sdata->node_wb_id) {
+			raw_val = workinfo_raw(delta_val, &remote_delta, "method");
+			deltas++;
+		} else
+			raw_val = workinfo_raw(wb_val, &remote_full, "method");
+		client->workinfo_id = wb->mapped_id;
+		add_raw_msg(&bulk_send, raw_val, client->id);
+		messages++;
+	}
+	DL_FOREACH2(sdata->node_instances, client, node_next) {
+		json_t *raw_val;
+
+		if (client->id == skip_node)
+			continue;
+		if (delta && client->txn_deltas && client->workinfo_id == sdata->node_wb_id) {
+			raw_val = workinfo_raw(delta_val, &node_delta, "node.method");
+			deltas++;
+		} else
+			raw_val = workinfo_raw(wb_val, &node_full, "node.method");
+		client->workinfo_id = wb->mapped_id;
+		add_raw_msg(&bulk_send, raw_val, client->id);
+		messages++;
+	}
+	ck_runlock(&sdata->instance_lock);
+
+	/* This workinfo is the base for the next delta */
+	if (messages && wb->txn_hashes) {
+		free(sdata->node_wb_hashes);
+		sdata->node_wb_hashes = strdup(wb->txn_hashes);
+		sdata->node_wb_id = wb->mapped_id;
+		memcpy(sdata->node_wb_prevhash, wb->prevhash, 65);
+		if (delta)
+			sdata->node_wb_deltas++;
+		else
+			sdata->node_wb_deltas = 0;
+	}
+	mutex_unlock(&sdata->workinfo_lock);
+
+	if (delta_val)
+		json_decref(delta_val);
+	free(remote_full);
+	free(node_full);
+	free(remote_delta);
+	free(node_delta);
+
+	if (bulk_send) {
+		LOGINFO("Sending workinfo to %d mining nodes and remote servers, %d as deltas",
+			messages, deltas);
+		ssend_bulk_append(sdata, bulk_send, messages);
+	}
+}
+
+static void send_node_workinfo(ckpool_t *ckp, sdata_t *sdata, const workbase_t *wb)
+{
 	json_t *wb_val;
 
 	wb_val = json_object();
@@ -913,46 +1391,11 @@ static void send_node_workinfo(ckpool_t *ckp, sdata_t *sdata, const workbase_t *
 	json_set_int(wb_val, "coinb2len", wb->coinb2len);
 	json_set_string(wb_val, "coinb2", wb->coinb2);
 
-	ck_rlock(&sdata->instance_lock);
-	DL_FOREACH2(sdata->node_instances, client, node_next) {
-		ckmsg_t *client_msg;
-		smsg_t *msg;
-		json_t *json_msg = json_deep_copy(wb_val);
-
-		json_set_string(json_msg, "node.method", stratum_msgs[SM_WORKINFO]);
-		client_msg = ckalloc(sizeof(ckmsg_t));
-		msg = ckzalloc(sizeof(smsg_t));
-		msg->json_msg = json_msg;
-		msg->client_id = client->id;
-		client_msg->data = msg;
-		DL_APPEND(bulk_send, client_msg);
-		messages++;
-	}
-	DL_FOREACH2(sdata->remote_instances, client, remote_next) {
-		ckmsg_t *client_msg;
-		smsg_t *msg;
-		json_t *json_msg = json_deep_copy(wb_val);
-
-		json_set_string(json_msg, "method", stratum_msgs[SM_WORKINFO]);
-		client_msg = ckalloc(sizeof(ckmsg_t));
-		msg = ckzalloc(sizeof(smsg_t));
-		msg->json_msg = json_msg;
-		msg->client_id = client->id;
-		client_msg->data = msg;
-		DL_APPEND(bulk_send, client_msg);
-		messages++;
-	}
-	ck_runlock(&sdata->instance_lock);
-
 	if (ckp->remote)
 		upstream_msgtype(ckp, wb_val, SM_WORKINFO);
 
+	downstream_workinfo(sdata, wb_val, wb, 0, 0);
 	json_decref(wb_val);
-
-	if (bulk_send) {
-		LOGINFO("Sending workinfo to mining nodes");
-		ssend_bulk_append(sdata, bulk_send, messages);
-	}
 }
 
 static json_t *generate_workinfo(ckpool_t *ckp, const workbase_t *wb, const char *func)
@@ -1691,12 +2134,8 @@ static void __add_to_remote_workbases(sdata_t *sdata, workbase_t *wb)
 
 static void add_remote_base(ckpool_t *ckp, sdata_t *sdata, workbase_t *wb)
 {
-	stratum_instance_t *client;
-	ckmsg_t *bulk_send = NULL;
 	workbase_t *tmp, *tmpa;
 	json_t *val, *wb_val;
-	int messages = 0;
-	int64_t skip;
 
 	ts_realtime(&wb->gentime);
 
@@ -1741,56 +2180,51 @@ static void add_remote_base(ckpool_t *ckp, sdata_t *sdata, workbase_t *wb)
 	json_set_string(wb_val, "txn_hashes", wb->txn_hashes);
 	json_set_int(wb_val, "merkles", wb->merkles);
 
-	skip = subclient(wb->client_id);
+	/* Send this to all OTHER remote trusted servers and nodes as well */
+	downstream_workinfo(sdata, wb_val, wb, wb->client_id, subclient(wb->client_id));
+	json_decref(wb_val);
 
-	/* Send a copy of this to all OTHER remote trusted servers as well */
-	ck_rlock(&sdata->instance_lock);
-	DL_FOREACH2(sdata->remote_instances, client, remote_next) {
-		ckmsg_t *client_msg;
-		json_t *json_msg;
-		smsg_t *msg;
+	ckdbq_add(ckp, ID_WORKINFO, val);
+}
 
-		/* Don't send remote workinfo back to the source remote */
-		if (client->id == wb->client_id)
-			continue;
-		json_msg = json_deep_copy(wb_val);
-		json_set_string(json_msg, "method", stratum_msgs[SM_WORKINFO]);
-		client_msg = ckalloc(sizeof(ckmsg_t));
-		msg = ckzalloc(sizeof(smsg_t));
-		msg->json_msg = json_msg;
-		msg->client_id = client->id;
-		client_msg->data = msg;
-		DL_APPEND(bulk_send, client_msg);
-		messages++;
-	}
-	DL_FOREACH2(sdata->node_instances, client, node_next) {
-		ckmsg_t *client_msg;
-		json_t *json_msg;
-		smsg_t *msg;
+/* Get the txn hashes of a workinfo from upstream, rebuilding them if they were
+ * sent as a delta, and keep them as the base for the next delta. If the delta
+ * can't be rebuilt a remote asks upstream for the full list in the next
+ * workinfo. Nodes have no way to signal upstream so they wait for the next
+ * full list, sent at least every WORKINFO_MAX_DELTAS. */
+static bool upstream_txn_hashes(ckpool_t *ckp, sdata_t *sdata, workbase_t *wb, json_t *val)
+{
+	const json_t *delta = json_object_get(val, "txn_delta");
+	int64_t base = 0;
+	bool ret = true;
 
-		/* Don't send node workinfo back to the source node */
-		if (client->id == skip)
-			continue;
-		json_msg = json_deep_copy(wb_val);
-		json_set_string(json_msg, "node.method", stratum_msgs[SM_WORKINFO]);
-		client_msg = ckalloc(sizeof(ckmsg_t));
-		msg = ckzalloc(sizeof(smsg_t));
-		msg->json_msg = json_msg;
-		msg->client_id = client->id;
-		client_msg->data = msg;
-		DL_APPEND(bulk_send, client_msg);
-		messages++;
+	mutex_lock(&sdata->workinfo_lock);
+	if (delta) {
+		json_get_int64(&base, val, "txn_base");
+		if (unlikely(!sdata->upstream_wb_hashes || base != sdata->upstream_wb_id)) {
+			LOGWARNING("Unable to rebuild workinfo %"PRId64" txns without workinfo %"PRId64,
+				   wb->id, base);
+			ret = false;
+		} else {
+			wb->txn_hashes = txn_hashes_undelta(sdata->upstream_wb_hashes, delta, wb->txns);
+			if (unlikely(!wb->txn_hashes)) {
+				LOGWARNING("Invalid txn delta in workinfo %"PRId64, wb->id);
+				ret = false;
+			}
+		}
+	} else
+		json_strdup(&wb->txn_hashes, val, "txn_hashes");
+	if (ret && wb->txn_hashes) {
+		free(sdata->upstream_wb_hashes);
+		sdata->upstream_wb_hashes = strdup(wb->txn_hashes);
+		sdata->upstream_wb_id = wb->id;
 	}
-	ck_runlock(&sdata->instance_lock);
-
-	json_decref(wb_val);
+	mutex_unlock(&sdata->workinfo_lock);
 
-	if (bulk_send) {
-		LOGINFO("Sending remote workinfo to %d other remote servers", messages);
-		ssend_bulk_append(sdata, bulk_send, messages);
-	}
+	if (!ret && ckp->remote)
+		upstream_json_msgtype(ckp, json_object(), SM_REQWORKINFO);
 
-	ckdbq_add(ckp, ID_WORKINFO, val);
+	return ret;
 }
 
 static void add_node_base(ckpool_t *ckp, json_t *val, bool trusted, int64_t client_id)
@@ -1822,7 +2256,13 @@ static void add_node_base(ckpool_t *ckp, json_t *val, bool trusted, int64_t clie
 	json_strdup(&wb->flags, val, "flags");
 
 	json_intcpy(&wb->txns, val, "txns");
-	json_strdup(&wb->txn_hashes, val, "txn_hashes");
+	/* Only our upstream sends txn hash deltas */
+	if (client_id)
+		json_strdup(&wb->txn_hashes, val, "txn_hashes");
+	else if (!upstream_txn_hashes(ckp, sdata, wb, val)) {
+		clear_workbase(wb);
+		return;
+	}
 	if (!ckp->proxy) {
 		/* This is a workbase from a trusted remote */
 		wb->merkle_array = json_object_dup(val, "merklehash");
@@ -2788,44 +3228,12 @@ static void dead_proxyid(sdata_t *sdata, const int id, const int subid, const bo
 		generator_recruit(sdata->ckp, proxyid, -headroom);
 }
 
-static void update_subscribe(ckpool_t *ckp, const char *cmd)
+/* Takes ownership of ps */
+static void update_subscribe(ckpool_t *ckp, proxy_subscribe_t *ps)
 {
 	sdata_t *sdata = ckp->sdata, *dsdata;
-	int id = 0, subid = 0, userid = 0;
+	int id = ps->id, subid = ps->subid;
 	proxy_t *proxy, *old = NULL;
-	const char *buf;
-	bool global;
-	json_t *val;
-
-	if (unlikely(strlen(cmd) < 11)) {
-		LOGWARNING("Received zero length string for subscribe in update_subscribe");
-		return;
-	}
-	buf = cmd + 10;
-	LOGDEBUG("Update subscribe: %s", buf);
-	val = json_loads(buf, 0, NULL);
-	if (unlikely(!val)) {
-		LOGWARNING("Failed to json decode subscribe response in update_subscribe %s", buf);
-		return;
-	}
-	if (unlikely(!json_get_int(&id, val, "proxy"))) {
-		LOGWARNING("Failed to json decode proxy value in update_subscribe %s", buf);
-		return;
-	}
-	if (unlikely(!json_get_int(&subid, val, "subproxy"))) {
-		LOGWARNING("Failed to json decode subproxy value in update_subscribe %s", buf);
-		return;
-	}
-	if (unlikely(!json_get_bool(&global, val, "global"))) {
-		LOGWARNING("Failed to json decode global value in update_subscribe %s", buf);
-		return;
-	}
-	if (!global) {
-		if (unlikely(!json_get_int(&userid, val, "userid"))) {
-			LOGWARNING("Failed to json decode userid value in update_subscribe %s", buf);
-			return;
-		}
-	}
 
 	if (!subid)
 		LOGNOTICE("Got updated subscribe for proxy %d", id);
@@ -2840,27 +3248,24 @@ static void update_subscribe(ckpool_t *ckp, const char *cmd)
 		proxy->dead = false;
 	} else /* This is where all new proxies are created */
 		proxy = subproxy_by_id(sdata, id, subid);
-	proxy->global = global;
-	proxy->userid = userid;
+	proxy->global = ps->global;
+	proxy->userid = ps->global ? 0 : ps->userid;
 	proxy->subscribed = true;
 	proxy->diff = ckp->startdiff;
-	memset(proxy->baseurl, 0, 128);
-	memset(proxy->url, 0, 128);
-	memset(proxy->auth, 0, 128);
-	memset(proxy->pass, 0, 128);
-	strncpy(proxy->baseurl, json_string_value(json_object_get(val, "baseurl")), 127);
-	strncpy(proxy->url, json_string_value(json_object_get(val, "url")), 127);
-	strncpy(proxy->auth, json_string_value(json_object_get(val, "auth")), 127);
-	strncpy(proxy->pass, json_string_value(json_object_get(val, "pass")), 127);
+	/* Strings are all null terminated within their size by the generator */
+	memcpy(proxy->baseurl, ps->baseurl, 128);
+	memcpy(proxy->url, ps->url, 128);
+	memcpy(proxy->auth, ps->auth, 128);
+	memcpy(proxy->pass, ps->pass, 128);
 
 	dsdata = proxy->sdata;
 
 	ck_wlock(&dsdata->workbase_lock);
 	/* Length is checked by generator */
-	strcpy(proxy->enonce1, json_string_value(json_object_get(val, "enonce1")));
+	strcpy(proxy->enonce1, ps->enonce1);
 	proxy->enonce1constlen = strlen(proxy->enonce1) / 2;
 	hex2bin(proxy->enonce1bin, proxy->enonce1, proxy->enonce1constlen);
-	proxy->nonce2len = json_integer_value(json_object_get(val, "nonce2len"));
+	proxy->nonce2len = ps->nonce2len;
 	if (ckp->nonce2length) {
 		proxy->enonce1varlen = proxy->nonce2len - ckp->nonce2length;
 		if (proxy->enonce1varlen < 0)
@@ -2888,7 +3293,7 @@ static void update_subscribe(ckpool_t *ckp, const char *cmd)
 	if (ckp->nonce2length && proxy->enonce2varlen != ckp->nonce2length)
 		LOGWARNING("Only able to set nonce2len %d of requested %d on proxy %d:%d",
 			   proxy->enonce2varlen, ckp->nonce2length, id, subid);
-	json_decref(val);
+	free(ps);
 
 	/* Set the priority on a new proxy now that we have all the fields
 	 * filled in to push it to its correct priority position in the
@@ -2939,35 +3344,32 @@ static void check_userproxies(sdata_t *sdata, proxy_t *proxy, const int userid)
 		generator_recruit(sdata->ckp, proxy->id, -headroom);
 }
 
-static void update_notify(ckpool_t *ckp, const char *cmd)
+static void free_proxy_notify(proxy_notify_t *pn)
+{
+	free(pn->coinb1);
+	free(pn->coinb1bin);
+	free(pn->coinb2);
+	free(pn->coinb2bin);
+	if (pn->merkle_array)
+		json_decref(pn->merkle_array);
+	free(pn);
+}
+
+/* Takes ownership of pn, which arrives fully decoded from the generator so
+ * the workbase just takes over its buffers */
+static void update_notify(ckpool_t *ckp, proxy_notify_t *pn)
 {
 	sdata_t *sdata = ckp->sdata, *dsdata;
+	int id = pn->id, subid = pn->subid;
 	bool new_block = false, clean;
-	int i, id = 0, subid = 0;
-	char header[228];
-	const char *buf;
 	proxy_t *proxy;
 	workbase_t *wb;
-	json_t *val;
-
-	if (unlikely(strlen(cmd) < 8)) {
-		LOGWARNING("Zero length string passed to update_notify");
-		return;
-	}
-	buf = cmd + 7; /* "notify=" */
-	LOGDEBUG("Update notify: %s", buf);
 
-	val = json_loads(buf, 0, NULL);
-	if (unlikely(!val)) {
-		LOGWARNING("Failed to json decode in update_notify");
-		return;
-	}
-	json_get_int(&id, val, "proxy");
-	json_get_int(&subid, val, "subproxy");
 	proxy = existing_subproxy(sdata, id, subid);
 	if (unlikely(!proxy || !proxy->subscribed)) {
 		LOGINFO("No valid proxy %d:%d subscription to update notify yet", id, subid);
-		goto out;
+		free_proxy_notify(pn);
+		return;
 	}
 	LOGINFO("Got updated notify for proxy %d:%d", id, subid);
 
@@ -2975,39 +3377,28 @@ static void update_notify(ckpool_t *ckp, const char *cmd)
 	wb->ckp = ckp;
 	wb->proxy = true;
 
-	json_get_int64(&wb->id, val, "jobid");
-	json_strcpy(wb->prevhash, val, "prevhash");
-	json_intcpy(&wb->coinb1len, val, "coinb1len");
-	wb->coinb1bin = ckalloc(wb->coinb1len);
-	wb->coinb1 = ckalloc(wb->coinb1len * 2 + 1);
-	json_strcpy(wb->coinb1, val, "coinbase1");
-	hex2bin(wb->coinb1bin, wb->coinb1, wb->coinb1len);
+	wb->id = pn->jobid;
+	strcpy(wb->prevhash, pn->prevhash);
+	wb->coinb1 = pn->coinb1;
+	wb->coinb1bin = pn->coinb1bin;
+	wb->coinb1len = pn->coinb1len;
 	wb->height = get_sernumber(wb->coinb1bin + 42);
-	json_strdup(&wb->coinb2, val, "coinbase2");
-	wb->coinb2len = strlen(wb->coinb2) / 2;
-	wb->coinb2bin = ckalloc(wb->coinb2len);
-	hex2bin(wb->coinb2bin, wb->coinb2, wb->coinb2len);
-	wb->merkle_array = json_object_dup(val, "merklehash");
-	wb->merkles = json_array_size(wb->merkle_array);
-	for (i = 0; i < wb->merkles; i++) {
-		strcpy(&wb->merklehash[i][0], json_string_value(json_array_get(wb->merkle_array, i)));
-		hex2bin(&wb->merklebin[i][0], &wb->merklehash[i][0], 32);
-	}
-	json_strcpy(wb->bbversion, val, "bbversion");
-	json_strcpy(wb->nbit, val, "nbit");
-	json_strcpy(wb->ntime, val, "ntime");
-	sscanf(wb->ntime, "%x", &wb->ntime32);
-	clean = json_is_true(json_object_get(val, "clean"));
+	wb->coinb2 = pn->coinb2;
+	wb->coinb2bin = pn->coinb2bin;
+	wb->coinb2len = pn->coinb2len;
+	wb->merkle_array = pn->merkle_array;
+	wb->merkles = pn->merkles;
+	memcpy(wb->merklehash, pn->merklehash, sizeof(wb->merklehash));
+	memcpy(wb->merklebin, pn->merklebin, sizeof(wb->merklebin));
+	strcpy(wb->bbversion, pn->bbversion);
+	strcpy(wb->nbit, pn->nbit);
+	strcpy(wb->ntime, pn->ntime);
+	wb->ntime32 = pn->ntime32;
+	clean = pn->clean;
 	ts_realtime(&wb->gentime);
-	snprintf(header, 225, "%s%s%s%s%s%s%s",
-		 wb->bbversion, wb->prevhash,
-		 "0000000000000000000000000000000000000000000000000000000000000000",
-		 wb->ntime, wb->nbit,
-		 "00000000", /* nonce */
-		 workpadding);
-	LOGDEBUG("Header: %s", header);
-	hex2bin(wb->headerbin, header, 112);
+	memcpy(wb->headerbin, pn->headerbin, 112);
 	wb->txn_hashes = ckzalloc(1);
+	free(pn);
 
 	dsdata = proxy->sdata;
 
@@ -3033,38 +3424,45 @@ static void update_notify(ckpool_t *ckp, const char *cmd)
 	LOGINFO("Proxy %d:%d broadcast updated stratum notify with%s clean", id,
 		subid, clean ? "" : "out");
 	stratum_broadcast_update(dsdata, wb, clean);
-out:
-	json_decref(val);
+}
+
+/* Takes ownership of ps */
+static void update_proxy_scores(ckpool_t *ckp, proxy_scores_t *ps)
+{
+	sdata_t *sdata = ckp->sdata;
+	proxy_t *proxy, *subproxy;
+	int i;
+
+	mutex_lock(&sdata->proxy_lock);
+	for (i = 0; i < ps->count; i++) {
+		proxy_score_t *score = &ps->scores[i];
+
+		proxy = __existing_proxy(sdata, score->id);
+		if (!proxy)
+			continue;
+		subproxy = __existing_subproxy(proxy, score->subid);
+		if (subproxy)
+			subproxy->score = score->score;
+	}
+	mutex_unlock(&sdata->proxy_lock);
+
+	LOGDEBUG("Updated %d subproxy scores", ps->count);
+	free(ps->scores);
+	free(ps);
 }
 
 static void stratum_send_diff(sdata_t *sdata, const stratum_instance_t *client);
 
-static void update_diff(ckpool_t *ckp, const char *cmd)
+/* Takes ownership of pd */
+static void update_diff(ckpool_t *ckp, proxy_diff_t *pd)
 {
 	sdata_t *sdata = ckp->sdata, *dsdata;
+	int id = pd->id, subid = pd->subid;
 	stratum_instance_t *client, *tmp;
-	double old_diff, diff;
-	int id = 0, subid = 0;
-	const char *buf;
+	double old_diff, diff = pd->diff;
 	proxy_t *proxy;
-	json_t *val;
-
-	if (unlikely(strlen(cmd) < 6)) {
-		LOGWARNING("Zero length string passed to update_diff");
-		return;
-	}
-	buf = cmd + 5; /* "diff=" */
-	LOGDEBUG("Update diff: %s", buf);
 
-	val = json_loads(buf, 0, NULL);
-	if (unlikely(!val)) {
-		LOGWARNING("Failed to json decode in update_diff");
-		return;
-	}
-	json_get_int(&id, val, "proxy");
-	json_get_int(&subid, val, "subproxy");
-	json_dblcpy(&diff, val, "diff");
-	json_decref(val);
+	free(pd);
 
 	LOGINFO("Got updated diff for proxy %d:%d", id, subid);
 	proxy = existing_subproxy(sdata, id, subid);
@@ -4301,7 +4699,7 @@ static json_t *json_proxyinfo(const proxy_t *proxy)
 	const proxy_t *parent = proxy->parent;
 	json_t *val;
 
-	JSON_CPACK(val, "{si,si,si,sf,ss,ss,ss,ss,ss,si,si,si,si,sb,sb,sI,sI,sI,sI,sI,si,sb,sb,si}",
+	JSON_CPACK(val, "{si,si,si,sf,ss,ss,ss,ss,ss,si,si,si,si,sb,sb,sI,sI,sI,sI,sI,si,sb,sb,si,sf}",
 	    "id", proxy->id, "subid", proxy->subid, "priority", proxy_prio(parent),
 	    "diff", proxy->diff, "baseurl", proxy->baseurl, "url", proxy->url,
 	    "auth", proxy->auth, "pass", proxy->pass,
@@ -4311,7 +4709,8 @@ static json_t *json_proxyinfo(const proxy_t *proxy)
 	    "notified", proxy->notified, "clients", proxy->clients, "maxclients", proxy->max_clients,
 	    "bound_clients", proxy->bound_clients, "combined_clients", parent->combined_clients,
 	    "headroom", proxy->headroom, "subproxy_count", parent->subproxy_count,
-	    "dead", proxy->dead, "global", proxy->global, "userid", proxy->userid);
+	    "dead", proxy->dead, "global", proxy->global, "userid", proxy->userid,
+	    "score", proxy->score);
 	return val;
 }
 
@@ -4583,12 +4982,26 @@ retry:
 		update_base(sdata, GEN_PRIORITY);
 	} else if (cmdmatch(buf, "subscribe")) {
 		/* Proxifier has a new subscription */
-		update_subscribe(ckp, buf);
+		if (likely(umsg->data))
+			update_subscribe(ckp, umsg->data);
+		else
+			LOGWARNING("Stratifier received subscribe without proxy data");
 	} else if (cmdmatch(buf, "notify")) {
 		/* Proxifier has a new notify ready */
-		update_notify(ckp, buf);
+		if (likely(umsg->data))
+			update_notify(ckp, umsg->data);
+		else
+			LOGWARNING("Stratifier received notify without proxy data");
 	} else if (cmdmatch(buf, "diff")) {
-		update_diff(ckp, buf);
+		if (likely(umsg->data))
+			update_diff(ckp, umsg->data);
+		else
+			LOGWARNING("Stratifier received diff without proxy data");
+	} else if (cmdmatch(buf, "proxyscores")) {
+		if (likely(umsg->data))
+			update_proxy_scores(ckp, umsg->data);
+		else
+			LOGWARNING("Stratifier received proxyscores without proxy data");
 	} else if (cmdmatch(buf, "dropclient")) {
 		int64_t client_id;
 
@@ -4721,8 +5134,9 @@ static bool new_enonce1(ckpool_t *ckp, sdata_t *ckp_sdata, sdata_t *sdata, strat
 
 static void stratum_send_message(sdata_t *sdata, const stratum_instance_t *client, const char *msg);
 
-/* Need to hold sdata->proxy_lock */
-static proxy_t *__best_subproxy(proxy_t *proxy, const bool vmask)
+/* Need to hold sdata->proxy_lock. With proxyscoring, the subproxy with room
+ * and the lowest score is chosen instead of the first with room. */
+static proxy_t *__best_subproxy(ckpool_t *ckp, proxy_t *proxy, const bool vmask)
 {
 	proxy_t *subproxy, *best = NULL, *tmp;
 	int64_t max_headroom;
@@ -4742,6 +5156,11 @@ static proxy_t *__best_subproxy(proxy_t *proxy, const bool vmask)
 		subproxy_headroom = subproxy->max_clients - subproxy->clients - subproxy->connecting;
 
 		proxy->headroom += subproxy_headroom;
+		if (ckp->proxy_scoring) {
+			if (subproxy_headroom > 0 && (!best || subproxy->score < best->score))
+				best = subproxy;
+			continue;
+		}
 		if (subproxy_headroom > max_headroom) {
 			best = subproxy;
 			max_headroom = subproxy_headroom;
@@ -4778,7 +5197,7 @@ static sdata_t *select_sdata(ckpool_t *ckp, sdata_t *ckp_sdata, const bool vmask
 			continue;
 		if (proxy->userid > userid)
 			break;
-		best = __best_subproxy(proxy, vmask);
+		best = __best_subproxy(ckp, proxy, vmask);
 		if (best)
 			break;
 	}
@@ -6279,7 +6698,7 @@ out_nowb:
 			LOGERR("Failed to fopen %s", fname);
 	}
 	if (ckp->remote)
-		upstream_json_msgtype(ckp, val, SM_SHARE);
+		upstream_share(ckp, sdata, val);
 	else
 		ckdbq_add(ckp, ID_SHARES, val);
 out:
@@ -6551,6 +6970,19 @@ static void *setup_node(void *arg)
 	return NULL;
 }
 
+/* Whether a node or remote listed cap after its version in its params */
+static bool client_cap(const json_t *params_val, const char *cap)
+{
+	const json_t *caps = json_array_get(params_val, 1);
+	size_t i;
+
+	for (i = 0; i < json_array_size(caps); i++) {
+		if (!safecmp(json_string_value(json_array_get(caps, i)), cap))
+			return true;
+	}
+	return false;
+}
+
 /* Create a thread to asynchronously set latency to the node to not
  * block. Increment the ref count to prevent the client pointer
  * dereferencing under us, allowing the thread to decrement it again when
@@ -6561,6 +6993,7 @@ static void add_mining_node(ckpool_t *ckp, sdata_t *sdata, stratum_instance_t *c
 
 	ck_wlock(&sdata->instance_lock);
 	client->node = true;
+	client->workinfo_id = -1;
 	DL_APPEND2(sdata->node_instances, client, node_prev, node_next);
 	__inc_instance_ref(client);
 	ck_wunlock(&sdata->instance_lock);
@@ -6575,6 +7008,7 @@ static void add_remote_server(sdata_t *sdata, stratum_instance_t *client)
 {
 	ck_wlock(&sdata->instance_lock);
 	client->trusted = true;
+	client->workinfo_id = -1;
 	DL_APPEND2(sdata->remote_instances, client, remote_prev, remote_next);
 	__inc_instance_ref(client);
 	ck_wunlock(&sdata->instance_lock);
@@ -6643,6 +7077,7 @@ static void parse_method(ckpool_t *ckp, sdata_t *sdata, stratum_instance_t *clie
 		} else {
 			snprintf(buf, 255, "remote=%"PRId64, client_id);
 			send_proc(ckp->connector, buf);
+			client->txn_deltas = client_cap(params_val, CAP_TXNDELTA);
 			add_remote_server(sdata, client);
 		}
 		sprintf(client->identity, "remote:%"PRId64, client_id);
@@ -6662,6 +7097,7 @@ static void parse_method(ckpool_t *ckp, sdata_t *sdata, stratum_instance_t *clie
 		} else {
 			snprintf(buf, 255, "passthrough=%"PRId64, client_id);
 			send_proc(ckp->connector, buf);
+			client->txn_deltas = client_cap(params_val, CAP_TXNDELTA);
 			add_mining_node(ckp, sdata, client);
 			sprintf(client->identity, "node:%"PRId64, client_id);
 		}
@@ -6939,6 +7375,97 @@ static void parse_remote_share(ckpool_t *ckp, sdata_t *sdata, json_t *val, const
 	ckdbq_add(ckp, ID_SHARES, val);
 }
 
+/* A batch of shares from a trusted remote, grouped by client and workinfo with
+ * the fields they have in common stored once per group. Each group needs only
+ * one user and worker lookup and is accounted for at once. */
+static void parse_remote_shares(ckpool_t *ckp, sdata_t *sdata, json_t *val, const char *buf,
+				const int64_t client_id)
+{
+	json_t *groups = json_object_get(val, "groups"), *group;
+	int64_t total_shares = 0;
+	double total_diff = 0;
+	size_t i;
+	tv_t now_t;
+
+	if (unlikely(!json_is_array(groups))) {
+		LOGWARNING("Failed to get share groups from remote message %s", buf);
+		return;
+	}
+	tv_time(&now_t);
+	json_array_foreach(groups, i, group) {
+		json_t *shares = json_object_get(group, "shares"), *share, *fields;
+		double diff, sdiff, group_diff = 0, best_sdiff = 0;
+		worker_instance_t *worker;
+		int64_t group_shares = 0;
+		user_instance_t *user;
+		const char *workername;
+		size_t j;
+
+		workername = json_string_value(json_object_get(group, "workername"));
+		if (unlikely(!workername || !json_is_array(shares))) {
+			LOGWARNING("Invalid share group in remote message %s", buf);
+			continue;
+		}
+		json_array_foreach(shares, j, share) {
+			if (unlikely(!json_get_double(&diff, share, "diff") || diff < 1))
+				continue;
+			sdiff = 0;
+			json_get_double(&sdiff, share, "sdiff");
+			if (sdiff > best_sdiff)
+				best_sdiff = sdiff;
+			group_diff += diff;
+			group_shares++;
+		}
+		if (unlikely(!group_shares)) {
+			LOGWARNING("Unable to parse valid diff from remote shares of %s", workername);
+			continue;
+		}
+		user = generate_remote_user(ckp, workername);
+		user->authorised = true;
+		worker = get_worker(sdata, user, workername);
+		check_best_diff(ckp, sdata, user, worker, best_sdiff, NULL);
+
+		worker->shares += group_diff;
+		user->shares += group_diff;
+
+		decay_worker(worker, group_diff, &now_t);
+		copy_tv(&worker->last_share, &now_t);
+		worker->idle = false;
+
+		decay_user(user, group_diff, &now_t);
+		copy_tv(&user->last_share, &now_t);
+
+		LOGINFO("Added %.0lf remote shares to worker %s", group_diff, workername);
+		total_shares += group_shares;
+		total_diff += group_diff;
+
+		/* Put the common fields back in each share and submit it to
+		 * ckdb */
+		fields = json_copy(group);
+		json_object_del(fields, "shares");
+		if (!CKP_STANDALONE(ckp)) {
+			json_set_string(fields, "poolinstance", ckp->name);
+			json_set_string(fields, "createby", "remote");
+		}
+		if (likely(user->secondaryuserid))
+			json_set_string(fields, "secondaryuserid", user->secondaryuserid);
+		remap_workinfo_id(sdata, fields, client_id);
+		json_array_foreach(shares, j, share) {
+			if (unlikely(!json_get_double(&diff, share, "diff") || diff < 1))
+				continue;
+			json_object_update(share, fields);
+			json_incref(share);
+			ckdbq_add(ckp, ID_SHARES, share);
+		}
+		json_decref(fields);
+	}
+
+	mutex_lock(&sdata->uastats_lock);
+	sdata->stats.unaccounted_shares += total_shares;
+	sdata->stats.unaccounted_diff_shares += total_diff;
+	mutex_unlock(&sdata->uastats_lock);
+}
+
 static void parse_remote_shareerr(ckpool_t *ckp, sdata_t *sdata, json_t *val, const char *buf,
 				  const int64_t client_id)
 {
@@ -7313,6 +7840,16 @@ out:
 	return ret;
 }
 
+/* A remote failed to rebuild a txn hash delta so send it the full list with
+ * the next workinfo */
+static void parse_remote_reqworkinfo(sdata_t *sdata, stratum_instance_t *client)
+{
+	LOGNOTICE("Remote %s requested full workinfo txn hashes", client->identity);
+	mutex_lock(&sdata->workinfo_lock);
+	client->workinfo_id = -1;
+	mutex_unlock(&sdata->workinfo_lock);
+}
+
 static void parse_remote_reqtxns(sdata_t *sdata, const json_t *val, const int64_t client_id)
 {
 	json_t *ret = get_reqtxns(sdata, val, true);
@@ -7352,7 +7889,9 @@ static void parse_trusted_msg(ckpool_t *ckp, sdata_t *sdata, json_t *val, stratu
 		json_set_string(val, "createby", "remote");
 	}
 
-	if (likely(!safecmp(method, stratum_msgs[SM_SHARE])))
+	if (likely(!safecmp(method, stratum_msgs[SM_SHARES])))
+		parse_remote_shares(ckp, sdata, val, buf, client->id);
+	else if (!safecmp(method, stratum_msgs[SM_SHARE]))
 		parse_remote_share(ckp, sdata, val, buf, client->id);
 	else if (!safecmp(method, stratum_msgs[SM_TRANSACTIONS]))
 		add_node_txns(ckp, sdata, val);
@@ -7368,6 +7907,8 @@ static void parse_trusted_msg(ckpool_t *ckp, sdata_t *sdata, json_t *val, stratu
 		parse_remote_block(ckp, sdata, val, buf, client->id);
 	else if (!safecmp(method, stratum_msgs[SM_REQTXNS]))
 		parse_remote_reqtxns(sdata, val, client->id);
+	else if (!safecmp(method, stratum_msgs[SM_REQWORKINFO]))
+		parse_remote_reqworkinfo(sdata, client);
 	else if (!safecmp(method, "workers"))
 		parse_remote_workers(sdata, val, buf);
 	else if (!safecmp(method, "ping"))
@@ -7784,10 +8325,28 @@ out_noclient:
 
 }
 
+/* Use the CKDB_RECFMT version ckdb reports, if we support it */
+static void set_ckdb_recfmt(sdata_t *sdata, int recfmt)
+{
+	int old;
+
+	if (recfmt > CKDB_RECFMT)
+		recfmt = CKDB_RECFMT;
+
+	mutex_lock(&sdata->ckdb_msg_lock);
+	old = sdata->ckdb_recfmt;
+	sdata->ckdb_recfmt = recfmt;
+	mutex_unlock(&sdata->ckdb_msg_lock);
+
+	if (old != recfmt)
+		LOGNOTICE("Using ckdb record format %d", recfmt);
+}
+
 static void parse_ckdb_cmd(ckpool_t *ckp, const char *cmd)
 {
 	json_t *val, *res_val, *arr_val;
 	json_error_t err_val;
+	int recfmt = 0;
 	size_t index;
 
 	val = json_loads(cmd, 0, &err_val);
@@ -7806,6 +8365,8 @@ static void parse_ckdb_cmd(ckpool_t *ckp, const char *cmd)
 		json_get_int(&mindiff, arr_val, "difficultydefault");
 		set_worker_mindiff(ckp, workername, mindiff);
 	}
+	json_get_int(&recfmt, val, "recfmt");
+	set_ckdb_recfmt(ckp->sdata, recfmt);
 	json_decref(val);
 }
 
@@ -7874,6 +8435,13 @@ static void ckdbq_process(ckpool_t *ckp, char *msg)
 				if (cmdmatch(cmd, "heartbeat=")) {
 					strsep(&cmd, "=");
 					parse_ckdb_cmd(ckp, cmd);
+				} else if (cmdmatch(cmd, "pulse")) {
+					int recfmt = 0;
+
+					strsep(&cmd, ".");
+					if (cmd && cmdmatch(cmd, "recfmt="))
+						recfmt = atoi(cmd + 7);
+					set_ckdb_recfmt(sdata, recfmt);
 				}
 			} else
 				LOGWARNING("Got ckdb failure response: %s", buf);
@@ -8723,6 +9291,7 @@ void *stratifier(void *arg)
 {
 	proc_instance_t *pi = (proc_instance_t *)arg;
 	pthread_t pth_blockupdate, pth_statsupdate, pth_heartbeat, pth_zmqnotify;
+	pthread_t pth_sharebatcher;
 	int threads, tvsec_diff = 0;
 	ckpool_t *ckp = pi->ckp;
 	int64_t randomiser;
@@ -8790,6 +9359,7 @@ void *stratifier(void *arg)
 
 	cklock_init(&sdata->txn_lock);
 	cklock_init(&sdata->workbase_lock);
+	mutex_init(&sdata->workinfo_lock);
 	if (!ckp->proxy)
 		create_pthread(&pth_blockupdate, blockupdate, ckp);
 	else {
@@ -8805,6 +9375,10 @@ void *stratifier(void *arg)
 	if (!ckp->proxy)
 		create_pthread(&pth_zmqnotify, zmqnotify, ckp);
 
+	mutex_init(&sdata->share_batch_lock);
+	if (ckp->remote)
+		create_pthread(&pth_sharebatcher, share_batcher, ckp);
+
 	ckp->stratifier_ready = true;
 	LOGWARNING("%s stratifier ready", ckp->name);
 
@@ -86,6 +86,79 @@ struct genwork {
 	json_t *json; /* getblocktemplate json */
 };
 
+/* Proxy updates are handed from the generator to the stratifier already
+ * decoded, attached to their "subscribe", "notify" or "diff" message on the
+ * stratifier's queue so they stay ordered with everything else. The
+ * stratifier owns them once queued and frees them. */
+struct proxy_subscribe {
+	int id;
+	int subid;
+	bool global;
+	int userid;
+	char baseurl[128];
+	char url[128];
+	char auth[128];
+	char pass[128];
+	char enonce1[32];
+	int nonce2len;
+};
+
+typedef struct proxy_subscribe proxy_subscribe_t;
+
+struct proxy_notify {
+	int id;
+	int subid;
+	int64_t jobid;	/* Our own notify id, not the upstream one */
+	char prevhash[68];
+	char bbversion[12];
+	char nbit[12];
+	char ntime[12];
+	uint32_t ntime32;
+	bool clean;
+
+	/* Both hex and binary, ownership passes to the workbase */
+	char *coinb1;
+	uchar *coinb1bin;
+	int coinb1len;
+	char *coinb2;
+	uchar *coinb2bin;
+	int coinb2len;
+
+	int merkles;
+	char merklehash[16][68];
+	char merklebin[16][32];
+	json_t *merkle_array;
+
+	/* Header with a zero merkle root and nonce */
+	char headerbin[112];
+};
+
+typedef struct proxy_notify proxy_notify_t;
+
+struct proxy_diff {
+	int id;
+	int subid;
+	double diff;
+};
+
+typedef struct proxy_diff proxy_diff_t;
+
+/* Periodic subproxy scoring from the generator, lower being better */
+struct proxy_score {
+	int id;
+	int subid;
+	double score;
+};
+
+typedef struct proxy_score proxy_score_t;
+
+struct proxy_scores {
+	int count;
+	proxy_score_t *scores;
+};
+
+typedef struct proxy_scores proxy_scores_t;
+
 void stratum_set_proxy_vmask(ckpool_t *ckp, int id, int subid, uint32_t version_mask);
 void parse_remote_txns(ckpool_t *ckp, const json_t *val);
 #define parse_upstream_txns(ckp, val) parse_remote_txns(ckp, val)